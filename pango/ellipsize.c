@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include "pango-glyph-item.h"
+#include "pango-context-private.h"
 #include "pango-layout-private.h"
 #include "pango-font-private.h"
 #include "pango-attributes-private.h"
@@ -31,6 +32,7 @@
 typedef struct _EllipsizeState EllipsizeState;
 typedef struct _RunInfo        RunInfo;
 typedef struct _LineIter       LineIter;
+typedef struct _ClusterInfo    ClusterInfo;
 
 
 /* Overall, the way we ellipsize is we grow a "gap" out from an original
@@ -61,6 +63,19 @@ typedef struct _LineIter       LineIter;
  *
  * All computations are done using logical order; the ellipsization
  * process occurs before the runs are ordered into visual order.
+ *
+ * Stepping through the line one span at a time, and trying each gap,
+ * is slow for long lines in narrow columns. So we compute the position
+ * and width of every cluster of the line once, and from that the
+ * positions where the gap can start and end, in the order in which
+ * growing the gap would reach them. Which of them the gap has reached
+ * after a given number of steps can be found by binary search, and
+ * since the gap only gets wider, so can the first gap that is wide
+ * enough. The only complication is that the ellipsis is shaped with
+ * the font of the first character of the gap, so the search is done
+ * separately over stretches of gap starts where the ellipsis doesn't
+ * change. If a cluster has a negative width, the gap doesn't get wider
+ * at every step, and we try the gaps in order instead.
  */
 
 /* Keeps information about a single run */
@@ -69,6 +84,8 @@ struct _RunInfo
   PangoGlyphItem *run;
   int start_offset;		/* Character offset of run start */
   int width;			/* Width of run in Pango units */
+  int first_cluster;		/* Index of first cluster of run in clusters */
+  int n_clusters;		/* Number of clusters in run */
 };
 
 /* Iterator to a position within the ellipsized line */
@@ -78,6 +95,14 @@ struct _LineIter
   int run_index;
 };
 
+/* Keeps information about a single cluster */
+struct _ClusterInfo
+{
+  LineIter iter;		/* Iterator pointing to the cluster */
+  int x;			/* x position of start of cluster, in Pango units */
+  int width;			/* Width of cluster in Pango units */
+};
+
 /* State of ellipsization process */
 struct _EllipsizeState
 {
@@ -87,6 +112,17 @@ struct _EllipsizeState
   RunInfo *run_info;		/* Array of information about each run */
   int n_runs;
 
+  ClusterInfo *clusters;	/* Array of information about each cluster */
+  int n_clusters;
+  gboolean monotonic;		/* Whether no cluster has a negative width */
+
+  int *gap_starts;		/* Clusters the gap can start with, from the gap center outwards */
+  int *wide_ends;		/* For each gap start, the last gap start of the stretch
+				 * from there on that are all wide, or all not wide */
+  int n_gap_starts;
+  int *gap_ends;		/* Clusters the gap can end with, from the gap center outwards */
+  int n_gap_ends;
+
   int total_width;		/* Original width of line in Pango units */
   int gap_center;		/* Goal for center of gap */
 
@@ -149,6 +185,16 @@ init_state (EllipsizeState  *state,
       start_offset += run->item->num_chars;
     }
 
+  state->clusters = NULL;
+  state->n_clusters = 0;
+  state->monotonic = TRUE;
+
+  state->gap_starts = NULL;
+  state->wide_ends = NULL;
+  state->n_gap_starts = 0;
+  state->gap_ends = NULL;
+  state->n_gap_ends = 0;
+
   state->ellipsis_run = NULL;
   state->ellipsis_is_cjk = FALSE;
   state->line_start_attr = NULL;
@@ -166,6 +212,10 @@ free_state (EllipsizeState *state)
   if (state->gap_start_attr)
     pango_attr_iterator_destroy (state->gap_start_attr);
   g_free (state->run_info);
+  g_free (state->clusters);
+  g_free (state->gap_starts);
+  g_free (state->wide_ends);
+  g_free (state->gap_ends);
 }
 
 /* Computes the width of a single cluster
@@ -192,50 +242,6 @@ get_cluster_width (LineIter *iter)
   return width;
 }
 
-/* Move forward one cluster. Returns %FALSE if we were already at the end
- */
-static gboolean
-line_iter_next_cluster (EllipsizeState *state,
-			LineIter       *iter)
-{
-  if (!pango_glyph_item_iter_next_cluster (&iter->run_iter))
-    {
-      if (iter->run_index == state->n_runs - 1)
-	return FALSE;
-      else
-	{
-	  iter->run_index++;
-	  pango_glyph_item_iter_init_start (&iter->run_iter,
-					    state->run_info[iter->run_index].run,
-					    state->layout->text);
-	}
-    }
-
-  return TRUE;
-}
-
-/* Move backward one cluster. Returns %FALSE if we were already at the end
- */
-static gboolean
-line_iter_prev_cluster (EllipsizeState *state,
-			LineIter       *iter)
-{
-  if (!pango_glyph_item_iter_prev_cluster (&iter->run_iter))
-    {
-      if (iter->run_index == 0)
-	return FALSE;
-      else
-	{
-	  iter->run_index--;
-	  pango_glyph_item_iter_init_end (&iter->run_iter,
-					  state->run_info[iter->run_index].run,
-					  state->layout->text);
-	}
-    }
-
-  return TRUE;
-}
-
 /*
  * An ellipsization boundary is defined by two things
  *
@@ -294,38 +300,133 @@ itemize_text (EllipsizeState *state,
   return item;
 }
 
-/* Shapes the ellipsis using the font and is_cjk information computed by
- * update_ellipsis_shape() from the first character in the gap.
+/* Shaping the ellipsis requires itemizing and shaping a short
+ * string, which is much more expensive than the rest of ellipsizing
+ * a line. Since most lines that get ellipsized share the same font,
+ * we keep the most recently shaped ellipses in a small cache on the
+ * context. The cache is dropped whenever the context changes, so
+ * entries are keyed on the font attributes at the start of the gap,
+ * and the parameters of shaping.
  */
+
+#define ELLIPSIS_CACHE_SIZE 16
+
+typedef struct _EllipsisCacheEntry EllipsisCacheEntry;
+
+struct _EllipsisCacheEntry
+{
+  PangoFontDescription *desc;
+  PangoLanguage *language;
+  PangoAttribute *letter_spacing;
+  gboolean is_cjk;
+  PangoShapeFlags shape_flags;
+
+  PangoItem *item;
+  PangoGlyphString *glyphs;
+  int width;
+};
+
+struct _PangoEllipsisCache
+{
+  GQueue entries;
+};
+
 static void
-shape_ellipsis (EllipsizeState *state)
+ellipsis_cache_entry_free (EllipsisCacheEntry *entry)
+{
+  pango_font_description_free (entry->desc);
+  if (entry->letter_spacing)
+    pango_attribute_destroy (entry->letter_spacing);
+  pango_item_free (entry->item);
+  pango_glyph_string_free (entry->glyphs);
+  g_free (entry);
+}
+
+void
+_pango_ellipsis_cache_free (PangoEllipsisCache *cache)
+{
+  g_queue_clear_full (&cache->entries, (GDestroyNotify) ellipsis_cache_entry_free);
+  g_free (cache);
+}
+
+static EllipsisCacheEntry *
+ellipsis_cache_lookup (PangoContext               *context,
+                       const PangoFontDescription *desc,
+                       PangoLanguage              *language,
+                       const PangoAttribute       *letter_spacing,
+                       gboolean                    is_cjk,
+                       PangoShapeFlags             shape_flags)
+{
+  PangoEllipsisCache *cache = context->ellipsis_cache;
+  GList *l;
+
+  if (!cache)
+    return NULL;
+
+  for (l = cache->entries.head; l; l = l->next)
+    {
+      EllipsisCacheEntry *entry = l->data;
+
+      if (entry->is_cjk != is_cjk ||
+          entry->shape_flags != shape_flags ||
+          entry->language != language)
+        continue;
+
+      if ((entry->letter_spacing == NULL) != (letter_spacing == NULL) ||
+          (letter_spacing && !pango_attribute_equal (entry->letter_spacing, letter_spacing)))
+        continue;
+
+      if (!pango_font_description_equal (entry->desc, desc))
+        continue;
+
+      if (l != cache->entries.head)
+        {
+          g_queue_unlink (&cache->entries, l);
+          g_queue_push_head_link (&cache->entries, l);
+        }
+
+      return entry;
+    }
+
+  return NULL;
+}
+
+static void
+ellipsis_cache_insert (PangoContext       *context,
+                       EllipsisCacheEntry *entry)
+{
+  PangoEllipsisCache *cache = context->ellipsis_cache;
+
+  if (!cache)
+    {
+      cache = context->ellipsis_cache = g_new0 (PangoEllipsisCache, 1);
+      g_queue_init (&cache->entries);
+    }
+
+  g_queue_push_head (&cache->entries, entry);
+
+  if (cache->entries.length > ELLIPSIS_CACHE_SIZE)
+    ellipsis_cache_entry_free (g_queue_pop_tail (&cache->entries));
+}
+
+/* Itemizes and shapes the ellipsis for the font attributes
+ * at the start of the gap
+ */
+static void
+itemize_and_shape_ellipsis (EllipsizeState   *state,
+                            PangoItem       **item_out,
+                            PangoGlyphString *glyphs)
 {
   PangoAttrList attrs;
   GSList *run_attrs;
   PangoItem *item;
-  PangoGlyphString *glyphs;
   GSList *l;
   PangoAttribute *fallback;
   const char *ellipsis_text;
   int len;
-  int i;
 
   _pango_attr_list_init (&attrs);
 
-  /* Create/reset state->ellipsis_run
-   */
-  if (!state->ellipsis_run)
-    {
-      state->ellipsis_run = g_slice_new0 (PangoGlyphItem);
-      state->ellipsis_run->glyphs = pango_glyph_string_new ();
-    }
-
-  if (state->ellipsis_run->item)
-    {
-      pango_item_free (state->ellipsis_run->item);
-      state->ellipsis_run->item = NULL;
-    }
-
   /* Create an attribute list by copying font attributes,
    * leaving out things that could be problematic like shapes,
    * or super/subscripts
@@ -393,21 +494,82 @@ shape_ellipsis (EllipsizeState *state)
 
   _pango_attr_list_destroy (&attrs);
 
-  state->ellipsis_run->item = item;
-
   /* Now shape
    */
-  glyphs = state->ellipsis_run->glyphs;
-
   len = strlen (ellipsis_text);
   pango_shape_with_flags (ellipsis_text, len,
                           ellipsis_text, len,
 	                  &item->analysis, glyphs,
                           state->shape_flags);
 
-  state->ellipsis_width = 0;
-  for (i = 0; i < glyphs->num_glyphs; i++)
-    state->ellipsis_width += glyphs->glyphs[i].geometry.width;
+  *item_out = item;
+}
+
+/* Shapes the ellipsis using the font and is_cjk information computed by
+ * update_ellipsis_shape() from the first character in the gap.
+ */
+static void
+shape_ellipsis (EllipsizeState *state)
+{
+  PangoContext *context = state->layout->context;
+  EllipsisCacheEntry *entry;
+  PangoFontDescription *desc;
+  PangoLanguage *language;
+  PangoAttribute *letter_spacing;
+
+  /* Create/reset state->ellipsis_run
+   */
+  if (!state->ellipsis_run)
+    state->ellipsis_run = g_slice_new0 (PangoGlyphItem);
+
+  if (state->ellipsis_run->item)
+    {
+      pango_item_free (state->ellipsis_run->item);
+      state->ellipsis_run->item = NULL;
+    }
+
+  if (state->ellipsis_run->glyphs)
+    {
+      pango_glyph_string_free (state->ellipsis_run->glyphs);
+      state->ellipsis_run->glyphs = NULL;
+    }
+
+  /* Letter spacing is the only attribute we copy in
+   * itemize_and_shape_ellipsis() that does not end up
+   * in the font description or language.
+   */
+  desc = pango_font_description_copy_static (context->font_desc);
+  pango_attr_iterator_get_font (state->gap_start_attr, desc, &language, NULL);
+  letter_spacing = pango_attr_iterator_get (state->gap_start_attr, PANGO_ATTR_LETTER_SPACING);
+
+  entry = ellipsis_cache_lookup (context, desc, language, letter_spacing,
+                                 state->ellipsis_is_cjk, state->shape_flags);
+  if (!entry)
+    {
+      int i;
+
+      entry = g_new0 (EllipsisCacheEntry, 1);
+      entry->desc = pango_font_description_copy (desc);
+      entry->language = language;
+      entry->letter_spacing = letter_spacing ? pango_attribute_copy (letter_spacing) : NULL;
+      entry->is_cjk = state->ellipsis_is_cjk;
+      entry->shape_flags = state->shape_flags;
+      entry->glyphs = pango_glyph_string_new ();
+
+      itemize_and_shape_ellipsis (state, &entry->item, entry->glyphs);
+
+      entry->width = 0;
+      for (i = 0; i < entry->glyphs->num_glyphs; i++)
+        entry->width += entry->glyphs->glyphs[i].geometry.width;
+
+      ellipsis_cache_insert (context, entry);
+    }
+
+  pango_font_description_free (desc);
+
+  state->ellipsis_run->item = pango_item_copy (entry->item);
+  state->ellipsis_run->glyphs = pango_glyph_string_copy (entry->glyphs);
+  state->ellipsis_width = entry->width;
 }
 
 /* Helper function to advance a PangoAttrIterator to a particular
@@ -498,17 +660,65 @@ update_ellipsis_shape (EllipsizeState *state)
     shape_ellipsis (state);
 }
 
-/* Computes the position of the gap center and finds the smallest span containing it
+/* Computes the position and width of every cluster in the line
  */
 static void
-find_initial_span (EllipsizeState *state)
+init_clusters (EllipsizeState *state)
 {
-  PangoGlyphItem *glyph_item;
-  PangoGlyphItemIter *run_iter;
-  gboolean have_cluster;
+  int max_clusters;
+  int x;
+  int i;
+
+  /* There are no more clusters than characters */
+  max_clusters = 0;
+  for (i = 0; i < state->n_runs; i++)
+    max_clusters += state->run_info[i].run->item->num_chars;
+
+  state->clusters = g_new (ClusterInfo, max_clusters);
+  state->n_clusters = 0;
+
+  x = 0;
+  for (i = 0; i < state->n_runs; i++)
+    {
+      ClusterInfo *cluster;
+      LineIter iter;
+      gboolean have_cluster;
+
+      state->run_info[i].first_cluster = state->n_clusters;
+
+      iter.run_index = i;
+      for (have_cluster = pango_glyph_item_iter_init_start (&iter.run_iter,
+                                                            state->run_info[i].run,
+                                                            state->layout->text);
+           have_cluster;
+           have_cluster = pango_glyph_item_iter_next_cluster (&iter.run_iter))
+        {
+          cluster = &state->clusters[state->n_clusters++];
+          cluster->iter = iter;
+          cluster->x = x;
+          cluster->width = get_cluster_width (&iter);
+          if (cluster->width < 0)
+            state->monotonic = FALSE;
+
+          x += cluster->width;
+        }
+
+      state->run_info[i].n_clusters = state->n_clusters - state->run_info[i].first_cluster;
+    }
+}
+
+/* Computes the position of the gap center and finds the smallest span containing it.
+ * Returns the indices of the first and last cluster of the span.
+ */
+static void
+find_initial_span (EllipsizeState *state,
+                   int            *start_cluster,
+                   int            *end_cluster)
+{
+  RunInfo *run_info;
   int i;
   int x;
-  int cluster_width;
+  int lo, hi;
 
   switch (state->layout->ellipsize)
     {
@@ -537,117 +747,383 @@ find_initial_span (EllipsizeState *state)
       x += state->run_info[i].width;
     }
 
-  if (i == state->n_runs)	/* Last run is a closed interval, so back off one run */
+  if (i == state->n_runs)
+    {
+      /* The line is a closed interval, so the gap center
+       * at its end is in the last cluster
+       */
+      lo = state->n_clusters - 1;
+    }
+  else
     {
-      i--;
-      x -= state->run_info[i].width;
+      /* Find the first cluster in the run that ends after the gap center.
+       * If there is none, the last cluster is a closed interval, so we
+       * use that.
+       */
+      run_info = &state->run_info[i];
+      lo = run_info->first_cluster;
+      hi = run_info->first_cluster + run_info->n_clusters - 1;
+
+      if (state->monotonic)
+        {
+          while (lo < hi)
+            {
+              int mid = (lo + hi) / 2;
+              ClusterInfo *cluster = &state->clusters[mid];
+
+              if (cluster->x + cluster->width > state->gap_center)
+                hi = mid;
+              else
+                lo = mid + 1;
+            }
+        }
+      else
+        {
+          for (; lo < hi; lo++)
+            {
+              ClusterInfo *cluster = &state->clusters[lo];
+
+              if (cluster->x + cluster->width > state->gap_center)
+                break;
+            }
+        }
     }
 
-  /* Find the cluster containing the gap center
+  /* Expand the gap to a full span
    */
-  state->gap_start_iter.run_index = i;
-  run_iter = &state->gap_start_iter.run_iter;
-  glyph_item = state->run_info[i].run;
+  *start_cluster = *end_cluster = lo;
 
-  cluster_width = 0;		/* Quiet GCC, the line must have at least one cluster */
-  for (have_cluster = pango_glyph_item_iter_init_start (run_iter, glyph_item, state->layout->text);
-       have_cluster;
-       have_cluster = pango_glyph_item_iter_next_cluster (run_iter))
-    {
-      cluster_width = get_cluster_width (&state->gap_start_iter);
+  while (!starts_at_ellipsization_boundary (state, &state->clusters[*start_cluster].iter))
+    (*start_cluster)--;
 
-      if (x + cluster_width > state->gap_center)
-	break;
+  while (!ends_at_ellipsization_boundary (state, &state->clusters[*end_cluster].iter))
+    (*end_cluster)++;
+}
 
-      x += cluster_width;
-    }
+/* x position of the start of the gap with index @i in gap_starts */
+#define GAP_START_X(state, i) ((state)->clusters[(state)->gap_starts[i]].x)
 
-  if (!have_cluster)	/* Last cluster is a closed interval, so back off one cluster */
-    x -= cluster_width;
+/* x position of the end of the gap with index @i in gap_ends */
+#define GAP_END_X(state, i) ((state)->clusters[(state)->gap_ends[i]].x + \
+                             (state)->clusters[(state)->gap_ends[i]].width)
 
-  state->gap_end_iter = state->gap_start_iter;
+/* Collects the clusters that the gap can start and end with as it
+ * grows from the span between @start_cluster and @end_cluster, one
+ * span at a time.
+ *
+ * A span before the gap starts with a cluster that isn't empty and
+ * starts at an ellipsization boundary, or with the first cluster of
+ * the line; a span after the gap ends likewise. We stop in a direction
+ * when the next span would not make the gap any wider.
+ */
+static void
+init_gap_edges (EllipsizeState *state,
+                int             start_cluster,
+                int             end_cluster)
+{
+  gboolean next_is_wide;
+  int i;
 
-  state->gap_start_x = x;
-  state->gap_end_x = x + cluster_width;
+  state->gap_starts = g_new (int, start_cluster + 1);
+  state->wide_ends = g_new (int, start_cluster + 1);
+  state->gap_starts[0] = start_cluster;
+  state->n_gap_starts = 1;
 
-  /* Expand the gap to a full span
-   */
-  while (!starts_at_ellipsization_boundary (state, &state->gap_start_iter))
+  for (i = start_cluster - 1; i >= 0; i--)
     {
-      line_iter_prev_cluster (state, &state->gap_start_iter);
-      state->gap_start_x -= get_cluster_width (&state->gap_start_iter);
+      ClusterInfo *cluster = &state->clusters[i];
+
+      if (i > 0 &&
+          (cluster->width == 0 || !starts_at_ellipsization_boundary (state, &cluster->iter)))
+        continue;
+
+      if (cluster->x == GAP_START_X (state, state->n_gap_starts - 1))
+        break;
+
+      state->gap_starts[state->n_gap_starts++] = i;
     }
 
-  while (!ends_at_ellipsization_boundary (state, &state->gap_end_iter))
+  /* update_ellipsis_shape() reshapes the ellipsis when the first
+   * character of the gap changes from wide to not wide, or back
+   */
+  next_is_wide = FALSE;
+  for (i = state->n_gap_starts - 1; i >= 0; i--)
     {
-      line_iter_next_cluster (state, &state->gap_end_iter);
-      state->gap_end_x += get_cluster_width (&state->gap_end_iter);
+      const char *p = state->layout->text + state->clusters[state->gap_starts[i]].iter.run_iter.start_index;
+      gboolean is_wide = g_unichar_iswide (g_utf8_get_char (p));
+
+      if (i + 1 < state->n_gap_starts && is_wide == next_is_wide)
+        state->wide_ends[i] = state->wide_ends[i + 1];
+      else
+        state->wide_ends[i] = i;
+
+      next_is_wide = is_wide;
     }
 
-  update_ellipsis_shape (state);
+  state->gap_ends = g_new (int, state->n_clusters - end_cluster);
+  state->gap_ends[0] = end_cluster;
+  state->n_gap_ends = 1;
+
+  for (i = end_cluster + 1; i < state->n_clusters; i++)
+    {
+      ClusterInfo *cluster = &state->clusters[i];
+
+      if (i < state->n_clusters - 1 &&
+          (cluster->width == 0 || !ends_at_ellipsization_boundary (state, &cluster->iter)))
+        continue;
+
+      if (cluster->x + cluster->width == GAP_END_X (state, state->n_gap_ends - 1))
+        break;
+
+      state->gap_ends[state->n_gap_ends++] = i;
+    }
 }
 
-/* Removes one run from the start or end of the gap. Returns FALSE
- * if there's nothing left to remove in either direction.
+/* Checks whether the gap grows at the start rather than at the end
+ * when it starts with gap start @start and ends with gap end @end.
+ * We pick the side which causes the smaller increase in
+ *
+ *  MAX (gap_end - gap_center, gap_start - gap_center)
  */
 static gboolean
-remove_one_span (EllipsizeState *state)
+gap_grows_at_start (EllipsizeState *state,
+                    int             start,
+                    int             end)
 {
-  LineIter new_gap_start_iter;
-  LineIter new_gap_end_iter;
-  int new_gap_start_x;
-  int new_gap_end_x;
-  int width;
+  if (start + 1 == state->n_gap_starts)
+    return FALSE;
 
-  /* Find one span backwards and forward from the gap
-   */
-  new_gap_start_iter = state->gap_start_iter;
-  new_gap_start_x = state->gap_start_x;
-  do
+  if (end + 1 == state->n_gap_ends)
+    return TRUE;
+
+  return state->gap_center - GAP_START_X (state, start + 1) <
+         GAP_END_X (state, end + 1) - state->gap_center;
+}
+
+/* Returns the step at which the gap grows to start with gap start
+ * @start, or the number of steps if it never does.
+ *
+ * Only valid if state->monotonic is set. Then the gap starts and ends
+ * get further from the gap center one by one, and the gap ends that
+ * are taken before gap start @start are the ones that are no further
+ * from the gap center than it.
+ */
+static int
+gap_start_step (EllipsizeState *state,
+                int             start)
+{
+  int distance;
+  int lo, hi;
+
+  if (start == 0)
+    return 0;
+
+  if (start == state->n_gap_starts)
+    return state->n_gap_starts + state->n_gap_ends - 1;
+
+  distance = state->gap_center - GAP_START_X (state, start);
+
+  /* Find the first gap end that is further away */
+  lo = 1;
+  hi = state->n_gap_ends;
+  while (lo < hi)
     {
-      if (!line_iter_prev_cluster (state, &new_gap_start_iter))
-	break;
-      width = get_cluster_width (&new_gap_start_iter);
-      new_gap_start_x -= width;
+      int mid = (lo + hi) / 2;
+
+      if (GAP_END_X (state, mid) - state->gap_center <= distance)
+        lo = mid + 1;
+      else
+        hi = mid;
     }
-  while (!starts_at_ellipsization_boundary (state, &new_gap_start_iter) ||
-	 width == 0);
 
-  new_gap_end_iter = state->gap_end_iter;
-  new_gap_end_x = state->gap_end_x;
-  do
+  return start + lo - 1;
+}
+
+/* Finds the gap start and end after @step steps of growing the gap.
+ * Only valid if state->monotonic is set.
+ */
+static void
+gap_at_step (EllipsizeState *state,
+             int             step,
+             int            *start,
+             int            *end)
+{
+  int lo, hi;
+
+  /* Find the last gap start that is reached by then */
+  lo = 0;
+  hi = MIN (step, state->n_gap_starts - 1);
+  while (lo < hi)
     {
-      if (!line_iter_next_cluster (state, &new_gap_end_iter))
-	break;
-      width = get_cluster_width (&new_gap_end_iter);
-      new_gap_end_x += width;
+      int mid = (lo + hi + 1) / 2;
+
+      if (gap_start_step (state, mid) <= step)
+        lo = mid;
+      else
+        hi = mid - 1;
     }
-  while (!ends_at_ellipsization_boundary (state, &new_gap_end_iter) ||
-	 width == 0);
 
-  if (state->gap_end_x == new_gap_end_x && state->gap_start_x == new_gap_start_x)
-    return FALSE;
+  *start = lo;
+  *end = step - lo;
+}
+
+/* Moves the gap to start with gap start @start and end with gap end @end
+ */
+static void
+set_gap (EllipsizeState *state,
+         int             start,
+         int             end)
+{
+  ClusterInfo *start_cluster = &state->clusters[state->gap_starts[start]];
+  ClusterInfo *end_cluster = &state->clusters[state->gap_ends[end]];
+
+  state->gap_start_iter = start_cluster->iter;
+  state->gap_start_x = start_cluster->x;
+  state->gap_end_iter = end_cluster->iter;
+  state->gap_end_x = end_cluster->x + end_cluster->width;
+}
+
+/* Computes the width of the line if it was ellipsized with the gap
+ * between gap start @start and gap end @end, and the current ellipsis
+ */
+static int
+gap_width (EllipsizeState *state,
+           int             start,
+           int             end)
+{
+  return state->total_width - (GAP_END_X (state, end) - GAP_START_X (state, start)) + state->ellipsis_width;
+}
+
+/* Finds the last gap start from @start on that doesn't make
+ * update_ellipsis_shape() reshape the ellipsis, which is shaped
+ * for gap start @start
+ */
+static int
+find_ellipsis_stretch_end (EllipsizeState *state,
+                           int             start)
+{
+  int range_start, range_end;
+  int lo, hi;
 
-  /* In the case where we could remove a span from either end of the
-   * gap, we look at which causes the smaller increase in the
-   * MAX (gap_end - gap_center, gap_start - gap_center)
+  pango_attr_iterator_range (state->gap_start_attr, &range_start, &range_end);
+
+  /* Gap starts move backwards through the text, so the ones that
+   * are still in the attribute range of the ellipsis come first
    */
-  if (state->gap_end_x == new_gap_end_x ||
-      (state->gap_start_x != new_gap_start_x &&
-       state->gap_center - new_gap_start_x < new_gap_end_x - state->gap_center))
+  lo = start;
+  hi = state->wide_ends[start];
+  while (lo < hi)
+    {
+      int mid = (lo + hi + 1) / 2;
+
+      if (state->clusters[state->gap_starts[mid]].iter.run_iter.start_index >= range_start)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+
+  return lo;
+}
+
+/* Grows the gap until the line fits in @goal_width, or there is nothing
+ * left to remove, by searching the steps of each stretch of gap starts
+ * with the same ellipsis for the first gap that is wide enough.
+ */
+static void
+grow_gap_monotonic (EllipsizeState *state,
+                    int             goal_width)
+{
+  int n_steps = state->n_gap_starts + state->n_gap_ends - 1;
+  int start, end;
+  int lo, hi;
+
+  start = 0;
+  while (TRUE)
     {
-      state->gap_start_iter = new_gap_start_iter;
-      state->gap_start_x = new_gap_start_x;
+      int stretch_end;
 
+      /* Shape the ellipsis for the first step with this gap start */
+      lo = gap_start_step (state, start);
+      set_gap (state, start, lo - start);
       update_ellipsis_shape (state);
+
+      stretch_end = find_ellipsis_stretch_end (state, start);
+      hi = gap_start_step (state, stretch_end + 1) - 1;
+
+      gap_at_step (state, hi, &start, &end);
+      if (gap_width (state, start, end) <= goal_width)
+        break;
+
+      /* Nothing left to remove; the last step is as good as it gets */
+      if (hi == n_steps - 1)
+        {
+          lo = hi;
+          break;
+        }
+
+      start = stretch_end + 1;
     }
-  else
+
+  while (lo < hi)
     {
-      state->gap_end_iter = new_gap_end_iter;
-      state->gap_end_x = new_gap_end_x;
+      int mid = (lo + hi) / 2;
+
+      gap_at_step (state, mid, &start, &end);
+      if (gap_width (state, start, end) <= goal_width)
+        hi = mid;
+      else
+        lo = mid + 1;
     }
 
-  return TRUE;
+  gap_at_step (state, lo, &start, &end);
+  set_gap (state, start, end);
+}
+
+/* Grows the gap until the line fits in @goal_width, or there is nothing
+ * left to remove, one span at a time.
+ */
+static void
+grow_gap_in_order (EllipsizeState *state,
+                   int             goal_width)
+{
+  int start = 0;
+  int end = 0;
+
+  while (TRUE)
+    {
+      set_gap (state, start, end);
+      update_ellipsis_shape (state);
+
+      if (gap_width (state, start, end) <= goal_width)
+        break;
+
+      if (start + 1 == state->n_gap_starts && end + 1 == state->n_gap_ends)
+        break;
+
+      if (gap_grows_at_start (state, start, end))
+        start++;
+      else
+        end++;
+    }
+}
+
+/* Grows the gap from the span between @start_cluster and @end_cluster
+ * until the line fits in @goal_width, or there is nothing left to remove
+ */
+static void
+grow_gap (EllipsizeState *state,
+          int             start_cluster,
+          int             end_cluster,
+          int             goal_width)
+{
+  init_gap_edges (state, start_cluster, end_cluster);
+
+  if (state->monotonic)
+    grow_gap_monotonic (state, goal_width);
+  else
+    grow_gap_in_order (state, goal_width);
+
+  update_ellipsis_shape (state);
 }
 
 /* Fixes up the properties of the ellipsis run once we've determined the final extents
@@ -667,6 +1143,7 @@ fixup_ellipsis_run (EllipsizeState *state,
     {
       glyphs->log_clusters[i] = 0;
       glyphs->glyphs[i].attr.is_cluster_start = FALSE;
+      glyphs->glyphs[i].attr.is_unsafe_to_break = FALSE;
     }
 
   glyphs->glyphs[0].attr.is_cluster_start = TRUE;
@@ -771,6 +1248,7 @@ _pango_layout_line_ellipsize (PangoLayoutLine *line,
 			      int              goal_width)
 {
   EllipsizeState state;
+  int start_cluster, end_cluster;
   gboolean is_ellipsized = FALSE;
 
   g_return_val_if_fail (line->layout->ellipsize != PANGO_ELLIPSIZE_NONE && goal_width >= 0, is_ellipsized);
@@ -780,13 +1258,9 @@ _pango_layout_line_ellipsize (PangoLayoutLine *line,
   if (state.total_width <= goal_width)
     goto out;
 
-  find_initial_span (&state);
-
-  while (current_width (&state) > goal_width)
-    {
-      if (!remove_one_span (&state))
-	break;
-    }
+  init_clusters (&state);
+  find_initial_span (&state, &start_cluster, &end_cluster);
+  grow_gap (&state, start_cluster, end_cluster, goal_width);
 
   fixup_ellipsis_run (&state, MAX (goal_width - current_width (&state), 0));
 
@@ -52,10 +52,26 @@ struct _PangoFontDescription
   guint static_variations : 1;
   guint static_features : 1;
   guint size_is_absolute : 1;
+  guint interned : 1;
 
   int size;
 };
 
+/* Interned descriptions are reference counted, carry their
+ * hash, and remember the interned description that is derived
+ * from them by unsetting some fields. See
+ * pango_font_description_intern().
+ */
+typedef struct
+{
+  PangoFontDescription desc;
+
+  int ref_count;
+  guint hash;
+  PangoFontMask ignoring_mask;
+  PangoFontDescription *ignoring;
+} PangoInternedFontDescription;
+
 G_DEFINE_BOXED_TYPE (PangoFontDescription, pango_font_description,
                      pango_font_description_copy,
                      pango_font_description_free);
@@ -77,6 +93,7 @@ static const PangoFontDescription pfd_defaults = {
   0,                    /* static_variations */
   0,                    /* static_features */
   0,                    /* size_is_absolute */
+  0,                    /* interned */
 
   0,                    /* size */
 };
@@ -1091,6 +1108,7 @@ pango_font_description_copy (const PangoFontDescription *desc)
   result = g_slice_new (PangoFontDescription);
 
   *result = *desc;
+  result->interned = FALSE;
 
   if (result->family_name)
     {
@@ -1134,6 +1152,7 @@ pango_font_description_copy_static (const PangoFontDescription *desc)
   result = g_slice_new (PangoFontDescription);
 
   *result = *desc;
+  result->interned = FALSE;
   if (result->family_name)
     result->static_family = TRUE;
 
@@ -1169,18 +1188,51 @@ pango_font_description_equal (const PangoFontDescription *desc1,
   g_return_val_if_fail (desc1 != NULL, FALSE);
   g_return_val_if_fail (desc2 != NULL, FALSE);
 
-  return desc1->style == desc2->style &&
-         desc1->variant == desc2->variant &&
-         desc1->weight == desc2->weight &&
-         desc1->width == desc2->width &&
-         desc1->size == desc2->size &&
-         desc1->size_is_absolute == desc2->size_is_absolute &&
-         desc1->gravity == desc2->gravity &&
-         desc1->color == desc2->color &&
-         (desc1->family_name == desc2->family_name ||
+  return pango_font_description_equal_ignoring (desc1, desc2, 0);
+}
+
+#define IGNORED(field) ((ignore & PANGO_FONT_MASK_##field) != 0)
+
+/*< private >
+ * pango_font_description_equal_ignoring:
+ * @desc1: a `PangoFontDescription`
+ * @desc2: another `PangoFontDescription`
+ * @ignore: the fields to leave out of the comparison
+ *
+ * Compares two font descriptions like [method@Pango.FontDescription.equal],
+ * as if the fields in @ignore were unset in both of them.
+ *
+ * This lets callers compare a description against a stored copy
+ * that had these fields unset, without making a copy of their own.
+ *
+ * Returns: %TRUE if the two font descriptions are identical
+ *   apart from the fields in @ignore
+ */
+gboolean
+pango_font_description_equal_ignoring (const PangoFontDescription *desc1,
+                                       const PangoFontDescription *desc2,
+                                       PangoFontMask               ignore)
+{
+  if (desc1 == desc2)
+    return TRUE;
+
+  /* There is only one interned description with the same fields */
+  if (ignore == 0 && desc1->interned && desc2->interned)
+    return FALSE;
+
+  return (IGNORED (STYLE) || desc1->style == desc2->style) &&
+         (IGNORED (VARIANT) || desc1->variant == desc2->variant) &&
+         (IGNORED (WEIGHT) || desc1->weight == desc2->weight) &&
+         (IGNORED (WIDTH) || desc1->width == desc2->width) &&
+         (IGNORED (SIZE) || (desc1->size == desc2->size &&
+                             desc1->size_is_absolute == desc2->size_is_absolute)) &&
+         (IGNORED (GRAVITY) || desc1->gravity == desc2->gravity) &&
+         (IGNORED (COLOR) || desc1->color == desc2->color) &&
+         (IGNORED (FAMILY) ||
+          desc1->family_name == desc2->family_name ||
           (desc1->family_name && desc2->family_name && g_ascii_strcasecmp (desc1->family_name, desc2->family_name) == 0)) &&
-         (g_strcmp0 (desc1->variations, desc2->variations) == 0) &&
-         (g_strcmp0 (desc1->features, desc2->features) == 0);
+         (IGNORED (VARIATIONS) || g_strcmp0 (desc1->variations, desc2->variations) == 0) &&
+         (IGNORED (FEATURES) || g_strcmp0 (desc1->features, desc2->features) == 0);
 }
 
 #define TOLOWER(c) \
@@ -1214,29 +1266,251 @@ case_insensitive_hash (const char *key)
  */
 guint
 pango_font_description_hash (const PangoFontDescription *desc)
+{
+  g_return_val_if_fail (desc != NULL, 0);
+
+  return pango_font_description_hash_ignoring (desc, 0);
+}
+
+/*< private >
+ * pango_font_description_hash_ignoring:
+ * @desc: a `PangoFontDescription`
+ * @ignore: the fields to leave out of the hash
+ *
+ * Computes a hash of a font description that is consistent
+ * with pango_font_description_equal_ignoring() for the
+ * same @ignore.
+ *
+ * Returns: the hash value
+ */
+guint
+pango_font_description_hash_ignoring (const PangoFontDescription *desc,
+                                      PangoFontMask               ignore)
 {
   guint hash = 0;
 
-  g_return_val_if_fail (desc != NULL, 0);
+  if (ignore == 0 && desc->interned)
+    return ((const PangoInternedFontDescription *) desc)->hash;
 
-  if (desc->family_name)
+  if (desc->family_name && !IGNORED (FAMILY))
     hash = case_insensitive_hash (desc->family_name);
-  if (desc->variations)
+  if (desc->variations && !IGNORED (VARIATIONS))
     hash ^= g_str_hash (desc->variations);
-  if (desc->features)
+  if (desc->features && !IGNORED (FEATURES))
     hash ^= g_str_hash (desc->features);
-  hash ^= desc->size;
-  hash ^= desc->size_is_absolute ? 0xc33ca55a : 0;
-  hash ^= desc->style << 16;
-  hash ^= desc->variant << 18;
-  hash ^= desc->weight << 16;
-  hash ^= desc->width << 22;
-  hash ^= desc->gravity << 28;
-  hash ^= desc->color << 29;
+  if (!IGNORED (SIZE))
+    {
+      hash ^= desc->size;
+      hash ^= desc->size_is_absolute ? 0xc33ca55a : 0;
+    }
+  if (!IGNORED (STYLE))
+    hash ^= desc->style << 16;
+  if (!IGNORED (VARIANT))
+    hash ^= desc->variant << 18;
+  if (!IGNORED (WEIGHT))
+    hash ^= desc->weight << 16;
+  if (!IGNORED (WIDTH))
+    hash ^= desc->width << 22;
+  if (!IGNORED (GRAVITY))
+    hash ^= desc->gravity << 28;
+  if (!IGNORED (COLOR))
+    hash ^= desc->color << 29;
 
   return hash;
 }
 
+#undef IGNORED
+
+G_LOCK_DEFINE_STATIC (interned_descs);
+static GHashTable *interned_descs;
+
+/*< private >
+ * pango_font_description_intern:
+ * @desc: a `PangoFontDescription`
+ *
+ * Returns the canonical instance of the font descriptions that
+ * are equal to @desc, as determined by [method@Pango.FontDescription.equal].
+ *
+ * Comparing two interned descriptions is a pointer comparison,
+ * and their hash is computed only once, which makes them cheap
+ * keys for the caches that are consulted while itemizing.
+ *
+ * Interned descriptions must not be modified. They are reference
+ * counted, and [method@Pango.FontDescription.free] drops a
+ * reference. Copies of them are regular descriptions.
+ *
+ * Returns: (transfer full): the interned description
+ */
+PangoFontDescription *
+pango_font_description_intern (const PangoFontDescription *desc)
+{
+  PangoInternedFontDescription *interned;
+
+  G_LOCK (interned_descs);
+
+  if (desc->interned)
+    interned = (PangoInternedFontDescription *) desc;
+  else
+    {
+      if (G_UNLIKELY (!interned_descs))
+        interned_descs = g_hash_table_new ((GHashFunc) pango_font_description_hash,
+                                           (GEqualFunc) pango_font_description_equal);
+
+      interned = g_hash_table_lookup (interned_descs, desc);
+    }
+
+  if (interned)
+    interned->ref_count++;
+  else
+    {
+      interned = g_new0 (PangoInternedFontDescription, 1);
+
+      interned->desc = *desc;
+      interned->desc.family_name = g_strdup (desc->family_name);
+      interned->desc.static_family = FALSE;
+      interned->desc.variations = g_strdup (desc->variations);
+      interned->desc.static_variations = FALSE;
+      interned->desc.features = g_strdup (desc->features);
+      interned->desc.static_features = FALSE;
+
+      interned->ref_count = 1;
+      interned->hash = pango_font_description_hash_ignoring (desc, 0);
+      interned->desc.interned = TRUE;
+
+      g_hash_table_add (interned_descs, interned);
+    }
+
+  G_UNLOCK (interned_descs);
+
+  return &interned->desc;
+}
+
+static void
+pango_font_description_release (PangoFontDescription *desc)
+{
+  PangoInternedFontDescription *interned = (PangoInternedFontDescription *) desc;
+
+  G_LOCK (interned_descs);
+
+  if (--interned->ref_count > 0)
+    {
+      G_UNLOCK (interned_descs);
+      return;
+    }
+
+  g_hash_table_remove (interned_descs, interned);
+  if (g_hash_table_size (interned_descs) == 0)
+    g_clear_pointer (&interned_descs, g_hash_table_unref);
+
+  G_UNLOCK (interned_descs);
+
+  /* The derived description never refers back to this one */
+  if (interned->ignoring != desc)
+    pango_font_description_free (interned->ignoring);
+
+  g_free (desc->family_name);
+  g_free (desc->variations);
+  g_free (desc->features);
+  g_free (interned);
+}
+
+/*< private >
+ * pango_font_description_intern_ignoring:
+ * @desc: a `PangoFontDescription`
+ * @ignore: the fields to unset
+ *
+ * Returns the interned description for a copy of @desc with
+ * the fields in @ignore unset.
+ *
+ * If @desc is interned itself, it keeps the result for the
+ * first @ignore that this is called with, and
+ * pango_font_description_peek_interned_ignoring() returns it
+ * from then on.
+ *
+ * Returns: (transfer full): the interned description
+ */
+PangoFontDescription *
+pango_font_description_intern_ignoring (const PangoFontDescription *desc,
+                                        PangoFontMask               ignore)
+{
+  PangoInternedFontDescription *interned;
+  PangoFontDescription *copy;
+  PangoFontDescription *result;
+
+  result = (PangoFontDescription *) pango_font_description_peek_interned_ignoring (desc, ignore);
+  if (result)
+    return pango_font_description_intern (result);
+
+  copy = pango_font_description_copy_static (desc);
+  pango_font_description_unset_fields (copy, ignore);
+  result = pango_font_description_intern (copy);
+  pango_font_description_free (copy);
+
+  if (!desc->interned)
+    return result;
+
+  interned = (PangoInternedFontDescription *) desc;
+
+  G_LOCK (interned_descs);
+
+  /* The derived description is set only once, so that
+   * peeking at it doesn't need the lock. It holds a
+   * reference, unless it is @desc itself.
+   */
+  if (!interned->ignoring)
+    {
+      if (result != desc)
+        ((PangoInternedFontDescription *) result)->ref_count++;
+
+      interned->ignoring_mask = ignore;
+      g_atomic_pointer_set (&interned->ignoring, result);
+    }
+
+  G_UNLOCK (interned_descs);
+
+  return result;
+}
+
+/*< private >
+ * pango_font_description_peek_interned_ignoring:
+ * @desc: a `PangoFontDescription`
+ * @ignore: the fields to unset
+ *
+ * Returns the description that pango_font_description_intern_ignoring()
+ * kept for @desc and @ignore, if there is one.
+ *
+ * Returns: (transfer none) (nullable): the interned description,
+ *   which lives as long as @desc
+ */
+const PangoFontDescription *
+pango_font_description_peek_interned_ignoring (const PangoFontDescription *desc,
+                                               PangoFontMask               ignore)
+{
+  PangoInternedFontDescription *interned = (PangoInternedFontDescription *) desc;
+  PangoFontDescription *ignoring;
+
+  if (!desc->interned)
+    return NULL;
+
+  ignoring = g_atomic_pointer_get (&interned->ignoring);
+  if (ignoring && interned->ignoring_mask == ignore)
+    return ignoring;
+
+  return NULL;
+}
+
+/*< private >
+ * pango_font_description_is_interned:
+ * @desc: a `PangoFontDescription`
+ *
+ * Returns: whether @desc was returned by pango_font_description_intern()
+ */
+gboolean
+pango_font_description_is_interned (const PangoFontDescription *desc)
+{
+  return desc->interned;
+}
+
 /**
  * pango_font_description_free:
  * @desc: (nullable): a `PangoFontDescription`, may be %NULL
@@ -1249,6 +1523,12 @@ pango_font_description_free (PangoFontDescription *desc)
   if (desc == NULL)
     return;
 
+  if (desc->interned)
+    {
+      pango_font_description_release (desc);
+      return;
+    }
+
   if (desc->family_name && !desc->static_family)
     g_free (desc->family_name);
 
@@ -2518,17 +2798,28 @@ hb_font_t *
 pango_font_get_hb_font (PangoFont *font)
 {
   PangoFontPrivate *priv = pango_font_get_instance_private (font);
+  hb_font_t *hb_font;
 
   g_return_val_if_fail (PANGO_IS_FONT (font), NULL);
 
-  if (priv->hb_font)
-    return priv->hb_font;
+  hb_font = g_atomic_pointer_get (&priv->hb_font);
+  if (hb_font)
+    return hb_font;
 
-  priv->hb_font = PANGO_FONT_GET_CLASS (font)->create_hb_font (font);
+  hb_font = PANGO_FONT_GET_CLASS (font)->create_hb_font (font);
 
-  hb_font_make_immutable (priv->hb_font);
+  hb_font_make_immutable (hb_font);
+
+  /* Fonts can be shared between threads, and another
+   * thread may have been faster
+   */
+  if (!g_atomic_pointer_compare_and_exchange (&priv->hb_font, NULL, hb_font))
+    {
+      hb_font_destroy (hb_font);
+      hb_font = g_atomic_pointer_get (&priv->hb_font);
+    }
 
-  return priv->hb_font;
+  return hb_font;
 }
 
 G_DEFINE_BOXED_TYPE (PangoFontMetrics, pango_font_metrics,
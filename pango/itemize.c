@@ -292,9 +292,10 @@ struct _ItemizeState
   GList *result;
   PangoItem *item;
 
-  guint8 *embedding_levels;
-  guint8 embedding_levels_[64];
-  int embedding_end_offset;
+  PangoBidiRun *bidi_runs;
+  PangoBidiRun bidi_runs_[8];
+  unsigned int n_bidi_runs;
+  unsigned int bidi_run;
   const char *embedding_end;
   guint8 embedding;
 
@@ -333,19 +334,27 @@ struct _ItemizeState
 
   const char *first_space; /* first of a sequence of spaces we've seen */
   int font_position; /* position of the current font in the fontset */
+
+  gboolean simple; /* ASCII text, see is_simple_text() */
 };
 
 static void
 update_embedding_end (ItemizeState *state)
 {
-  state->embedding = state->embedding_levels[state->embedding_end_offset];
-  while (state->embedding_end < state->end &&
-         state->embedding_levels[state->embedding_end_offset] == state->embedding)
+  if (state->bidi_run < state->n_bidi_runs)
     {
-      state->embedding_end_offset++;
-      state->embedding_end = g_utf8_next_char (state->embedding_end);
+      const PangoBidiRun *run = &state->bidi_runs[state->bidi_run++];
+
+      state->embedding = run->level;
+      if (state->simple)
+        state->embedding_end += run->length;
+      else
+        state->embedding_end = g_utf8_offset_to_pointer (state->embedding_end, run->length);
     }
 
+  if (state->bidi_run == state->n_bidi_runs)
+    state->embedding_end = state->end;
+
   state->changed |= EMBEDDING_CHANGED;
 }
 
@@ -443,6 +452,38 @@ update_end (ItemizeState *state)
 }
 
 
+/* Text that is all ASCII has no emoji, and is a single script
+ * run, Latin or Common if it has no letters. Unless the context
+ * is vertical, where the width iterator matters, we can skip
+ * the script, width and emoji iterators for such text.
+ */
+static gboolean
+is_simple_text (PangoContext *context,
+                const char   *text,
+                int           length,
+                PangoScript  *script)
+{
+  gboolean has_letters = FALSE;
+  int i;
+
+  if (PANGO_GRAVITY_IS_VERTICAL (context->resolved_gravity))
+    return FALSE;
+
+  for (i = 0; i < length; i++)
+    {
+      guchar c = text[i];
+
+      if (c == 0 || c >= 0x80)
+        return FALSE;
+
+      has_letters |= g_ascii_isalpha (c);
+    }
+
+  *script = has_letters ? PANGO_SCRIPT_LATIN : PANGO_SCRIPT_COMMON;
+
+  return TRUE;
+}
+
 static void
 itemize_state_init (ItemizeState               *state,
                     PangoContext               *context,
@@ -452,11 +493,19 @@ itemize_state_init (ItemizeState               *state,
                     int                         length,
                     PangoAttrList              *attrs,
                     PangoAttrIterator          *cached_iter,
-                    const PangoFontDescription *desc)
+                    const PangoFontDescription *desc,
+                    const PangoAnalyzedParagraph *para)
 {
   unsigned int n_chars;
+  const PangoBidiRun *runs;
 
-  n_chars = g_utf8_strlen (text + start_index, length);
+  state->simple = is_simple_text (context, text + start_index, length, &state->script);
+  if (para)
+    n_chars = para->n_chars;
+  else if (state->simple)
+    n_chars = length;
+  else
+    n_chars = g_utf8_strlen (text + start_index, length);
 
   state->context = context;
   state->text = text;
@@ -470,15 +519,26 @@ itemize_state_init (ItemizeState               *state,
                    FONT_CHANGED | WIDTH_CHANGED | EMOJI_CHANGED;
 
   /* First, apply the bidirectional algorithm to break
-   * the text into directional runs.
+   * the text into directional runs. The runs live in a
+   * per-thread buffer, so we copy them before anything
+   * else gets a chance to resolve levels.
    */
-  if (n_chars < 64)
-    state->embedding_levels = state->embedding_levels_;
+  if (para)
+    runs = pango_log2vis_get_runs (para->chars, para->bidi_types, n_chars,
+                                   para->ored_types, para->anded_strongs,
+                                   &base_dir, &state->n_bidi_runs);
   else
-    state->embedding_levels = g_new (guint8, n_chars);
-  pango_log2vis_fill_embedding_levels (text + start_index, length, n_chars, state->embedding_levels, &base_dir);
+    runs = pango_log2vis_get_runs_for_text (text + start_index, length, n_chars,
+                                            &base_dir, &state->n_bidi_runs);
 
-  state->embedding_end_offset = 0;
+  if (state->n_bidi_runs <= G_N_ELEMENTS (state->bidi_runs_))
+    state->bidi_runs = state->bidi_runs_;
+  else
+    state->bidi_runs = g_new (PangoBidiRun, state->n_bidi_runs);
+  memcpy (state->bidi_runs, runs, state->n_bidi_runs * sizeof (PangoBidiRun));
+
+  state->bidi_run = 0;
+  state->embedding = 0;
   state->embedding_end = text + start_index;
   update_embedding_end (state);
 
@@ -528,19 +588,36 @@ itemize_state_init (ItemizeState               *state,
       state->enable_fallback = TRUE;
     }
 
-  /* Initialize the script iterator
-   */
-  _pango_script_iter_init (&state->script_iter, text + start_index, length);
-  pango_script_iter_get_range (&state->script_iter, NULL,
-                               &state->script_end, &state->script);
+  if (state->simple)
+    {
+      /* The script has been determined already, and the
+       * iterators cover the whole text, so itemize_state_next()
+       * never advances them
+       */
+      state->script_end = state->end;
+      state->width_iter.end = state->end;
+      state->width_iter.upright = FALSE;
+      state->emoji_iter.end = state->end;
+      state->emoji_iter.is_emoji = FALSE;
+      state->emoji_iter.has_vs = FALSE;
+    }
+  else
+    {
+      /* Initialize the script iterator
+       */
+      _pango_script_iter_init (&state->script_iter, text + start_index, length);
+      pango_script_iter_get_range (&state->script_iter, NULL,
+                                   &state->script_end, &state->script);
 
-  width_iter_init (&state->width_iter, text + start_index, length);
-  _pango_emoji_iter_init (&state->emoji_iter, text + start_index, length, n_chars);
+      width_iter_init (&state->width_iter, text + start_index, length);
+      _pango_emoji_iter_init (&state->emoji_iter, text + start_index, length,
+                              para ? para->chars : NULL, n_chars);
 
-  if (!PANGO_GRAVITY_IS_VERTICAL (state->context->resolved_gravity))
-    state->width_iter.end = state->end;
-  else if (state->emoji_iter.is_emoji)
-    state->width_iter.end = MAX (state->width_iter.end, state->emoji_iter.end);
+      if (!PANGO_GRAVITY_IS_VERTICAL (state->context->resolved_gravity))
+        state->width_iter.end = state->end;
+      else if (state->emoji_iter.is_emoji)
+        state->width_iter.end = MAX (state->width_iter.end, state->emoji_iter.end);
+    }
 
   update_end (state);
 
@@ -920,6 +997,8 @@ itemize_state_update_for_new_run (ItemizeState *state)
     {
       gboolean is_emoji = state->emoji_iter.is_emoji;
       gboolean has_vs = state->emoji_iter.has_vs;
+      PangoFontDescription *desc;
+
       if (is_emoji && !state->emoji_font_desc)
         {
           state->emoji_font_desc = pango_font_description_copy_static (state->font_desc);
@@ -932,10 +1011,15 @@ itemize_state_update_for_new_run (ItemizeState *state)
           pango_font_description_set_family_static (state->text_emoji_font_desc, "emoji");
           pango_font_description_set_color (state->text_emoji_font_desc, PANGO_FONT_COLOR_FORBIDDEN);
         }
-      state->current_fonts = pango_font_map_load_fontset (state->context->font_map,
-                                                          state->context,
-                                                          is_emoji ? state->emoji_font_desc : (has_vs ? state->text_emoji_font_desc : state->font_desc),
-                                                          state->derived_lang);
+
+      /* Interned descriptions make the fontset lookups
+       * in the context and the fontmap pointer compares.
+       * The context keeps them alive while it remembers
+       * the fontset.
+       */
+      desc = pango_font_description_intern (is_emoji ? state->emoji_font_desc : (has_vs ? state->text_emoji_font_desc : state->font_desc));
+      state->current_fonts = pango_context_load_fontset (state->context, desc, state->derived_lang);
+      pango_font_description_free (desc);
       state->cache = get_font_cache (state->current_fonts);
     }
 
@@ -981,6 +1065,75 @@ consider_as_space (gunichar wc)
          (wc >= 0xe0100u && wc <= 0xe01efu);
 }
 
+/* Only one character has type G_UNICODE_LINE_SEPARATOR in Unicode 4.0;
+ * update this if that changes. */
+#define LINE_SEPARATOR 0x2028
+
+static gboolean
+get_first_font_foreach (PangoFontset *fontset,
+                        PangoFont    *font,
+                        gpointer      data)
+{
+  PangoFont **first = data;
+
+  if (G_UNLIKELY (!font))
+    return FALSE;
+
+  *first = font;
+  return TRUE;
+}
+
+/* If the first font of the fontset has all the characters
+ * of the run, and a space for runs that are only spaces,
+ * the loop in itemize_state_process_run() puts the whole
+ * run into a single item with that font. We check for that
+ * with the coverage of the font and make the item directly.
+ */
+static gboolean
+itemize_state_process_run_fast (ItemizeState *state)
+{
+  PangoFont *font = NULL;
+  PangoCoverage *coverage;
+  gboolean covered;
+  const char *p;
+  int n_chars;
+
+  if (!state->enable_fallback)
+    return FALSE;
+
+  pango_fontset_foreach (state->current_fonts, get_first_font_foreach, &font);
+  if (!font)
+    return FALSE;
+
+  coverage = pango_font_get_coverage (font, state->derived_lang);
+  covered = pango_coverage_get (coverage, ' ') != PANGO_COVERAGE_NONE;
+
+  for (p = state->run_start, n_chars = 0;
+       covered && p < state->run_end;
+       p = g_utf8_next_char (p), n_chars++)
+    {
+      gunichar wc = g_utf8_get_char (p);
+
+      if (wc == '\t' || wc == LINE_SEPARATOR)
+        covered = FALSE;
+      else if (!consider_as_space (wc))
+        covered = pango_coverage_get (coverage, wc) != PANGO_COVERAGE_NONE;
+    }
+
+  g_object_unref (coverage);
+
+  if (!covered)
+    return FALSE;
+
+  itemize_state_add_character (state, font, 0, FALSE, state->run_start, FALSE);
+  state->item->num_chars = n_chars;
+  state->item->length = (state->run_end - state->text) - state->item->offset;
+  state->item = NULL;
+  state->first_space = NULL;
+
+  return TRUE;
+}
+
 static void
 itemize_state_process_run (ItemizeState *state)
 {
@@ -988,15 +1141,14 @@ itemize_state_process_run (ItemizeState *state)
   gboolean last_was_forced_break = FALSE;
   gboolean is_space;
 
-  /* Only one character has type G_UNICODE_LINE_SEPARATOR in Unicode 4.0;
-   * update this if that changes. */
-#define LINE_SEPARATOR 0x2028
-
   itemize_state_update_for_new_run (state);
 
   /* We should never get an empty run */
   g_assert (state->run_end != state->run_start);
 
+  if (itemize_state_process_run_fast (state))
+    return;
+
   for (p = state->run_start;
        p < state->run_end;
        p = g_utf8_next_char (p))
@@ -1060,16 +1212,19 @@ itemize_state_process_run (ItemizeState *state)
 static void
 itemize_state_finish (ItemizeState *state)
 {
-  if (state->embedding_levels != state->embedding_levels_)
-    g_free (state->embedding_levels);
+  if (state->bidi_runs != state->bidi_runs_)
+    g_free (state->bidi_runs);
   if (state->free_attr_iter)
     pango_attr_iterator_destroy (state->attr_iter);
-  _pango_script_iter_fini (&state->script_iter);
   pango_font_description_free (state->font_desc);
   pango_font_description_free (state->emoji_font_desc);
   pango_font_description_free (state->text_emoji_font_desc);
-  width_iter_fini (&state->width_iter);
-  _pango_emoji_iter_fini (&state->emoji_iter);
+  if (!state->simple)
+    {
+      _pango_script_iter_fini (&state->script_iter);
+      width_iter_fini (&state->width_iter);
+      _pango_emoji_iter_fini (&state->emoji_iter);
+    }
 
   if (state->current_fonts)
     g_object_unref (state->current_fonts);
@@ -1582,18 +1737,19 @@ post_process_items (PangoContext *context,
  * separately, after applying attributes that affect segmentation and
  * computing the log attrs.
  */
-GList *
-pango_itemize_with_font (PangoContext               *context,
-                         PangoDirection              base_dir,
-                         const char                 *text,
-                         int                         start_index,
-                         int                         length,
-                         PangoAttrList              *attrs,
-                         PangoAttrIterator          *cached_iter,
-                         const PangoFontDescription *desc)
+static GList *
+itemize_with_font (PangoContext                 *context,
+                   PangoDirection                base_dir,
+                   const char                   *text,
+                   int                           start_index,
+                   int                           length,
+                   PangoAttrList                *attrs,
+                   PangoAttrIterator            *cached_iter,
+                   const PangoFontDescription   *desc,
+                   const PangoAnalyzedParagraph *para,
+                   int                           initial_offset)
 {
   ItemizeState state;
-  int initial_offset;
 
   g_return_val_if_fail (context->font_map != NULL, NULL);
 
@@ -1601,7 +1757,7 @@ pango_itemize_with_font (PangoContext               *context,
     return NULL;
 
   itemize_state_init (&state, context, text, base_dir, start_index, length,
-                      attrs, cached_iter, desc);
+                      attrs, cached_iter, desc, para);
 
   do
     itemize_state_process_run (&state);
@@ -1609,11 +1765,46 @@ pango_itemize_with_font (PangoContext               *context,
 
   itemize_state_finish (&state);
 
-  initial_offset = g_utf8_strlen (text, start_index);
+  if (initial_offset < 0)
+    initial_offset = g_utf8_strlen (text, start_index);
 
   return reorder_items (context, state.result, initial_offset);
 }
 
+GList *
+pango_itemize_with_font (PangoContext               *context,
+                         PangoDirection              base_dir,
+                         const char                 *text,
+                         int                         start_index,
+                         int                         length,
+                         PangoAttrList              *attrs,
+                         PangoAttrIterator          *cached_iter,
+                         const PangoFontDescription *desc)
+{
+  return itemize_with_font (context, base_dir, text, start_index, length,
+                            attrs, cached_iter, desc, NULL, -1);
+}
+
+/* Like pango_itemize_with_font, for a paragraph of a
+ * PangoAnalyzedText. The characters and bidi types that
+ * were collected for the paragraph are used instead of
+ * decoding the text again.
+ */
+GList *
+pango_itemize_paragraph (PangoContext                 *context,
+                         PangoDirection                base_dir,
+                         const char                   *text,
+                         const PangoAnalyzedParagraph *para,
+                         PangoAttrList                *attrs,
+                         PangoAttrIterator            *cached_iter,
+                         const PangoFontDescription   *desc)
+{
+  return itemize_with_font (context, base_dir, text,
+                            para->start_index, para->length,
+                            attrs, cached_iter, desc,
+                            para, para->start_offset);
+}
+
 /* Apply post-processing steps that may require log attrs.
  */
 GList *
@@ -0,0 +1,75 @@
+/* Pango
+ * pango-analyzed-text-private.h: Decoded and classified paragraph text
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PANGO_ANALYZED_TEXT_PRIVATE_H__
+#define __PANGO_ANALYZED_TEXT_PRIVATE_H__
+
+#include <glib.h>
+#include <pango/pango-direction.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PangoAnalyzedParagraph PangoAnalyzedParagraph;
+typedef struct _PangoAnalyzedText PangoAnalyzedText;
+
+struct _PangoAnalyzedParagraph
+{
+  int start_index;     /* byte index of the paragraph in the text */
+  int length;          /* length in bytes, without the delimiter */
+  int delim_len;       /* length of the paragraph delimiter in bytes */
+  int start_offset;    /* character offset of the paragraph in the text */
+  int n_chars;         /* length in characters, without the delimiter */
+  PangoDirection dir;  /* direction of the first strong character, or NEUTRAL */
+
+  /* For recognizing unidirectional text without looking at the
+   * characters again, see pango_log2vis_get_runs()
+   */
+  guint32 ored_types;    /* the bidi types of all characters, or'ed */
+  guint32 anded_strongs; /* the strong bidi types, and'ed */
+
+  const gunichar *chars;       /* the characters of the paragraph */
+  const guint32 *bidi_types;   /* the FriBidiCharType of each character */
+};
+
+struct _PangoAnalyzedText
+{
+  guint single_paragraph : 1;
+
+  int n_chars;
+  gunichar *chars;
+  guint32 *bidi_types;
+
+  /* The first strong direction of the text, or NEUTRAL */
+  PangoDirection dir;
+
+  int n_paragraphs;
+  PangoAnalyzedParagraph *paragraphs;
+};
+
+PangoAnalyzedText *     pango_analyzed_text_new         (const char        *text,
+                                                         int                length,
+                                                         gboolean           single_paragraph);
+
+void                    pango_analyzed_text_free        (PangoAnalyzedText *analysis);
+
+G_END_DECLS
+
+#endif /* __PANGO_ANALYZED_TEXT_PRIVATE_H__ */
@@ -0,0 +1,208 @@
+/* Pango
+ * pango-analyzed-text.c: Decoded and classified paragraph text
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include <fribidi.h>
+
+#include "pango-analyzed-text-private.h"
+
+/* A PangoAnalyzedText holds what the layout code needs to
+ * know about its text before itemizing it: the characters,
+ * their bidi types, the paragraph boundaries and the base
+ * direction of each paragraph, and a summary of the bidi
+ * types that lets unidirectional paragraphs skip the bidi
+ * algorithm. All of this is collected in
+ * a single pass over the UTF-8, and kept by the layout as
+ * long as its text does not change, so relayouts for a new
+ * width or new attributes don't need to decode it again.
+ */
+
+#define PARAGRAPH_SEPARATOR 0x2029
+
+static inline gboolean
+is_paragraph_separator (gunichar ch)
+{
+  return ch == '\n' || ch == '\r' || ch == PARAGRAPH_SEPARATOR;
+}
+
+static inline PangoDirection
+direction_from_bidi_type (FriBidiCharType type)
+{
+  if (!FRIBIDI_IS_STRONG (type))
+    return PANGO_DIRECTION_NEUTRAL;
+  else if (FRIBIDI_IS_RTL (type))
+    return PANGO_DIRECTION_RTL;
+  else
+    return PANGO_DIRECTION_LTR;
+}
+
+/* The paragraphs are split the same way as with
+ * pango_find_paragraph_boundary(): a paragraph ends
+ * after \n, \r, \r\n or a paragraph separator.
+ * If the text ends with a delimiter, it is followed
+ * by an empty paragraph.
+ */
+PangoAnalyzedText *
+pango_analyzed_text_new (const char *text,
+                         int         length,
+                         gboolean    single_paragraph)
+{
+  PangoAnalyzedText *analysis;
+  GArray *paragraphs;
+  PangoAnalyzedParagraph para;
+  const char *p;
+  const char *end;
+  const char *delimiter;
+  int delimiter_offset;
+  gunichar prev_sep;
+  int n, i;
+
+  g_return_val_if_fail (length >= 0, NULL);
+
+  analysis = g_new0 (PangoAnalyzedText, 1);
+  analysis->single_paragraph = single_paragraph;
+  analysis->dir = PANGO_DIRECTION_NEUTRAL;
+
+  /* The number of bytes is an upper bound for the number of
+   * characters, we give the excess back at the end
+   */
+  analysis->chars = g_new (gunichar, length + 1);
+  analysis->bidi_types = g_new (guint32, length + 1);
+
+  paragraphs = g_array_new (FALSE, FALSE, sizeof (PangoAnalyzedParagraph));
+
+  memset (&para, 0, sizeof (para));
+  para.dir = PANGO_DIRECTION_NEUTRAL;
+  para.anded_strongs = FRIBIDI_TYPE_RLE;
+  delimiter = NULL;
+  delimiter_offset = 0;
+  prev_sep = 0;
+
+  end = text + length;
+  for (p = text, n = 0; p < end; p = g_utf8_next_char (p), n++)
+    {
+      gunichar ch = g_utf8_get_char (p);
+      FriBidiCharType type;
+
+      if (!single_paragraph)
+        {
+          /* don't break between \r and \n */
+          if (prev_sep == '\n' ||
+              prev_sep == PARAGRAPH_SEPARATOR ||
+              (prev_sep == '\r' && ch != '\n'))
+            {
+              para.length = delimiter - (text + para.start_index);
+              para.delim_len = p - delimiter;
+              para.n_chars = delimiter_offset - para.start_offset;
+              g_array_append_val (paragraphs, para);
+
+              para.start_index = p - text;
+              para.start_offset = n;
+              para.dir = PANGO_DIRECTION_NEUTRAL;
+              para.ored_types = 0;
+              para.anded_strongs = FRIBIDI_TYPE_RLE;
+              delimiter = NULL;
+            }
+
+          if (is_paragraph_separator (ch))
+            {
+              if (delimiter == NULL)
+                {
+                  delimiter = p;
+                  delimiter_offset = n;
+                }
+              prev_sep = ch;
+            }
+          else
+            prev_sep = 0;
+        }
+
+      type = fribidi_get_bidi_type (ch);
+
+      analysis->chars[n] = ch;
+      analysis->bidi_types[n] = type;
+
+      /* The delimiter is not part of the paragraph */
+      if (delimiter == NULL)
+        {
+          para.ored_types |= type;
+          if (FRIBIDI_IS_STRONG (type))
+            para.anded_strongs &= type;
+
+          if (para.dir == PANGO_DIRECTION_NEUTRAL)
+            {
+              para.dir = direction_from_bidi_type (type);
+              if (analysis->dir == PANGO_DIRECTION_NEUTRAL)
+                analysis->dir = para.dir;
+            }
+        }
+    }
+
+  if (delimiter)
+    {
+      para.length = delimiter - (text + para.start_index);
+      para.delim_len = end - delimiter;
+      para.n_chars = delimiter_offset - para.start_offset;
+      g_array_append_val (paragraphs, para);
+
+      para.start_index = length;
+      para.start_offset = n;
+      para.dir = PANGO_DIRECTION_NEUTRAL;
+      para.ored_types = 0;
+      para.anded_strongs = FRIBIDI_TYPE_RLE;
+    }
+
+  para.length = length - para.start_index;
+  para.delim_len = 0;
+  para.n_chars = n - para.start_offset;
+  g_array_append_val (paragraphs, para);
+
+  analysis->n_chars = n;
+  analysis->chars = g_renew (gunichar, analysis->chars, n + 1);
+  analysis->bidi_types = g_renew (guint32, analysis->bidi_types, n + 1);
+
+  analysis->n_paragraphs = paragraphs->len;
+  analysis->paragraphs = (PangoAnalyzedParagraph *) g_array_free (paragraphs, FALSE);
+
+  for (i = 0; i < analysis->n_paragraphs; i++)
+    {
+      PangoAnalyzedParagraph *para_i = &analysis->paragraphs[i];
+
+      para_i->chars = analysis->chars + para_i->start_offset;
+      para_i->bidi_types = analysis->bidi_types + para_i->start_offset;
+    }
+
+  return analysis;
+}
+
+void
+pango_analyzed_text_free (PangoAnalyzedText *analysis)
+{
+  if (analysis == NULL)
+    return;
+
+  g_free (analysis->chars);
+  g_free (analysis->bidi_types);
+  g_free (analysis->paragraphs);
+  g_free (analysis);
+}
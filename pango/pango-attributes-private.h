@@ -26,6 +26,7 @@ struct _PangoAttrIterator
   guint n_attrs; /* Copied from the list */
 
   GPtrArray *attribute_stack;
+  guint64 stack_types; /* Bit n is set if there is an attribute of type n on the stack */
 
   guint attr_index;
   guint start_index;
@@ -36,15 +37,55 @@ struct _PangoAttrList
 {
   guint ref_count;
   GPtrArray *attributes;
+  guint *max_spans; /* Per attribute type, no attribute in the list is longer than this */
+};
+
+/* A segment table is a flattened form of an attribute list:
+ * the ranges that a PangoAttrIterator would visit, with the
+ * attributes that pango_attr_iterator_get_attrs() would return
+ * for each of them. It is computed once, and can then be
+ * searched for the segment at an index.
+ */
+typedef struct _PangoAttrSegment PangoAttrSegment;
+typedef struct _PangoAttrSegments PangoAttrSegments;
+
+struct _PangoAttrSegment
+{
+  int start_index;
+  int end_index;
+  guint first_attr; /* Index of the first attribute in attrs */
+  guint n_attrs;
+};
+
+struct _PangoAttrSegments
+{
+  guint n_segments;
+  PangoAttrSegment *segments;
+  PangoAttribute **attrs; /* Owned by the list */
 };
 
 void     _pango_attr_list_init         (PangoAttrList     *list);
 void     _pango_attr_list_destroy      (PangoAttrList     *list);
 gboolean _pango_attr_list_has_attributes (const PangoAttrList *list);
+void     _pango_attr_list_insert_all   (PangoAttrList     *list,
+                                        GSList            *attrs);
 
 void     _pango_attr_list_get_iterator (PangoAttrList     *list,
                                         PangoAttrIterator *iterator);
 
+PANGO_AVAILABLE_IN_ALL
+PangoAttrSegments *
+         _pango_attr_list_get_segments (PangoAttrList     *list);
+PANGO_AVAILABLE_IN_ALL
+void     _pango_attr_segments_free     (PangoAttrSegments *segments);
+guint    _pango_attr_segments_find     (const PangoAttrSegments *segments,
+                                        int                      index);
+PANGO_AVAILABLE_IN_ALL
+PangoAttribute * const *
+         _pango_attr_segments_get_attrs (const PangoAttrSegments *segments,
+                                         guint                    segment,
+                                         guint                   *n_attrs);
+
 void     _pango_attr_iterator_destroy  (PangoAttrIterator *iterator);
 gboolean  pango_attr_iterator_advance  (PangoAttrIterator *iterator,
                                         int                index);
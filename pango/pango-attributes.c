@@ -1878,6 +1878,70 @@ _pango_attr_list_init (PangoAttrList *list)
 {
   list->ref_count = 1;
   list->attributes = NULL;
+  list->max_spans = NULL;
+}
+
+/* Custom attribute types share the last slot */
+#define N_TYPE_SLOTS 64
+
+static inline guint
+type_slot (PangoAttrType type)
+{
+  return MIN ((guint) type, N_TYPE_SLOTS - 1);
+}
+
+/* We keep an upper bound for the length of the attributes
+ * of each type in the list, so pango_attr_list_change() only
+ * needs to look at attributes that start close enough to
+ * reach the changed range, instead of all the ones before it.
+ */
+static inline void
+update_max_span (PangoAttrList        *list,
+                 const PangoAttribute *attr)
+{
+  guint slot;
+
+  if (attr->end_index <= attr->start_index)
+    return;
+
+  if (G_UNLIKELY (!list->max_spans))
+    list->max_spans = g_new0 (guint, N_TYPE_SLOTS);
+
+  slot = type_slot (attr->klass->type);
+  list->max_spans[slot] = MAX (list->max_spans[slot], attr->end_index - attr->start_index);
+}
+
+static inline guint
+get_max_span (PangoAttrList *list,
+              PangoAttrType  type)
+{
+  return list->max_spans ? list->max_spans[type_slot (type)] : 0;
+}
+
+/* Returns the index of the first attribute in @list whose
+ * start index is larger than @start_index, or at least
+ * @start_index if @inclusive is %TRUE
+ */
+static guint
+find_start_index (GPtrArray *attributes,
+                  guint      start_index,
+                  gboolean   inclusive)
+{
+  guint lo = 0, hi = attributes->len;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+      PangoAttribute *attr = g_ptr_array_index (attributes, mid);
+
+      if (attr->start_index < start_index ||
+          (!inclusive && attr->start_index == start_index))
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
 }
 
 /**
@@ -1927,6 +1991,8 @@ _pango_attr_list_destroy (PangoAttrList *list)
 {
   guint i, p;
 
+  g_clear_pointer (&list->max_spans, g_free);
+
   if (!list->attributes)
     return;
 
@@ -1989,6 +2055,8 @@ pango_attr_list_copy (PangoAttrList *list)
     return new;
 
   new->attributes = g_ptr_array_copy (list->attributes, (GCopyFunc)pango_attribute_copy, NULL);
+  if (list->max_spans)
+    new->max_spans = g_memdup2 (list->max_spans, N_TYPE_SLOTS * sizeof (guint));
 
   return new;
 }
@@ -2004,6 +2072,8 @@ pango_attr_list_insert_internal (PangoAttrList  *list,
   if (G_UNLIKELY (!list->attributes))
     list->attributes = g_ptr_array_new ();
 
+  update_max_span (list, attr);
+
   if (list->attributes->len == 0)
     {
       g_ptr_array_add (list->attributes, attr);
@@ -2021,19 +2091,10 @@ pango_attr_list_insert_internal (PangoAttrList  *list,
     }
   else
     {
-      guint i, p;
-
-      for (i = 0, p = list->attributes->len; i < p; i++)
-        {
-          PangoAttribute *cur = g_ptr_array_index (list->attributes, i);
+      guint i;
 
-          if (cur->start_index > start_index ||
-              (before && cur->start_index == start_index))
-            {
-              g_ptr_array_insert (list->attributes, i, attr);
-              break;
-            }
-        }
+      i = find_start_index (list->attributes, start_index, before);
+      g_ptr_array_insert (list->attributes, i, attr);
     }
 }
 
@@ -2077,6 +2138,59 @@ pango_attr_list_insert_before (PangoAttrList  *list,
   pango_attr_list_insert_internal (list, attr, TRUE);
 }
 
+static int
+compare_start_index (gconstpointer a,
+                     gconstpointer b)
+{
+  const PangoAttribute *attr_a = *(const PangoAttribute **) a;
+  const PangoAttribute *attr_b = *(const PangoAttribute **) b;
+
+  if (attr_a->start_index < attr_b->start_index)
+    return -1;
+  else if (attr_a->start_index > attr_b->start_index)
+    return 1;
+  else
+    return 0;
+}
+
+/* Inserts all of @attrs, in order, with the same result as
+ * calling pango_attr_list_insert() on each of them. Instead
+ * of finding the position of each attribute, we append them
+ * all and sort the list once; the sort is stable, so the
+ * attributes end up after those with the same start index
+ * that were inserted before them.
+ *
+ * Takes ownership of the attributes, but not of the list.
+ */
+void
+_pango_attr_list_insert_all (PangoAttrList *list,
+                             GSList        *attrs)
+{
+  GSList *l;
+
+  if (attrs == NULL)
+    return;
+
+  if (attrs->next == NULL)
+    {
+      pango_attr_list_insert_internal (list, attrs->data, FALSE);
+      return;
+    }
+
+  if (G_UNLIKELY (!list->attributes))
+    list->attributes = g_ptr_array_new ();
+
+  for (l = attrs; l; l = l->next)
+    {
+      PangoAttribute *attr = l->data;
+
+      update_max_span (list, attr);
+      g_ptr_array_add (list->attributes, attr);
+    }
+
+  g_ptr_array_sort (list->attributes, compare_start_index);
+}
+
 /**
  * pango_attr_list_change:
  * @list: a `PangoAttrList`
@@ -2102,6 +2216,7 @@ pango_attr_list_change (PangoAttrList  *list,
   guint i, p;
   guint start_index = attr->start_index;
   guint end_index = attr->end_index;
+  guint max_span;
   gboolean inserted;
 
   g_return_if_fail (list != NULL);
@@ -2118,13 +2233,21 @@ pango_attr_list_change (PangoAttrList  *list,
       return;
     }
 
+  /* Attributes of this type that start before this can't reach start_index */
+  max_span = get_max_span (list, attr->klass->type);
+  if (start_index > max_span)
+    i = find_start_index (list->attributes, start_index - max_span, TRUE);
+  else
+    i = 0;
+
   inserted = FALSE;
-  for (i = 0, p = list->attributes->len; i < p; i++)
+  for (p = list->attributes->len; i < p; i++)
     {
       PangoAttribute *tmp_attr = g_ptr_array_index (list->attributes, i);
 
       if (tmp_attr->start_index > start_index)
         {
+          update_max_span (list, attr);
           g_ptr_array_insert (list->attributes, i, attr);
           inserted = TRUE;
           break;
@@ -2153,6 +2276,7 @@ pango_attr_list_change (PangoAttrList  *list,
             }
 
           tmp_attr->end_index = end_index;
+          update_max_span (list, tmp_attr);
           pango_attribute_destroy (attr);
 
           attr = tmp_attr;
@@ -2210,6 +2334,7 @@ pango_attr_list_change (PangoAttrList  *list,
         {
           /* We can merge the new attribute with this attribute. */
           attr->end_index = MAX (end_index, tmp_attr->end_index);
+          update_max_span (list, attr);
           pango_attribute_destroy (tmp_attr);
           g_ptr_array_remove_index (list->attributes, i);
           i--;
@@ -2270,57 +2395,69 @@ pango_attr_list_update (PangoAttrList *list,
                         int             remove,
                         int             add)
 {
-  guint i, p;
+  guint i, j, p;
 
   g_return_if_fail (pos >= 0);
   g_return_if_fail (remove >= 0);
   g_return_if_fail (add >= 0);
 
-  if (list->attributes)
-    for (i = 0, p = list->attributes->len; i < p; i++)
-      {
-        PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
+  if (!list->attributes)
+    return;
 
-        if (attr->start_index >= pos &&
-          attr->end_index < pos + remove)
-          {
-            pango_attribute_destroy (attr);
-            g_ptr_array_remove_index (list->attributes, i);
-            i--; /* Look at this index again */
-            p--;
-            continue;
-          }
+  /* The removed attributes are dropped by moving the
+   * remaining ones down, in a single pass over the list.
+   * Start indices are mapped monotonically, so the list
+   * stays sorted.
+   */
+  if (list->max_spans)
+    memset (list->max_spans, 0, N_TYPE_SLOTS * sizeof (guint));
 
-        if (attr->start_index != PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING)
-          {
-            if (attr->start_index >= pos &&
-                attr->start_index < pos + remove)
-              {
-                attr->start_index = pos + add;
-              }
-            else if (attr->start_index >= pos + remove)
-              {
-                attr->start_index += add - remove;
-              }
-          }
+  for (i = 0, j = 0, p = list->attributes->len; i < p; i++)
+    {
+      PangoAttribute *attr = g_ptr_array_index (list->attributes, i);
 
-        if (attr->end_index != PANGO_ATTR_INDEX_TO_TEXT_END)
-          {
-            if (attr->end_index >= pos &&
-                attr->end_index < pos + remove)
-              {
-                attr->end_index = pos;
-              }
-            else if (attr->end_index >= pos + remove)
-              {
-                if (add > remove &&
-                    G_MAXUINT - attr->end_index < add - remove)
-                  attr->end_index = G_MAXUINT;
-                else
-                  attr->end_index += add - remove;
-              }
-          }
-      }
+      if (attr->start_index >= pos &&
+        attr->end_index < pos + remove)
+        {
+          pango_attribute_destroy (attr);
+          continue;
+        }
+
+      if (attr->start_index != PANGO_ATTR_INDEX_FROM_TEXT_BEGINNING)
+        {
+          if (attr->start_index >= pos &&
+              attr->start_index < pos + remove)
+            {
+              attr->start_index = pos + add;
+            }
+          else if (attr->start_index >= pos + remove)
+            {
+              attr->start_index += add - remove;
+            }
+        }
+
+      if (attr->end_index != PANGO_ATTR_INDEX_TO_TEXT_END)
+        {
+          if (attr->end_index >= pos &&
+              attr->end_index < pos + remove)
+            {
+              attr->end_index = pos;
+            }
+          else if (attr->end_index >= pos + remove)
+            {
+              if (add > remove &&
+                  G_MAXUINT - attr->end_index < add - remove)
+                attr->end_index = G_MAXUINT;
+              else
+                attr->end_index += add - remove;
+            }
+        }
+
+      update_max_span (list, attr);
+      g_ptr_array_index (list->attributes, j++) = attr;
+    }
+
+  g_ptr_array_set_size (list->attributes, j);
 }
 
 /**
@@ -2384,7 +2521,10 @@ pango_attr_list_splice (PangoAttrList *list,
         if (attr->start_index <= upos)
           {
             if (attr->end_index > upos)
-              attr->end_index = CLAMP_ADD (attr->end_index, ulen);
+              {
+                attr->end_index = CLAMP_ADD (attr->end_index, ulen);
+                update_max_span (list, attr);
+              }
           }
         else
           {
@@ -2559,23 +2699,19 @@ pango_attr_list_filter (PangoAttrList       *list,
 
 {
   PangoAttrList *new = NULL;
-  guint i, p;
+  guint i, j, p;
 
   g_return_val_if_fail (list != NULL, NULL);
 
   if (!list->attributes || list->attributes->len == 0)
     return NULL;
 
-  for (i = 0, p = list->attributes->len; i < p; i++)
+  for (i = 0, j = 0, p = list->attributes->len; i < p; i++)
     {
       PangoAttribute *tmp_attr = g_ptr_array_index (list->attributes, i);
 
       if ((*func) (tmp_attr, data))
         {
-          g_ptr_array_remove_index (list->attributes, i);
-          i--; /* Need to look at this index again */
-          p--;
-
           if (G_UNLIKELY (!new))
             {
               new = pango_attr_list_new ();
@@ -2583,9 +2719,14 @@ pango_attr_list_filter (PangoAttrList       *list,
             }
 
           g_ptr_array_add (new->attributes, tmp_attr);
+          update_max_span (new, tmp_attr);
         }
+      else
+        g_ptr_array_index (list->attributes, j++) = tmp_attr;
     }
 
+  g_ptr_array_set_size (list->attributes, j);
+
   return new;
 }
 
@@ -3190,7 +3331,7 @@ pango_attr_list_from_string (const char *text)
 
       attr->start_index = (guint)start_index;
       attr->end_index = (guint)end_index;
-      g_ptr_array_add (list->attributes, attr);
+      pango_attr_list_insert_internal (list, attr, FALSE);
 
       p = endp;
       if (*p)
@@ -3219,11 +3360,21 @@ G_DEFINE_BOXED_TYPE (PangoAttrIterator,
                      pango_attr_iterator_copy,
                      pango_attr_iterator_destroy)
 
+/* Custom attribute types don't fit in the bitmask of
+ * types on the stack, they all share the last slot
+ */
+static inline guint64
+type_bit (PangoAttrType type)
+{
+  return G_GUINT64_CONSTANT (1) << type_slot (type);
+}
+
 void
 _pango_attr_list_get_iterator (PangoAttrList     *list,
                                PangoAttrIterator *iterator)
 {
   iterator->attribute_stack = NULL;
+  iterator->stack_types = 0;
   iterator->attrs = list->attributes;
   iterator->n_attrs = iterator->attrs ? iterator->attrs->len : 0;
 
@@ -3308,6 +3459,7 @@ pango_attr_iterator_next (PangoAttrIterator *iterator)
 
   iterator->start_index = iterator->end_index;
   iterator->end_index = G_MAXUINT;
+  iterator->stack_types = 0;
 
   if (iterator->attribute_stack)
     {
@@ -3318,7 +3470,10 @@ pango_attr_iterator_next (PangoAttrIterator *iterator)
           if (attr->end_index == iterator->start_index)
             g_ptr_array_remove_index (iterator->attribute_stack, i); /* Can't use index_fast :( */
           else
-            iterator->end_index = MIN (iterator->end_index, attr->end_index);
+            {
+              iterator->end_index = MIN (iterator->end_index, attr->end_index);
+              iterator->stack_types |= type_bit (attr->klass->type);
+            }
         }
     }
 
@@ -3340,6 +3495,7 @@ pango_attr_iterator_next (PangoAttrIterator *iterator)
             iterator->attribute_stack = g_ptr_array_new ();
 
           g_ptr_array_add (iterator->attribute_stack, attr);
+          iterator->stack_types |= type_bit (attr->klass->type);
 
           iterator->end_index = MIN (iterator->end_index, attr->end_index);
         }
@@ -3435,6 +3591,9 @@ pango_attr_iterator_get (PangoAttrIterator *iterator,
   if (!iterator->attribute_stack)
     return NULL;
 
+  if ((iterator->stack_types & type_bit (type)) == 0)
+    return NULL;
+
   for (i = iterator->attribute_stack->len - 1; i>= 0; i--)
     {
       PangoAttribute *attr = g_ptr_array_index (iterator->attribute_stack, i);
@@ -3700,6 +3859,126 @@ pango_attr_iterator_advance (PangoAttrIterator *iterator,
 
   return TRUE;
 }
+/* }}} */
+/* {{{ Attribute Segments */
+
+/* Returns whether an attribute of the same type as @attr
+ * is in @attrs, between @first and the end
+ */
+static gboolean
+has_attr_of_type (GPtrArray            *attrs,
+                  guint                 first,
+                  const PangoAttribute *attr)
+{
+  guint i;
+
+  for (i = first; i < attrs->len; i++)
+    {
+      const PangoAttribute *other = g_ptr_array_index (attrs, i);
+
+      if (other->klass->type == attr->klass->type)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+PangoAttrSegments *
+_pango_attr_list_get_segments (PangoAttrList *list)
+{
+  PangoAttrSegments *segments;
+  PangoAttrIterator iter;
+  GArray *segment_array;
+  GPtrArray *attrs;
+
+  segment_array = g_array_new (FALSE, FALSE, sizeof (PangoAttrSegment));
+  attrs = g_ptr_array_new ();
+
+  _pango_attr_list_get_iterator (list, &iter);
+  do
+    {
+      PangoAttrSegment segment;
+      int i;
+
+      pango_attr_iterator_range (&iter, &segment.start_index, &segment.end_index);
+      segment.first_attr = attrs->len;
+
+      /* Keep the same attributes as pango_attr_iterator_get_attrs() */
+      if (iter.attribute_stack)
+        for (i = iter.attribute_stack->len - 1; i >= 0; i--)
+          {
+            PangoAttribute *attr = g_ptr_array_index (iter.attribute_stack, i);
+
+            if (attr->klass->type != PANGO_ATTR_FONT_DESC &&
+                attr->klass->type != PANGO_ATTR_BASELINE_SHIFT &&
+                attr->klass->type != PANGO_ATTR_FONT_SCALE &&
+                has_attr_of_type (attrs, segment.first_attr, attr))
+              continue;
+
+            g_ptr_array_add (attrs, attr);
+          }
+
+      segment.n_attrs = attrs->len - segment.first_attr;
+      g_array_append_val (segment_array, segment);
+    }
+  while (pango_attr_iterator_next (&iter));
+
+  _pango_attr_iterator_destroy (&iter);
+
+  segments = g_new (PangoAttrSegments, 1);
+  segments->n_segments = segment_array->len;
+  segments->segments = (PangoAttrSegment *) g_array_free (segment_array, FALSE);
+  segments->attrs = (PangoAttribute **) g_ptr_array_free (attrs, FALSE);
+
+  return segments;
+}
+
+void
+_pango_attr_segments_free (PangoAttrSegments *segments)
+{
+  g_free (segments->segments);
+  g_free (segments->attrs);
+  g_free (segments);
+}
+
+/* Returns the first segment that ends after @index,
+ * or the last segment if there is none
+ */
+guint
+_pango_attr_segments_find (const PangoAttrSegments *segments,
+                           int                      index)
+{
+  guint lo = 0, hi = segments->n_segments - 1;
+
+  while (lo < hi)
+    {
+      guint mid = lo + (hi - lo) / 2;
+
+      if (segments->segments[mid].end_index > index)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+  return lo;
+}
+
+/* Returns the attributes that pango_attr_iterator_get_attrs()
+ * returns for a segment, in reverse order. They are owned by
+ * the list, and are not copied.
+ */
+PangoAttribute * const *
+_pango_attr_segments_get_attrs (const PangoAttrSegments *segments,
+                                guint                    segment,
+                                guint                   *n_attrs)
+{
+  const PangoAttrSegment *seg = &segments->segments[segment];
+
+  *n_attrs = seg->n_attrs;
+
+  return segments->attrs + seg->first_attr;
+}
+
 /* }}} */
 
 /* vim:set foldmethod=marker expandtab: */
@@ -123,83 +123,39 @@ pango_log2vis_get_embedding_levels (const gchar    *text,
   return embedding_levels;
 }
 
-void
-pango_log2vis_fill_embedding_levels (const gchar    *text,
-                                    int             length,
-                                    unsigned int    n_chars,
-                                    guint8         *embedding_levels_list,
-                                    PangoDirection *pbase_dir)
+static FriBidiParType
+get_fribidi_base_dir (PangoDirection base_dir)
 {
-  glong i;
-  const gchar *p;
-  FriBidiParType fribidi_base_dir;
-  FriBidiCharType *bidi_types;
-  FriBidiCharType bidi_types_[64];
-  FriBidiBracketType *bracket_types;
-  FriBidiBracketType bracket_types_[64];
-  FriBidiLevel max_level;
-  FriBidiCharType ored_types = 0;
-  FriBidiCharType anded_strongs = FRIBIDI_TYPE_RLE;
-
-  G_STATIC_ASSERT (sizeof (FriBidiLevel) == sizeof (guint8));
-  G_STATIC_ASSERT (sizeof (FriBidiChar) == sizeof (gunichar));
-
-  switch (*pbase_dir)
+  switch (base_dir)
     {
     case PANGO_DIRECTION_LTR:
     case PANGO_DIRECTION_TTB_RTL:
-      fribidi_base_dir = FRIBIDI_PAR_LTR;
-      break;
+      return FRIBIDI_PAR_LTR;
     case PANGO_DIRECTION_RTL:
     case PANGO_DIRECTION_TTB_LTR:
-      fribidi_base_dir = FRIBIDI_PAR_RTL;
-      break;
+      return FRIBIDI_PAR_RTL;
     case PANGO_DIRECTION_WEAK_RTL:
-      fribidi_base_dir = FRIBIDI_PAR_WRTL;
-      break;
+      return FRIBIDI_PAR_WRTL;
     case PANGO_DIRECTION_WEAK_LTR:
     case PANGO_DIRECTION_NEUTRAL:
     default:
-      fribidi_base_dir = FRIBIDI_PAR_WLTR;
-      break;
-    }
-
-  if (n_chars < 64)
-    {
-      bidi_types = bidi_types_;
-      bracket_types = bracket_types_;
-    }
-  else
-    {
-      bidi_types = g_new (FriBidiCharType, n_chars);
-      bracket_types = g_new (FriBidiBracketType, n_chars);
-    }
-
-  for (i = 0, p = text; p < text + length; p = g_utf8_next_char(p), i++)
-    {
-      gunichar ch = g_utf8_get_char (p);
-      FriBidiCharType char_type = fribidi_get_bidi_type (ch);
-
-      if (i == n_chars)
-        break;
-
-      bidi_types[i] = char_type;
-      ored_types |= char_type;
-      if (FRIBIDI_IS_STRONG (char_type))
-        anded_strongs &= char_type;
-      if (G_UNLIKELY(bidi_types[i] == FRIBIDI_TYPE_ON))
-        bracket_types[i] = fribidi_get_bracket (ch);
-      else
-        bracket_types[i] = FRIBIDI_NO_BRACKET;
+      return FRIBIDI_PAR_WLTR;
     }
+}
 
-    /* Short-circuit (malloc-expensive) FriBidi call for unidirectional
-     * text.
-     *
-     * For details see:
-     * https://bugzilla.gnome.org/show_bug.cgi?id=590183
-     */
-
+/* Short-circuit (malloc-expensive) FriBidi call for unidirectional
+ * text. Returns the level that all characters resolve to, or -1 if
+ * the levels have to be resolved by FriBidi. @ored_types and
+ * @anded_strongs are accumulated over the bidi types by the caller.
+ *
+ * For details see:
+ * https://bugzilla.gnome.org/show_bug.cgi?id=590183
+ */
+static int
+get_uniform_level (FriBidiCharType  ored_types,
+                   FriBidiCharType  anded_strongs,
+                   FriBidiParType  *fribidi_base_dir)
+{
     /* The case that all resolved levels will be ltr.
      * No isolates, all strongs be LTR, there should be no Arabic numbers
      * (or letters for that matter), and one of the following:
@@ -210,15 +166,14 @@ pango_log2vis_fill_embedding_levels (const gchar    *text,
     if (!FRIBIDI_IS_ISOLATE (ored_types) &&
 	!FRIBIDI_IS_RTL (ored_types) &&
 	!FRIBIDI_IS_ARABIC (ored_types) &&
-	(!FRIBIDI_IS_RTL (fribidi_base_dir) ||
-	  (FRIBIDI_IS_WEAK (fribidi_base_dir) &&
+	(!FRIBIDI_IS_RTL (*fribidi_base_dir) ||
+	  (FRIBIDI_IS_WEAK (*fribidi_base_dir) &&
 	   FRIBIDI_IS_LETTER (ored_types))
 	))
       {
         /* all LTR */
-	fribidi_base_dir = FRIBIDI_PAR_LTR;
-	memset (embedding_levels_list, 0, n_chars);
-	goto resolved;
+	*fribidi_base_dir = FRIBIDI_PAR_LTR;
+	return 0;
       }
     /* The case that all resolved levels will be RTL is much more complex.
      * No isolates, no numbers, all strongs are RTL, and one of
@@ -230,36 +185,342 @@ pango_log2vis_fill_embedding_levels (const gchar    *text,
     else if (!FRIBIDI_IS_ISOLATE (ored_types) &&
 	     !FRIBIDI_IS_NUMBER (ored_types) &&
 	     FRIBIDI_IS_RTL (anded_strongs) &&
-	     (FRIBIDI_IS_RTL (fribidi_base_dir) ||
-	       (FRIBIDI_IS_WEAK (fribidi_base_dir) &&
+	     (FRIBIDI_IS_RTL (*fribidi_base_dir) ||
+	       (FRIBIDI_IS_WEAK (*fribidi_base_dir) &&
 		FRIBIDI_IS_LETTER (ored_types))
 	     ))
       {
         /* all RTL */
-	fribidi_base_dir = FRIBIDI_PAR_RTL;
-	memset (embedding_levels_list, 1, n_chars);
-	goto resolved;
+	*fribidi_base_dir = FRIBIDI_PAR_RTL;
+	return 1;
       }
 
+  return -1;
+}
+
+static void
+resolve_embedding_levels (const FriBidiCharType    *bidi_types,
+                          const FriBidiBracketType *bracket_types,
+                          unsigned int              n_chars,
+                          FriBidiParType           *fribidi_base_dir,
+                          guint8                   *embedding_levels_list)
+{
+  FriBidiLevel max_level;
+
+  G_STATIC_ASSERT (sizeof (FriBidiLevel) == sizeof (guint8));
 
   max_level = fribidi_get_par_embedding_levels_ex (bidi_types, bracket_types, n_chars,
-						   &fribidi_base_dir,
+						   fribidi_base_dir,
 						   (FriBidiLevel*)embedding_levels_list);
 
   if (G_UNLIKELY(max_level == 0))
     {
       /* fribidi_get_par_embedding_levels() failed. */
-      memset (embedding_levels_list, 0, length);
+      memset (embedding_levels_list, 0, n_chars);
+    }
+}
+
+static PangoDirection
+get_pango_direction (FriBidiParType fribidi_base_dir)
+{
+  return (fribidi_base_dir == FRIBIDI_PAR_LTR) ?  PANGO_DIRECTION_LTR : PANGO_DIRECTION_RTL;
+}
+
+/* Scratch space for resolving embedding levels. It is kept
+ * per thread and grows to the longest paragraph seen, so
+ * that resolving the levels of a paragraph does not need
+ * to allocate. Exceptionally long paragraphs don't keep
+ * their memory around, see bidi_scratch_release().
+ */
+#define BIDI_SCRATCH_MAX_SIZE 65536
+
+typedef struct
+{
+  unsigned int size;
+  gunichar *chars;
+  FriBidiCharType *bidi_types;
+  FriBidiBracketType *bracket_types;
+  FriBidiLevel *levels;
+
+  unsigned int runs_size;
+  PangoBidiRun *runs;
+} BidiScratch;
+
+static void
+bidi_scratch_clear (BidiScratch *scratch)
+{
+  g_clear_pointer (&scratch->chars, g_free);
+  g_clear_pointer (&scratch->bidi_types, g_free);
+  g_clear_pointer (&scratch->bracket_types, g_free);
+  g_clear_pointer (&scratch->levels, g_free);
+  scratch->size = 0;
+}
+
+static void
+bidi_scratch_free (gpointer data)
+{
+  BidiScratch *scratch = data;
+
+  bidi_scratch_clear (scratch);
+  g_free (scratch->runs);
+  g_free (scratch);
+}
+
+static GPrivate bidi_scratch_key = G_PRIVATE_INIT (bidi_scratch_free);
+
+static BidiScratch *
+bidi_scratch_get (unsigned int n_chars)
+{
+  BidiScratch *scratch;
+
+  scratch = g_private_get (&bidi_scratch_key);
+  if (G_UNLIKELY (scratch == NULL))
+    {
+      scratch = g_new0 (BidiScratch, 1);
+      g_private_set (&bidi_scratch_key, scratch);
+    }
+
+  if (scratch->size < n_chars)
+    {
+      unsigned int size = MAX (n_chars, MAX (2 * scratch->size, 64));
+
+      /* The contents don't need to be preserved */
+      bidi_scratch_clear (scratch);
+      scratch->chars = g_new (gunichar, size);
+      scratch->bidi_types = g_new (FriBidiCharType, size);
+      scratch->bracket_types = g_new (FriBidiBracketType, size);
+      scratch->levels = g_new (FriBidiLevel, size);
+      scratch->size = size;
+    }
+
+  return scratch;
+}
+
+/* The runs are handed out until the next call, so unlike
+ * the other arrays, a huge runs array is only dropped here
+ */
+static PangoBidiRun *
+bidi_scratch_get_runs (BidiScratch  *scratch,
+                       unsigned int  n_runs)
+{
+  if (scratch->runs_size > BIDI_SCRATCH_MAX_SIZE && n_runs <= BIDI_SCRATCH_MAX_SIZE)
+    {
+      g_clear_pointer (&scratch->runs, g_free);
+      scratch->runs_size = 0;
+    }
+
+  if (scratch->runs_size < n_runs)
+    {
+      scratch->runs_size = MAX (n_runs, MAX (2 * scratch->runs_size, 16));
+      g_free (scratch->runs);
+      scratch->runs = g_new (PangoBidiRun, scratch->runs_size);
     }
 
-resolved:
-  if (n_chars >= 64)
+  return scratch->runs;
+}
+
+static void
+bidi_scratch_release (BidiScratch *scratch)
+{
+  if (scratch->size > BIDI_SCRATCH_MAX_SIZE)
+    bidi_scratch_clear (scratch);
+}
+
+void
+pango_log2vis_fill_embedding_levels (const gchar    *text,
+                                    int             length,
+                                    unsigned int    n_chars,
+                                    guint8         *embedding_levels_list,
+                                    PangoDirection *pbase_dir)
+{
+  glong i;
+  const gchar *p;
+  BidiScratch *scratch;
+  FriBidiParType fribidi_base_dir;
+  FriBidiCharType ored_types = 0;
+  FriBidiCharType anded_strongs = FRIBIDI_TYPE_RLE;
+  int level;
+
+  G_STATIC_ASSERT (sizeof (FriBidiChar) == sizeof (gunichar));
+
+  scratch = bidi_scratch_get (n_chars);
+
+  for (i = 0, p = text; p < text + length; p = g_utf8_next_char(p), i++)
     {
-      g_free (bidi_types);
-      g_free (bracket_types);
+      gunichar ch = g_utf8_get_char (p);
+      FriBidiCharType char_type = fribidi_get_bidi_type (ch);
+
+      if (i == n_chars)
+        break;
+
+      scratch->bidi_types[i] = char_type;
+      ored_types |= char_type;
+      if (FRIBIDI_IS_STRONG (char_type))
+        anded_strongs &= char_type;
+      if (G_UNLIKELY(char_type == FRIBIDI_TYPE_ON))
+        scratch->bracket_types[i] = fribidi_get_bracket (ch);
+      else
+        scratch->bracket_types[i] = FRIBIDI_NO_BRACKET;
+    }
+
+  fribidi_base_dir = get_fribidi_base_dir (*pbase_dir);
+
+  level = get_uniform_level (ored_types, anded_strongs, &fribidi_base_dir);
+  if (level >= 0)
+    memset (embedding_levels_list, level, n_chars);
+  else
+    resolve_embedding_levels (scratch->bidi_types, scratch->bracket_types, n_chars,
+                              &fribidi_base_dir, embedding_levels_list);
+
+  *pbase_dir = get_pango_direction (fribidi_base_dir);
+
+  bidi_scratch_release (scratch);
+}
+
+/*< private >
+ * pango_log2vis_get_runs:
+ * @chars: the characters of the paragraph
+ * @bidi_types: the fribidi types of @chars
+ * @n_chars: the number of characters
+ * @ored_types: the bidi types of all characters, or'ed together
+ * @anded_strongs: the strong bidi types, and'ed together,
+ *   starting from `FRIBIDI_TYPE_RLE`
+ * @pbase_dir: (inout): input base direction, and output resolved direction
+ * @n_runs: (out): return location for the number of runs
+ *
+ * Resolves the embedding levels of a paragraph that has been
+ * decoded and classified already, see `PangoAnalyzedText`, and
+ * returns them as runs of characters with the same level.
+ *
+ * Unidirectional text is recognized from @ored_types and
+ * @anded_strongs alone, without looking at the characters.
+ *
+ * Returns: (transfer none): the runs. They are kept in a
+ *   per-thread buffer, and are only valid until the next
+ *   call on the same thread
+ */
+const PangoBidiRun *
+pango_log2vis_get_runs (const gunichar *chars,
+                        const guint32  *bidi_types,
+                        unsigned int    n_chars,
+                        guint32         ored_types,
+                        guint32         anded_strongs,
+                        PangoDirection *pbase_dir,
+                        unsigned int   *n_runs)
+{
+  BidiScratch *scratch;
+  FriBidiParType fribidi_base_dir;
+  PangoBidiRun *runs;
+  unsigned int i, n;
+  int level;
+
+  G_STATIC_ASSERT (sizeof (FriBidiCharType) == sizeof (guint32));
+
+  fribidi_base_dir = get_fribidi_base_dir (*pbase_dir);
+
+  level = get_uniform_level (ored_types, anded_strongs, &fribidi_base_dir);
+  if (level >= 0)
+    {
+      *pbase_dir = get_pango_direction (fribidi_base_dir);
+
+      scratch = bidi_scratch_get (0);
+      runs = bidi_scratch_get_runs (scratch, 1);
+      runs[0].length = n_chars;
+      runs[0].level = level;
+      *n_runs = n_chars > 0 ? 1 : 0;
+
+      bidi_scratch_release (scratch);
+
+      return runs;
+    }
+
+  scratch = bidi_scratch_get (n_chars);
+
+  for (i = 0; i < n_chars; i++)
+    {
+      if (G_UNLIKELY (bidi_types[i] == FRIBIDI_TYPE_ON))
+        scratch->bracket_types[i] = fribidi_get_bracket (chars[i]);
+      else
+        scratch->bracket_types[i] = FRIBIDI_NO_BRACKET;
+    }
+
+  resolve_embedding_levels ((const FriBidiCharType *) bidi_types, scratch->bracket_types, n_chars,
+                            &fribidi_base_dir, scratch->levels);
+
+  *pbase_dir = get_pango_direction (fribidi_base_dir);
+
+  n = 0;
+  for (i = 0; i < n_chars; i++)
+    if (i == 0 || scratch->levels[i] != scratch->levels[i - 1])
+      n++;
+
+  runs = bidi_scratch_get_runs (scratch, n);
+
+  n = 0;
+  for (i = 0; i < n_chars; i++)
+    {
+      if (i == 0 || scratch->levels[i] != scratch->levels[i - 1])
+        {
+          runs[n].length = 0;
+          runs[n].level = scratch->levels[i];
+          n++;
+        }
+      runs[n - 1].length++;
+    }
+
+  *n_runs = n;
+
+  bidi_scratch_release (scratch);
+
+  return runs;
+}
+
+/*< private >
+ * pango_log2vis_get_runs_for_text:
+ * @text: the text of the paragraph
+ * @length: the length of @text in bytes
+ * @n_chars: the number of characters in @text
+ * @pbase_dir: (inout): input base direction, and output resolved direction
+ * @n_runs: (out): return location for the number of runs
+ *
+ * Like pango_log2vis_get_runs(), for text that has not
+ * been classified yet.
+ *
+ * Returns: (transfer none): the runs, see pango_log2vis_get_runs()
+ */
+const PangoBidiRun *
+pango_log2vis_get_runs_for_text (const char     *text,
+                                 int             length,
+                                 unsigned int    n_chars,
+                                 PangoDirection *pbase_dir,
+                                 unsigned int   *n_runs)
+{
+  BidiScratch *scratch;
+  const char *p;
+  unsigned int i;
+  FriBidiCharType ored_types = 0;
+  FriBidiCharType anded_strongs = FRIBIDI_TYPE_RLE;
+
+  scratch = bidi_scratch_get (n_chars);
+
+  for (i = 0, p = text; p < text + length && i < n_chars; p = g_utf8_next_char (p), i++)
+    {
+      gunichar ch = g_utf8_get_char (p);
+      FriBidiCharType char_type = fribidi_get_bidi_type (ch);
+
+      scratch->chars[i] = ch;
+      scratch->bidi_types[i] = char_type;
+      ored_types |= char_type;
+      if (FRIBIDI_IS_STRONG (char_type))
+        anded_strongs &= char_type;
     }
 
-  *pbase_dir = (fribidi_base_dir == FRIBIDI_PAR_LTR) ?  PANGO_DIRECTION_LTR : PANGO_DIRECTION_RTL;
+  /* The scratch buffer is large enough already,
+   * so it is not reallocated under our feet
+   */
+  return pango_log2vis_get_runs (scratch->chars, (const guint32 *) scratch->bidi_types, i,
+                                 ored_types, anded_strongs,
+                                 pbase_dir, n_runs);
 }
 
 /**
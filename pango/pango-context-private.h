@@ -26,6 +26,10 @@
 
 G_BEGIN_DECLS
 
+typedef struct _PangoEllipsisCache PangoEllipsisCache;
+typedef struct _PangoFontsetMemo PangoFontsetMemo;
+typedef struct _PangoMarkupCache PangoMarkupCache;
+
 struct _PangoContext
 {
   GObject parent_instance;
@@ -46,10 +50,25 @@ struct _PangoContext
   PangoFontMap *font_map;
 
   PangoFontMetrics *metrics;
+  PangoEllipsisCache *ellipsis_cache;
+  PangoFontsetMemo *fontset_memo;
+  PangoMarkupCache *markup_cache;
 
   gboolean round_glyph_positions;
 };
 
+void _pango_ellipsis_cache_free (PangoEllipsisCache *cache);
+void _pango_markup_cache_free   (PangoMarkupCache   *cache);
+
+gboolean _pango_context_parse_markup (PangoContext   *context,
+                                      const char     *markup_text,
+                                      int             length,
+                                      gunichar        accel_marker,
+                                      PangoAttrList **attr_list,
+                                      char          **text,
+                                      gunichar       *accel_char,
+                                      GError        **error);
+
 G_END_DECLS
 
 #endif /* __PANGO_CONTEXT_PRIVATE_H__ */
@@ -55,6 +55,7 @@ struct _PangoContextClass
 
 static void pango_context_finalize    (GObject       *object);
 static void context_changed           (PangoContext  *context);
+static void fontset_memo_free         (PangoFontsetMemo *memo);
 
 G_DEFINE_TYPE (PangoContext, pango_context, G_TYPE_OBJECT)
 
@@ -105,6 +106,15 @@ pango_context_finalize (GObject *object)
   if (context->metrics)
     pango_font_metrics_unref (context->metrics);
 
+  if (context->ellipsis_cache)
+    _pango_ellipsis_cache_free (context->ellipsis_cache);
+
+  if (context->fontset_memo)
+    fontset_memo_free (context->fontset_memo);
+
+  if (context->markup_cache)
+    _pango_markup_cache_free (context->markup_cache);
+
   G_OBJECT_CLASS (pango_context_parent_class)->finalize (object);
 }
 
@@ -313,6 +323,111 @@ pango_context_load_font (PangoContext               *context,
   return pango_font_map_load_font (context->font_map, context, desc);
 }
 
+/* Itemization asks for the fontset of every run, and most of
+ * the time it is one of the few it asked for last. We remember
+ * the last few results, so that these lookups don't have to go
+ * to the fontmap, which builds and hashes a full key each time.
+ *
+ * The memo keeps interned descriptions, so lookups with an
+ * interned description, like the ones from the itemizer, are
+ * pointer compares.
+ *
+ * The memo is dropped whenever the context changes, and checked
+ * against the fontmap serial before use. Fontmaps that don't
+ * have a serial don't get a memo. Backends must call
+ * pango_context_changed() when context state that they use
+ * for loading fontsets changes, like the resolution.
+ */
+#define FONTSET_MEMO_SIZE 4
+
+typedef struct
+{
+  PangoFontDescription *desc;
+  PangoLanguage *language;
+  PangoFontset *fontset;
+} FontsetMemoEntry;
+
+struct _PangoFontsetMemo
+{
+  guint fontmap_serial;
+  guint last;
+  FontsetMemoEntry entries[FONTSET_MEMO_SIZE];
+};
+
+static void
+fontset_memo_clear (PangoFontsetMemo *memo)
+{
+  for (guint i = 0; i < FONTSET_MEMO_SIZE; i++)
+    {
+      FontsetMemoEntry *entry = &memo->entries[i];
+
+      g_clear_pointer (&entry->desc, pango_font_description_free);
+      g_clear_object (&entry->fontset);
+      entry->language = NULL;
+    }
+}
+
+static void
+fontset_memo_free (PangoFontsetMemo *memo)
+{
+  fontset_memo_clear (memo);
+  g_free (memo);
+}
+
+static PangoFontset *
+fontset_memo_lookup (PangoFontsetMemo           *memo,
+                     const PangoFontDescription *desc,
+                     PangoLanguage              *language)
+{
+  gboolean interned = pango_font_description_is_interned (desc);
+  guint hash = 0;
+
+  /* Entries cache the hash of their description, so other
+   * descriptions only need to be hashed once per lookup
+   */
+  if (!interned)
+    hash = pango_font_description_hash (desc);
+
+  for (guint i = 0; i < FONTSET_MEMO_SIZE; i++)
+    {
+      guint idx = (memo->last + i) % FONTSET_MEMO_SIZE;
+      FontsetMemoEntry *entry = &memo->entries[idx];
+
+      if (entry->fontset &&
+          entry->language == language &&
+          (entry->desc == desc ||
+           (!interned &&
+            pango_font_description_hash (entry->desc) == hash &&
+            pango_font_description_equal (entry->desc, desc))))
+        {
+          memo->last = idx;
+          return entry->fontset;
+        }
+    }
+
+  return NULL;
+}
+
+static void
+fontset_memo_insert (PangoFontsetMemo           *memo,
+                     const PangoFontDescription *desc,
+                     PangoLanguage              *language,
+                     PangoFontset               *fontset)
+{
+  FontsetMemoEntry *entry;
+
+  /* Replace the entry that was hit longest ago, roughly */
+  memo->last = (memo->last + FONTSET_MEMO_SIZE - 1) % FONTSET_MEMO_SIZE;
+  entry = &memo->entries[memo->last];
+
+  g_clear_pointer (&entry->desc, pango_font_description_free);
+  g_clear_object (&entry->fontset);
+
+  entry->desc = pango_font_description_intern (desc);
+  entry->language = language;
+  entry->fontset = g_object_ref (fontset);
+}
+
 /**
  * pango_context_load_fontset:
  * @context: a `PangoContext`
@@ -330,9 +445,45 @@ pango_context_load_fontset (PangoContext               *context,
                             const PangoFontDescription *desc,
                             PangoLanguage             *language)
 {
+  PangoFontsetMemo *memo;
+  PangoFontset *fontset;
+  guint serial;
+
   g_return_val_if_fail (context != NULL, NULL);
 
-  return pango_font_map_load_fontset (context->font_map, context, desc, language);
+  if (!context->font_map ||
+      !PANGO_FONT_MAP_GET_CLASS (context->font_map)->get_serial)
+    return pango_font_map_load_fontset (context->font_map, context, desc, language);
+
+  serial = pango_font_map_get_serial (context->font_map);
+
+  memo = context->fontset_memo;
+  if (memo && memo->fontmap_serial != serial)
+    {
+      fontset_memo_clear (memo);
+      memo->fontmap_serial = serial;
+    }
+
+  if (memo)
+    {
+      fontset = fontset_memo_lookup (memo, desc, language);
+      if (fontset)
+        return g_object_ref (fontset);
+    }
+
+  fontset = pango_font_map_load_fontset (context->font_map, context, desc, language);
+  if (!fontset)
+    return NULL;
+
+  if (!memo)
+    {
+      memo = context->fontset_memo = g_new0 (PangoFontsetMemo, 1);
+      memo->fontmap_serial = serial;
+    }
+
+  fontset_memo_insert (memo, desc, language, fontset);
+
+  return fontset;
 }
 
 /**
@@ -710,7 +861,7 @@ pango_context_get_metrics (PangoContext               *context,
       context->metrics != NULL)
     return pango_font_metrics_ref (context->metrics);
 
-  current_fonts = pango_font_map_load_fontset (context->font_map, context, desc, language);
+  current_fonts = pango_context_load_fontset (context, desc, language);
   metrics = get_base_metrics (current_fonts);
 
   sample_str = pango_language_get_sample_string (language);
@@ -742,6 +893,8 @@ context_changed (PangoContext *context)
     context->serial++;
 
   g_clear_pointer (&context->metrics, pango_font_metrics_unref);
+  g_clear_pointer (&context->ellipsis_cache, _pango_ellipsis_cache_free);
+  g_clear_pointer (&context->fontset_memo, fontset_memo_free);
 }
 
 /**
@@ -51,6 +51,7 @@ PangoEmojiIter *
 _pango_emoji_iter_init (PangoEmojiIter *iter,
                         const char     *text,
                         int             length,
+                        const gunichar *chars,
                         unsigned int    n_chars);
 
 gboolean
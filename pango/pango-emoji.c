@@ -214,6 +214,7 @@ PangoEmojiIter *
 _pango_emoji_iter_init (PangoEmojiIter *iter,
                         const char     *text,
                         int             length,
+                        const gunichar *chars,
                         unsigned int    n_chars)
 {
   unsigned char *types;
@@ -225,12 +226,20 @@ _pango_emoji_iter_init (PangoEmojiIter *iter,
   else
     types = g_malloc (n_chars);
 
-  p = text;
-  for (i = 0; i < n_chars; i++)
-  {
-    types[i] = _pango_EmojiSegmentationCategory (g_utf8_get_char (p));
-    p = g_utf8_next_char (p);
-  }
+  if (chars)
+    {
+      for (i = 0; i < n_chars; i++)
+        types[i] = _pango_EmojiSegmentationCategory (chars[i]);
+    }
+  else
+    {
+      p = text;
+      for (i = 0; i < n_chars; i++)
+      {
+        types[i] = _pango_EmojiSegmentationCategory (g_utf8_get_char (p));
+        p = g_utf8_next_char (p);
+      }
+    }
 
   iter->text_start = iter->start = iter->end = text;
   if (length >= 0)
@@ -33,6 +33,29 @@ G_BEGIN_DECLS
 PANGO_AVAILABLE_IN_ALL
 PangoFontMetrics *pango_font_metrics_new (void);
 
+PANGO_AVAILABLE_IN_ALL
+gboolean pango_font_description_equal_ignoring (const PangoFontDescription *desc1,
+                                                const PangoFontDescription *desc2,
+                                                PangoFontMask               ignore);
+PANGO_AVAILABLE_IN_ALL
+guint    pango_font_description_hash_ignoring  (const PangoFontDescription *desc,
+                                                PangoFontMask               ignore);
+
+PANGO_AVAILABLE_IN_ALL
+PangoFontDescription *
+         pango_font_description_intern          (const PangoFontDescription *desc);
+PANGO_AVAILABLE_IN_ALL
+PangoFontDescription *
+         pango_font_description_intern_ignoring (const PangoFontDescription *desc,
+                                                 PangoFontMask               ignore);
+PANGO_AVAILABLE_IN_ALL
+const PangoFontDescription *
+         pango_font_description_peek_interned_ignoring
+                                                (const PangoFontDescription *desc,
+                                                 PangoFontMask               ignore);
+PANGO_AVAILABLE_IN_ALL
+gboolean pango_font_description_is_interned    (const PangoFontDescription *desc);
+
 typedef struct {
   PangoLanguage ** (* get_languages) (PangoFont *font);
 
@@ -39,6 +39,15 @@ typedef struct {
                                const char    *filename,
                                GError       **error);
 
+  /* Whether the font map can be used from other threads */
+  gboolean (* is_thread_safe)  (PangoFontMap  *fontmap);
+
+  /* Starts work that loading the fonts of fontset will
+   * need, in the background and without blocking
+   */
+  void     (* prewarm_fontset) (PangoFontMap  *fontmap,
+                                PangoFontset  *fontset);
+
 } PangoFontMapClassPrivate;
 
 PANGO_DEPRECATED_IN_1_38
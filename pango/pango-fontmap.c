@@ -628,6 +628,258 @@ pango_font_map_add_font_file (PangoFontMap  *fontmap,
   return pclass->add_font_file (fontmap, filename, error);
 }
 
+typedef struct
+{
+  PangoFontDescription *desc;
+  PangoLanguage *language;
+  PangoFontset *fontset;
+} PrewarmJob;
+
+typedef struct
+{
+  PangoContext *context;
+  GArray *jobs;
+
+  /* For prewarming in idle steps */
+  guint n_loaded;
+  guint n_warmed;
+} PrewarmData;
+
+static void
+prewarm_data_free (gpointer data)
+{
+  PrewarmData *pd = data;
+  guint i;
+
+  for (i = 0; i < pd->jobs->len; i++)
+    {
+      PrewarmJob *job = &g_array_index (pd->jobs, PrewarmJob, i);
+
+      pango_font_description_free (job->desc);
+      g_clear_object (&job->fontset);
+    }
+
+  g_array_unref (pd->jobs);
+  g_object_unref (pd->context);
+  g_free (pd);
+}
+
+static gboolean
+prewarm_first_font (PangoFontset *fontset G_GNUC_UNUSED,
+                    PangoFont    *font,
+                    gpointer      data)
+{
+  PangoLanguage *language = data;
+  PangoCoverage *coverage;
+
+  /* This loads the HarfBuzz face */
+  pango_font_get_hb_font (font);
+
+  coverage = pango_font_get_coverage (font, language);
+  g_object_unref (coverage);
+
+  /* The fallback fonts are loaded when a layout needs them */
+  return TRUE;
+}
+
+static void
+prewarm_load_fontset (PangoFontMap *fontmap,
+                      PrewarmData  *pd,
+                      PrewarmJob   *job)
+{
+  PangoFontMapClassPrivate *pclass;
+
+  job->fontset = pango_font_map_load_fontset (fontmap, pd->context, job->desc, job->language);
+
+  pclass = g_type_class_get_private ((GTypeClass *) PANGO_FONT_MAP_GET_CLASS (fontmap),
+                                     PANGO_TYPE_FONT_MAP);
+  if (job->fontset && pclass->prewarm_fontset)
+    pclass->prewarm_fontset (fontmap, job->fontset);
+}
+
+static void
+prewarm_in_thread (GTask        *task,
+                   gpointer      source_object,
+                   gpointer      task_data,
+                   GCancellable *cancellable G_GNUC_UNUSED)
+{
+  PangoFontMap *fontmap = source_object;
+  PrewarmData *pd = task_data;
+  guint i;
+
+  for (i = 0; i < pd->jobs->len; i++)
+    {
+      PrewarmJob *job = &g_array_index (pd->jobs, PrewarmJob, i);
+
+      if (g_task_return_error_if_cancelled (task))
+        return;
+
+      prewarm_load_fontset (fontmap, pd, job);
+      if (job->fontset)
+        pango_fontset_foreach (job->fontset, prewarm_first_font, job->language);
+    }
+
+  if (!g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, TRUE);
+}
+
+/* Font maps that can't be used from other threads are prewarmed
+ * in small steps from an idle handler. All fontsets are loaded
+ * first, so the backend can work on them in the background,
+ * then each step loads the first font of one fontset.
+ */
+static gboolean
+prewarm_step (gpointer data)
+{
+  GTask *task = data;
+  PangoFontMap *fontmap = g_task_get_source_object (task);
+  PrewarmData *pd = g_task_get_task_data (task);
+  PrewarmJob *job;
+
+  if (g_task_return_error_if_cancelled (task))
+    return G_SOURCE_REMOVE;
+
+  if (pd->n_loaded < pd->jobs->len)
+    {
+      job = &g_array_index (pd->jobs, PrewarmJob, pd->n_loaded++);
+      prewarm_load_fontset (fontmap, pd, job);
+
+      return G_SOURCE_CONTINUE;
+    }
+
+  if (pd->n_warmed < pd->jobs->len)
+    {
+      job = &g_array_index (pd->jobs, PrewarmJob, pd->n_warmed++);
+      if (job->fontset)
+        pango_fontset_foreach (job->fontset, prewarm_first_font, job->language);
+
+      return G_SOURCE_CONTINUE;
+    }
+
+  g_task_return_boolean (task, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * pango_font_map_prewarm:
+ * @fontmap: a `PangoFontMap`
+ * @descs: (array zero-terminated=1): a `NULL`-terminated array of
+ *   font descriptions
+ * @languages: (array zero-terminated=1) (nullable): a `NULL`-terminated
+ *   array of languages, or `NULL` for the default language
+ * @cancellable: (nullable): a `GCancellable`
+ * @callback: (scope async): callback to call when prewarming is done
+ * @user_data: data to pass to @callback
+ *
+ * Loads the fonts that will be needed for the given font
+ * descriptions and languages ahead of time.
+ *
+ * This loads the fontsets for all combinations of @descs and
+ * @languages, and for the first font of each of them, the font
+ * data and the coverage. Layouts that use these fonts later won't
+ * have to wait for them. Where the backend supports it, looking
+ * up the fallback fonts is started in the background, but they
+ * are only loaded when they are needed.
+ *
+ * If the font map can be used from multiple threads, the work is
+ * done in a separate thread. Otherwise, it is done in small steps
+ * from an idle handler in the thread-default main context, and
+ * slow work like font matching is started in the background where
+ * the backend supports it.
+ *
+ * Since: 1.60
+ */
+void
+pango_font_map_prewarm (PangoFontMap          *fontmap,
+                        PangoFontDescription **descs,
+                        PangoLanguage        **languages,
+                        GCancellable          *cancellable,
+                        GAsyncReadyCallback    callback,
+                        gpointer               user_data)
+{
+  PangoFontMapClassPrivate *pclass;
+  PangoLanguage *default_languages[2] = { NULL, NULL };
+  PrewarmData *pd;
+  GTask *task;
+  int i, j;
+
+  g_return_if_fail (PANGO_IS_FONT_MAP (fontmap));
+  g_return_if_fail (descs != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  if (languages == NULL)
+    {
+      default_languages[0] = pango_language_get_default ();
+      languages = default_languages;
+    }
+
+  pd = g_new0 (PrewarmData, 1);
+  pd->context = pango_font_map_create_context (fontmap);
+  pd->jobs = g_array_new (FALSE, FALSE, sizeof (PrewarmJob));
+
+  for (i = 0; descs[i]; i++)
+    for (j = 0; languages[j]; j++)
+      {
+        PrewarmJob job;
+
+        job.desc = pango_font_description_copy (descs[i]);
+        job.language = languages[j];
+        job.fontset = NULL;
+
+        g_array_append_val (pd->jobs, job);
+      }
+
+  task = g_task_new (fontmap, cancellable, callback, user_data);
+  g_task_set_source_tag (task, pango_font_map_prewarm);
+  g_task_set_priority (task, G_PRIORITY_LOW);
+  g_task_set_task_data (task, pd, prewarm_data_free);
+
+  pclass = g_type_class_get_private ((GTypeClass *) PANGO_FONT_MAP_GET_CLASS (fontmap),
+                                     PANGO_TYPE_FONT_MAP);
+
+  if (pclass->is_thread_safe && pclass->is_thread_safe (fontmap))
+    {
+      g_task_run_in_thread (task, prewarm_in_thread);
+    }
+  else
+    {
+      GSource *source;
+
+      source = g_idle_source_new ();
+      g_source_set_static_name (source, "[pango] prewarm fonts");
+      g_task_attach_source (task, source, prewarm_step);
+      g_source_unref (source);
+    }
+
+  g_object_unref (task);
+}
+
+/**
+ * pango_font_map_prewarm_finish:
+ * @fontmap: a `PangoFontMap`
+ * @result: the `GAsyncResult` passed to the callback
+ * @error: return location for an error
+ *
+ * Finishes an operation started with [method@Pango.FontMap.prewarm].
+ *
+ * Returns: `TRUE` if the fonts were loaded, `FALSE` if the
+ *   operation was cancelled
+ *
+ * Since: 1.60
+ */
+gboolean
+pango_font_map_prewarm_finish (PangoFontMap  *fontmap,
+                               GAsyncResult  *result,
+                               GError       **error)
+{
+  g_return_val_if_fail (PANGO_IS_FONT_MAP (fontmap), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, fontmap), FALSE);
+  g_return_val_if_fail (g_task_get_source_tag (G_TASK (result)) == pango_font_map_prewarm, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
 static GType
 pango_font_map_get_item_type (GListModel *list)
 {
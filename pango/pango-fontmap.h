@@ -25,6 +25,7 @@
 #include <pango/pango-types.h>
 #include <pango/pango-font.h>
 #include <pango/pango-fontset.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -136,6 +137,18 @@ gboolean      pango_font_map_add_font_file (PangoFontMap                 *fontma
                                             const char                   *filename,
                                             GError                      **error);
 
+PANGO_AVAILABLE_IN_1_60
+void          pango_font_map_prewarm        (PangoFontMap                 *fontmap,
+                                             PangoFontDescription        **descs,
+                                             PangoLanguage               **languages,
+                                             GCancellable                 *cancellable,
+                                             GAsyncReadyCallback           callback,
+                                             gpointer                      user_data);
+PANGO_AVAILABLE_IN_1_60
+gboolean      pango_font_map_prewarm_finish (PangoFontMap                 *fontmap,
+                                             GAsyncResult                 *result,
+                                             GError                      **error);
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(PangoFontMap, g_object_unref)
 
 G_END_DECLS
@@ -0,0 +1,36 @@
+/* Pango
+ * pango-glyph-item-private.h: Pair of PangoItem and a glyph string, private definitions
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PANGO_GLYPH_ITEM_PRIVATE_H__
+#define __PANGO_GLYPH_ITEM_PRIVATE_H__
+
+#include <pango/pango-glyph-item.h>
+#include "pango-attributes-private.h"
+
+G_BEGIN_DECLS
+
+GSList *        pango_glyph_item_apply_attr_segments (PangoGlyphItem          *glyph_item,
+                                                      const char              *text,
+                                                      const PangoAttrSegments *segments);
+
+G_END_DECLS
+
+#endif /* __PANGO_GLYPH_ITEM_PRIVATE_H__ */
@@ -25,6 +25,7 @@
 #include "pango-glyph-item.h"
 #include "pango-impl-utils.h"
 #include "pango-attributes-private.h"
+#include "pango-glyph-item-private.h"
 
 #define LTR(glyph_item) (((glyph_item)->item->analysis.level % 2) == 0)
 
@@ -500,11 +501,55 @@ pango_glyph_item_iter_init_end (PangoGlyphItemIter  *iter,
   return pango_glyph_item_iter_prev_cluster (iter);
 }
 
+/* The attribute ranges for apply_attrs() come either from
+ * an attribute iterator, or from a segment table
+ */
+typedef struct
+{
+  PangoAttrIterator *iter;
+  const PangoAttrSegments *segments;
+  guint segment;
+} AttrCursor;
+
+static void
+attr_cursor_range (AttrCursor *cursor,
+                   int        *range_start,
+                   int        *range_end)
+{
+  if (cursor->iter)
+    pango_attr_iterator_range (cursor->iter, range_start, range_end);
+  else
+    {
+      *range_start = cursor->segments->segments[cursor->segment].start_index;
+      *range_end = cursor->segments->segments[cursor->segment].end_index;
+    }
+}
+
+static gboolean
+attr_cursor_next (AttrCursor *cursor)
+{
+  if (cursor->iter)
+    return pango_attr_iterator_next (cursor->iter);
+
+  if (cursor->segment + 1 >= cursor->segments->n_segments)
+    return FALSE;
+
+  cursor->segment++;
+  return TRUE;
+}
+
 typedef struct
 {
   PangoGlyphItemIter iter;
+  AttrCursor *cursor;
 
+  /* The attributes for the next output item: copies from
+   * the attribute iterator, or the span of segments they
+   * come from in the segment table
+   */
   GSList *segment_attrs;
+  guint first_segment;
+  guint last_segment;
 } ApplyAttrsState;
 
 /* Tack @attrs onto the attributes of glyph_item
@@ -533,16 +578,88 @@ attr_slist_copy (GSList *attrs)
   return new_attrs;
 }
 
+/* Make a deep copy of the attributes of the segments from
+ * @first to @last, in the order that concatenating
+ * pango_attr_iterator_get_attrs() for each of them gives
+ */
+static GSList *
+attr_segments_copy_attrs (const PangoAttrSegments *segments,
+                          guint                    first,
+                          guint                    last)
+{
+  GSList *attrs = NULL;
+  guint segment;
+
+  for (segment = last + 1; segment-- > first; )
+    {
+      PangoAttribute * const *segment_attrs;
+      guint n_attrs, i;
+
+      segment_attrs = _pango_attr_segments_get_attrs (segments, segment, &n_attrs);
+      for (i = 0; i < n_attrs; i++)
+        attrs = g_slist_prepend (attrs, pango_attribute_copy (segment_attrs[i]));
+    }
+
+  return attrs;
+}
+
+/* Start collecting the attributes for the next output item
+ * with those of the current range of the cursor
+ */
+static void
+state_start_attrs (ApplyAttrsState *state)
+{
+  if (state->cursor->iter)
+    state->segment_attrs = pango_attr_iterator_get_attrs (state->cursor->iter);
+  else
+    state->first_segment = state->last_segment = state->cursor->segment;
+}
+
+/* Add the attributes of the current range of the cursor
+ */
+static void
+state_add_attrs (ApplyAttrsState *state)
+{
+  if (state->cursor->iter)
+    state->segment_attrs = g_slist_concat (state->segment_attrs,
+                                           pango_attr_iterator_get_attrs (state->cursor->iter));
+  else
+    state->last_segment = state->cursor->segment;
+}
+
+/* Return the attributes collected for the next output item.
+ * With a segment table, they are only copied here, once per
+ * item. If @keep is TRUE, they stay collected for the item
+ * after it as well.
+ */
+static GSList *
+state_take_attrs (ApplyAttrsState *state,
+                  gboolean         keep)
+{
+  GSList *attrs;
+
+  if (!state->cursor->iter)
+    return attr_segments_copy_attrs (state->cursor->segments,
+                                     state->first_segment,
+                                     state->last_segment);
+
+  attrs = state->segment_attrs;
+  state->segment_attrs = keep ? attr_slist_copy (attrs) : NULL;
+
+  return attrs;
+}
+
 /* Split the glyph item at the start of the current cluster
  */
 static PangoGlyphItem *
-split_before_cluster_start (ApplyAttrsState *state)
+split_before_cluster_start (ApplyAttrsState *state,
+                            gboolean         keep_attrs)
 {
   PangoGlyphItem *split_item;
   int split_len = state->iter.start_index - state->iter.glyph_item->item->offset;
 
   split_item = pango_glyph_item_split (state->iter.glyph_item, state->iter.text, split_len);
-  append_attrs (split_item, state->segment_attrs);
+  append_attrs (split_item, state_take_attrs (state, keep_attrs));
 
   /* Adjust iteration to account for the split
    */
@@ -558,43 +675,14 @@ split_before_cluster_start (ApplyAttrsState *state)
   return split_item;
 }
 
-/**
- * pango_glyph_item_apply_attrs:
- * @glyph_item: (transfer full): a shaped item
- * @text: text that @list applies to
- * @list: a `PangoAttrList`
- *
- * Splits a shaped item (`PangoGlyphItem`) into multiple items based
- * on an attribute list.
- *
- * The idea is that if you have attributes that don't affect shaping,
- * such as color or underline, to avoid affecting shaping, you filter
- * them out ([method@Pango.AttrList.filter]), apply the shaping process
- * and then reapply them to the result using this function.
- *
- * All attributes that start or end inside a cluster are applied
- * to that cluster; for instance, if half of a cluster is underlined
- * and the other-half strikethrough, then the cluster will end
- * up with both underline and strikethrough attributes. In these
- * cases, it may happen that @item->extra_attrs for some of the
- * result items can have multiple attributes of the same type.
- *
- * This function takes ownership of @glyph_item; it will be reused
- * as one of the elements in the list.
- *
- * Returns: (transfer full) (element-type Pango.GlyphItem): a
- *   list of glyph items resulting from splitting @glyph_item. Free
- *   the elements using [method@Pango.GlyphItem.free], the list using
- *   g_slist_free().
- *
- * Since: 1.2
+/* @cursor must be at the first range that ends
+ * after the start of the item
  */
-GSList *
-pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
-			      const char       *text,
-			      PangoAttrList    *list)
+static GSList *
+apply_attrs (PangoGlyphItem *glyph_item,
+             const char     *text,
+             AttrCursor     *cursor)
 {
-  PangoAttrIterator iter;
   GSList *result = NULL;
   ApplyAttrsState state;
   gboolean start_new_segment = FALSE;
@@ -615,18 +703,11 @@ pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
    *    split between this cluster and the next one.
    */
 
-  /* Advance the attr iterator to the start of the item
-   */
-  _pango_attr_list_get_iterator (list, &iter);
-  do
-    {
-      pango_attr_iterator_range (&iter, &range_start, &range_end);
-      if (range_end > glyph_item->item->offset)
-	break;
-    }
-  while (pango_attr_iterator_next (&iter));
+  attr_cursor_range (cursor, &range_start, &range_end);
 
-  state.segment_attrs = pango_attr_iterator_get_attrs (&iter);
+  state.cursor = cursor;
+  state.segment_attrs = NULL;
+  state_start_attrs (&state);
 
   is_ellipsis = (glyph_item->item->analysis.flags & PANGO_ANALYSIS_FLAG_IS_ELLIPSIS) != 0;
 
@@ -654,8 +735,8 @@ pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
       if (start_new_segment)
 	{
 	  result = g_slist_prepend (result,
-				    split_before_cluster_start (&state));
-	  state.segment_attrs = pango_attr_iterator_get_attrs (&iter);
+				    split_before_cluster_start (&state, FALSE));
+	  state_start_attrs (&state);
 	}
 
       start_new_segment = FALSE;
@@ -674,8 +755,8 @@ pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
 	   */
 	  start_new_segment = TRUE;
 
-	  have_next = pango_attr_iterator_next (&iter);
-	  pango_attr_iterator_range (&iter, &range_start, &range_end);
+	  have_next = attr_cursor_next (cursor);
+	  attr_cursor_range (cursor, &range_start, &range_end);
 
 	  if (range_start >= state.iter.end_index) /* New range doesn't intersect this cluster */
 	    {
@@ -691,15 +772,10 @@ pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
 	   */
 	  if (range_start > state.iter.start_index &&
 	      state.iter.start_index != glyph_item->item->offset)
-	    {
-	      GSList *new_attrs = attr_slist_copy (state.segment_attrs);
-	      result = g_slist_prepend (result,
-					split_before_cluster_start (&state));
-	      state.segment_attrs = new_attrs;
-	    }
+	    result = g_slist_prepend (result,
+				      split_before_cluster_start (&state, TRUE));
 
-	  state.segment_attrs = g_slist_concat (state.segment_attrs,
-						pango_attr_iterator_get_attrs (&iter));
+	  state_add_attrs (&state);
 	}
       while (have_next);
     }
@@ -707,12 +783,93 @@ pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
  out:
   /* What's left in glyph_item is the remaining portion
    */
-  append_attrs (glyph_item, state.segment_attrs);
+  append_attrs (glyph_item, state_take_attrs (&state, FALSE));
   result = g_slist_prepend (result, glyph_item);
 
   if (LTR (glyph_item))
     result = g_slist_reverse (result);
 
+  return result;
+}
+
+/* Like pango_glyph_item_apply_attrs(), with the attributes
+ * in a segment table. This lets callers that apply the same
+ * attributes to many glyph items, like PangoLayout, find the
+ * segments for each item with a binary search, instead of
+ * iterating the attribute list from the start every time.
+ */
+GSList *
+pango_glyph_item_apply_attr_segments (PangoGlyphItem          *glyph_item,
+                                      const char              *text,
+                                      const PangoAttrSegments *segments)
+{
+  AttrCursor cursor;
+
+  cursor.iter = NULL;
+  cursor.segments = segments;
+  cursor.segment = _pango_attr_segments_find (segments, glyph_item->item->offset);
+
+  return apply_attrs (glyph_item, text, &cursor);
+}
+
+/**
+ * pango_glyph_item_apply_attrs:
+ * @glyph_item: (transfer full): a shaped item
+ * @text: text that @list applies to
+ * @list: a `PangoAttrList`
+ *
+ * Splits a shaped item (`PangoGlyphItem`) into multiple items based
+ * on an attribute list.
+ *
+ * The idea is that if you have attributes that don't affect shaping,
+ * such as color or underline, to avoid affecting shaping, you filter
+ * them out ([method@Pango.AttrList.filter]), apply the shaping process
+ * and then reapply them to the result using this function.
+ *
+ * All attributes that start or end inside a cluster are applied
+ * to that cluster; for instance, if half of a cluster is underlined
+ * and the other-half strikethrough, then the cluster will end
+ * up with both underline and strikethrough attributes. In these
+ * cases, it may happen that @item->extra_attrs for some of the
+ * result items can have multiple attributes of the same type.
+ *
+ * This function takes ownership of @glyph_item; it will be reused
+ * as one of the elements in the list.
+ *
+ * Returns: (transfer full) (element-type Pango.GlyphItem): a
+ *   list of glyph items resulting from splitting @glyph_item. Free
+ *   the elements using [method@Pango.GlyphItem.free], the list using
+ *   g_slist_free().
+ *
+ * Since: 1.2
+ */
+GSList *
+pango_glyph_item_apply_attrs (PangoGlyphItem   *glyph_item,
+			      const char       *text,
+			      PangoAttrList    *list)
+{
+  PangoAttrIterator iter;
+  AttrCursor cursor;
+  GSList *result;
+  int range_start, range_end;
+
+  /* Advance the attr iterator to the start of the item
+   */
+  _pango_attr_list_get_iterator (list, &iter);
+  do
+    {
+      pango_attr_iterator_range (&iter, &range_start, &range_end);
+      if (range_end > glyph_item->item->offset)
+	break;
+    }
+  while (pango_attr_iterator_next (&iter));
+
+  cursor.iter = &iter;
+  cursor.segments = NULL;
+  cursor.segment = 0;
+
+  result = apply_attrs (glyph_item, text, &cursor);
+
   _pango_attr_iterator_destroy (&iter);
 
   return result;
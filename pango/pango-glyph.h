@@ -88,11 +88,14 @@ struct _PangoGlyphGeometry
  * PangoGlyphVisAttr:
  * @is_cluster_start: set for the first logical glyph in each cluster.
  * @is_color: set if the the font will render this glyph with color. Since 1.50
+ * @is_unsafe_to_break: set if breaking the text at the start of the cluster
+ *   that this glyph belongs to changes the shaping, so the text on both sides
+ *   has to be shaped again. Since 1.60
  *
  * A `PangoGlyphVisAttr` structure communicates information between
  * the shaping and rendering phases.
  *
- * Currently, it contains cluster start and color information.
+ * Currently, it contains cluster start, color and line breaking information.
  * More attributes may be added in the future.
  *
  * Clusters are stored in visual order, within the cluster, glyphs
@@ -102,8 +105,9 @@ struct _PangoGlyphGeometry
  */
 struct _PangoGlyphVisAttr
 {
-  guint is_cluster_start : 1;
-  guint is_color         : 1;
+  guint is_cluster_start   : 1;
+  guint is_color           : 1;
+  guint is_unsafe_to_break : 1;
 };
 
 /* A single glyph
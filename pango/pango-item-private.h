@@ -23,6 +23,7 @@
 
 #include <pango/pango-item.h>
 #include <pango/pango-break.h>
+#include "pango-analyzed-text-private.h"
 
 G_BEGIN_DECLS
 
@@ -105,6 +106,14 @@ GList *            pango_itemize_with_font            (PangoContext
                                                        PangoAttrIterator          *cached_iter,
                                                        const PangoFontDescription *desc);
 
+GList *            pango_itemize_paragraph            (PangoContext                 *context,
+                                                       PangoDirection                base_dir,
+                                                       const char                   *text,
+                                                       const PangoAnalyzedParagraph *para,
+                                                       PangoAttrList                *attrs,
+                                                       PangoAttrIterator            *cached_iter,
+                                                       const PangoFontDescription   *desc);
+
 GList *            pango_itemize_post_process_items   (PangoContext               *context,
                                                        const char                 *text,
                                                        PangoLogAttr               *log_attrs,
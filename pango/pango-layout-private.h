@@ -23,6 +23,7 @@
 #define __PANGO_LAYOUT_PRIVATE_H__
 
 #include <pango/pango-layout.h>
+#include "pango-analyzed-text-private.h"
 
 G_BEGIN_DECLS
 
@@ -81,8 +82,10 @@ struct _PangoLayout
   /* Not copied during _copy() */
 
   PangoLogAttr *log_attrs;	/* Logical attributes for layout's text */
+  PangoAnalyzedText *analysis;	/* Characters and paragraphs of layout's text */
   GSList *lines;
   guint line_count;		/* Number of lines in @lines. 0 if lines is %NULL */
+  guint reshapes_avoided;	/* Runs whose glyphs were sliced out of their item's glyphs while breaking lines */
 };
 
 typedef struct _Extents Extents;
@@ -107,6 +110,7 @@ struct _PangoLayoutIter
    */
   GSList *run_list_link;
   PangoLayoutRun *run; /* FIXME nuke this, just keep the link */
+  int run_index; /* position of the run in the line */
   int index;
 
   /* list of Extents for each line in layout coordinates */
@@ -155,6 +159,14 @@ void     _pango_layout_get_iter (PangoLayout     *layout,
 
 void     _pango_layout_iter_destroy (PangoLayoutIter *iter);
 
+PangoLayoutLine * _pango_layout_line_new (PangoLayout     *layout);
+
+void     _pango_layout_set_output (PangoLayout     *layout,
+                                   GSList          *lines,
+                                   PangoLogAttr    *log_attrs,
+                                   gboolean         is_wrapped,
+                                   gboolean         is_ellipsized);
+
 G_END_DECLS
 
 #endif /* __PANGO_LAYOUT_PRIVATE_H__ */
@@ -79,7 +79,7 @@
 #include "pango-item-private.h"
 #include "pango-engine.h"
 #include "pango-impl-utils.h"
-#include "pango-glyph-item.h"
+#include "pango-glyph-item-private.h"
 #include <string.h>
 #include <math.h>
 #include <locale.h>
@@ -88,6 +88,7 @@
 
 #include "pango-layout-private.h"
 #include "pango-attributes-private.h"
+#include "pango-context-private.h"
 #include "pango-font-private.h"
 
 
@@ -121,6 +122,30 @@ struct _ItemProperties
 };
 
 typedef struct _PangoLayoutLinePrivate PangoLayoutLinePrivate;
+typedef struct _RunPosition RunPosition;
+typedef struct _RunCache RunCache;
+
+/* The position of a run in its line, in visual order */
+struct _RunPosition
+{
+  PangoLayoutRun *run;
+  int x;      /* sum of the logical widths of the runs before it */
+  int width;  /* logical width of the glyphs of the run */
+};
+
+/* The runs of a line with their positions, for the queries
+ * that map between x positions and indexes. They are found
+ * by binary searches over the visual order for x positions,
+ * and over the logical order for indexes.
+ */
+struct _RunCache
+{
+  int n_runs;
+  int start_offset;        /* character offset of the start of the line */
+  gboolean sorted_by_x;    /* no run has negative width */
+  RunPosition *runs;       /* in visual order */
+  RunPosition **by_index;  /* in logical order */
+};
 
 struct _PangoLayoutLinePrivate
 {
@@ -141,6 +166,9 @@ struct _PangoLayoutLinePrivate
   PangoRectangle ink_rect;
   PangoRectangle logical_rect;
   int height;
+
+  /* Like the extents, this is only kept while the line is not leaked */
+  RunCache *run_cache;
 };
 
 struct _PangoLayoutClass
@@ -187,6 +215,18 @@ static void              pango_layout_line_postprocess (PangoLayoutLine *line,
 
 static void pango_layout_line_leaked (PangoLayoutLine *line);
 
+static RunCache *    pango_layout_line_get_run_cache (PangoLayoutLine *line);
+static void         run_cache_free                  (RunCache        *cache);
+static gboolean     line_find_run_by_index          (PangoLayoutLine *line,
+                                                     int              index,
+                                                     RunPosition     *pos);
+static gboolean     line_find_run_by_x              (PangoLayoutLine *line,
+                                                     int              x,
+                                                     RunPosition     *pos);
+static int          run_get_char_offset             (PangoLayout     *layout,
+                                                     PangoLayoutRun  *run,
+                                                     int              index);
+
 /* doesn't leak line */
 static PangoLayoutLine * _pango_layout_iter_get_line (PangoLayoutIter *iter);
 static PangoLayoutRun *  _pango_layout_iter_get_run  (PangoLayoutIter *iter);
@@ -225,6 +265,7 @@ pango_layout_init (PangoLayout *layout)
   layout->single_paragraph = FALSE;
 
   layout->log_attrs = NULL;
+  layout->analysis = NULL;
   layout->lines = NULL;
   layout->line_count = 0;
 
@@ -255,6 +296,7 @@ pango_layout_finalize (GObject *object)
 
   pango_layout_clear_lines (layout);
   g_free (layout->log_attrs);
+  pango_analyzed_text_free (layout->analysis);
 
   if (layout->context)
     g_object_unref (layout->context);
@@ -1283,6 +1325,7 @@ pango_layout_set_text (PangoLayout *layout,
   layout->length = strlen (layout->text);
 
   g_clear_pointer (&layout->log_attrs, g_free);
+  g_clear_pointer (&layout->analysis, pango_analyzed_text_free);
   layout_changed (layout);
 
   g_free (old_text);
@@ -1388,27 +1431,34 @@ pango_layout_set_markup_with_accel (PangoLayout *layout,
 {
   PangoAttrList *list = NULL;
   char *text = NULL;
+  gunichar layout_accel_char = 0;
   GError *error;
 
   g_return_if_fail (PANGO_IS_LAYOUT (layout));
   g_return_if_fail (markup != NULL);
 
   error = NULL;
-  if (!pango_parse_markup (markup, length,
-                           accel_marker,
-                           &list, &text,
-                           accel_char,
-                           &error))
+  if (!_pango_context_parse_markup (layout->context,
+                                    markup, length,
+                                    accel_marker,
+                                    &list, &text,
+                                    &layout_accel_char,
+                                    &error))
     {
       g_warning ("pango_layout_set_markup_with_accel: %s", error->message);
       g_error_free (error);
       return;
     }
 
-  pango_layout_set_text (layout, text, -1);
+  /* Keep the lines if the markup is set again */
+  if (g_strcmp0 (layout->text, text) != 0)
+    pango_layout_set_text (layout, text, -1);
   pango_layout_set_attributes (layout, list);
   pango_attr_list_unref (list);
   g_free (text);
+
+  if (accel_char)
+    *accel_char = layout_accel_char;
 }
 
 /**
@@ -1786,63 +1836,53 @@ pango_layout_line_index_to_x (PangoLayoutLine *line,
                               int             *x_pos)
 {
   PangoLayout *layout = line->layout;
-  GSList *run_list = line->runs;
-  int width = 0;
+  RunPosition pos;
 
-  while (run_list)
+  if (line_find_run_by_index (line, index, &pos))
     {
-      PangoLayoutRun *run = run_list->data;
+      PangoLayoutRun *run = pos.run;
+      int offset;
+      int attr_offset;
 
-      if (run->item->offset <= index && run->item->offset + run->item->length > index)
-        {
-          int offset = g_utf8_pointer_to_offset (layout->text, layout->text + index);
-          int attr_offset;
+      /* Note: we simply assert here, since our items are all internally
+       * created. If that ever changes, we need to add a fallback here.
+       */
+      g_assert (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET);
+      attr_offset = ((PangoItemPrivate *)run->item)->char_offset;
 
-          if (trailing)
+      offset = run_get_char_offset (layout, run, index);
+
+      if (trailing)
+        {
+          while (index < line->start_index + line->length &&
+                 offset + 1 < layout->n_chars &&
+                 !layout->log_attrs[offset + 1].is_cursor_position)
             {
-              while (index < line->start_index + line->length &&
-                     offset + 1 < layout->n_chars &&
-                     !layout->log_attrs[offset + 1].is_cursor_position)
-                {
-                  offset++;
-                  index = g_utf8_next_char (layout->text + index) - layout->text;
-                }
+              offset++;
+              index = g_utf8_next_char (layout->text + index) - layout->text;
             }
-          else
+        }
+      else
+        {
+          while (index > line->start_index &&
+                 !layout->log_attrs[offset].is_cursor_position)
             {
-              while (index > line->start_index &&
-                     !layout->log_attrs[offset].is_cursor_position)
-                {
-                  offset--;
-                  index = g_utf8_prev_char (layout->text + index) - layout->text;
-                }
+              offset--;
+              index = g_utf8_prev_char (layout->text + index) - layout->text;
             }
-
-          /* Note: we simply assert here, since our items are all internally
-           * created. If that ever changes, we need to add a fallback here.
-           */
-          g_assert (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET);
-          attr_offset = ((PangoItemPrivate *)run->item)->char_offset;
-
-          pango_glyph_string_index_to_x_full (run->glyphs,
-                                              layout->text + run->item->offset,
-                                              run->item->length,
-                                              &run->item->analysis,
-                                              layout->log_attrs + attr_offset,
-                                              index - run->item->offset, trailing, x_pos);
-          if (x_pos)
-            *x_pos += width;
-
-          return;
         }
 
-      width += pango_glyph_string_get_width (run->glyphs);
-
-      run_list = run_list->next;
+      pango_glyph_string_index_to_x_full (run->glyphs,
+                                          layout->text + run->item->offset,
+                                          run->item->length,
+                                          &run->item->analysis,
+                                          layout->log_attrs + attr_offset,
+                                          index - run->item->offset, trailing, x_pos);
+      if (x_pos)
+        *x_pos += pos.x;
     }
-
-  if (x_pos)
-    *x_pos = width;
+  else if (x_pos)
+    *x_pos = pos.x;
 }
 
 static PangoLayoutLine *
@@ -3257,6 +3297,7 @@ pango_layout_line_leaked (PangoLayoutLine *line)
   PangoLayoutLinePrivate *private = (PangoLayoutLinePrivate *)line;
 
   private->cache_status = LEAKED;
+  g_clear_pointer (&private->run_cache, run_cache_free);
 
   if (line->layout)
     {
@@ -3265,6 +3306,272 @@ pango_layout_line_leaked (PangoLayoutLine *line)
     }
 }
 
+/* Returns the character offset of @index in the text,
+ * counting from the start of @run rather than the start
+ * of the text where possible
+ */
+static int
+run_get_char_offset (PangoLayout    *layout,
+                     PangoLayoutRun *run,
+                     int             index)
+{
+  PangoItem *item = run->item;
+
+  /* The ellipsis covers the elided text, but its
+   * character offset is that of the ellipsis text
+   */
+  if (!(item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET) ||
+      (item->analysis.flags & PANGO_ANALYSIS_FLAG_IS_ELLIPSIS))
+    return g_utf8_pointer_to_offset (layout->text, layout->text + index);
+
+  return ((PangoItemPrivate *)item)->char_offset +
+         g_utf8_pointer_to_offset (layout->text + item->offset, layout->text + index);
+}
+
+static int
+compare_run_position_index (const void *a,
+                            const void *b)
+{
+  const PangoItem *item_a = (*(const RunPosition **) a)->run->item;
+  const PangoItem *item_b = (*(const RunPosition **) b)->run->item;
+
+  return item_a->offset < item_b->offset ? -1 : item_a->offset > item_b->offset;
+}
+
+static RunCache *
+run_cache_new (PangoLayoutLine *line)
+{
+  PangoLayout *layout = line->layout;
+  RunCache *cache;
+  GSList *l;
+  int i;
+  int x;
+
+  cache = g_new (RunCache, 1);
+  cache->n_runs = g_slist_length (line->runs);
+  cache->runs = g_new (RunPosition, cache->n_runs);
+  cache->by_index = g_new (RunPosition *, cache->n_runs);
+  cache->sorted_by_x = TRUE;
+
+  for (l = line->runs, i = 0, x = 0; l; l = l->next, i++)
+    {
+      RunPosition *pos = &cache->runs[i];
+
+      pos->run = l->data;
+      pos->x = x;
+      pos->width = pango_glyph_string_get_width (pos->run->glyphs);
+      if (pos->width < 0)
+        cache->sorted_by_x = FALSE;
+
+      x += pos->width;
+
+      cache->by_index[i] = pos;
+    }
+
+  qsort (cache->by_index, cache->n_runs, sizeof (RunPosition *), compare_run_position_index);
+
+  if (cache->n_runs > 0)
+    cache->start_offset = run_get_char_offset (layout, cache->by_index[0]->run, line->start_index);
+  else
+    cache->start_offset = g_utf8_pointer_to_offset (layout->text, layout->text + line->start_index);
+
+  return cache;
+}
+
+static void
+run_cache_free (RunCache *cache)
+{
+  g_free (cache->runs);
+  g_free (cache->by_index);
+  g_free (cache);
+}
+
+/* Returns the run cache of @line, creating it if needed.
+ *
+ * The glyphs of a leaked line can be changed at any time,
+ * so those don't get a cache, and NULL is returned.
+ */
+static RunCache *
+pango_layout_line_get_run_cache (PangoLayoutLine *line)
+{
+  PangoLayoutLinePrivate *private = (PangoLayoutLinePrivate *)line;
+
+  if (private->cache_status == LEAKED)
+    return NULL;
+
+  if (!private->run_cache)
+    private->run_cache = run_cache_new (line);
+
+  return private->run_cache;
+}
+
+/* Finds the run containing the byte @index */
+static RunPosition *
+run_cache_find_index (RunCache *cache,
+                      int       index)
+{
+  int lo = 0;
+  int hi = cache->n_runs;
+
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      PangoItem *item = cache->by_index[mid]->run->item;
+
+      if (index < item->offset)
+        hi = mid;
+      else if (index >= item->offset + item->length)
+        lo = mid + 1;
+      else
+        return cache->by_index[mid];
+    }
+
+  return NULL;
+}
+
+/* Finds the run whose logical extents contain @x */
+static RunPosition *
+run_cache_find_x (RunCache *cache,
+                  int       x)
+{
+  RunPosition *pos;
+  int lo = 0;
+  int hi = cache->n_runs;
+
+  if (G_UNLIKELY (!cache->sorted_by_x))
+    {
+      for (int i = 0; i < cache->n_runs; i++)
+        {
+          pos = &cache->runs[i];
+          if (x >= pos->x && x < pos->x + pos->width)
+            return pos;
+        }
+
+      return NULL;
+    }
+
+  /* Find the last run that starts at or before x */
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+
+      if (cache->runs[mid].x <= x)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  if (lo == 0)
+    return NULL;
+
+  pos = &cache->runs[lo - 1];
+  if (x < pos->x + pos->width)
+    return pos;
+
+  return NULL;
+}
+
+/* Finds the run of @line containing the byte @index. If there
+ * is none, returns FALSE and sets @pos->x to the width of the
+ * line. Lines without a run cache are walked run by run.
+ */
+static gboolean
+line_find_run_by_index (PangoLayoutLine *line,
+                        int              index,
+                        RunPosition     *pos)
+{
+  RunCache *cache;
+  RunPosition *found;
+  GSList *l;
+  int x;
+
+  cache = pango_layout_line_get_run_cache (line);
+  if (cache)
+    {
+      found = run_cache_find_index (cache, index);
+      if (found)
+        {
+          *pos = *found;
+          return TRUE;
+        }
+
+      pos->run = NULL;
+      pos->x = 0;
+      pos->width = 0;
+      if (cache->n_runs > 0)
+        {
+          found = &cache->runs[cache->n_runs - 1];
+          pos->x = found->x + found->width;
+        }
+
+      return FALSE;
+    }
+
+  for (l = line->runs, x = 0; l; l = l->next)
+    {
+      PangoLayoutRun *run = l->data;
+      int width = pango_glyph_string_get_width (run->glyphs);
+
+      if (run->item->offset <= index && index < run->item->offset + run->item->length)
+        {
+          pos->run = run;
+          pos->x = x;
+          pos->width = width;
+          return TRUE;
+        }
+
+      x += width;
+    }
+
+  pos->run = NULL;
+  pos->x = x;
+  pos->width = 0;
+
+  return FALSE;
+}
+
+/* Finds the run of @line whose logical extents contain @x.
+ * Lines without a run cache are walked run by run.
+ */
+static gboolean
+line_find_run_by_x (PangoLayoutLine *line,
+                    int              x,
+                    RunPosition     *pos)
+{
+  RunCache *cache;
+  RunPosition *found;
+  GSList *l;
+  int start_x;
+
+  cache = pango_layout_line_get_run_cache (line);
+  if (cache)
+    {
+      found = run_cache_find_x (cache, x);
+      if (found)
+        *pos = *found;
+
+      return found != NULL;
+    }
+
+  for (l = line->runs, start_x = 0; l; l = l->next)
+    {
+      PangoLayoutRun *run = l->data;
+      int width = pango_glyph_string_get_width (run->glyphs);
+
+      if (x >= start_x && x < start_x + width)
+        {
+          pos->run = run;
+          pos->x = start_x;
+          pos->width = width;
+          return TRUE;
+        }
+
+      start_x += width;
+    }
+
+  return FALSE;
+}
+
 
 /*****************
  * Line Breaking *
@@ -3508,6 +3815,7 @@ shape_tab (PangoLayoutLine  *line,
   glyphs->glyphs[0].geometry.y_offset = 0;
   glyphs->glyphs[0].attr.is_cluster_start = 1;
   glyphs->glyphs[0].attr.is_color = 0;
+  glyphs->glyphs[0].attr.is_unsafe_to_break = 0;
 
   glyphs->log_clusters[0] = 0;
 
@@ -3613,6 +3921,9 @@ struct _ParaBreakState
   int line_of_par;              /* Line of the paragraph, starting at 1 for first line */
 
   PangoGlyphString *glyphs;     /* Glyphs for the first item in state->items */
+  int glyphs_offset;            /* Byte offset of the item that glyphs were shaped for,
+                                 * or -1 if they can't be sliced, see slice_run() */
+  int glyphs_length;            /* Length of that item in bytes */
   int start_offset;             /* Character offset of first item in state->items in layout->text */
   ItemProperties properties;    /* Properties for the first item in state->items */
   int *log_widths;              /* Logical widths for first item in state->items.. */
@@ -3777,6 +4088,123 @@ shape_run (PangoLayoutLine *line,
   return glyphs;
 }
 
+/* Finds the position in @glyphs between the glyphs for the
+ * text before @index and the glyphs for the text after it.
+ * Returns FALSE if no cluster starts at @index, or if HarfBuzz
+ * told us that breaking the text there changes the shaping.
+ */
+static gboolean
+find_safe_glyph_break (PangoGlyphString *glyphs,
+                       gboolean          rtl,
+                       int               index,
+                       int              *pos)
+{
+  int lo, hi;
+  int glyph;
+
+  /* In RTL runs, the glyphs for the text after @index come first */
+  lo = 0;
+  hi = glyphs->num_glyphs;
+  while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+
+      if (rtl ? glyphs->log_clusters[mid] >= index : glyphs->log_clusters[mid] < index)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  *pos = lo;
+
+  glyph = rtl ? lo - 1 : lo;
+  if (glyph < 0 || glyph >= glyphs->num_glyphs)
+    return FALSE;
+
+  return glyphs->log_clusters[glyph] == index &&
+         !glyphs->glyphs[glyph].attr.is_unsafe_to_break;
+}
+
+/* While we break an item, we need glyphs for parts of it.
+ * If the part starts and ends at positions where the text
+ * can be broken without changing the shaping, we can copy
+ * them out of state->glyphs instead of shaping it again.
+ *
+ * Returns NULL if that is not possible.
+ */
+static PangoGlyphString *
+slice_run (PangoLayoutLine *line,
+           ParaBreakState  *state,
+           PangoItem       *item)
+{
+  PangoGlyphString *glyphs;
+  gboolean rtl;
+  int start, end;
+  int first, last;
+  int i;
+
+  if (!state->glyphs || state->glyphs_offset < 0)
+    return NULL;
+
+  /* shape_run() updates the width of the last tab for us */
+  if (state->last_tab.glyphs != NULL)
+    return NULL;
+
+  if (item->analysis.flags & PANGO_ANALYSIS_FLAG_NEED_HYPHEN)
+    return NULL;
+
+  start = item->offset - state->glyphs_offset;
+  end = start + item->length;
+
+  g_assert (start >= 0 && end <= state->glyphs_length);
+
+  rtl = item->analysis.level % 2;
+
+  if (start == 0)
+    first = rtl ? state->glyphs->num_glyphs : 0;
+  else if (!find_safe_glyph_break (state->glyphs, rtl, start, &first))
+    return NULL;
+
+  if (end == state->glyphs_length)
+    last = rtl ? 0 : state->glyphs->num_glyphs;
+  else if (!find_safe_glyph_break (state->glyphs, rtl, end, &last))
+    return NULL;
+
+  if (rtl)
+    {
+      int tmp = first;
+      first = last;
+      last = tmp;
+    }
+
+  if (first >= last)
+    return NULL;
+
+  glyphs = pango_glyph_string_new ();
+  pango_glyph_string_set_size (glyphs, last - first);
+  memcpy (glyphs->glyphs, state->glyphs->glyphs + first, (last - first) * sizeof (PangoGlyphInfo));
+  for (i = 0; i < last - first; i++)
+    glyphs->log_clusters[i] = state->glyphs->log_clusters[first + i] - start;
+
+  line->layout->reshapes_avoided++;
+
+  return glyphs;
+}
+
+static PangoGlyphString *
+get_run_glyphs (PangoLayoutLine *line,
+                ParaBreakState  *state,
+                PangoItem       *item)
+{
+  PangoGlyphString *glyphs;
+
+  glyphs = slice_run (line, state, item);
+  if (glyphs)
+    return glyphs;
+
+  return shape_run (line, state, item);
+}
+
 static void
 insert_run (PangoLayoutLine  *line,
             ParaBreakState   *state,
@@ -3798,7 +4226,7 @@ insert_run (PangoLayoutLine  *line,
       state->glyphs = NULL;
     }
   else
-    run->glyphs = shape_run (line, state, run_item);
+    run->glyphs = get_run_glyphs (line, state, run_item);
 
   if (last_run && state->glyphs)
     {
@@ -4049,6 +4477,10 @@ process_item (PangoLayout     *layout,
    * evenly divided for clusters, and b) clusters may change as we
    * break in the middle (think ff- i).
    *
+   * The glyphs for the parts of the item that we measure or insert
+   * are sliced out of state->glyphs where HarfBuzz tells us that this
+   * gives the same result as shaping them again, see slice_run().
+   *
    * We use state->log_widths_offset != 0 to detect if we are dealing
    * with the original item, or one that has been chopped off.
    */
@@ -4058,6 +4490,17 @@ process_item (PangoLayout     *layout,
       state->glyphs = shape_run (line, state, item);
       state->log_widths_offset = 0;
       processing_new_item = TRUE;
+
+      if (state->properties.shape_set ||
+          state->properties.letter_spacing ||
+          layout->text[item->offset] == '\t' ||
+          (item->analysis.flags & PANGO_ANALYSIS_FLAG_NEED_HYPHEN))
+        state->glyphs_offset = -1;
+      else
+        {
+          state->glyphs_offset = item->offset;
+          state->glyphs_length = item->length;
+        }
     }
   else
     processing_new_item = FALSE;
@@ -4131,7 +4574,7 @@ process_item (PangoLayout     *layout,
       PangoGlyphString *glyphs;
 
       DEBUG1 ("%d + %d <= %d", width, extra_width, state->remaining_width);
-      glyphs = shape_run (line, state, item);
+      glyphs = get_run_glyphs (line, state, item);
 
       width = pango_glyph_string_get_width (glyphs) + tab_width_change (state);
 
@@ -4235,7 +4678,7 @@ retry_break:
               else
                 new_item = item;
 
-              glyphs = shape_run (line, state, new_item);
+              glyphs = get_run_glyphs (line, state, new_item);
 
               new_break_width = pango_glyph_string_get_width (glyphs) + tab_width_change (state);
 
@@ -4773,11 +5216,17 @@ static void
 apply_attributes_to_runs (PangoLayout   *layout,
                           PangoAttrList *attrs)
 {
+  PangoAttrSegments *segments;
   GSList *ll;
 
   if (!attrs)
     return;
 
+  /* Flatten the attributes once, instead of iterating
+   * them from the start for every run
+   */
+  segments = _pango_attr_list_get_segments (attrs);
+
   for (ll = layout->lines; ll; ll = ll->next)
     {
       PangoLayoutLine *line = ll->data;
@@ -4790,15 +5239,17 @@ apply_attributes_to_runs (PangoLayout   *layout,
           PangoGlyphItem *glyph_item = rl->data;
           GSList *new_runs;
 
-          new_runs = pango_glyph_item_apply_attrs (glyph_item,
-                                                   layout->text,
-                                                   attrs);
+          new_runs = pango_glyph_item_apply_attr_segments (glyph_item,
+                                                           layout->text,
+                                                           segments);
 
           line->runs = g_slist_concat (new_runs, line->runs);
         }
 
       g_slist_free (old_runs);
     }
+
+  _pango_attr_segments_free (segments);
 }
 
 #pragma GCC diagnostic push
@@ -4810,6 +5261,8 @@ pango_layout_check_lines (PangoLayout *layout)
   const char *start;
   gboolean done = FALSE;
   int start_offset;
+  PangoAnalyzedText *analysis;
+  int para_index;
   PangoAttrList *attrs;
   PangoAttrList *itemize_attrs;
   PangoAttrList *shape_attrs;
@@ -4855,13 +5308,25 @@ pango_layout_check_lines (PangoLayout *layout)
       need_log_attrs = FALSE;
     }
 
-  start_offset = 0;
-  start = layout->text;
+  /* The analysis only depends on the text, so it is kept
+   * across relayouts until the text changes
+   */
+  if (layout->analysis &&
+      layout->analysis->single_paragraph != layout->single_paragraph)
+    g_clear_pointer (&layout->analysis, pango_analyzed_text_free);
+
+  if (!layout->analysis)
+    layout->analysis = pango_analyzed_text_new (layout->text,
+                                                layout->length,
+                                                layout->single_paragraph);
+
+  analysis = layout->analysis;
+  para_index = 0;
 
   /* Find the first strong direction of the text */
   if (layout->auto_dir)
     {
-      prev_base_dir = pango_find_base_dir (layout->text, layout->length);
+      prev_base_dir = analysis->dir;
       if (prev_base_dir == PANGO_DIRECTION_NEUTRAL)
         prev_base_dir = pango_context_get_base_dir (layout->context);
     }
@@ -4886,28 +5351,22 @@ pango_layout_check_lines (PangoLayout *layout)
   DEBUG1 ("START layout");
   do
     {
+      const PangoAnalyzedParagraph *para;
       int delim_len;
       const char *end;
-      int delimiter_index, next_para_index;
+      int delimiter_index;
 
-      if (layout->single_paragraph)
-        {
-          delimiter_index = layout->length;
-          next_para_index = layout->length;
-        }
-      else
-        {
-          pango_find_paragraph_boundary (start,
-                                         (layout->text + layout->length) - start,
-                                         &delimiter_index,
-                                         &next_para_index);
-        }
+      g_assert (para_index < analysis->n_paragraphs);
+
+      para = &analysis->paragraphs[para_index++];
 
-      g_assert (next_para_index >= delimiter_index);
+      start = layout->text + para->start_index;
+      start_offset = para->start_offset;
+      delimiter_index = para->length;
 
       if (layout->auto_dir)
         {
-          base_dir = pango_find_base_dir (start, delimiter_index);
+          base_dir = para->dir;
 
           /* Propagate the base direction for neutral paragraphs */
           if (base_dir == PANGO_DIRECTION_NEUTRAL)
@@ -4918,7 +5377,7 @@ pango_layout_check_lines (PangoLayout *layout)
 
       end = start + delimiter_index;
 
-      delim_len = next_para_index - delimiter_index;
+      delim_len = para->delim_len;
 
       if (end == (layout->text + layout->length))
         done = TRUE;
@@ -4929,11 +5388,10 @@ pango_layout_check_lines (PangoLayout *layout)
       g_assert (delim_len >= 0);
 
       state.attrs = itemize_attrs;
-      state.items = pango_itemize_with_font (layout->context,
+      state.items = pango_itemize_paragraph (layout->context,
                                              base_dir,
                                              layout->text,
-                                             start - layout->text,
-                                             end - start,
+                                             para,
                                              itemize_attrs,
                                              itemize_attrs ? &iter : NULL,
                                              NULL);
@@ -4961,6 +5419,7 @@ pango_layout_check_lines (PangoLayout *layout)
       state.line_start_index = start - layout->text;
 
       state.glyphs = NULL;
+      state.glyphs_offset = -1;
 
       /* for deterministic bug hunting's sake set everything! */
       state.line_width = -1;
@@ -4988,11 +5447,6 @@ pango_layout_check_lines (PangoLayout *layout)
 
       if (layout->height >= 0 && state.remaining_height < state.line_height)
         done = TRUE;
-
-      if (!done)
-        start_offset += pango_utf8_strlen (start, (end - start) + delim_len);
-
-      start = end + delim_len;
     }
   while (!done);
 
@@ -5064,6 +5518,7 @@ pango_layout_line_unref (PangoLayoutLine *line)
     {
       g_slist_foreach (line->runs, (GFunc)free_run, GINT_TO_POINTER (1));
       g_slist_free (line->runs);
+      g_clear_pointer (&private->run_cache, run_cache_free);
       g_slice_free (PangoLayoutLinePrivate, private);
     }
 }
@@ -5168,7 +5623,6 @@ pango_layout_line_x_to_index (PangoLayoutLine *line,
                               int             *trailing)
 {
   GSList *tmp_list;
-  gint start_pos = 0;
   gint first_index = 0; /* line->start_index */
   gint first_offset;
   gint last_index;      /* start of last grapheme in line */
@@ -5178,6 +5632,9 @@ pango_layout_line_x_to_index (PangoLayoutLine *line,
   PangoLayout *layout;
   gint last_trailing;
   gboolean suppress_last_trailing;
+  RunCache *cache;
+  RunPosition pos;
+  gboolean retval;
 
   g_return_val_if_fail (LINE_IS_VALID (line), FALSE);
 
@@ -5199,7 +5656,11 @@ pango_layout_line_x_to_index (PangoLayoutLine *line,
 
   g_assert (line->length > 0);
 
-  first_offset = g_utf8_pointer_to_offset (layout->text, layout->text + line->start_index);
+  cache = pango_layout_line_get_run_cache (line);
+  if (cache)
+    first_offset = cache->start_offset;
+  else
+    first_offset = g_utf8_pointer_to_offset (layout->text, layout->text + line->start_index);
 
   end_index = first_index + line->length;
   end_offset = first_offset + g_utf8_pointer_to_offset (layout->text + first_index, layout->text + end_index);
@@ -5258,84 +5719,76 @@ pango_layout_line_x_to_index (PangoLayoutLine *line,
       if (trailing)
         *trailing = (line->resolved_dir == PANGO_DIRECTION_LTR || suppress_last_trailing) ? 0 : last_trailing;
 
-      return FALSE;
+      retval = FALSE;
     }
-
-  tmp_list = line->runs;
-  while (tmp_list)
+  else if (line_find_run_by_x (line, x_pos, &pos))
     {
-      PangoLayoutRun *run = tmp_list->data;
-      int logical_width;
+      PangoLayoutRun *run = pos.run;
+      int offset;
+      gboolean char_trailing;
+      int grapheme_start_index;
+      int grapheme_start_offset;
+      int grapheme_end_offset;
+      int char_pos;
+      int char_index;
 
-      logical_width = pango_glyph_string_get_width (run->glyphs);
+      pango_glyph_string_x_to_index (run->glyphs,
+                                     layout->text + run->item->offset, run->item->length,
+                                     &run->item->analysis,
+                                     x_pos - pos.x,
+                                     &char_pos, &char_trailing);
 
-      if (x_pos >= start_pos && x_pos < start_pos + logical_width)
-        {
-          int offset;
-          gboolean char_trailing;
-          int grapheme_start_index;
-          int grapheme_start_offset;
-          int grapheme_end_offset;
-          int pos;
-          int char_index;
-
-          pango_glyph_string_x_to_index (run->glyphs,
-                                         layout->text + run->item->offset, run->item->length,
-                                         &run->item->analysis,
-                                         x_pos - start_pos,
-                                         &pos, &char_trailing);
-
-          char_index = run->item->offset + pos;
-
-          /* Convert from characters to graphemes */
-
-          offset = g_utf8_pointer_to_offset (layout->text, layout->text + char_index);
-
-          grapheme_start_offset = offset;
-          grapheme_start_index = char_index;
-          while (grapheme_start_offset > first_offset &&
-                 !layout->log_attrs[grapheme_start_offset].is_cursor_position)
-            {
-              grapheme_start_index = g_utf8_prev_char (layout->text + grapheme_start_index) - layout->text;
-              grapheme_start_offset--;
-            }
+      char_index = run->item->offset + char_pos;
 
-          grapheme_end_offset = offset;
-          do
-            {
-              grapheme_end_offset++;
-            }
-          while (grapheme_end_offset < end_offset &&
-                 !layout->log_attrs[grapheme_end_offset].is_cursor_position);
+      /* Convert from characters to graphemes */
 
-          if (index)
-            *index = grapheme_start_index;
+      offset = run_get_char_offset (layout, run, char_index);
 
-          if (trailing)
-            {
-              if ((grapheme_end_offset == end_offset && suppress_last_trailing) ||
-                  offset + char_trailing <= (grapheme_start_offset + grapheme_end_offset) / 2)
-                *trailing = 0;
-              else
-                *trailing = grapheme_end_offset - grapheme_start_offset;
-            }
+      grapheme_start_offset = offset;
+      grapheme_start_index = char_index;
+      while (grapheme_start_offset > first_offset &&
+             !layout->log_attrs[grapheme_start_offset].is_cursor_position)
+        {
+          grapheme_start_index = g_utf8_prev_char (layout->text + grapheme_start_index) - layout->text;
+          grapheme_start_offset--;
+        }
 
-          return TRUE;
+      grapheme_end_offset = offset;
+      do
+        {
+          grapheme_end_offset++;
         }
+      while (grapheme_end_offset < end_offset &&
+             !layout->log_attrs[grapheme_end_offset].is_cursor_position);
 
-      start_pos += logical_width;
-      tmp_list = tmp_list->next;
+      if (index)
+        *index = grapheme_start_index;
+
+      if (trailing)
+        {
+          if ((grapheme_end_offset == end_offset && suppress_last_trailing) ||
+              offset + char_trailing <= (grapheme_start_offset + grapheme_end_offset) / 2)
+            *trailing = 0;
+          else
+            *trailing = grapheme_end_offset - grapheme_start_offset;
+        }
+
+      retval = TRUE;
     }
+  else
+    {
+      /* pick the rightmost char */
+      if (index)
+        *index = (line->resolved_dir == PANGO_DIRECTION_LTR) ? last_index : first_index;
 
-  /* pick the rightmost char */
-  if (index)
-    *index = (line->resolved_dir == PANGO_DIRECTION_LTR) ? last_index : first_index;
+      /* and its rightmost edge */
+      if (trailing)
+        *trailing = (line->resolved_dir == PANGO_DIRECTION_LTR && !suppress_last_trailing) ? last_trailing : 0;
 
-  /* and its rightmost edge */
-  if (trailing)
-    *trailing = (line->resolved_dir == PANGO_DIRECTION_LTR && !suppress_last_trailing) ? last_trailing : 0;
+      retval = FALSE;
+    }
 
-  return FALSE;
+  return retval;
 }
 
 static int
@@ -5390,12 +5843,14 @@ pango_layout_line_get_x_ranges (PangoLayoutLine  *line,
                                 int              *n_ranges)
 {
   gint line_start_index = 0;
-  GSList *tmp_list;
   int range_count = 0;
-  int accumulated_width = 0;
   int x_offset;
   int width, line_width;
   PangoAlignment alignment;
+  RunCache *cache;
+  GSList *tmp_list;
+  int accumulated_width = 0;
+  int i;
 
   g_return_if_fail (line != NULL);
   g_return_if_fail (line->layout != NULL);
@@ -5426,6 +5881,8 @@ pango_layout_line_get_x_ranges (PangoLayoutLine  *line,
 
   line_start_index = line->start_index;
 
+  cache = pango_layout_line_get_run_cache (line);
+
   /* Allocate the maximum possible size */
   if (ranges)
     *ranges = g_new (int, 2 * (2 + g_slist_length (line->runs)));
@@ -5443,10 +5900,10 @@ pango_layout_line_get_x_ranges (PangoLayoutLine  *line,
       range_count ++;
     }
 
-  tmp_list = line->runs;
-  while (tmp_list)
+  for (tmp_list = line->runs, i = 0; tmp_list; tmp_list = tmp_list->next, i++)
     {
-      PangoLayoutRun *run = (PangoLayoutRun *)tmp_list->data;
+      PangoLayoutRun *run = tmp_list->data;
+      int run_x = cache ? cache->runs[i].x : accumulated_width;
 
       if ((start_index < run->item->offset + run->item->length &&
            end_index > run->item->offset))
@@ -5485,17 +5942,15 @@ pango_layout_line_get_x_ranges (PangoLayoutLine  *line,
                                                   run_end_index - run->item->offset, TRUE,
                                                   &run_end_x);
 
-              (*ranges)[2*range_count] = x_offset + accumulated_width + MIN (run_start_x, run_end_x);
-              (*ranges)[2*range_count + 1] = x_offset + accumulated_width + MAX (run_start_x, run_end_x);
+              (*ranges)[2*range_count] = x_offset + run_x + MIN (run_start_x, run_end_x);
+              (*ranges)[2*range_count + 1] = x_offset + run_x + MAX (run_start_x, run_end_x);
             }
 
           range_count++;
         }
 
-      if (tmp_list->next)
+      if (!cache && tmp_list->next)
         accumulated_width += pango_glyph_string_get_width (run->glyphs);
-
-      tmp_list = tmp_list->next;
     }
 
   if (x_offset + line_width < line->layout->width &&
@@ -5985,6 +6440,7 @@ pango_layout_line_new (PangoLayout *layout)
   private->line.runs = NULL;
   private->line.length = 0;
   private->cache_status = NOT_CACHED;
+  private->run_cache = NULL;
 
   /* Note that we leave start_index, resolved_dir, and is_paragraph_start
    *  uninitialized */
@@ -5992,6 +6448,43 @@ pango_layout_line_new (PangoLayout *layout)
   return (PangoLayoutLine *) private;
 }
 
+PangoLayoutLine *
+_pango_layout_line_new (PangoLayout *layout)
+{
+  return pango_layout_line_new (layout);
+}
+
+/* Makes @lines the output of @layout, as if they had been
+ * produced by pango_layout_check_lines(). This is used to
+ * restore layouts that were serialized with their output.
+ *
+ * Takes ownership of @lines and @log_attrs. The lines must
+ * have been created for @layout, and @log_attrs must have
+ * an entry for each character of the text, plus one.
+ */
+void
+_pango_layout_set_output (PangoLayout  *layout,
+                          GSList       *lines,
+                          PangoLogAttr *log_attrs,
+                          gboolean      is_wrapped,
+                          gboolean      is_ellipsized)
+{
+  pango_layout_clear_lines (layout);
+
+  g_free (layout->log_attrs);
+  layout->log_attrs = log_attrs;
+
+  layout->lines = lines;
+  layout->line_count = g_slist_length (lines);
+  layout->is_wrapped = is_wrapped;
+  layout->is_ellipsized = is_ellipsized;
+
+  /* The lines are only valid for the current state of the
+   * context; if it changes, they get recomputed as usual
+   */
+  layout->context_serial = pango_context_get_serial (layout->context);
+}
+
 /**
  * pango_layout_line_get_pixel_extents:
  * @layout_line: a `PangoLayoutLine`
@@ -6396,6 +6889,55 @@ adjust_line_letter_spacing (PangoLayoutLine *line,
     line->runs = g_slist_reverse (line->runs);
 }
 
+/* The places in a line where justification can add space,
+ * collected in a single walk over the clusters of the line.
+ * The space is then distributed over them in a second, flat
+ * loop that does not need to look at the clusters again.
+ */
+typedef struct {
+  PangoGlyphString *glyphs;
+  int leftmost;  /* the glyph to add space to, or the leftmost glyph of the cluster */
+  int rightmost; /* the rightmost glyph of the cluster */
+  int width;     /* the width of the space glyph, or of the cluster */
+} JustifyGap;
+
+typedef struct {
+  int n_gaps;
+  int size;
+  JustifyGap *gaps;
+  JustifyGap gaps_[64];
+} JustifyGaps;
+
+static void
+justify_gaps_init (JustifyGaps *gaps)
+{
+  gaps->n_gaps = 0;
+  gaps->size = G_N_ELEMENTS (gaps->gaps_);
+  gaps->gaps = gaps->gaps_;
+}
+
+static void
+justify_gaps_clear (JustifyGaps *gaps)
+{
+  if (gaps->gaps != gaps->gaps_)
+    g_free (gaps->gaps);
+}
+
+static JustifyGap *
+justify_gaps_add (JustifyGaps *gaps)
+{
+  if (G_UNLIKELY (gaps->n_gaps == gaps->size))
+    {
+      gaps->size *= 2;
+      if (gaps->gaps == gaps->gaps_)
+        gaps->gaps = g_memdup2 (gaps->gaps_, gaps->size * sizeof (JustifyGap));
+      else
+        gaps->gaps = g_renew (JustifyGap, gaps->gaps, gaps->size);
+    }
+
+  return &gaps->gaps[gaps->n_gaps++];
+}
+
 static void
 justify_clusters (PangoLayoutLine *line,
                   ParaBreakState  *state)
@@ -6403,14 +6945,15 @@ justify_clusters (PangoLayoutLine *line,
   const gchar *text = line->layout->text;
   const PangoLogAttr *log_attrs = line->layout->log_attrs;
 
-  int total_remaining_width, total_gaps = 0;
-  int added_so_far, gaps_so_far;
+  int total_remaining_width, total_gaps;
+  int added_so_far;
   gboolean is_hinted;
   GSList *run_iter;
-  enum {
-    MEASURE,
-    ADJUST
-  } mode;
+  JustifyGaps gaps;
+  PangoGlyphString *last_glyphs = NULL;
+  int rightmost_space = 0;
+  int residual = 0;
+  int i;
 
   total_remaining_width = state->remaining_width;
   if (total_remaining_width <= 0)
@@ -6419,126 +6962,114 @@ justify_clusters (PangoLayoutLine *line,
   /* hint to full pixel if total remaining width was so */
   is_hinted = (total_remaining_width & (PANGO_SCALE - 1)) == 0;
 
-  for (mode = MEASURE; mode <= ADJUST; mode++)
+  justify_gaps_init (&gaps);
+
+  /* Collect the clusters from left to right */
+  for (run_iter = line->runs; run_iter; run_iter = run_iter->next)
     {
-      gboolean leftedge = TRUE;
-      PangoGlyphString *rightmost_glyphs = NULL;
-      int rightmost_space = 0;
-      int residual = 0;
+      PangoLayoutRun *run = run_iter->data;
+      PangoGlyphString *glyphs = run->glyphs;
+      PangoGlyphItemIter cluster_iter;
+      gboolean have_cluster;
+      int dir;
+      int offset;
 
-      added_so_far = 0;
-      gaps_so_far = 0;
+      dir = run->item->analysis.level % 2 == 0 ? +1 : -1;
 
-      for (run_iter = line->runs; run_iter; run_iter = run_iter->next)
+      /* Note: we simply assert here, since our items are all internally
+       * created. If that ever changes, we need to add a fallback here.
+       */
+      g_assert (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET);
+      offset = ((PangoItemPrivate *)run->item)->char_offset;
+
+      for (have_cluster = dir > 0 ?
+             pango_glyph_item_iter_init_start (&cluster_iter, run, text) :
+             pango_glyph_item_iter_init_end   (&cluster_iter, run, text);
+           have_cluster;
+           have_cluster = dir > 0 ?
+             pango_glyph_item_iter_next_cluster (&cluster_iter) :
+             pango_glyph_item_iter_prev_cluster (&cluster_iter))
         {
-          PangoLayoutRun *run = run_iter->data;
-          PangoGlyphString *glyphs = run->glyphs;
-          PangoGlyphItemIter cluster_iter;
-          gboolean have_cluster;
-          int dir;
-          int offset;
-
-          dir = run->item->analysis.level % 2 == 0 ? +1 : -1;
-
-          /* Note: we simply assert here, since our items are all internally
-           * created. If that ever changes, we need to add a fallback here.
-           */
-          g_assert (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET);
-          offset = ((PangoItemPrivate *)run->item)->char_offset;
-
-          for (have_cluster = dir > 0 ?
-                 pango_glyph_item_iter_init_start (&cluster_iter, run, text) :
-                 pango_glyph_item_iter_init_end   (&cluster_iter, run, text);
-               have_cluster;
-               have_cluster = dir > 0 ?
-                 pango_glyph_item_iter_next_cluster (&cluster_iter) :
-                 pango_glyph_item_iter_prev_cluster (&cluster_iter))
-            {
-              int i;
-              int width = 0;
+          JustifyGap *gap;
+          int width = 0;
 
-              /* don't expand in the middle of graphemes */
-              if (!log_attrs[offset + cluster_iter.start_char].is_cursor_position)
-                continue;
+          /* don't expand in the middle of graphemes */
+          if (!log_attrs[offset + cluster_iter.start_char].is_cursor_position)
+            continue;
 
-              for (i = cluster_iter.start_glyph; i != cluster_iter.end_glyph; i += dir)
-                width += glyphs->glyphs[i].geometry.width;
+          for (i = cluster_iter.start_glyph; i != cluster_iter.end_glyph; i += dir)
+            width += glyphs->glyphs[i].geometry.width;
 
-              /* also don't expand zero-width clusters. */
-              if (width == 0)
-                continue;
+          /* also don't expand zero-width clusters. */
+          if (width == 0)
+            continue;
 
-              gaps_so_far++;
+          gap = justify_gaps_add (&gaps);
+          gap->glyphs = glyphs;
+          if (cluster_iter.start_glyph < cluster_iter.end_glyph)
+            {
+              /* LTR */
+              gap->leftmost  = cluster_iter.start_glyph;
+              gap->rightmost = cluster_iter.end_glyph - 1;
+            }
+          else
+            {
+              /* RTL */
+              gap->leftmost  = cluster_iter.end_glyph + 1;
+              gap->rightmost = cluster_iter.start_glyph;
+            }
+          gap->width = width;
+        }
+    }
 
-              if (mode == ADJUST)
-                {
-                  int leftmost, rightmost;
-                  int adjustment, space_left, space_right;
+  total_gaps = gaps.n_gaps - 1;
 
-                  adjustment = total_remaining_width / total_gaps + residual;
-                  if (is_hinted)
-                  {
-                    int old_adjustment = adjustment;
-                    adjustment = PANGO_UNITS_ROUND (adjustment);
-                    residual = old_adjustment - adjustment;
-                  }
-                  /* distribute to before/after */
-                  distribute_letter_spacing (adjustment, &space_left, &space_right);
-
-                  if (cluster_iter.start_glyph < cluster_iter.end_glyph)
-                  {
-                    /* LTR */
-                    leftmost  = cluster_iter.start_glyph;
-                    rightmost = cluster_iter.end_glyph - 1;
-                  }
-                  else
-                  {
-                    /* RTL */
-                    leftmost  = cluster_iter.end_glyph + 1;
-                    rightmost = cluster_iter.start_glyph;
-                  }
-                  /* Don't add to left-side of left-most glyph of left-most non-zero run. */
-                  if (leftedge)
-                    leftedge = FALSE;
-                  else
-                  {
-                    glyphs->glyphs[leftmost].geometry.width    += space_left ;
-                    glyphs->glyphs[leftmost].geometry.x_offset += space_left ;
-                    added_so_far += space_left;
-                  }
-                  /* Don't add to right-side of right-most glyph of right-most non-zero run. */
-                  {
-                    /* Save so we can undo later. */
-                    rightmost_glyphs = glyphs;
-                    rightmost_space = space_right;
+  if (total_gaps <= 0)
+    {
+      /* a single cluster, can't really justify it */
+      justify_gaps_clear (&gaps);
+      return;
+    }
 
-                    glyphs->glyphs[rightmost].geometry.width  += space_right;
-                    added_so_far += space_right;
-                  }
-                }
-            }
-        }
+  added_so_far = 0;
+  for (i = 0; i < gaps.n_gaps; i++)
+    {
+      JustifyGap *gap = &gaps.gaps[i];
+      PangoGlyphInfo *infos = gap->glyphs->glyphs;
+      int adjustment, space_left, space_right;
 
-      if (mode == MEASURE)
+      adjustment = total_remaining_width / total_gaps + residual;
+      if (is_hinted)
         {
-          total_gaps = gaps_so_far - 1;
-
-          if (total_gaps == 0)
-            {
-              /* a single cluster, can't really justify it */
-              return;
-            }
+          int old_adjustment = adjustment;
+          adjustment = PANGO_UNITS_ROUND (adjustment);
+          residual = old_adjustment - adjustment;
         }
-      else /* mode == ADJUST */
+      /* distribute to before/after */
+      distribute_letter_spacing (adjustment, &space_left, &space_right);
+
+      /* Don't add to left-side of left-most glyph of left-most non-zero run. */
+      if (i > 0)
         {
-          if (rightmost_glyphs)
-           {
-             rightmost_glyphs->glyphs[rightmost_glyphs->num_glyphs - 1].geometry.width -= rightmost_space;
-             added_so_far -= rightmost_space;
-           }
+          infos[gap->leftmost].geometry.width    += space_left;
+          infos[gap->leftmost].geometry.x_offset += space_left;
+          added_so_far += space_left;
         }
+
+      infos[gap->rightmost].geometry.width += space_right;
+      added_so_far += space_right;
+
+      /* Save so we can undo later. */
+      last_glyphs = gap->glyphs;
+      rightmost_space = space_right;
     }
 
+  /* Don't add to right-side of right-most glyph of right-most non-zero run. */
+  last_glyphs->glyphs[last_glyphs->num_glyphs - 1].geometry.width -= rightmost_space;
+  added_so_far -= rightmost_space;
+
+  justify_gaps_clear (&gaps);
+
   state->remaining_width -= added_so_far;
 }
 
@@ -6553,10 +7084,8 @@ justify_words (PangoLayoutLine *line,
   int added_so_far, spaces_so_far;
   gboolean is_hinted;
   GSList *run_iter;
-  enum {
-    MEASURE,
-    ADJUST
-  } mode;
+  JustifyGaps gaps;
+  int i;
 
   total_remaining_width = state->remaining_width;
   if (total_remaining_width <= 0)
@@ -6565,72 +7094,77 @@ justify_words (PangoLayoutLine *line,
   /* hint to full pixel if total remaining width was so */
   is_hinted = (total_remaining_width & (PANGO_SCALE - 1)) == 0;
 
-  for (mode = MEASURE; mode <= ADJUST; mode++)
+  justify_gaps_init (&gaps);
+
+  /* Collect the glyphs of expandable spaces */
+  for (run_iter = line->runs; run_iter; run_iter = run_iter->next)
     {
-      added_so_far = 0;
-      spaces_so_far = 0;
+      PangoLayoutRun *run = run_iter->data;
+      PangoGlyphString *glyphs = run->glyphs;
+      PangoGlyphItemIter cluster_iter;
+      gboolean have_cluster;
+      int offset;
+
+      /* Note: we simply assert here, since our items are all internally
+       * created. If that ever changes, we need to add a fallback here.
+       */
+      g_assert (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET);
+      offset = ((PangoItemPrivate *)run->item)->char_offset;
 
-      for (run_iter = line->runs; run_iter; run_iter = run_iter->next)
+      for (have_cluster = pango_glyph_item_iter_init_start (&cluster_iter, run, text);
+           have_cluster;
+           have_cluster = pango_glyph_item_iter_next_cluster (&cluster_iter))
         {
-          PangoLayoutRun *run = run_iter->data;
-          PangoGlyphString *glyphs = run->glyphs;
-          PangoGlyphItemIter cluster_iter;
-          gboolean have_cluster;
-          int offset;
-
-          /* Note: we simply assert here, since our items are all internally
-           * created. If that ever changes, we need to add a fallback here.
-           */
-          g_assert (run->item->analysis.flags & PANGO_ANALYSIS_FLAG_HAS_CHAR_OFFSET);
-          offset = ((PangoItemPrivate *)run->item)->char_offset;
+          int dir;
+
+          if (!log_attrs[offset + cluster_iter.start_char].is_expandable_space)
+            continue;
 
-          for (have_cluster = pango_glyph_item_iter_init_start (&cluster_iter, run, text);
-               have_cluster;
-               have_cluster = pango_glyph_item_iter_next_cluster (&cluster_iter))
+          dir = (cluster_iter.start_glyph < cluster_iter.end_glyph) ? 1 : -1;
+          for (i = cluster_iter.start_glyph; i != cluster_iter.end_glyph; i += dir)
             {
-              int i;
-              int dir;
+              int glyph_width = glyphs->glyphs[i].geometry.width;
+              JustifyGap *gap;
 
-              if (!log_attrs[offset + cluster_iter.start_char].is_expandable_space)
+              if (glyph_width == 0)
                 continue;
 
-              dir = (cluster_iter.start_glyph < cluster_iter.end_glyph) ? 1 : -1;
-              for (i = cluster_iter.start_glyph; i != cluster_iter.end_glyph; i += dir)
-                {
-                  int glyph_width = glyphs->glyphs[i].geometry.width;
+              gap = justify_gaps_add (&gaps);
+              gap->glyphs = glyphs;
+              gap->leftmost = gap->rightmost = i;
+              gap->width = glyph_width;
 
-                  if (glyph_width == 0)
-                    continue;
+              total_space_width += glyph_width;
+            }
+        }
+    }
 
-                  spaces_so_far += glyph_width;
+  if (total_space_width == 0)
+    {
+      justify_gaps_clear (&gaps);
+      justify_clusters (line, state);
+      return;
+    }
 
-                  if (mode == ADJUST)
-                    {
-                      int adjustment;
+  added_so_far = 0;
+  spaces_so_far = 0;
+  for (i = 0; i < gaps.n_gaps; i++)
+    {
+      JustifyGap *gap = &gaps.gaps[i];
+      int adjustment;
 
-                      adjustment = ((guint64) spaces_so_far * total_remaining_width) / total_space_width - added_so_far;
-                      if (is_hinted)
-                        adjustment = PANGO_UNITS_ROUND (adjustment);
+      spaces_so_far += gap->width;
 
-                      glyphs->glyphs[i].geometry.width += adjustment;
-                      added_so_far += adjustment;
-                    }
-                }
-            }
-        }
-
-      if (mode == MEASURE)
-        {
-          total_space_width = spaces_so_far;
+      adjustment = ((guint64) spaces_so_far * total_remaining_width) / total_space_width - added_so_far;
+      if (is_hinted)
+        adjustment = PANGO_UNITS_ROUND (adjustment);
 
-          if (total_space_width == 0)
-            {
-              justify_clusters (line, state);
-              return;
-            }
-        }
+      gap->glyphs->glyphs[gap->leftmost].geometry.width += adjustment;
+      added_so_far += adjustment;
     }
 
+  justify_gaps_clear (&gaps);
+
   state->remaining_width -= added_so_far;
 }
 
@@ -7117,23 +7651,32 @@ update_run (PangoLayoutIter *iter,
             int              run_start_index)
 {
   const Extents *line_ext = &iter->line_extents[iter->line_index];
+  RunCache *cache = ((PangoLayoutLinePrivate *)iter->line)->run_cache;
 
   /* Note that in iter_new() the iter->run_width
    * is garbage but we don't use it since we're on the first run of
    * a line.
    */
   if (iter->run_list_link == iter->line->runs)
-    iter->run_x = line_ext->logical_rect.x;
+    {
+      iter->run_x = line_ext->logical_rect.x;
+      iter->run_index = 0;
+    }
   else
     {
       iter->run_x += iter->end_x_offset + iter->run_width;
       if (iter->run)
         iter->run_x += iter->run->start_x_offset;
+      iter->run_index++;
     }
 
   if (iter->run)
     {
-      iter->run_width = pango_glyph_string_get_width (iter->run->glyphs);
+      /* Reuse the widths if position queries have cached them */
+      if (cache)
+        iter->run_width = cache->runs[iter->run_index].width;
+      else
+        iter->run_width = pango_glyph_string_get_width (iter->run->glyphs);
       iter->end_x_offset = iter->run->end_x_offset;
     }
   else
@@ -7191,6 +7734,7 @@ pango_layout_iter_copy (PangoLayoutIter *iter)
 
   new->run_list_link = iter->run_list_link;
   new->run = iter->run;
+  new->run_index = iter->run_index;
   new->index = iter->index;
 
   new->line_extents = NULL;
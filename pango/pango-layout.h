@@ -365,6 +365,8 @@ GSList *         pango_layout_get_lines_readonly   (PangoLayout    *layout);
  * @PANGO_LAYOUT_SERIALIZE_DEFAULT: Default behavior
  * @PANGO_LAYOUT_SERIALIZE_CONTEXT: Include context information
  * @PANGO_LAYOUT_SERIALIZE_OUTPUT: Include information about the formatted output
+ * @PANGO_LAYOUT_SERIALIZE_BINARY: Use a compact binary format instead
+ *   of JSON. Since: 1.60
  *
  * Flags that influence the behavior of [method@Pango.Layout.serialize].
  *
@@ -376,6 +378,7 @@ typedef enum {
   PANGO_LAYOUT_SERIALIZE_DEFAULT = 0,
   PANGO_LAYOUT_SERIALIZE_CONTEXT = 1 << 0,
   PANGO_LAYOUT_SERIALIZE_OUTPUT = 1 << 1,
+  PANGO_LAYOUT_SERIALIZE_BINARY = 1 << 2,
 } PangoLayoutSerializeFlags;
 
 PANGO_AVAILABLE_IN_1_50
@@ -417,6 +420,9 @@ GQuark          pango_layout_deserialize_error_quark (void);
  * @PANGO_LAYOUT_DESERIALIZE_DEFAULT: Default behavior
  * @PANGO_LAYOUT_DESERIALIZE_CONTEXT: Apply context information
  *   from the serialization to the `PangoContext`
+ * @PANGO_LAYOUT_DESERIALIZE_OUTPUT: Restore the formatted output
+ *   instead of laying out the text again, if the fonts match.
+ *   Since: 1.60
  *
  * Flags that influence the behavior of [func@Pango.Layout.deserialize].
  *
@@ -427,6 +433,7 @@ GQuark          pango_layout_deserialize_error_quark (void);
 typedef enum {
   PANGO_LAYOUT_DESERIALIZE_DEFAULT = 0,
   PANGO_LAYOUT_DESERIALIZE_CONTEXT = 1 << 0,
+  PANGO_LAYOUT_DESERIALIZE_OUTPUT = 1 << 1,
 } PangoLayoutDeserializeFlags;
 
 PANGO_AVAILABLE_IN_1_50
@@ -27,6 +27,8 @@
 #include "pango-markup.h"
 
 #include "pango-attributes.h"
+#include "pango-attributes-private.h"
+#include "pango-context-private.h"
 #include "pango-font.h"
 #include "pango-enum-types.h"
 #include "pango-impl-utils.h"
@@ -326,6 +328,20 @@ markup_data_close_tag (MarkupData *md)
   g_slice_free (OpenTag, ot);
 }
 
+/* The fast path in pango_parse_markup() calls the handlers
+ * without a parse context; there is no position to report then.
+ */
+static void
+get_position (GMarkupParseContext *context,
+              int                 *line_number,
+              int                 *char_number)
+{
+  if (context)
+    g_markup_parse_context_get_position (context, line_number, char_number);
+  else
+    *line_number = *char_number = 0;
+}
+
 static void
 start_element_handler  (GMarkupParseContext *context,
 			const gchar         *element_name,
@@ -387,8 +403,7 @@ start_element_handler  (GMarkupParseContext *context,
     {
       gint line_number, char_number;
 
-      g_markup_parse_context_get_position (context,
-					   &line_number, &char_number);
+      get_position (context, &line_number, &char_number);
 
       g_set_error (error,
 		   G_MARKUP_ERROR,
@@ -561,13 +576,11 @@ destroy_markup_data (MarkupData *md)
   g_slice_free (MarkupData, md);
 }
 
-static GMarkupParseContext *
-pango_markup_parser_new_internal (char       accel_marker,
-				  GError   **error,
-				  gboolean   want_attr_list)
+static MarkupData *
+markup_data_new (char     accel_marker,
+                 gboolean want_attr_list)
 {
   MarkupData *md;
-  GMarkupParseContext *context;
 
   md = g_slice_new (MarkupData);
 
@@ -589,6 +602,55 @@ pango_markup_parser_new_internal (char       accel_marker,
   md->tag_stack = NULL;
   md->to_apply = NULL;
 
+  return md;
+}
+
+/* Moves the results out of @md, once all tags are closed */
+static void
+markup_data_finish (MarkupData     *md,
+                    PangoAttrList **attr_list,
+                    char          **text,
+                    gunichar       *accel_char)
+{
+  if (md->attr_list)
+    {
+      /* The apply list has the most-recently-closed tags first;
+       * we want to apply the least-recently-closed tag last,
+       * so innermost tags go before outermost.
+       */
+      _pango_attr_list_insert_all (md->attr_list, md->to_apply);
+      g_slist_free (md->to_apply);
+      md->to_apply = NULL;
+    }
+
+  if (attr_list)
+    {
+      *attr_list = md->attr_list;
+      md->attr_list = NULL;
+    }
+
+  if (text)
+    {
+      *text = g_string_free (md->text, FALSE);
+      md->text = NULL;
+    }
+
+  if (accel_char)
+    *accel_char = md->accel_char;
+
+  g_assert (md->tag_stack == NULL);
+}
+
+static GMarkupParseContext *
+pango_markup_parser_new_internal (char       accel_marker,
+				  GError   **error,
+				  gboolean   want_attr_list)
+{
+  MarkupData *md;
+  GMarkupParseContext *context;
+
+  md = markup_data_new (accel_marker, want_attr_list);
+
   context = g_markup_parse_context_new (&pango_markup_parser,
 					0, md,
                                         (GDestroyNotify)destroy_markup_data);
@@ -599,6 +661,341 @@ pango_markup_parser_new_internal (char       accel_marker,
   return context;
 }
 
+/* pango_parse_markup() is given all of the markup at once, so
+ * it does not need the incremental machinery of GMarkup. The
+ * functions below tokenize the common cases directly - tags,
+ * attributes, text and the predefined entities - and call the
+ * same handlers that the GMarkup parser would call.
+ *
+ * Anything out of the ordinary, such as comments, CDATA, line
+ * breaks inside attribute values, unknown entities or any error,
+ * makes the fast path give up. The markup is then parsed again
+ * with GMarkup, so that errors are reported exactly as before.
+ */
+
+static inline gboolean
+is_name_start_char (char c)
+{
+  return g_ascii_isalpha (c) || c == '_' || c == ':';
+}
+
+static inline gboolean
+is_name_char (char c)
+{
+  return g_ascii_isalnum (c) || c == '_' || c == ':' || c == '.' || c == '-';
+}
+
+/* Returns the end of the name at @p, or @p if there is none.
+ * Names with non-ASCII characters are left to GMarkup.
+ */
+static const char *
+scan_name (const char *p,
+           const char *end)
+{
+  if (p == end || !is_name_start_char (*p))
+    return p;
+
+  for (p++; p < end && is_name_char (*p); p++)
+    ;
+
+  return p;
+}
+
+/* Appends the text from @p to @end to @out, with entities
+ * and character references replaced. Returns FALSE if the
+ * text contains something that GMarkup should deal with.
+ */
+static gboolean
+decode_text (GString    *out,
+             const char *p,
+             const char *end,
+             gboolean    is_value)
+{
+  while (p < end)
+    {
+      const char *q;
+      const char *semi;
+
+      for (q = p; q < end && *q != '&'; q++)
+        {
+          /* GMarkup normalizes or rejects these in attribute values */
+          if (is_value && (*q == '<' || *q == '\t' || *q == '\n'))
+            return FALSE;
+        }
+
+      g_string_append_len (out, p, q - p);
+      if (q == end)
+        break;
+
+      /* The longest reference we handle is &#x10FFFF; */
+      p = q + 1;
+      semi = memchr (p, ';', MIN (end - p, 9));
+      if (semi == NULL)
+        return FALSE;
+
+      if (*p == '#')
+        {
+          gunichar ch = 0;
+          int base = 10;
+
+          p++;
+          if (p < semi && *p == 'x')
+            {
+              base = 16;
+              p++;
+            }
+
+          if (p == semi)
+            return FALSE;
+
+          for (; p < semi; p++)
+            {
+              int digit;
+
+              if (base == 16)
+                digit = g_ascii_xdigit_value (*p);
+              else
+                digit = g_ascii_digit_value (*p);
+
+              if (digit < 0)
+                return FALSE;
+
+              ch = ch * base + digit;
+            }
+
+          /* the characters that GMarkup accepts */
+          if (!((0 < ch && ch <= 0xD7FF) ||
+                (0xE000 <= ch && ch <= 0xFFFD) ||
+                (0x10000 <= ch && ch <= 0x10FFFF)))
+            return FALSE;
+
+          g_string_append_unichar (out, ch);
+        }
+      else if (semi - p == 2 && strncmp (p, "lt", 2) == 0)
+        g_string_append_c (out, '<');
+      else if (semi - p == 2 && strncmp (p, "gt", 2) == 0)
+        g_string_append_c (out, '>');
+      else if (semi - p == 3 && strncmp (p, "amp", 3) == 0)
+        g_string_append_c (out, '&');
+      else if (semi - p == 4 && strncmp (p, "quot", 4) == 0)
+        g_string_append_c (out, '"');
+      else if (semi - p == 4 && strncmp (p, "apos", 4) == 0)
+        g_string_append_c (out, '\'');
+      else
+        return FALSE;
+
+      p = semi + 1;
+    }
+
+  return TRUE;
+}
+
+/* Returns TRUE and sets the output arguments if the markup
+ * was parsed; FALSE means the markup must be parsed with
+ * GMarkup instead.
+ */
+static gboolean
+parse_markup_fast (const char     *markup_text,
+                   int             length,
+                   char            accel_marker,
+                   PangoAttrList **attr_list,
+                   char          **text,
+                   gunichar       *accel_char)
+{
+  const char *no_attrs[] = { NULL };
+  MarkupData *md;
+  GString *buffer;
+  GArray *offsets;
+  GPtrArray *names;
+  GPtrArray *values;
+  GPtrArray *elements;
+  GError *error = NULL;
+  const char *p;
+  const char *end;
+  gboolean ret = FALSE;
+
+  /* GMarkup normalizes line ends */
+  if (memchr (markup_text, '\r', length) != NULL ||
+      !g_utf8_validate (markup_text, length, NULL))
+    return FALSE;
+
+  md = markup_data_new (accel_marker, attr_list != NULL);
+
+  buffer = g_string_new (NULL);
+  offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+  names = g_ptr_array_new ();
+  values = g_ptr_array_new ();
+  elements = g_ptr_array_new_with_free_func (g_free);
+
+  start_element_handler (NULL, "markup", no_attrs, no_attrs, md, &error);
+
+  p = markup_text;
+  end = markup_text + length;
+  while (p < end && error == NULL)
+    {
+      const char *q;
+
+      if (*p != '<')
+        {
+          q = memchr (p, '<', end - p);
+          if (q == NULL)
+            q = end;
+
+          if (memchr (p, '&', q - p) != NULL)
+            {
+              g_string_truncate (buffer, 0);
+              if (!decode_text (buffer, p, q, FALSE))
+                goto out;
+
+              text_handler (NULL, buffer->str, buffer->len, md, &error);
+            }
+          else
+            text_handler (NULL, p, q - p, md, &error);
+
+          p = q;
+        }
+      else if (end - p > 1 && p[1] == '/')
+        {
+          const char *name = p + 2;
+          const char *name_end = scan_name (name, end);
+          const char *element;
+
+          if (name_end == name || name_end == end || *name_end != '>' ||
+              elements->len == 0)
+            goto out;
+
+          element = g_ptr_array_index (elements, elements->len - 1);
+          if (strlen (element) != (gsize) (name_end - name) ||
+              strncmp (element, name, name_end - name) != 0)
+            goto out;
+
+          end_element_handler (NULL, element, md, &error);
+          g_ptr_array_set_size (elements, elements->len - 1);
+
+          p = name_end + 1;
+        }
+      else
+        {
+          const char *name = p + 1;
+          const char *name_end = scan_name (name, end);
+          gboolean empty = FALSE;
+          char *element;
+          guint i;
+
+          if (name_end == name)
+            goto out;
+
+          g_string_truncate (buffer, 0);
+          g_array_set_size (offsets, 0);
+
+          p = name_end;
+          for (;;)
+            {
+              const char *attr_name;
+              gsize offset;
+              char quote;
+
+              q = p;
+              while (p < end && xml_isspace (*p))
+                p++;
+
+              if (p == end)
+                goto out;
+
+              if (*p == '>')
+                {
+                  p++;
+                  break;
+                }
+
+              if (*p == '/')
+                {
+                  if (end - p < 2 || p[1] != '>')
+                    goto out;
+
+                  p += 2;
+                  empty = TRUE;
+                  break;
+                }
+
+              /* attributes must be preceded by whitespace */
+              if (p == q)
+                goto out;
+
+              attr_name = p;
+              p = scan_name (p, end);
+              if (p == attr_name || end - p < 2 || *p != '=')
+                goto out;
+
+              quote = p[1];
+              if (quote != '"' && quote != '\'')
+                goto out;
+
+              q = memchr (p + 2, quote, end - (p + 2));
+              if (q == NULL)
+                goto out;
+
+              offset = buffer->len;
+              g_array_append_val (offsets, offset);
+              g_string_append_len (buffer, attr_name, p - attr_name);
+              g_string_append_c (buffer, '\0');
+
+              offset = buffer->len;
+              g_array_append_val (offsets, offset);
+              if (!decode_text (buffer, p + 2, q, TRUE))
+                goto out;
+              g_string_append_c (buffer, '\0');
+
+              p = q + 1;
+            }
+
+          /* The buffer may have moved while we were appending */
+          g_ptr_array_set_size (names, 0);
+          g_ptr_array_set_size (values, 0);
+          for (i = 0; i < offsets->len; i += 2)
+            {
+              g_ptr_array_add (names, buffer->str + g_array_index (offsets, gsize, i));
+              g_ptr_array_add (values, buffer->str + g_array_index (offsets, gsize, i + 1));
+            }
+          g_ptr_array_add (names, NULL);
+          g_ptr_array_add (values, NULL);
+
+          element = g_strndup (name, name_end - name);
+          g_ptr_array_add (elements, element);
+
+          start_element_handler (NULL, element,
+                                 (const char **) names->pdata,
+                                 (const char **) values->pdata,
+                                 md, &error);
+
+          if (empty && error == NULL)
+            {
+              end_element_handler (NULL, element, md, &error);
+              g_ptr_array_set_size (elements, elements->len - 1);
+            }
+        }
+    }
+
+  if (error != NULL || elements->len != 0)
+    goto out;
+
+  end_element_handler (NULL, "markup", md, NULL);
+
+  markup_data_finish (md, attr_list, text, accel_char);
+  ret = TRUE;
+
+ out:
+  g_clear_error (&error);
+  g_ptr_array_unref (elements);
+  g_ptr_array_unref (values);
+  g_ptr_array_unref (names);
+  g_array_unref (offsets);
+  g_string_free (buffer, TRUE);
+  destroy_markup_data (md);
+
+  return ret;
+}
+
 /**
  * pango_parse_markup:
  * @markup_text: markup to parse (see the [Pango Markup](pango_markup.html) docs)
@@ -653,6 +1050,10 @@ pango_parse_markup (const char                 *markup_text,
   while (p != end && xml_isspace (*p))
     ++p;
 
+  if (parse_markup_fast (markup_text, length, accel_marker,
+                         attr_list, text, accel_char))
+    return TRUE;
+
   context = pango_markup_parser_new_internal (accel_marker,
                                               error,
                                               (attr_list != NULL));
@@ -678,6 +1079,169 @@ pango_parse_markup (const char                 *markup_text,
   return ret;
 }
 
+/* Widgets tend to set the same markup on their layouts over
+ * and over, e.g. whenever their state changes. The context
+ * keeps the results of the last few parses, so that those
+ * don't need to be parsed again. Long markup is not cached,
+ * to keep the memory use bounded.
+ */
+#define MARKUP_CACHE_SIZE 8
+#define MARKUP_CACHE_MAX_LENGTH 4096
+
+typedef struct _MarkupCacheEntry MarkupCacheEntry;
+
+struct _MarkupCacheEntry
+{
+  guint hash;
+  char *markup;
+  int length;
+  gunichar accel_marker;
+
+  char *text;
+  PangoAttrList *attr_list;
+  gunichar accel_char;
+};
+
+struct _PangoMarkupCache
+{
+  GQueue entries;
+};
+
+static void
+markup_cache_entry_free (MarkupCacheEntry *entry)
+{
+  g_free (entry->markup);
+  g_free (entry->text);
+  pango_attr_list_unref (entry->attr_list);
+  g_free (entry);
+}
+
+void
+_pango_markup_cache_free (PangoMarkupCache *cache)
+{
+  g_queue_clear_full (&cache->entries, (GDestroyNotify) markup_cache_entry_free);
+  g_free (cache);
+}
+
+static guint
+markup_hash (const char *markup,
+             int         length)
+{
+  guint h = 5381;
+  int i;
+
+  for (i = 0; i < length; i++)
+    h = (h << 5) + h + (guchar) markup[i];
+
+  return h;
+}
+
+static MarkupCacheEntry *
+markup_cache_lookup (PangoMarkupCache *cache,
+                     guint             hash,
+                     const char       *markup,
+                     int               length,
+                     gunichar          accel_marker)
+{
+  GList *l;
+
+  for (l = cache->entries.head; l; l = l->next)
+    {
+      MarkupCacheEntry *entry = l->data;
+
+      if (entry->hash != hash ||
+          entry->length != length ||
+          entry->accel_marker != accel_marker ||
+          memcmp (entry->markup, markup, length) != 0)
+        continue;
+
+      if (l != cache->entries.head)
+        {
+          g_queue_unlink (&cache->entries, l);
+          g_queue_push_head_link (&cache->entries, l);
+        }
+
+      return entry;
+    }
+
+  return NULL;
+}
+
+/* Like pango_parse_markup(), but looks in the markup cache
+ * of @context first. The returned attribute list is a copy,
+ * so callers are free to modify it.
+ */
+gboolean
+_pango_context_parse_markup (PangoContext   *context,
+                             const char     *markup_text,
+                             int             length,
+                             gunichar        accel_marker,
+                             PangoAttrList **attr_list,
+                             char          **text,
+                             gunichar       *accel_char,
+                             GError        **error)
+{
+  PangoMarkupCache *cache;
+  MarkupCacheEntry *entry;
+  guint hash;
+
+  g_return_val_if_fail (markup_text != NULL, FALSE);
+
+  if (length < 0)
+    length = strlen (markup_text);
+
+  if (context == NULL || length > MARKUP_CACHE_MAX_LENGTH)
+    return pango_parse_markup (markup_text, length, accel_marker,
+                               attr_list, text, accel_char, error);
+
+  hash = markup_hash (markup_text, length);
+
+  cache = context->markup_cache;
+  if (cache)
+    {
+      entry = markup_cache_lookup (cache, hash, markup_text, length, accel_marker);
+      if (entry)
+        goto done;
+    }
+
+  entry = g_new0 (MarkupCacheEntry, 1);
+  if (!pango_parse_markup (markup_text, length, accel_marker,
+                           &entry->attr_list, &entry->text, &entry->accel_char,
+                           error))
+    {
+      g_free (entry);
+      return FALSE;
+    }
+
+  entry->hash = hash;
+  entry->markup = g_strndup (markup_text, length);
+  entry->length = length;
+  entry->accel_marker = accel_marker;
+
+  if (!cache)
+    {
+      cache = context->markup_cache = g_new0 (PangoMarkupCache, 1);
+      g_queue_init (&cache->entries);
+    }
+
+  g_queue_push_head (&cache->entries, entry);
+
+  if (cache->entries.length > MARKUP_CACHE_SIZE)
+    markup_cache_entry_free (g_queue_pop_tail (&cache->entries));
+
+done:
+  if (attr_list)
+    *attr_list = pango_attr_list_copy (entry->attr_list);
+
+  if (text)
+    *text = g_strdup (entry->text);
+
+  if (accel_char)
+    *accel_char = entry->accel_char;
+
+  return TRUE;
+}
+
 /**
  * pango_markup_parser_new:
  * @accel_marker: character that precedes an accelerator, or 0 for none
@@ -744,7 +1308,6 @@ pango_markup_parser_finish (GMarkupParseContext   *context,
 {
   gboolean ret = FALSE;
   MarkupData *md = g_markup_parse_context_get_user_data (context);
-  GSList *tmp_list;
 
   if (!g_markup_parse_context_parse (context,
                                      "</markup>",
@@ -755,41 +1318,7 @@ pango_markup_parser_finish (GMarkupParseContext   *context,
   if (!g_markup_parse_context_end_parse (context, error))
     goto out;
 
-  if (md->attr_list)
-    {
-      /* The apply list has the most-recently-closed tags first;
-       * we want to apply the least-recently-closed tag last.
-       */
-      tmp_list = md->to_apply;
-      while (tmp_list != NULL)
-	{
-	  PangoAttribute *attr = tmp_list->data;
-
-	  /* Innermost tags before outermost */
-	  pango_attr_list_insert (md->attr_list, attr);
-
-	  tmp_list = g_slist_next (tmp_list);
-	}
-      g_slist_free (md->to_apply);
-      md->to_apply = NULL;
-    }
-
-  if (attr_list)
-    {
-      *attr_list = md->attr_list;
-      md->attr_list = NULL;
-    }
-
-  if (text)
-    {
-      *text = g_string_free (md->text, FALSE);
-      md->text = NULL;
-    }
-
-  if (accel_char)
-    *accel_char = md->accel_char;
-
-  g_assert (md->tag_stack == NULL);
+  markup_data_finish (md, attr_list, text, accel_char);
   ret = TRUE;
 
  out:
@@ -804,8 +1333,7 @@ set_bad_attribute (GError             **error,
 {
   gint line_number, char_number;
 
-  g_markup_parse_context_get_position (context,
-				       &line_number, &char_number);
+  get_position (context, &line_number, &char_number);
 
   g_set_error (error,
 	       G_MARKUP_ERROR,
@@ -1235,8 +1763,7 @@ span_parse_func     (MarkupData            *md G_GNUC_UNUSED,
   const char *segment = NULL;
   const char *font_scale = NULL;
 
-  g_markup_parse_context_get_position (context,
-				       &line_number, &char_number);
+  get_position (context, &line_number, &char_number);
 
 #define CHECK_DUPLICATE(var) G_STMT_START{                              \
 	  if ((var) != NULL) {                                          \
@@ -214,6 +214,7 @@ pango_ot_buffer_output (const PangoOTBuffer *buffer,
       glyphs->glyphs[i].glyph = hb_glyph->codepoint;
       glyphs->log_clusters[i] = hb_glyph->cluster;
       glyphs->glyphs[i].attr.is_cluster_start = glyphs->log_clusters[i] != last_cluster;
+      glyphs->glyphs[i].attr.is_unsafe_to_break = FALSE;
       last_cluster = glyphs->log_clusters[i];
 
       glyphs->glyphs[i].geometry.width = hb_position->x_advance;
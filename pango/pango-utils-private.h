@@ -60,6 +60,27 @@ void pango_log2vis_fill_embedding_levels (const char     *text,
                                           guint8         *embedding_levels,
                                           PangoDirection *pbase_dir);
 
+/* A run of characters with the same embedding level */
+typedef struct
+{
+  unsigned int length; /* in characters */
+  guint8 level;
+} PangoBidiRun;
+
+const PangoBidiRun * pango_log2vis_get_runs (const gunichar *chars,
+                                             const guint32  *bidi_types,
+                                             unsigned int    n_chars,
+                                             guint32         ored_types,
+                                             guint32         anded_strongs,
+                                             PangoDirection *pbase_dir,
+                                             unsigned int   *n_runs);
+
+const PangoBidiRun * pango_log2vis_get_runs_for_text (const char     *text,
+                                                      int             length,
+                                                      unsigned int    n_chars,
+                                                      PangoDirection *pbase_dir,
+                                                      unsigned int   *n_runs);
+
 
 G_END_DECLS
 
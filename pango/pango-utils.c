@@ -1102,6 +1102,7 @@ _pango_shape_shape (const char       *text,
       glyphs->glyphs[i].geometry.y_offset = 0;
       glyphs->glyphs[i].geometry.width = shape_logical->width;
       glyphs->glyphs[i].attr.is_cluster_start = 1;
+      glyphs->glyphs[i].attr.is_unsafe_to_break = 0;
 
       glyphs->log_clusters[i] = p - text;
     }
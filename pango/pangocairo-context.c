@@ -199,7 +199,13 @@ pango_cairo_context_set_resolution (PangoContext *context,
 				    double        dpi)
 {
   PangoCairoContextInfo *info = get_context_info (context, TRUE);
+
+  if (info->dpi == dpi)
+    return;
+
+  /* The resolution is part of the fontset lookups */
   info->dpi = dpi;
+  pango_context_changed (context);
 }
 
 /**
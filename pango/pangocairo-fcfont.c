@@ -133,6 +133,45 @@ pango_cairo_fc_font_get_glyph_extents (PangoFont      *font,
 					       logical_rect);
 }
 
+/* The metrics are cached per language on the font. If the
+ * fontmap is shared between threads, we hold its lock while
+ * looking them up and adding them, but not while computing
+ * them, since that needs a layout.
+ */
+static PangoFontMetrics *
+pango_cairo_fc_font_get_metrics (PangoFont     *font,
+                                 PangoLanguage *language)
+{
+  PangoFcFontMap *fontmap = (PangoFcFontMap *) PANGO_FC_FONT (font)->fontmap;
+  PangoFontMetrics *metrics;
+  gboolean cacheable;
+
+  if (fontmap)
+    _pango_fc_font_map_lock (fontmap);
+
+  metrics = _pango_cairo_font_lookup_metrics (font, language);
+
+  if (fontmap)
+    _pango_fc_font_map_unlock (fontmap);
+
+  if (metrics)
+    return metrics;
+
+  metrics = _pango_cairo_font_create_metrics (font, language, &cacheable);
+  if (!cacheable)
+    return metrics;
+
+  if (fontmap)
+    _pango_fc_font_map_lock (fontmap);
+
+  metrics = _pango_cairo_font_add_metrics (font, language, metrics);
+
+  if (fontmap)
+    _pango_fc_font_map_unlock (fontmap);
+
+  return metrics;
+}
+
 static FT_Face
 pango_cairo_fc_font_lock_face (PangoFcFont *font)
 {
@@ -167,7 +206,7 @@ pango_cairo_fc_font_class_init (PangoCairoFcFontClass *class)
   object_class->finalize = pango_cairo_fc_font_finalize;
 
   font_class->get_glyph_extents = pango_cairo_fc_font_get_glyph_extents;
-  font_class->get_metrics = _pango_cairo_font_get_metrics;
+  font_class->get_metrics = pango_cairo_fc_font_get_metrics;
 
   fc_font_class->lock_face = pango_cairo_fc_font_lock_face;
   fc_font_class->unlock_face = pango_cairo_fc_font_unlock_face;
@@ -274,6 +313,7 @@ _pango_cairo_fc_font_new (PangoCairoFcFontMap *cffontmap,
 					options,
 					pango_fc_font_key_get_matrix (key),
 					&font_matrix);
+  cffont->cf_priv.thread_safe = _pango_fc_font_map_is_thread_safe (PANGO_FC_FONT_MAP (cffontmap));
 
   ((PangoFcFont *)(cffont))->is_hinted = _pango_cairo_font_private_is_metrics_hinted (&cffont->cf_priv);
 
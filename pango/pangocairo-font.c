@@ -39,6 +39,8 @@ G_DEFINE_INTERFACE (PangoCairoFont, pango_cairo_font, PANGO_TYPE_FONT)
 static PangoCairoFontHexBoxInfo *
 _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv);
 static void
+_pango_cairo_font_hex_box_info_destroy (PangoCairoFontHexBoxInfo *hbi);
+static void
 _pango_cairo_font_private_get_glyph_extents_missing (PangoCairoFontPrivate *cf_priv,
 						     PangoGlyph             glyph,
 						     PangoRectangle        *ink_rect,
@@ -50,6 +52,20 @@ pango_cairo_font_default_init (PangoCairoFontIface *iface)
 }
 
 
+static inline void
+pango_cairo_font_private_lock (PangoCairoFontPrivate *cf_priv)
+{
+  if (cf_priv->thread_safe)
+    g_mutex_lock (&cf_priv->mutex);
+}
+
+static inline void
+pango_cairo_font_private_unlock (PangoCairoFontPrivate *cf_priv)
+{
+  if (cf_priv->thread_safe)
+    g_mutex_unlock (&cf_priv->mutex);
+}
+
 static PangoCairoFontPrivateScaledFontData *
 _pango_cairo_font_private_scaled_font_data_create (void)
 {
@@ -105,6 +121,8 @@ pango_cairo_hex_box_encode_glyph (PangoCairoFontPrivate *cf_priv,
   if (!(glyph & PANGO_GLYPH_UNKNOWN_FLAG))
     return glyph;
 
+  pango_cairo_font_private_lock (cf_priv);
+
   if (!cf_priv->hex_box_glyphs)
     {
       cf_priv->hex_box_glyph_base = 1;
@@ -113,17 +131,22 @@ pango_cairo_hex_box_encode_glyph (PangoCairoFontPrivate *cf_priv,
     }
 
   value = g_hash_table_lookup (cf_priv->hex_box_glyphs, GUINT_TO_POINTER (glyph));
-  if (value)
-    return GPOINTER_TO_UINT (value);
+  if (!value)
+    {
+      if (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len > 0xFFFF)
+        {
+          pango_cairo_font_private_unlock (cf_priv);
+          return glyph;
+        }
 
-  if (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len > 0xFFFF)
-    return glyph;
+      value = GUINT_TO_POINTER (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len);
+      g_hash_table_insert (cf_priv->hex_box_glyphs,
+                           GUINT_TO_POINTER (glyph),
+                           value);
+      g_array_append_val (cf_priv->hex_box_pango_glyphs, glyph);
+    }
 
-  value = GUINT_TO_POINTER (cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len);
-  g_hash_table_insert (cf_priv->hex_box_glyphs,
-                       GUINT_TO_POINTER (glyph),
-                       value);
-  g_array_append_val (cf_priv->hex_box_pango_glyphs, glyph);
+  pango_cairo_font_private_unlock (cf_priv);
 
   return GPOINTER_TO_UINT (value);
 }
@@ -132,14 +155,20 @@ static PangoGlyph
 pango_cairo_hex_box_decode_glyph (PangoCairoFontPrivate *cf_priv,
                                   unsigned long          glyph)
 {
+  PangoGlyph result = glyph;
+
+  pango_cairo_font_private_lock (cf_priv);
+
   if (cf_priv->hex_box_pango_glyphs &&
       glyph >= cf_priv->hex_box_glyph_base &&
       glyph < cf_priv->hex_box_glyph_base + cf_priv->hex_box_pango_glyphs->len)
-    return g_array_index (cf_priv->hex_box_pango_glyphs,
-                          PangoGlyph,
-                          glyph - cf_priv->hex_box_glyph_base);
+    result = g_array_index (cf_priv->hex_box_pango_glyphs,
+                            PangoGlyph,
+                            glyph - cf_priv->hex_box_glyph_base);
+
+  pango_cairo_font_private_unlock (cf_priv);
 
-  return glyph;
+  return result;
 }
 
 static void
@@ -464,9 +493,11 @@ cairo_scaled_font_t *
 _pango_cairo_font_private_get_scaled_font (PangoCairoFontPrivate *cf_priv)
 {
   cairo_font_face_t *font_face;
+  cairo_scaled_font_t *scaled_font = NULL;
 
-  if (G_LIKELY (cf_priv->scaled_font))
-    return cf_priv->scaled_font;
+  scaled_font = g_atomic_pointer_get (&cf_priv->scaled_font);
+  if (G_LIKELY (scaled_font))
+    return scaled_font;
 
   /* need to create it */
 
@@ -480,18 +511,24 @@ _pango_cairo_font_private_get_scaled_font (PangoCairoFontPrivate *cf_priv)
   if (G_UNLIKELY (font_face == NULL))
     goto done;
 
-  cf_priv->scaled_font = cairo_scaled_font_create (font_face,
-						   &cf_priv->data->font_matrix,
-						   &cf_priv->data->ctm,
-						   cf_priv->data->options);
+  scaled_font = cairo_scaled_font_create (font_face,
+                                          &cf_priv->data->font_matrix,
+                                          &cf_priv->data->ctm,
+                                          cf_priv->data->options);
 
   cairo_font_face_destroy (font_face);
 
+  /* Another thread may have been faster */
+  if (!g_atomic_pointer_compare_and_exchange (&cf_priv->scaled_font, NULL, scaled_font))
+    {
+      cairo_scaled_font_destroy (scaled_font);
+      return g_atomic_pointer_get (&cf_priv->scaled_font);
+    }
+
 done:
 
-  if (G_UNLIKELY (cf_priv->scaled_font == NULL || cairo_scaled_font_status (cf_priv->scaled_font) != CAIRO_STATUS_SUCCESS))
+  if (G_UNLIKELY (scaled_font == NULL || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
     {
-      cairo_scaled_font_t *scaled_font = cf_priv->scaled_font;
       PangoFont *font = PANGO_FONT (cf_priv->cfont);
       static GQuark warned_quark = 0; /* MT-safe */
       if (!warned_quark)
@@ -529,10 +566,16 @@ done:
 	}
     }
 
-  _pango_cairo_font_private_scaled_font_data_destroy (cf_priv->data);
-  cf_priv->data = NULL;
+  /* Other threads may still be using the data to create the
+   * scaled font, so keep it around until the font is finalized
+   */
+  if (!cf_priv->thread_safe)
+    {
+      _pango_cairo_font_private_scaled_font_data_destroy (cf_priv->data);
+      cf_priv->data = NULL;
+    }
 
-  return cf_priv->scaled_font;
+  return scaled_font;
 }
 
 cairo_scaled_font_t *
@@ -544,12 +587,14 @@ _pango_cairo_font_get_hex_box_scaled_font (PangoCairoFont *cfont)
   cairo_font_options_t *font_options;
   cairo_matrix_t ctm, font_matrix;
   PangoCairoHexBoxFontUserData *user_data;
+  cairo_scaled_font_t *scaled_font;
 
   if (G_UNLIKELY (!cf_priv))
     return NULL;
 
-  if (cf_priv->hex_box_scaled_font)
-    return cf_priv->hex_box_scaled_font;
+  scaled_font = g_atomic_pointer_get (&cf_priv->hex_box_scaled_font);
+  if (scaled_font)
+    return scaled_font;
 
   native_scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
   if (G_UNLIKELY (!native_scaled_font || cairo_scaled_font_status (native_scaled_font) != CAIRO_STATUS_SUCCESS))
@@ -581,25 +626,30 @@ _pango_cairo_font_get_hex_box_scaled_font (PangoCairoFont *cfont)
   font_options = cairo_font_options_create ();
   cairo_scaled_font_get_font_options (native_scaled_font, font_options);
 
-  cf_priv->hex_box_scaled_font = cairo_scaled_font_create (font_face,
-                                                           &font_matrix,
-                                                           &ctm,
-                                                           font_options);
+  scaled_font = cairo_scaled_font_create (font_face,
+                                          &font_matrix,
+                                          &ctm,
+                                          font_options);
 
   cairo_font_options_destroy (font_options);
   cairo_font_face_destroy (font_face);
 
-  if (G_UNLIKELY (!cf_priv->hex_box_scaled_font ||
-                  cairo_scaled_font_status (cf_priv->hex_box_scaled_font) != CAIRO_STATUS_SUCCESS))
+  if (G_UNLIKELY (!scaled_font ||
+                  cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
     {
-      cairo_scaled_font_t *scaled_font = cf_priv->hex_box_scaled_font;
-
-      cf_priv->hex_box_scaled_font = NULL;
       if (scaled_font)
         cairo_scaled_font_destroy (scaled_font);
+      return NULL;
+    }
+
+  /* Another thread may have been faster */
+  if (!g_atomic_pointer_compare_and_exchange (&cf_priv->hex_box_scaled_font, NULL, scaled_font))
+    {
+      cairo_scaled_font_destroy (scaled_font);
+      scaled_font = g_atomic_pointer_get (&cf_priv->hex_box_scaled_font);
     }
 
-  return cf_priv->hex_box_scaled_font;
+  return scaled_font;
 }
 
 unsigned long
@@ -709,128 +759,206 @@ typedef struct _PangoCairoFontMetricsInfo
   PangoFontMetrics *metrics;
 } PangoCairoFontMetricsInfo;
 
-PangoFontMetrics *
-_pango_cairo_font_get_metrics (PangoFont     *font,
-			       PangoLanguage *language)
+static PangoCairoFontMetricsInfo *
+find_metrics_info (PangoCairoFontPrivate *cf_priv,
+                   const char            *sample_str)
 {
-  PangoCairoFont *cfont = (PangoCairoFont *) font;
-  PangoCairoFontPrivate *cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
-  PangoCairoFontMetricsInfo *info = NULL; /* Quiet gcc */
   GSList *tmp_list;
-  static int in_get_metrics;
-
-  const char *sample_str = pango_language_get_sample_string (language);
 
-  tmp_list = cf_priv->metrics_by_lang;
-  while (tmp_list)
+  for (tmp_list = cf_priv->metrics_by_lang; tmp_list; tmp_list = tmp_list->next)
     {
-      info = tmp_list->data;
+      PangoCairoFontMetricsInfo *info = tmp_list->data;
 
       if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
-	break;
-
-      tmp_list = tmp_list->next;
+        return info;
     }
 
-  if (!tmp_list)
-    {
-      PangoFontMap *fontmap;
-      PangoContext *context;
-      cairo_font_options_t *font_options;
-      PangoLayout *layout;
-      PangoRectangle extents;
-      PangoFontDescription *desc;
-      cairo_scaled_font_t *scaled_font;
-      glong sample_str_width;
+  return NULL;
+}
 
-      int height, shift;
+/* Getting the metrics is split in three steps, so that
+ * fonts that are shared between threads can look up and
+ * add metrics under a lock, but compute them outside of it:
+ * computing them may need a PangoLayout.
+ */
 
-      /* XXX this is racy.  need a ref'ing getter... */
-      fontmap = pango_font_get_font_map (font);
-      if (!fontmap)
-        return pango_font_metrics_new ();
-      fontmap = g_object_ref (fontmap);
+/* Returns the cached metrics for @language, or %NULL */
+PangoFontMetrics *
+_pango_cairo_font_lookup_metrics (PangoFont     *font,
+                                  PangoLanguage *language)
+{
+  PangoCairoFontPrivate *cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
+  PangoCairoFontMetricsInfo *info;
 
-      info = g_slice_new0 (PangoCairoFontMetricsInfo);
+  info = find_metrics_info (cf_priv, pango_language_get_sample_string (language));
+  if (info)
+    return pango_font_metrics_ref (info->metrics);
 
-      cf_priv->metrics_by_lang = g_slist_prepend (cf_priv->metrics_by_lang, info);
+  return NULL;
+}
 
-      info->sample_str = sample_str;
+/* Computes the metrics for @language, without looking at
+ * the cache. @cacheable is set to %FALSE if the result
+ * should not be added to the cache.
+ */
+PangoFontMetrics *
+_pango_cairo_font_create_metrics (PangoFont     *font,
+                                  PangoLanguage *language,
+                                  gboolean      *cacheable)
+{
+  PangoCairoFont *cfont = (PangoCairoFont *) font;
+  PangoCairoFontPrivate *cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
+  static GPrivate in_get_metrics;
+  const char *sample_str = pango_language_get_sample_string (language);
+  PangoFontMetrics *metrics;
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  cairo_font_options_t *font_options;
+  PangoLayout *layout;
+  PangoRectangle extents;
+  PangoFontDescription *desc;
+  cairo_scaled_font_t *scaled_font;
+  glong sample_str_width;
+  int height, shift;
 
-      scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
+  /* XXX this is racy.  need a ref'ing getter... */
+  fontmap = pango_font_get_font_map (font);
+  if (!fontmap)
+    {
+      *cacheable = FALSE;
+      return pango_font_metrics_new ();
+    }
+  fontmap = g_object_ref (fontmap);
 
-      context = pango_font_map_create_context (fontmap);
-      pango_context_set_language (context, language);
+  /* When we get here again while measuring with a PangoLayout
+   * below, the approximate widths are left out. Don't cache
+   * those metrics, the outer call will add the complete ones.
+   */
+  *cacheable = !g_private_get (&in_get_metrics);
 
-      font_options = cairo_font_options_create ();
-      cairo_scaled_font_get_font_options (scaled_font, font_options);
-      pango_cairo_context_set_font_options (context, font_options);
-      cairo_font_options_destroy (font_options);
+  scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
 
-      info->metrics = (* PANGO_CAIRO_FONT_GET_IFACE (font)->create_base_metrics_for_context) (cfont, context);
+  context = pango_font_map_create_context (fontmap);
+  pango_context_set_language (context, language);
 
-      /* Ugly. We need to prevent recursion when we call into
-       * PangoLayout to determine approximate char width.
-       */
-      if (!in_get_metrics)
-        {
-          in_get_metrics = 1;
+  font_options = cairo_font_options_create ();
+  cairo_scaled_font_get_font_options (scaled_font, font_options);
+  pango_cairo_context_set_font_options (context, font_options);
+  cairo_font_options_destroy (font_options);
 
-          /* Update approximate_*_width now */
-          layout = pango_layout_new (context);
-          desc = pango_font_describe_with_absolute_size (font);
-          pango_layout_set_font_description (layout, desc);
-          pango_font_description_free (desc);
+  metrics = (* PANGO_CAIRO_FONT_GET_IFACE (font)->create_base_metrics_for_context) (cfont, context);
 
-          pango_layout_set_text (layout, sample_str, -1);
-          pango_layout_get_extents (layout, NULL, &extents);
+  /* Backends may have computed the approximate widths
+   * already. If not, measure them with a PangoLayout.
+   * Ugly. We need to prevent recursion when we call into
+   * PangoLayout to determine approximate char width.
+   */
+  if (metrics->approximate_char_width == 0 &&
+      !g_private_get (&in_get_metrics))
+    {
+      g_private_set (&in_get_metrics, GINT_TO_POINTER (1));
 
-          sample_str_width = pango_utf8_strwidth (sample_str);
-          g_assert (sample_str_width > 0);
-          info->metrics->approximate_char_width = extents.width / sample_str_width;
+      /* Update approximate_*_width now */
+      layout = pango_layout_new (context);
+      desc = pango_font_describe_with_absolute_size (font);
+      pango_layout_set_font_description (layout, desc);
+      pango_font_description_free (desc);
 
-          pango_layout_set_text (layout, "0123456789", -1);
-          info->metrics->approximate_digit_width = max_glyph_width (layout);
+      pango_layout_set_text (layout, sample_str, -1);
+      pango_layout_get_extents (layout, NULL, &extents);
 
-          g_object_unref (layout);
-          in_get_metrics = 0;
+      sample_str_width = pango_utf8_strwidth (sample_str);
+      g_assert (sample_str_width > 0);
+      metrics->approximate_char_width = extents.width / sample_str_width;
+
+      pango_layout_set_text (layout, "0123456789", -1);
+      metrics->approximate_digit_width = max_glyph_width (layout);
+
+      g_object_unref (layout);
+      g_private_set (&in_get_metrics, NULL);
+    }
+
+  /* We may actually reuse ascent/descent we got from cairo here.  that's
+   * in cf_priv->font_extents.
+   */
+  height = metrics->ascent + metrics->descent;
+  switch (cf_priv->gravity)
+    {
+      default:
+      case PANGO_GRAVITY_AUTO:
+      case PANGO_GRAVITY_SOUTH:
+        break;
+      case PANGO_GRAVITY_NORTH:
+        metrics->ascent = metrics->descent;
+        break;
+      case PANGO_GRAVITY_EAST:
+      case PANGO_GRAVITY_WEST:
+        {
+          int ascent = height / 2;
+          if (cf_priv->is_hinted)
+            ascent = PANGO_UNITS_ROUND (ascent);
+          metrics->ascent = ascent;
         }
+    }
+  shift = (height - metrics->ascent) - metrics->descent;
+  metrics->descent += shift;
+  metrics->underline_position -= shift;
+  metrics->strikethrough_position -= shift;
+  metrics->ascent = height - metrics->descent;
 
-      /* We may actually reuse ascent/descent we got from cairo here.  that's
-       * in cf_priv->font_extents.
-       */
-      height = info->metrics->ascent + info->metrics->descent;
-      switch (cf_priv->gravity)
-	{
-	  default:
-	  case PANGO_GRAVITY_AUTO:
-	  case PANGO_GRAVITY_SOUTH:
-	    break;
-	  case PANGO_GRAVITY_NORTH:
-	    info->metrics->ascent = info->metrics->descent;
-	    break;
-	  case PANGO_GRAVITY_EAST:
-	  case PANGO_GRAVITY_WEST:
-	    {
-	      int ascent = height / 2;
-	      if (cf_priv->is_hinted)
-	        ascent = PANGO_UNITS_ROUND (ascent);
-	      info->metrics->ascent = ascent;
-	    }
-	}
-      shift = (height - info->metrics->ascent) - info->metrics->descent;
-      info->metrics->descent += shift;
-      info->metrics->underline_position -= shift;
-      info->metrics->strikethrough_position -= shift;
-      info->metrics->ascent = height - info->metrics->descent;
-
-      g_object_unref (context);
-      g_object_unref (fontmap);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+
+  return metrics;
+}
+
+/* Adds @metrics, which were computed by _pango_cairo_font_create_metrics(),
+ * to the cache, unless metrics for @language have been added in the meantime.
+ * Takes ownership of @metrics, and returns the cached metrics.
+ */
+PangoFontMetrics *
+_pango_cairo_font_add_metrics (PangoFont        *font,
+                               PangoLanguage    *language,
+                               PangoFontMetrics *metrics)
+{
+  PangoCairoFontPrivate *cf_priv = PANGO_CAIRO_FONT_PRIVATE (font);
+  const char *sample_str = pango_language_get_sample_string (language);
+  PangoCairoFontMetricsInfo *info;
+
+  info = find_metrics_info (cf_priv, sample_str);
+  if (info)
+    {
+      pango_font_metrics_unref (metrics);
+      return pango_font_metrics_ref (info->metrics);
     }
 
+  info = g_slice_new0 (PangoCairoFontMetricsInfo);
+  info->sample_str = sample_str;
+  info->metrics = metrics;
+
+  cf_priv->metrics_by_lang = g_slist_prepend (cf_priv->metrics_by_lang, info);
+
   return pango_font_metrics_ref (info->metrics);
 }
 
+PangoFontMetrics *
+_pango_cairo_font_get_metrics (PangoFont     *font,
+			       PangoLanguage *language)
+{
+  PangoFontMetrics *metrics;
+  gboolean cacheable;
+
+  metrics = _pango_cairo_font_lookup_metrics (font, language);
+  if (metrics)
+    return metrics;
+
+  metrics = _pango_cairo_font_create_metrics (font, language, &cacheable);
+  if (!cacheable)
+    return metrics;
+
+  return _pango_cairo_font_add_metrics (font, language, metrics);
+}
+
 static PangoCairoFontHexBoxInfo *
 _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv)
 {
@@ -860,8 +988,9 @@ _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv)
   if (!cf_priv)
     return NULL;
 
-  if (cf_priv->hbi)
-    return cf_priv->hbi;
+  hbi = g_atomic_pointer_get (&cf_priv->hbi);
+  if (hbi)
+    return hbi;
 
   scaled_font = _pango_cairo_font_private_get_scaled_font (cf_priv);
   if (G_UNLIKELY (scaled_font == NULL || cairo_scaled_font_status (scaled_font) != CAIRO_STATUS_SUCCESS))
@@ -1028,7 +1157,13 @@ _pango_cairo_font_private_get_hex_box_info (PangoCairoFontPrivate *cf_priv)
        hbi->box_descent = HINT_Y (hbi->box_descent);
     }
 
-  cf_priv->hbi = hbi;
+  /* Another thread may have been faster */
+  if (!g_atomic_pointer_compare_and_exchange (&cf_priv->hbi, NULL, hbi))
+    {
+      _pango_cairo_font_hex_box_info_destroy (hbi);
+      hbi = g_atomic_pointer_get (&cf_priv->hbi);
+    }
+
   return hbi;
 }
 
@@ -1096,6 +1231,9 @@ _pango_cairo_font_private_initialize (PangoCairoFontPrivate      *cf_priv,
   cf_priv->hex_box_glyph_base = 0;
   cf_priv->glyph_extents_cache = NULL;
   cf_priv->metrics_by_lang = NULL;
+
+  cf_priv->thread_safe = FALSE;
+  g_mutex_init (&cf_priv->mutex);
 }
 
 static void
@@ -1137,6 +1275,8 @@ _pango_cairo_font_private_finalize (PangoCairoFontPrivate *cf_priv)
   g_slist_foreach (cf_priv->metrics_by_lang, (GFunc)free_metrics_info, NULL);
   g_slist_free (cf_priv->metrics_by_lang);
   cf_priv->metrics_by_lang = NULL;
+
+  g_mutex_clear (&cf_priv->mutex);
 }
 
 gboolean
@@ -1149,8 +1289,10 @@ void
 pango_cairo_font_private_get_font_options (PangoCairoFontPrivate *cf_priv,
                                            cairo_font_options_t  *options)
 {
-  if (cf_priv->scaled_font)
-    cairo_scaled_font_get_font_options (cf_priv->scaled_font, options);
+  cairo_scaled_font_t *scaled_font = g_atomic_pointer_get (&cf_priv->scaled_font);
+
+  if (scaled_font)
+    cairo_scaled_font_get_font_options (scaled_font, options);
   else if (cf_priv->data)
     cairo_font_options_merge (options, cf_priv->data->options);
 }
@@ -1251,60 +1393,73 @@ static gboolean
 _pango_cairo_font_private_glyph_extents_cache_init (PangoCairoFontPrivate *cf_priv)
 {
   hb_font_extents_t extents;
+  PangoRectangle font_extents;
+  PangoCairoFontGlyphExtentsCacheEntry *cache;
 
   hb_font_get_h_extents (pango_font_get_hb_font (PANGO_FONT (cf_priv->cfont)),
                          &extents);
 
-  cf_priv->font_extents.x = 0;
-  cf_priv->font_extents.width = 0;
-  cf_priv->font_extents.height = extents.ascender - extents.descender;
+  font_extents.x = 0;
+  font_extents.width = 0;
+  font_extents.height = extents.ascender - extents.descender;
 
   switch (cf_priv->gravity)
     {
       default:
       case PANGO_GRAVITY_AUTO:
       case PANGO_GRAVITY_SOUTH:
-        cf_priv->font_extents.y = - extents.ascender;
+        font_extents.y = - extents.ascender;
         break;
       case PANGO_GRAVITY_NORTH:
-        cf_priv->font_extents.y = extents.descender;
+        font_extents.y = extents.descender;
         break;
       case PANGO_GRAVITY_EAST:
       case PANGO_GRAVITY_WEST:
         {
-          int ascent = cf_priv->font_extents.height / 2;
+          int ascent = font_extents.height / 2;
           if (cf_priv->is_hinted)
             ascent = PANGO_UNITS_ROUND (ascent);
-          cf_priv->font_extents.y = - ascent;
+          font_extents.y = - ascent;
         }
        break;
     }
 
   if (cf_priv->is_hinted)
     {
-      if (cf_priv->font_extents.y < 0)
-        cf_priv->font_extents.y = PANGO_UNITS_FLOOR (cf_priv->font_extents.y);
+      if (font_extents.y < 0)
+        font_extents.y = PANGO_UNITS_FLOOR (font_extents.y);
       else
-        cf_priv->font_extents.y = PANGO_UNITS_CEIL (cf_priv->font_extents.y);
-      if (cf_priv->font_extents.height < 0)
-        cf_priv->font_extents.height = PANGO_UNITS_FLOOR (extents.ascender) - PANGO_UNITS_CEIL (extents.descender);
+        font_extents.y = PANGO_UNITS_CEIL (font_extents.y);
+      if (font_extents.height < 0)
+        font_extents.height = PANGO_UNITS_FLOOR (extents.ascender) - PANGO_UNITS_CEIL (extents.descender);
       else
-        cf_priv->font_extents.height = PANGO_UNITS_CEIL (extents.ascender) - PANGO_UNITS_FLOOR (extents.descender);
+        font_extents.height = PANGO_UNITS_CEIL (extents.ascender) - PANGO_UNITS_FLOOR (extents.descender);
     }
 
   if (PANGO_GRAVITY_IS_IMPROPER (cf_priv->gravity))
     {
-      cf_priv->font_extents.y = - cf_priv->font_extents.y;
-      cf_priv->font_extents.height = - cf_priv->font_extents.height;
+      font_extents.y = - font_extents.y;
+      font_extents.height = - font_extents.height;
     }
 
+  /* The font extents must be in place before other threads
+   * can see the cache
+   */
+  pango_cairo_font_private_lock (cf_priv);
+
   if (!cf_priv->glyph_extents_cache)
     {
-      cf_priv->glyph_extents_cache = g_new0 (PangoCairoFontGlyphExtentsCacheEntry, GLYPH_CACHE_NUM_ENTRIES);
+      cf_priv->font_extents = font_extents;
+
+      cache = g_new0 (PangoCairoFontGlyphExtentsCacheEntry, GLYPH_CACHE_NUM_ENTRIES);
       /* Make sure all cache entries are invalid initially */
-      cf_priv->glyph_extents_cache[0].glyph = 1; /* glyph 1 cannot happen in bucket 0 */
+      cache[0].glyph = 1; /* glyph 1 cannot happen in bucket 0 */
+
+      g_atomic_pointer_set (&cf_priv->glyph_extents_cache, cache);
     }
 
+  pango_cairo_font_private_unlock (cf_priv);
+
   return TRUE;
 }
 
@@ -1337,9 +1492,14 @@ compute_glyph_extents (PangoCairoFontPrivate  *cf_priv,
   entry->ink_rect.height = pango_units_from_double (extents.height);
 }
 
-static PangoCairoFontGlyphExtentsCacheEntry *
-_pango_cairo_font_private_get_glyph_extents_cache_entry (PangoCairoFontPrivate  *cf_priv,
-							 PangoGlyph              glyph)
+/* Copies the cache entry for glyph to result, filling
+ * the cache first if needed. The extents are computed
+ * without holding the lock, since that calls into cairo.
+ */
+static void
+_pango_cairo_font_private_get_glyph_extents_cache_entry (PangoCairoFontPrivate                *cf_priv,
+							 PangoGlyph                            glyph,
+							 PangoCairoFontGlyphExtentsCacheEntry *result)
 {
   PangoCairoFontGlyphExtentsCacheEntry *entry;
   guint idx;
@@ -1347,12 +1507,18 @@ _pango_cairo_font_private_get_glyph_extents_cache_entry (PangoCairoFontPrivate
   idx = glyph & GLYPH_CACHE_MASK;
   entry = cf_priv->glyph_extents_cache + idx;
 
-  if (entry->glyph != glyph)
+  pango_cairo_font_private_lock (cf_priv);
+  *result = *entry;
+  pango_cairo_font_private_unlock (cf_priv);
+
+  if (result->glyph != glyph)
     {
-      compute_glyph_extents (cf_priv, glyph, entry);
-    }
+      compute_glyph_extents (cf_priv, glyph, result);
 
-  return entry;
+      pango_cairo_font_private_lock (cf_priv);
+      *entry = *result;
+      pango_cairo_font_private_unlock (cf_priv);
+    }
 }
 
 void
@@ -1361,10 +1527,10 @@ _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
 					     PangoRectangle        *ink_rect,
 					     PangoRectangle        *logical_rect)
 {
-  PangoCairoFontGlyphExtentsCacheEntry *entry;
+  PangoCairoFontGlyphExtentsCacheEntry entry;
 
   if (!cf_priv ||
-      (cf_priv->glyph_extents_cache == NULL &&
+      (g_atomic_pointer_get (&cf_priv->glyph_extents_cache) == NULL &&
        !_pango_cairo_font_private_glyph_extents_cache_init (cf_priv)))
     {
       /* Get generic unknown-glyph extents. */
@@ -1386,24 +1552,24 @@ _pango_cairo_font_private_get_glyph_extents (PangoCairoFontPrivate *cf_priv,
       return;
     }
 
-  entry = _pango_cairo_font_private_get_glyph_extents_cache_entry (cf_priv, glyph);
+  _pango_cairo_font_private_get_glyph_extents_cache_entry (cf_priv, glyph, &entry);
 
   if (ink_rect)
-    *ink_rect = entry->ink_rect;
+    *ink_rect = entry.ink_rect;
   if (logical_rect)
     {
       *logical_rect = cf_priv->font_extents;
       switch (cf_priv->gravity)
         {
         case PANGO_GRAVITY_SOUTH:
-          logical_rect->width = entry->width;
+          logical_rect->width = entry.width;
           break;
         case PANGO_GRAVITY_EAST:
           logical_rect->width = cf_priv->font_extents.height;
           logical_rect->x = - logical_rect->width;
           break;
         case PANGO_GRAVITY_NORTH:
-          logical_rect->width = entry->width;
+          logical_rect->width = entry.width;
           break;
         case PANGO_GRAVITY_WEST:
           logical_rect->width = - cf_priv->font_extents.height;
@@ -167,6 +167,10 @@ static GPrivate default_font_map = G_PRIVATE_INIT (g_object_unref); /* MT-safe *
  * Each thread gets its own default fontmap. In this way, PangoCairo
  * can be used safely from multiple threads.
  *
+ * To avoid loading the same fonts once per thread, a fontmap
+ * that was made thread-safe with [method@PangoFc.FontMap.set_thread_safe]
+ * can be shared, by making it the default in each thread.
+ *
  * Return value: (transfer none): the default PangoCairo fontmap
  *  for the current thread. This object is owned by Pango and must
  *  not be freed.
@@ -92,6 +92,14 @@ struct _PangoCairoFontPrivate
   PangoCairoFontGlyphExtentsCacheEntry *glyph_extents_cache;
 
   GSList *metrics_by_lang;
+
+  /* If the font is shared between threads, mutex protects the
+   * glyph extents cache and the hex box glyph tables. The other
+   * fields are created lazily without holding the lock, and
+   * installed atomically.
+   */
+  gboolean thread_safe;
+  GMutex mutex;
 };
 
 struct _PangoCairoFontIface
@@ -112,6 +120,14 @@ unsigned long _pango_cairo_font_encode_hex_box_glyph (PangoCairoFont *cfont,
 						      PangoGlyph      glyph);
 PangoFontMetrics * _pango_cairo_font_get_metrics (PangoFont     *font,
 						  PangoLanguage *language);
+PangoFontMetrics * _pango_cairo_font_lookup_metrics (PangoFont        *font,
+                                                     PangoLanguage    *language);
+PangoFontMetrics * _pango_cairo_font_create_metrics (PangoFont        *font,
+                                                     PangoLanguage    *language,
+                                                     gboolean         *cacheable);
+PangoFontMetrics * _pango_cairo_font_add_metrics    (PangoFont        *font,
+                                                     PangoLanguage    *language,
+                                                     PangoFontMetrics *metrics);
 PangoCairoFontHexBoxInfo *_pango_cairo_font_get_hex_box_info (PangoCairoFont *cfont);
 
 void _pango_cairo_font_private_initialize (PangoCairoFontPrivate      *cf_priv,
@@ -0,0 +1,177 @@
+/* Pango
+ * pangofc-facecache.c: Process-wide cache of HarfBuzz faces
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "pangofc-private.h"
+
+/* Every fontmap keeps the hb_face_t of the font files it uses
+ * with its face data. To avoid reading and parsing the same
+ * files once per fontmap, the faces are shared between all
+ * fontmaps of the process through this cache.
+ *
+ * Faces are keyed on the filename, the index of the face in
+ * the file and the modification time of the file, so that a
+ * font file that is replaced gets a new face. The blobs are
+ * created with hb_blob_create_from_file(), which maps the file
+ * read-only, so the font tables are also shared with other
+ * processes that use the same files.
+ *
+ * Entries are refcounted separately from the faces. When the
+ * last fontmap releases a face, the entry is removed, while
+ * hb_font_t objects that still reference the face keep it alive.
+ */
+
+typedef struct
+{
+  char *filename;
+  unsigned int index;
+  gint64 mtime;
+
+  hb_face_t *hb_face;
+  int ref_count;
+} FaceCacheEntry;
+
+static GMutex face_cache_lock;
+static GHashTable *face_cache;
+static hb_user_data_key_t face_cache_key;
+
+static guint
+face_cache_entry_hash (gconstpointer data)
+{
+  const FaceCacheEntry *entry = data;
+
+  return g_str_hash (entry->filename) ^ entry->index ^ (guint) entry->mtime;
+}
+
+static gboolean
+face_cache_entry_equal (gconstpointer data1,
+                        gconstpointer data2)
+{
+  const FaceCacheEntry *entry1 = data1;
+  const FaceCacheEntry *entry2 = data2;
+
+  return entry1->index == entry2->index &&
+         entry1->mtime == entry2->mtime &&
+         strcmp (entry1->filename, entry2->filename) == 0;
+}
+
+static void
+face_cache_entry_free (gpointer data)
+{
+  FaceCacheEntry *entry = data;
+
+  hb_face_destroy (entry->hb_face);
+  g_free (entry->filename);
+  g_free (entry);
+}
+
+/*
+ * _pango_fc_face_cache_acquire:
+ * @filename: the font file
+ * @index: the index of the face in @filename
+ *
+ * Returns the shared `hb_face_t` for a face of a font file,
+ * creating it if needed. The face must be given back with
+ * _pango_fc_face_cache_release() when it is no longer needed.
+ *
+ * The face is immutable and can be used from any thread.
+ *
+ * Returns: (transfer none): the `hb_face_t`
+ */
+hb_face_t *
+_pango_fc_face_cache_acquire (const char   *filename,
+                              unsigned int  index)
+{
+  FaceCacheEntry key;
+  FaceCacheEntry *entry;
+  GStatBuf st;
+
+  key.filename = (char *) filename;
+  key.index = index;
+  key.mtime = g_stat (filename, &st) == 0 ? (gint64) st.st_mtime : 0;
+
+  g_mutex_lock (&face_cache_lock);
+
+  if (G_UNLIKELY (!face_cache))
+    face_cache = g_hash_table_new_full (face_cache_entry_hash,
+                                        face_cache_entry_equal,
+                                        NULL,
+                                        face_cache_entry_free);
+
+  entry = g_hash_table_lookup (face_cache, &key);
+  if (!entry)
+    {
+      hb_blob_t *blob;
+
+      entry = g_new0 (FaceCacheEntry, 1);
+      entry->filename = g_strdup (filename);
+      entry->index = index;
+      entry->mtime = key.mtime;
+
+      blob = hb_blob_create_from_file (filename);
+      entry->hb_face = hb_face_create (blob, index);
+      hb_blob_destroy (blob);
+
+      hb_face_set_user_data (entry->hb_face, &face_cache_key, entry, NULL, TRUE);
+
+      /* Other threads will use the face without the lock */
+      hb_face_make_immutable (entry->hb_face);
+
+      g_hash_table_add (face_cache, entry);
+    }
+
+  entry->ref_count++;
+
+  g_mutex_unlock (&face_cache_lock);
+
+  return entry->hb_face;
+}
+
+/*
+ * _pango_fc_face_cache_release:
+ * @hb_face: (nullable): a face from _pango_fc_face_cache_acquire()
+ *
+ * Gives back a face. When it has been released as often as it
+ * was acquired, it is dropped from the cache.
+ */
+void
+_pango_fc_face_cache_release (hb_face_t *hb_face)
+{
+  FaceCacheEntry *entry;
+
+  if (!hb_face)
+    return;
+
+  g_mutex_lock (&face_cache_lock);
+
+  entry = hb_face_get_user_data (hb_face, &face_cache_key);
+  g_assert (entry != NULL && entry->ref_count > 0);
+
+  entry->ref_count--;
+  if (entry->ref_count == 0)
+    g_hash_table_remove (face_cache, entry);
+
+  g_mutex_unlock (&face_cache_lock);
+}
@@ -44,6 +44,7 @@ struct _PangoFcFontPrivate
   PangoFcDecoder *decoder;
   PangoFcFontKey *key;
   PangoFontFace *face;
+  PangoLanguage **languages; /* Our copy of the face data's languages */
 };
 
 static gboolean pango_fc_font_real_has_char  (PangoFcFont *font,
@@ -51,6 +52,7 @@ static gboolean pango_fc_font_real_has_char  (PangoFcFont *font,
 static guint    pango_fc_font_real_get_glyph (PangoFcFont *font,
 					      gunichar     wc);
 
+static void                  pango_fc_font_dispose      (GObject          *object);
 static void                  pango_fc_font_finalize     (GObject          *object);
 static void                  pango_fc_font_set_property (GObject          *object,
 							 guint             prop_id,
@@ -81,6 +83,7 @@ static void                 pango_fc_font_get_matrix      (PangoFont        *fon
                                                            PangoMatrix      *matrix);
 static int                  pango_fc_font_get_absolute_size (PangoFont        *font);
 static PangoVariant         pango_fc_font_get_variant       (PangoFont        *font);
+static PangoGravity         pango_fc_font_key_get_gravity   (PangoFcFontKey   *key);
 static PangoFontFace *      pango_fc_font_get_face          (PangoFont        *font);
 
 #define PANGO_FC_FONT_LOCK_FACE(font)	(PANGO_FC_FONT_GET_CLASS (font)->lock_face (font))
@@ -100,6 +103,7 @@ pango_fc_font_class_init (PangoFcFontClass *class)
   class->get_glyph = pango_fc_font_real_get_glyph;
   class->get_unknown_glyph = NULL;
 
+  object_class->dispose = pango_fc_font_dispose;
   object_class->finalize = pango_fc_font_finalize;
   object_class->set_property = pango_fc_font_set_property;
   object_class->get_property = pango_fc_font_get_property;
@@ -160,6 +164,24 @@ free_metrics_info (PangoFcMetricsInfo *info)
   g_slice_free (PangoFcMetricsInfo, info);
 }
 
+static void
+pango_fc_font_dispose (GObject *object)
+{
+  PangoFcFont *fcfont = PANGO_FC_FONT (object);
+  PangoFontMap *fontmap = fcfont->fontmap;
+
+  /* If the fontmap is shared between threads, another thread
+   * may find this font in the font hash while we are dropping
+   * the last reference. Remove it before it gets finalized,
+   * under the fontmap lock, so that it either gets revived or
+   * can no longer be found.
+   */
+  if (fontmap && _pango_fc_font_map_is_thread_safe (PANGO_FC_FONT_MAP (fontmap)))
+    _pango_fc_font_map_remove (PANGO_FC_FONT_MAP (fontmap), fcfont);
+
+  G_OBJECT_CLASS (pango_fc_font_parent_class)->dispose (object);
+}
+
 static void
 pango_fc_font_finalize (GObject *object)
 {
@@ -184,6 +206,7 @@ pango_fc_font_finalize (GObject *object)
     _pango_fc_font_set_decoder (fcfont, NULL);
 
   g_clear_object (&priv->face);
+  g_free (priv->languages);
 
   G_OBJECT_CLASS (pango_fc_font_parent_class)->finalize (object);
 }
@@ -416,6 +439,94 @@ get_face_metrics (PangoFcFont      *fcfont,
     metrics->strikethrough_position = metrics->ascent / 2;
 }
 
+/* Sums the advances of glyphs, rounding them
+ * the same way that pango_shape() does
+ */
+static void
+get_advances (PangoFcFont    *fcfont,
+              gboolean        round,
+              hb_codepoint_t *glyphs,
+              guint           n_glyphs,
+              int            *total,
+              int            *max)
+{
+  hb_font_t *hb_font = pango_font_get_hb_font (PANGO_FONT (fcfont));
+  double x_scale_inv, y_scale_inv;
+  gboolean hint;
+  guint i;
+
+  _pango_fc_font_get_scale_factors (PANGO_FONT (fcfont), &x_scale_inv, &y_scale_inv);
+  hint = fcfont->is_hinted && (x_scale_inv != 1.0 || y_scale_inv != 1.0);
+
+  *total = 0;
+  *max = 0;
+
+  for (i = 0; i < n_glyphs; i++)
+    {
+      int advance = hb_font_get_glyph_h_advance (hb_font, glyphs[i]);
+
+      if (round && hint)
+        advance = PANGO_UNITS_ROUND ((int) (advance / x_scale_inv)) * x_scale_inv;
+      else if (round)
+        advance = PANGO_UNITS_ROUND (advance);
+
+      *total += advance;
+      *max = MAX (*max, advance);
+    }
+}
+
+/* Computes the approximate char and digit widths from the
+ * nominal glyph advances for the sample string and the digits,
+ * without shaping. This ignores kerning and ligatures. Returns
+ * FALSE if the font does not cover all of the characters, or is
+ * not upright, and a layout with fallback fonts is needed.
+ */
+static gboolean
+get_approximate_widths (PangoFcFont      *fcfont,
+                        PangoContext     *context,
+                        PangoFontMetrics *metrics)
+{
+  PangoFcFontKey *key = _pango_fc_font_get_font_key (fcfont);
+  PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (fcfont->fontmap);
+  const char *sample_str;
+  gboolean round;
+  hb_codepoint_t *glyphs;
+  guint n_glyphs;
+  int n_columns;
+  int total, max;
+  int char_width;
+
+  if (!key || !fcfontmap ||
+      pango_fc_font_key_get_gravity (key) != PANGO_GRAVITY_SOUTH)
+    return FALSE;
+
+  sample_str = pango_language_get_sample_string (pango_context_get_language (context));
+  round = pango_context_get_round_glyph_positions (context);
+
+  glyphs = _pango_fc_font_map_get_sample_glyphs (fcfontmap, fcfont, sample_str,
+                                                 &n_glyphs, &n_columns);
+  get_advances (fcfont, round, glyphs, n_glyphs, &total, &max);
+  g_free (glyphs);
+
+  if (n_columns == 0 || n_columns != pango_utf8_strwidth (sample_str))
+    return FALSE;
+
+  char_width = total / n_columns;
+
+  glyphs = _pango_fc_font_map_get_sample_glyphs (fcfontmap, fcfont, "0123456789",
+                                                 &n_glyphs, &n_columns);
+  get_advances (fcfont, round, glyphs, n_glyphs, &total, &max);
+  g_free (glyphs);
+
+  if (n_glyphs != 10)
+    return FALSE;
+
+  metrics->approximate_char_width = char_width;
+  metrics->approximate_digit_width = max;
+
+  return TRUE;
+}
+
 PangoFontMetrics *
 pango_fc_font_create_base_metrics_for_context (PangoFcFont   *fcfont,
 					       PangoContext  *context)
@@ -425,6 +536,11 @@ pango_fc_font_create_base_metrics_for_context (PangoFcFont   *fcfont,
 
   get_face_metrics (fcfont, metrics);
 
+  /* If this fails, callers fill in the approximate
+   * widths by measuring a layout
+   */
+  get_approximate_widths (fcfont, context, metrics);
+
   return metrics;
 }
 
@@ -452,85 +568,129 @@ max_glyph_width (PangoLayout *layout)
   return max_width;
 }
 
+static PangoFontMetrics *
+lookup_metrics (PangoFcFont *fcfont,
+                const char  *sample_str)
+{
+  GSList *tmp_list;
+
+  for (tmp_list = fcfont->metrics_by_lang; tmp_list; tmp_list = tmp_list->next)
+    {
+      PangoFcMetricsInfo *info = tmp_list->data;
+
+      if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
+        return pango_font_metrics_ref (info->metrics);
+    }
+
+  return NULL;
+}
+
+/* If the fontmap is shared between threads, its lock is held
+ * while looking up and adding the metrics, but not while they
+ * are computed, since that needs a PangoLayout. If another
+ * thread added them in the meantime, we use those.
+ */
 static PangoFontMetrics *
 pango_fc_font_get_metrics (PangoFont     *font,
 			   PangoLanguage *language)
 {
   PangoFcFont *fcfont = PANGO_FC_FONT (font);
-  PangoFcMetricsInfo *info = NULL; /* Quiet gcc */
-  GSList *tmp_list;
-  static int in_get_metrics;
+  PangoFcFontMap *fcfontmap;
+  PangoFontMap *fontmap;
+  PangoFontMetrics *metrics;
+  PangoFcMetricsInfo *info;
+  PangoContext *context;
+  static GPrivate in_get_metrics;
+  gboolean cacheable;
 
   const char *sample_str = pango_language_get_sample_string (language);
 
-  tmp_list = fcfont->metrics_by_lang;
-  while (tmp_list)
-    {
-      info = tmp_list->data;
+  fcfontmap = (PangoFcFontMap *) fcfont->fontmap;
+  if (!fcfontmap)
+    return pango_font_metrics_new ();
 
-      if (info->sample_str == sample_str)    /* We _don't_ need strcmp */
-	break;
+  fontmap = g_object_ref (PANGO_FONT_MAP (fcfontmap));
 
-      tmp_list = tmp_list->next;
-    }
+  _pango_fc_font_map_lock (fcfontmap);
+  metrics = lookup_metrics (fcfont, sample_str);
+  _pango_fc_font_map_unlock (fcfontmap);
 
-  if (!tmp_list)
+  if (metrics)
     {
-      PangoFontMap *fontmap;
-      PangoContext *context;
+      g_object_unref (fontmap);
+      return metrics;
+    }
 
-      fontmap = fcfont->fontmap;
-      if (!fontmap)
-	return pango_font_metrics_new ();
+  /* When we get here again while measuring with a PangoLayout
+   * below, the approximate widths are left out. Don't cache
+   * those metrics, the outer call will add the complete ones.
+   */
+  cacheable = !g_private_get (&in_get_metrics);
 
-      info = g_slice_new0 (PangoFcMetricsInfo);
+  context = pango_font_map_create_context (fontmap);
+  pango_context_set_language (context, language);
 
-      /* Note: we need to add info to the list before calling
-       * into PangoLayout below, to prevent recursion
-       */
-      fcfont->metrics_by_lang = g_slist_prepend (fcfont->metrics_by_lang,
-						 info);
+  metrics = pango_fc_font_create_base_metrics_for_context (fcfont, context);
 
-      info->sample_str = sample_str;
+  if (metrics->approximate_char_width == 0 &&
+      !g_private_get (&in_get_metrics))
+    {
+      /* Compute derived metrics */
+      PangoLayout *layout;
+      PangoRectangle extents;
+      PangoFontDescription *desc = pango_font_describe_with_absolute_size (font);
+      gulong sample_str_width;
 
-      context = pango_font_map_create_context (fontmap);
-      pango_context_set_language (context, language);
+      g_private_set (&in_get_metrics, GINT_TO_POINTER (1));
 
-      info->metrics = pango_fc_font_create_base_metrics_for_context (fcfont, context);
+      layout = pango_layout_new (context);
+      pango_layout_set_font_description (layout, desc);
+      pango_font_description_free (desc);
 
-      if (!in_get_metrics)
-        {
-          /* Compute derived metrics */
-          PangoLayout *layout;
-          PangoRectangle extents;
-          PangoFontDescription *desc = pango_font_describe_with_absolute_size (font);
-          gulong sample_str_width;
+      pango_layout_set_text (layout, sample_str, -1);
+      pango_layout_get_extents (layout, NULL, &extents);
+
+      sample_str_width = pango_utf8_strwidth (sample_str);
+      g_assert (sample_str_width > 0);
+      metrics->approximate_char_width = extents.width / sample_str_width;
+
+      pango_layout_set_text (layout, "0123456789", -1);
+      metrics->approximate_digit_width = max_glyph_width (layout);
 
-          in_get_metrics = 1;
+      g_object_unref (layout);
 
-          layout = pango_layout_new (context);
-          pango_layout_set_font_description (layout, desc);
-          pango_font_description_free (desc);
+      g_private_set (&in_get_metrics, NULL);
+    }
 
-          pango_layout_set_text (layout, sample_str, -1);
-          pango_layout_get_extents (layout, NULL, &extents);
+  g_object_unref (context);
 
-          sample_str_width = pango_utf8_strwidth (sample_str);
-          g_assert (sample_str_width > 0);
-          info->metrics->approximate_char_width = extents.width / sample_str_width;
+  if (cacheable)
+    {
+      PangoFontMetrics *cached;
 
-          pango_layout_set_text (layout, "0123456789", -1);
-          info->metrics->approximate_digit_width = max_glyph_width (layout);
+      _pango_fc_font_map_lock (fcfontmap);
 
-          g_object_unref (layout);
+      cached = lookup_metrics (fcfont, sample_str);
+      if (cached)
+        {
+          pango_font_metrics_unref (metrics);
+          metrics = cached;
+        }
+      else
+        {
+          info = g_slice_new0 (PangoFcMetricsInfo);
+          info->sample_str = sample_str;
+          info->metrics = pango_font_metrics_ref (metrics);
 
-          in_get_metrics = 0;
+          fcfont->metrics_by_lang = g_slist_prepend (fcfont->metrics_by_lang, info);
         }
 
-      g_object_unref (context);
+      _pango_fc_font_map_unlock (fcfontmap);
     }
 
-  return pango_font_metrics_ref (info->metrics);
+  g_object_unref (fontmap);
+
+  return metrics;
 }
 
 static PangoFontMap *
@@ -1077,15 +1237,33 @@ pango_fc_font_get_languages (PangoFcFont *font)
   return pango_font_get_languages (PANGO_FONT (font));
 }
 
+/* The fontmap gives us a copy of the languages, since its
+ * face data may go away. We keep it for the lifetime of the
+ * font, which is what pango_font_get_languages() promises.
+ */
 static PangoLanguage **
 _pango_fc_font_get_languages (PangoFont *font)
 {
   PangoFcFont * fcfont = PANGO_FC_FONT (font);
+  PangoFcFontPrivate *priv = fcfont->priv;
+  PangoLanguage **languages;
+
+  languages = g_atomic_pointer_get (&priv->languages);
+  if (languages)
+    return languages;
 
   if (!fcfont->fontmap)
     return NULL;
 
-  return _pango_fc_font_map_get_languages (PANGO_FC_FONT_MAP (fcfont->fontmap), fcfont);
+  languages = _pango_fc_font_map_get_languages (PANGO_FC_FONT_MAP (fcfont->fontmap), fcfont);
+
+  if (!g_atomic_pointer_compare_and_exchange (&priv->languages, NULL, languages))
+    {
+      g_free (languages);
+      languages = g_atomic_pointer_get (&priv->languages);
+    }
+
+  return languages;
 }
 
 /**
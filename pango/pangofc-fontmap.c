@@ -31,6 +31,7 @@
  * range of shapers implemented using FreeType that come with Pango.
  */
 #define FONTSET_CACHE_SIZE 256
+#define PATTERNS_PER_FONTSET 16
 
 #include "config.h"
 #include <math.h>
@@ -62,7 +63,8 @@
  * - All FcPattern's referenced by any object in the fontmap are uniquified
  *   and cached in the fontmap.  This both speeds lookups based on patterns
  *   faster, and saves memory.  This is handled by fontmap->priv->pattern_hash.
- *   The patterns are cached indefinitely.
+ *   When fontsets are evicted and there are many patterns, the ones that
+ *   no fontset and no font uses anymore are dropped.
  *
  * - The results of a FcFontSort() are used to populate fontsets.  However,
  *   FcFontSort() relies on the search pattern only, which includes the font
@@ -73,10 +75,16 @@
  *   is a refcounted structure.  This level of abstraction also allows for
  *   optimizations like calling FcFontMatch() instead of FcFontSort(), and
  *   only calling FcFontSort() if any patterns other than the first match
- *   are needed.  Another possible optimization would be to call FcFontSort()
- *   without trimming, and do the trimming lazily as we go.  Only pattern sets
+ *   are needed.  FcFontSort() is called without trimming, and the trimming
+ *   is done lazily as fontsets ask for more fonts, so we only look at the
+ *   charsets of the fonts that are actually used.  Only pattern sets
  *   already referenced by a fontset are cached.
  *
+ * - If a fontset cache file is set, the results of FcFontMatch() and
+ *   FcFontSort() are also looked up in fontmap->priv->sort_cache, which
+ *   is loaded from that file, before asking fontconfig.  See
+ *   pangofc-sortcache.c.
+ *
  * - A number of most-recently-used fontsets are cached and reused when
  *   needed.  This is achieved using fontmap->priv->fontset_hash and
  *   fontmap->priv->fontset_cache.
@@ -86,20 +94,33 @@
  *
  * - Data that only depends on the font file and face index is cached and
  *   reused by multiple fonts.  This includes coverage and cmap cache info.
- *   This is done using fontmap->priv->font_face_data_hash.
+ *   This is done using fontmap->priv->font_face_data_hash.  Entries that
+ *   are not used by any font in font_hash are kept in an LRU list,
+ *   fontmap->priv->face_data_idle, and evicted from its end.
+ *
+ * The number of fontsets and of unused face data entries can be limited
+ * with pango_fc_font_map_set_cache_limit(), and the hits, misses and
+ * evictions of all caches are counted in fontmap->priv->stats.
  *
  * Upon a cache_clear() request, all caches are emptied.  All objects (fonts,
  * fontsets, faces, families) having a reference from outside will still live
  * and may reference the fontmap still, but will not be reused by the fontmap.
  *
+ * By default, none of this is thread-safe, and each thread is expected to
+ * use its own fontmap.  If pango_fc_font_map_set_thread_safe() is called,
+ * fontmap->priv->lock protects all of the above caches, the families and
+ * faces, and the contents of fontsets.  It is a recursive lock, since
+ * creating fonts calls back into the fontmap.  The pattern caches and the
+ * reference counts of PangoFcPatterns are protected by a separate
+ * fontmap->priv->patterns_lock, which is never held while taking another
+ * lock or waiting: the fontconfig thread needs it to drop its references,
+ * while we may be waiting for that thread with fontmap->priv->lock held.
+ *
  *
  * Todo:
  *
  * - Make PangoCoverage a GObject and subclass it as PangoFcCoverage which
  *   will directly use FcCharset. (#569622)
- *
- * - Lazy trimming of FcFontSort() results.  Requires fontconfig with
- *   FcCharSetMerge().
  */
 
 typedef enum {
@@ -141,6 +162,8 @@ typedef struct _PangoFcFontset      PangoFcFontset;
 #define PANGO_FC_FONTSET(object)        (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_FC_TYPE_FONTSET, PangoFcFontset))
 #define PANGO_FC_IS_FONTSET(object)     (G_TYPE_CHECK_INSTANCE_TYPE ((object), PANGO_FC_TYPE_FONTSET))
 
+#define N_CACHES (PANGO_FC_FONT_MAP_CACHE_PATTERNS + 1)
+
 struct _PangoFcFontMapPrivate
 {
   GHashTable *fontset_hash;	/* Maps PangoFcFontsetKey -> PangoFcFontset  */
@@ -172,6 +195,18 @@ struct _PangoFcFontMapPrivate
   FcFontSet *fonts;
 
   GAsyncQueue *queue;
+
+  GQueue face_data_idle;	/* Unused face data, most recent first */
+  PangoFcFontMapCacheStats stats[N_CACHES];
+
+  /* Match and sort results from and for the fontset cache file */
+  char *fontset_cache_file;
+  PangoFcSortCache *sort_cache;
+
+  /* See the overview above */
+  gboolean thread_safe;
+  GRecMutex lock;
+  GMutex patterns_lock;
 };
 
 struct _PangoFcFontFaceData
@@ -180,14 +215,32 @@ struct _PangoFcFontFaceData
   char *filename;
   int id;            /* needed to handle TTC files with multiple faces */
 
+  /* Number of fonts in font_hash using this face. If
+   * this is zero, idle_link is in face_data_idle.
+   */
+  guint n_fonts;
+  GList idle_link;
+
   /* Data */
   FcPattern *pattern;  /* Referenced pattern that owns filename */
   PangoCoverage *coverage;
   PangoLanguage **languages;
+  GSList *sample_glyphs;
 
   hb_face_t *hb_face;
 };
 
+/* The glyphs for the characters of a string that a face
+ * has, for computing approximate widths without shaping
+ */
+typedef struct
+{
+  char *str;
+  guint n_glyphs;
+  int n_columns;
+  hb_codepoint_t *glyphs;
+} PangoFcSampleGlyphs;
+
 struct _PangoFcFace
 {
   PangoFontFace parent_instance;
@@ -264,7 +317,13 @@ static gboolean  pango_fc_font_map_add_font_file (PangoFontMap  *fontmap,
                                                   const char    *filename,
                                                   GError       **error);
 
+static gboolean  pango_fc_font_map_is_thread_safe (PangoFontMap *fontmap);
+static void      pango_fc_font_map_prewarm_fontset (PangoFontMap *fontmap,
+                                                    PangoFontset *fontset);
+
 static guint    pango_fc_font_face_data_hash  (PangoFcFontFaceData *key);
+static void     pango_fc_font_map_trim_face_data (PangoFcFontMap *fcfontmap,
+                                                  guint           keep);
 static gboolean pango_fc_font_face_data_equal (PangoFcFontFaceData *key1,
 					       PangoFcFontFaceData *key2);
 
@@ -310,6 +369,40 @@ static int compare_face_pattern (FcPattern *p1,
 
 gpointer get_gravity_class (void);
 
+void
+_pango_fc_font_map_lock (PangoFcFontMap *fcfontmap)
+{
+  if (fcfontmap->priv->thread_safe)
+    g_rec_mutex_lock (&fcfontmap->priv->lock);
+}
+
+void
+_pango_fc_font_map_unlock (PangoFcFontMap *fcfontmap)
+{
+  if (fcfontmap->priv->thread_safe)
+    g_rec_mutex_unlock (&fcfontmap->priv->lock);
+}
+
+gboolean
+_pango_fc_font_map_is_thread_safe (PangoFcFontMap *fcfontmap)
+{
+  return fcfontmap->priv->thread_safe;
+}
+
+static inline void
+patterns_lock (PangoFcFontMap *fcfontmap)
+{
+  if (fcfontmap->priv->thread_safe)
+    g_mutex_lock (&fcfontmap->priv->patterns_lock);
+}
+
+static inline void
+patterns_unlock (PangoFcFontMap *fcfontmap)
+{
+  if (fcfontmap->priv->thread_safe)
+    g_mutex_unlock (&fcfontmap->priv->patterns_lock);
+}
+
 gpointer
 get_gravity_class (void)
 {
@@ -335,6 +428,16 @@ pango_fc_font_face_data_equal (PangoFcFontFaceData *key1,
 	 (key1 == key2 || 0 == strcmp (key1->filename, key2->filename));
 }
 
+static void
+pango_fc_sample_glyphs_free (gpointer data)
+{
+  PangoFcSampleGlyphs *sample = data;
+
+  g_free (sample->str);
+  g_free (sample->glyphs);
+  g_free (sample);
+}
+
 static void
 pango_fc_font_face_data_free (PangoFcFontFaceData *data)
 {
@@ -345,7 +448,9 @@ pango_fc_font_face_data_free (PangoFcFontFaceData *data)
 
   g_free (data->languages);
 
-  hb_face_destroy (data->hb_face);
+  g_slist_free_full (data->sample_glyphs, pango_fc_sample_glyphs_free);
+
+  _pango_fc_face_cache_release (data->hb_face);
 
   g_slice_free (PangoFcFontFaceData, data);
 }
@@ -414,6 +519,7 @@ struct _PangoFcFontsetKey {
   gpointer context_key;
   char *variations;
   char *features;
+  guint hash;
 };
 
 struct _PangoFcFontKey {
@@ -425,6 +531,52 @@ struct _PangoFcFontKey {
   char *features;
 };
 
+/* The fields of the description that are not part of
+ * the desc in a fontset key. The size is in pixelsize,
+ * and variations and features have their own fields.
+ */
+#define FONTSET_KEY_UNSET_FIELDS (PANGO_FONT_MASK_SIZE | PANGO_FONT_MASK_VARIATIONS | PANGO_FONT_MASK_FEATURES)
+
+static guint
+pango_fc_fontset_key_compute_hash (const PangoFcFontsetKey *key,
+                                   guint                    desc_hash)
+{
+    guint32 hash = FNV1_32_INIT;
+
+    /* We do a bytewise hash on the doubles */
+    hash = hash_bytes_fnv ((unsigned char *)(&key->matrix), sizeof (double) * 4, hash);
+    hash = hash_bytes_fnv ((unsigned char *)(&key->resolution), sizeof (double), hash);
+
+    hash ^= key->pixelsize;
+
+    if (key->variations)
+      hash ^= g_str_hash (key->variations);
+
+    if (key->features)
+      hash ^= g_str_hash (key->features);
+
+    if (key->context_key)
+      hash ^= PANGO_FC_FONT_MAP_GET_CLASS (key->fontmap)->context_key_hash (key->fontmap,
+									    key->context_key);
+
+    return hash ^ GPOINTER_TO_UINT (key->language) ^ desc_hash;
+}
+
+/* Initializes a key for looking up a fontset, without
+ * allocating. The key borrows the strings and the
+ * description from @desc, and the description still
+ * has the fields in FONTSET_KEY_UNSET_FIELDS set.
+ * Use pango_fc_fontset_key_copy() to get a key that
+ * can be stored.
+ *
+ * The hash is computed here once and kept with the key,
+ * so stored keys don't hash their description again.
+ *
+ * Stored keys have an interned description. If @desc is
+ * interned too, and was used for a stored key before, the
+ * key gets the interned description without those fields,
+ * and comparing it with the stored key is a pointer compare.
+ */
 static void
 pango_fc_fontset_key_init (PangoFcFontsetKey          *key,
 			   PangoFcFontMap             *fcfontmap,
@@ -432,6 +584,8 @@ pango_fc_fontset_key_init (PangoFcFontsetKey          *key,
 			   const PangoFontDescription *desc,
 			   PangoLanguage              *language)
 {
+  guint desc_hash;
+
   if (!language && context)
     language = pango_context_get_language (context);
 
@@ -440,29 +594,44 @@ pango_fc_fontset_key_init (PangoFcFontsetKey          *key,
   key->pixelsize = get_scaled_size (fcfontmap, context, desc);
   key->resolution = pango_fc_font_map_get_resolution (fcfontmap, context);
   key->language = language;
-  key->variations = g_strdup (pango_font_description_get_variations (desc));
-  key->features = g_strdup (pango_font_description_get_features (desc));
-  key->desc = pango_font_description_copy_static (desc);
-  pango_font_description_unset_fields (key->desc, PANGO_FONT_MASK_SIZE | PANGO_FONT_MASK_VARIATIONS | PANGO_FONT_MASK_FEATURES);
+  key->variations = (char *) pango_font_description_get_variations (desc);
+  key->features = (char *) pango_font_description_get_features (desc);
+  key->desc = (PangoFontDescription *) pango_font_description_peek_interned_ignoring (desc, FONTSET_KEY_UNSET_FIELDS);
+  if (key->desc)
+    {
+      /* The fields are unset to their defaults, which don't
+       * change the hash, so the cached hash is the same
+       */
+      desc_hash = pango_font_description_hash (key->desc);
+    }
+  else
+    {
+      key->desc = (PangoFontDescription *) desc;
+      desc_hash = pango_font_description_hash_ignoring (desc, FONTSET_KEY_UNSET_FIELDS);
+    }
 
   if (context && PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap)->context_key_get)
     key->context_key = (gpointer)PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap)->context_key_get (fcfontmap, context);
   else
     key->context_key = NULL;
+
+  key->hash = pango_fc_fontset_key_compute_hash (key, desc_hash);
 }
 
 static gboolean
 pango_fc_fontset_key_equal (const PangoFcFontsetKey *key_a,
 			    const PangoFcFontsetKey *key_b)
 {
-  if (key_a->language == key_b->language &&
+  if (key_a->hash == key_b->hash &&
+      key_a->language == key_b->language &&
       key_a->pixelsize == key_b->pixelsize &&
       key_a->resolution == key_b->resolution &&
       ((key_a->variations == NULL && key_b->variations == NULL) ||
        (key_a->variations && key_b->variations && (strcmp (key_a->variations, key_b->variations) == 0))) &&
       ((key_a->features == NULL && key_b->features == NULL) ||
        (key_a->features && key_b->features && (strcmp (key_a->features, key_b->features) == 0))) &&
-      pango_font_description_equal (key_a->desc, key_b->desc) &&
+      (key_a->desc == key_b->desc ||
+       pango_font_description_equal_ignoring (key_a->desc, key_b->desc, FONTSET_KEY_UNSET_FIELDS)) &&
       0 == memcmp (&key_a->matrix, &key_b->matrix, 4 * sizeof (double)))
     {
       if (key_a->context_key)
@@ -479,27 +648,7 @@ pango_fc_fontset_key_equal (const PangoFcFontsetKey *key_a,
 static guint
 pango_fc_fontset_key_hash (const PangoFcFontsetKey *key)
 {
-    guint32 hash = FNV1_32_INIT;
-
-    /* We do a bytewise hash on the doubles */
-    hash = hash_bytes_fnv ((unsigned char *)(&key->matrix), sizeof (double) * 4, hash);
-    hash = hash_bytes_fnv ((unsigned char *)(&key->resolution), sizeof (double), hash);
-
-    hash ^= key->pixelsize;
-
-    if (key->variations)
-      hash ^= g_str_hash (key->variations);
-
-    if (key->features)
-      hash ^= g_str_hash (key->features);
-
-    if (key->context_key)
-      hash ^= PANGO_FC_FONT_MAP_GET_CLASS (key->fontmap)->context_key_hash (key->fontmap,
-									    key->context_key);
-
-    return (hash ^
-	    GPOINTER_TO_UINT (key->language) ^
-	    pango_font_description_hash (key->desc));
+  return key->hash;
 }
 
 static void
@@ -523,12 +672,13 @@ pango_fc_fontset_key_copy (const PangoFcFontsetKey *old)
 
   key->fontmap = old->fontmap;
   key->language = old->language;
-  key->desc = pango_font_description_copy (old->desc);
+  key->desc = pango_font_description_intern_ignoring (old->desc, FONTSET_KEY_UNSET_FIELDS);
   key->matrix = old->matrix;
   key->pixelsize = old->pixelsize;
   key->resolution = old->resolution;
   key->variations = g_strdup (old->variations);
   key->features = g_strdup (old->features);
+  key->hash = old->hash;
 
   if (old->context_key)
     key->context_key = PANGO_FC_FONT_MAP_GET_CLASS (key->fontmap)->context_key_copy (key->fontmap,
@@ -825,6 +975,17 @@ struct _PangoFcPatterns {
   FcPattern *pattern;
   FcPattern *match;
   FcFontSet *fontset;
+  gboolean sort_queued;
+
+  /* fontset is the untrimmed result of FcFontSort(). trimmed
+   * holds the fonts of fontset that we have looked at so far
+   * and that add coverage, trim_pos is the position of the next
+   * font to look at, and trim_charset the accumulated coverage.
+   * These are protected by the mutex as well.
+   */
+  GPtrArray *trimmed;
+  int trim_pos;
+  FcCharSet *trim_charset;
 };
 
 static FcFontSet *
@@ -863,6 +1024,7 @@ typedef struct {
 } ThreadData;
 
 static FcFontSet *pango_fc_font_map_get_config_fonts (PangoFcFontMap *fcfontmap);
+static PangoFcSortCache *pango_fc_font_map_get_sort_cache (PangoFcFontMap *fcfontmap);
 
 static ThreadData *
 thread_data_new (FcOp             op,
@@ -942,7 +1104,7 @@ sort_in_thread (gpointer task_data)
   fontset = FcFontSetSort (td->config,
                            &td->fonts, 1,
                            td->pattern,
-                           FcTrue,
+                           FcFalse,
                            NULL,
                            &result);
 
@@ -964,6 +1126,7 @@ match_in_thread (gpointer task_data)
   ThreadData *td = task_data;
   FcResult result;
   FcPattern *match;
+  gboolean sort;
   gint64 before G_GNUC_UNUSED;
 
   before = PANGO_TRACE_CURRENT_TIME;
@@ -977,10 +1140,13 @@ match_in_thread (gpointer task_data)
 
   g_mutex_lock (&td->patterns->mutex);
   td->patterns->match = match;
+  /* If a sort is queued already, it will provide the fontset */
+  sort = result == FcResultNoMatch && !td->patterns->sort_queued;
+  td->patterns->sort_queued |= sort;
   g_cond_signal (&td->patterns->cond);
   g_mutex_unlock (&td->patterns->mutex);
 
-  if (result == FcResultNoMatch)
+  if (sort)
     sort_in_thread (td);
   else
     thread_data_free (td);
@@ -1035,9 +1201,16 @@ pango_fc_patterns_new (FcPattern *pat, PangoFcFontMap *fontmap)
   PangoFcPatterns *pats;
 
   pat = uniquify_pattern (fontmap, pat);
+
+  patterns_lock (fontmap);
+
   pats = g_hash_table_lookup (fontmap->priv->patterns_hash, pat);
   if (pats)
-    return pango_fc_patterns_ref (pats);
+    {
+      pats = pango_fc_patterns_ref (pats);
+      patterns_unlock (fontmap);
+      return pats;
+    }
 
   pats = g_atomic_rc_box_new0 (PangoFcPatterns);
 
@@ -1049,10 +1222,22 @@ pango_fc_patterns_new (FcPattern *pat, PangoFcFontMap *fontmap)
   g_mutex_init (&pats->mutex);
   g_cond_init (&pats->cond);
 
-  g_async_queue_push (fontmap->priv->queue, thread_data_new (FC_MATCH, pats));
+  if (fontmap->priv->sort_cache)
+    {
+      FcPattern *match;
+
+      if (_pango_fc_sort_cache_lookup (fontmap->priv->sort_cache, pat, &match, &pats->fontset) &&
+          match)
+        pats->match = FcFontRenderPrepare (fontmap->priv->config, pat, match);
+    }
 
   g_hash_table_insert (fontmap->priv->patterns_hash, pats->pattern, pats);
 
+  patterns_unlock (fontmap);
+
+  if (!pats->match && !pats->fontset)
+    g_async_queue_push (fontmap->priv->queue, thread_data_new (FC_MATCH, pats));
+
   return pats;
 }
 
@@ -1062,6 +1247,7 @@ pango_fc_patterns_ref (PangoFcPatterns *pats)
   return g_atomic_rc_box_acquire (pats);
 }
 
+/* Called with the patterns lock held */
 static void
 free_patterns (gpointer data)
 {
@@ -1082,6 +1268,12 @@ free_patterns (gpointer data)
   if (pats->fontset)
     FcFontSetDestroy (pats->fontset);
 
+  if (pats->trimmed)
+    g_ptr_array_unref (pats->trimmed);
+
+  if (pats->trim_charset)
+    FcCharSetDestroy (pats->trim_charset);
+
   g_cond_clear (&pats->cond);
   g_mutex_clear (&pats->mutex);
 }
@@ -1089,7 +1281,14 @@ free_patterns (gpointer data)
 static void
 pango_fc_patterns_unref (PangoFcPatterns *pats)
 {
+  PangoFcFontMap *fontmap = pats->fontmap;
+
+  /* Dropping the last reference and removing pats from the
+   * patterns hash has to be atomic with respect to lookups
+   */
+  patterns_lock (fontmap);
   g_atomic_rc_box_release_full (pats, free_patterns);
+  patterns_unlock (fontmap);
 }
 
 static FcPattern *
@@ -1182,6 +1381,65 @@ filter_by_format (FcFontSet **sets, int nsets)
   return result;
 }
 
+/* Queues a FcFontSort() for pats, unless it has
+ * been done or queued already
+ */
+static void
+pango_fc_patterns_queue_sort (PangoFcPatterns *pats)
+{
+  gboolean queue;
+
+  g_mutex_lock (&pats->mutex);
+  queue = !pats->fontset && !pats->sort_queued;
+  pats->sort_queued = TRUE;
+  g_mutex_unlock (&pats->mutex);
+
+  if (queue)
+    g_async_queue_push (pats->fontmap->priv->queue, thread_data_new (FC_SORT, pats));
+}
+
+/* Returns the i-th font of the trimmed sort results, trimming
+ * only as much of the untrimmed results as needed to find it.
+ * This skips the same fonts that FcFontSort() skips when asked
+ * to trim: fonts without a charset, and fonts after the first
+ * that don't add any characters to the ones before them.
+ *
+ * Called with the mutex of pats held.
+ */
+static FcPattern *
+pango_fc_patterns_get_trimmed (PangoFcPatterns *pats,
+                               int              i)
+{
+  FcFontSet *fontset = pats->fontset;
+
+  if (!pats->trimmed)
+    {
+      pats->trimmed = g_ptr_array_new ();
+      pats->trim_charset = FcCharSetCreate ();
+    }
+
+  while ((int) pats->trimmed->len <= i && pats->trim_pos < fontset->nfont)
+    {
+      FcPattern *pat = fontset->fonts[pats->trim_pos++];
+      FcCharSet *cs;
+      FcBool adds_chars = FcFalse;
+
+      if (FcPatternGetCharSet (pat, FC_CHARSET, 0, &cs) != FcResultMatch)
+        continue;
+
+      if (!FcCharSetMerge (pats->trim_charset, cs, &adds_chars))
+        break;
+
+      if (pats->trimmed->len == 0 || adds_chars)
+        g_ptr_array_add (pats->trimmed, pat);
+    }
+
+  if (i < (int) pats->trimmed->len)
+    return g_ptr_array_index (pats->trimmed, i);
+
+  return NULL;
+}
+
 static FcPattern *
 pango_fc_patterns_get_font_pattern (PangoFcPatterns *pats, int i, gboolean *prepare)
 {
@@ -1224,8 +1482,7 @@ pango_fc_patterns_get_font_pattern (PangoFcPatterns *pats, int i, gboolean *prep
 
       before = PANGO_TRACE_CURRENT_TIME;
 
-      if (!pats->fontset)
-        g_async_queue_push (pats->fontmap->priv->queue, thread_data_new (FC_SORT, pats));
+      pango_fc_patterns_queue_sort (pats);
 
       g_mutex_lock (&pats->mutex);
 
@@ -1245,10 +1502,16 @@ pango_fc_patterns_get_font_pattern (PangoFcPatterns *pats, int i, gboolean *prep
 
   if (fontset)
     {
-      if (i < fontset->nfont)
+      FcPattern *pat;
+
+      g_mutex_lock (&pats->mutex);
+      pat = pango_fc_patterns_get_trimmed (pats, i);
+      g_mutex_unlock (&pats->mutex);
+
+      if (pat)
         {
           *prepare = TRUE;
-          return fontset->fonts[i];
+          return pat;
         }
     }
 
@@ -1287,6 +1550,7 @@ typedef PangoFontsetClass PangoFcFontsetClass;
 
 G_DEFINE_TYPE (PangoFcFontset, pango_fc_fontset, PANGO_TYPE_FONTSET)
 
+/* Takes ownership of key */
 static PangoFcFontset *
 pango_fc_fontset_new (PangoFcFontsetKey *key,
 		      PangoFcPatterns   *patterns)
@@ -1295,7 +1559,7 @@ pango_fc_fontset_new (PangoFcFontsetKey *key,
 
   fontset = g_object_new (PANGO_FC_TYPE_FONTSET, NULL);
 
-  fontset->key = pango_fc_fontset_key_copy (key);
+  fontset->key = key;
   fontset->patterns = pango_fc_patterns_ref (patterns);
 
   return fontset;
@@ -1419,6 +1683,7 @@ pango_fc_fontset_get_font (PangoFontset  *fontset,
 			   guint          wc)
 {
   PangoFcFontset *fcfontset = PANGO_FC_FONTSET (fontset);
+  PangoFcFontMap *fcfontmap = fcfontset->key->fontmap;
   PangoCoverageLevel best_level = PANGO_COVERAGE_NONE;
   PangoCoverageLevel level;
   PangoFont *font;
@@ -1426,6 +1691,8 @@ pango_fc_fontset_get_font (PangoFontset  *fontset,
   int result = -1;
   unsigned int i;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   for (i = 0;
        pango_fc_fontset_get_font_at (fcfontset, i);
        i++)
@@ -1452,10 +1719,13 @@ pango_fc_fontset_get_font (PangoFontset  *fontset,
     }
 
   if (G_UNLIKELY (result == -1))
-    return NULL;
+    font = NULL;
+  else
+    font = g_object_ref (g_ptr_array_index (fcfontset->fonts, result));
+
+  _pango_fc_font_map_unlock (fcfontmap);
 
-  font = g_ptr_array_index (fcfontset->fonts, result);
-  return g_object_ref (font);
+  return font;
 }
 
 static void
@@ -1464,13 +1734,20 @@ pango_fc_fontset_foreach (PangoFontset           *fontset,
 			  gpointer                data)
 {
   PangoFcFontset *fcfontset = PANGO_FC_FONTSET (fontset);
+  PangoFcFontMap *fcfontmap = fcfontset->key->fontmap;
   PangoFont *font;
   unsigned int i;
 
-  for (i = 0;
-       (font = pango_fc_fontset_get_font_at (fcfontset, i));
-       i++)
+  for (i = 0; ; i++)
     {
+      /* Don't hold the lock while calling out */
+      _pango_fc_font_map_lock (fcfontmap);
+      font = pango_fc_fontset_get_font_at (fcfontset, i);
+      _pango_fc_font_map_unlock (fcfontmap);
+
+      if (!font)
+        break;
+
       if ((*func) (fontset, font, data))
 	return;
     }
@@ -1491,10 +1768,14 @@ static guint
 pango_fc_font_map_get_n_items (GListModel *list)
 {
   PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (list);
+  guint n_items;
 
+  _pango_fc_font_map_lock (fcfontmap);
   ensure_families (fcfontmap);
+  n_items = fcfontmap->priv->n_families;
+  _pango_fc_font_map_unlock (fcfontmap);
 
-  return fcfontmap->priv->n_families;
+  return n_items;
 }
 
 static gpointer
@@ -1502,13 +1783,18 @@ pango_fc_font_map_get_item (GListModel *list,
                             guint       position)
 {
   PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (list);
+  gpointer item = NULL;
+
+  _pango_fc_font_map_lock (fcfontmap);
 
   ensure_families (fcfontmap);
 
   if (position < fcfontmap->priv->n_families)
-    return g_object_ref (fcfontmap->priv->families[position]);
+    item = g_object_ref (fcfontmap->priv->families[position]);
 
-  return NULL;
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return item;
 }
 
 static void
@@ -1563,12 +1849,13 @@ wait_for_fc_init (void)
     pango_trace_mark (before, "wait for FcInit", NULL);
 }
 
+/* Sets up the caches, initially and after they were
+ * cleared by pango_fc_font_map_fini()
+ */
 static void
-pango_fc_font_map_init (PangoFcFontMap *fcfontmap)
+pango_fc_font_map_reset (PangoFcFontMap *fcfontmap)
 {
-  PangoFcFontMapPrivate *priv;
-
-  priv = fcfontmap->priv = pango_fc_font_map_get_instance_private (fcfontmap);
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
 
   priv->n_families = -1;
 
@@ -1599,6 +1886,21 @@ pango_fc_font_map_init (PangoFcFontMap *fcfontmap)
   start_fontconfig_thread (fcfontmap);
 }
 
+static void
+pango_fc_font_map_init (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv;
+  int i;
+
+  priv = fcfontmap->priv = pango_fc_font_map_get_instance_private (fcfontmap);
+
+  for (i = 0; i < N_CACHES; i++)
+    priv->stats[i].limit = G_MAXUINT;
+  priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTSETS].limit = FONTSET_CACHE_SIZE;
+
+  pango_fc_font_map_reset (fcfontmap);
+}
+
 static void
 pango_fc_font_map_fini (PangoFcFontMap *fcfontmap)
 {
@@ -1606,6 +1908,7 @@ pango_fc_font_map_fini (PangoFcFontMap *fcfontmap)
   int i;
 
   g_clear_pointer (&priv->fonts, FcFontSetDestroy);
+  g_clear_pointer (&priv->sort_cache, _pango_fc_sort_cache_free);
 
   g_queue_free (priv->fontset_cache);
   priv->fontset_cache = NULL;
@@ -1613,18 +1916,25 @@ pango_fc_font_map_fini (PangoFcFontMap *fcfontmap)
   g_hash_table_destroy (priv->fontset_hash);
   priv->fontset_hash = NULL;
 
-  g_hash_table_destroy (priv->patterns_hash);
-  priv->patterns_hash = NULL;
-
   g_hash_table_destroy (priv->font_hash);
   priv->font_hash = NULL;
 
+  /* The links are freed with the face data */
+  g_queue_init (&priv->face_data_idle);
+
   g_hash_table_destroy (priv->font_face_data_hash);
   priv->font_face_data_hash = NULL;
 
+  patterns_lock (fcfontmap);
+
+  g_hash_table_destroy (priv->patterns_hash);
+  priv->patterns_hash = NULL;
+
   g_hash_table_destroy (priv->pattern_hash);
   priv->pattern_hash = NULL;
 
+  patterns_unlock (fcfontmap);
+
   for (i = 0; i < priv->n_families; i++)
     g_object_unref (priv->families[i]);
   g_free (priv->families);
@@ -1657,6 +1967,8 @@ pango_fc_font_map_class_init (PangoFcFontMapClass *class)
 
   pclass->reload_font = pango_fc_font_map_reload_font;
   pclass->add_font_file = pango_fc_font_map_add_font_file;
+  pclass->is_thread_safe = pango_fc_font_map_is_thread_safe;
+  pclass->prewarm_fontset = pango_fc_font_map_prewarm_fontset;
 }
 
 
@@ -1750,6 +2062,14 @@ pango_fc_font_map_finalize (GObject *object)
   if (fcfontmap->priv->config)
     FcConfigDestroy (fcfontmap->priv->config);
 
+  g_free (fcfontmap->priv->fontset_cache_file);
+
+  if (fcfontmap->priv->thread_safe)
+    {
+      g_rec_mutex_clear (&fcfontmap->priv->lock);
+      g_mutex_clear (&fcfontmap->priv->patterns_lock);
+    }
+
   G_OBJECT_CLASS (pango_fc_font_map_parent_class)->finalize (object);
 }
 
@@ -1765,6 +2085,8 @@ pango_fc_font_map_add (PangoFcFontMap *fcfontmap,
   key_copy = pango_fc_font_key_copy (key);
   _pango_fc_font_set_font_key (fcfont, key_copy);
   g_hash_table_insert (priv->font_hash, key_copy, fcfont);
+
+  pango_fc_font_map_face_data_add_font (fcfontmap, fcfont);
 }
 
 static PangoFont *
@@ -1782,6 +2104,8 @@ pango_fc_font_map_reload_font (PangoFontMap *fontmap,
   double pixel_size;
   PangoFont *scaled;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   pango_fc_font_key_init_from_key (&key, _pango_fc_font_get_font_key (fcfont));
 
   if (scale != 1.0)
@@ -1831,6 +2155,8 @@ pango_fc_font_map_reload_font (PangoFontMap *fontmap,
   if (pattern)
     FcPatternDestroy (pattern);
 
+  _pango_fc_font_map_unlock (fcfontmap);
+
   return scaled;
 }
 
@@ -1843,6 +2169,17 @@ _pango_fc_font_map_remove (PangoFcFontMap *fcfontmap,
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
   PangoFcFontKey *key;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
+  /* Another thread may have found the font in the font hash
+   * and taken a reference while it was being disposed.
+   */
+  if (priv->thread_safe && g_atomic_int_get (&G_OBJECT (fcfont)->ref_count) > 1)
+    {
+      _pango_fc_font_map_unlock (fcfontmap);
+      return;
+    }
+
   key = _pango_fc_font_get_font_key (fcfont);
   if (key)
     {
@@ -1852,10 +2189,13 @@ _pango_fc_font_map_remove (PangoFcFontMap *fcfontmap,
 	  fcfont == g_hash_table_lookup (priv->font_hash, key))
         {
 	  g_hash_table_remove (priv->font_hash, key);
+	  pango_fc_font_map_face_data_remove_font (fcfontmap, fcfont);
 	}
       _pango_fc_font_set_font_key (fcfont, NULL);
       pango_fc_font_key_free (key);
     }
+
+  _pango_fc_font_map_unlock (fcfontmap);
 }
 
 static PangoFcFamily *
@@ -2008,6 +2348,8 @@ pango_fc_font_map_list_families (PangoFontMap      *fontmap,
       return;
     }
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   ensure_families (fcfontmap);
 
   if (n_families)
@@ -2015,6 +2357,8 @@ pango_fc_font_map_list_families (PangoFontMap      *fontmap,
 
   if (families)
     *families = g_memdup2 (priv->families, priv->n_families * sizeof (PangoFontFamily *));
+
+  _pango_fc_font_map_unlock (fcfontmap);
 }
 
 static PangoFontFamily *
@@ -2023,21 +2367,29 @@ pango_fc_font_map_get_family (PangoFontMap *fontmap,
 {
   PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (fontmap);
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFontFamily *result = NULL;
   int i;
 
   if (priv->closed)
     return NULL;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   ensure_families (fcfontmap);
 
   for (i = 0; i < priv->n_families; i++)
     {
       PangoFontFamily *family = PANGO_FONT_FAMILY (priv->families[i]);
       if (strcmp (name, pango_font_family_get_name (family)) == 0)
-        return family;
+        {
+          result = family;
+          break;
+        }
     }
 
-  return NULL;
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return result;
 }
 
 static double
@@ -2173,17 +2525,22 @@ uniquify_pattern (PangoFcFontMap *fcfontmap,
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
   FcPattern *old_pattern;
 
+  patterns_lock (fcfontmap);
+
   old_pattern = g_hash_table_lookup (priv->pattern_hash, pattern);
-  if (old_pattern)
-    {
-      return old_pattern;
-    }
-  else
+  if (!old_pattern)
     {
       FcPatternReference (pattern);
       g_hash_table_insert (priv->pattern_hash, pattern, pattern);
-      return pattern;
+      old_pattern = pattern;
+      priv->stats[PANGO_FC_FONT_MAP_CACHE_PATTERNS].misses++;
     }
+  else
+    priv->stats[PANGO_FC_FONT_MAP_CACHE_PATTERNS].hits++;
+
+  patterns_unlock (fcfontmap);
+
+  return old_pattern;
 }
 
 static PangoFont *
@@ -2199,7 +2556,12 @@ pango_fc_font_map_new_font_from_key (PangoFcFontMap *fcfontmap,
 
   fcfont = g_hash_table_lookup (priv->font_hash, key);
   if (fcfont)
-    return g_object_ref (PANGO_FONT (fcfont));
+    {
+      priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTS].hits++;
+      return g_object_ref (PANGO_FONT (fcfont));
+    }
+
+  priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTS].misses++;
 
   class = PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap);
 
@@ -2239,7 +2601,12 @@ pango_fc_font_map_new_font (PangoFcFontMap    *fcfontmap,
 
   fcfont = g_hash_table_lookup (priv->font_hash, &key);
   if (fcfont)
-    return g_object_ref (PANGO_FONT (fcfont));
+    {
+      priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTS].hits++;
+      return g_object_ref (PANGO_FONT (fcfont));
+    }
+
+  priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTS].misses++;
 
   class = PANGO_FC_FONT_MAP_GET_CLASS (fcfontmap);
 
@@ -2296,7 +2663,9 @@ static PangoFontFace *
 pango_fc_font_map_get_face (PangoFontMap *fontmap,
                             PangoFont    *font)
 {
+  PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (fontmap);
   PangoFcFont *fcfont = PANGO_FC_FONT (font);
+  PangoFontFace *face = NULL;
   FcResult res;
   const char *s;
   PangoFcFamily *family;
@@ -2304,6 +2673,8 @@ pango_fc_font_map_get_face (PangoFontMap *fontmap,
   res = FcPatternGetString (fcfont->font_pattern, FC_FAMILY, 0, (FcChar8 **) &s);
   g_assert (res == FcResultMatch);
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   family = (PangoFcFamily *) pango_fc_font_map_get_family (fontmap, s);
   if (family)
     {
@@ -2312,11 +2683,16 @@ pango_fc_font_map_get_face (PangoFontMap *fontmap,
       for (int i = 0; i < family->n_faces; i++)
         {
           if (compare_face_pattern (family->faces[i]->pattern, fcfont->font_pattern) == 0)
-            return PANGO_FONT_FACE (family->faces[i]);
+            {
+              face = PANGO_FONT_FACE (family->faces[i]);
+              break;
+            }
         }
     }
 
-  return NULL;
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return face;
 }
 
 static void
@@ -2404,6 +2780,9 @@ pango_fc_font_map_get_patterns (PangoFontMap      *fontmap,
 
   wait_for_fc_init ();
 
+  /* Load the fontset cache file before taking the patterns lock */
+  pango_fc_font_map_get_sort_cache (fcfontmap);
+
   pattern = pango_fc_fontset_key_make_pattern (key);
   pango_fc_default_substitute (fcfontmap, key, pattern);
 
@@ -2453,46 +2832,117 @@ pango_fc_font_map_load_font (PangoFontMap               *fontmap,
   return font;
 }
 
+/* Drops the uniquified patterns that are neither the pattern
+ * of a live PangoFcPatterns nor of a font in font_hash, once
+ * there are more than PATTERNS_PER_FONTSET for each fontset we
+ * may cache. Anybody else using them holds a reference, they
+ * just don't get shared with new lookups anymore.
+ */
 static void
-pango_fc_fontset_cache (PangoFcFontset *fontset,
-			PangoFcFontMap *fcfontmap)
+pango_fc_font_map_trim_patterns (PangoFcFontMap *fcfontmap)
 {
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
-  GQueue *cache = priv->fontset_cache;
+  guint limit = priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTSETS].limit;
+  GHashTable *used;
+  GHashTableIter iter;
+  gpointer key;
 
-  if (fontset->cache_link)
-    {
-      if (fontset->cache_link == cache->head)
-        return;
+  if (limit > G_MAXUINT / PATTERNS_PER_FONTSET)
+    return;
 
-      /* Already in cache, move to head
-       */
-      if (fontset->cache_link == cache->tail)
-	cache->tail = fontset->cache_link->prev;
+  patterns_lock (fcfontmap);
 
-      cache->head = g_list_remove_link (cache->head, fontset->cache_link);
-      cache->length--;
-    }
-  else
+  if (g_hash_table_size (priv->pattern_hash) <= MAX (limit, 1) * PATTERNS_PER_FONTSET)
     {
-      /* Add to cache initially
-       */
-      if (cache->length == FONTSET_CACHE_SIZE)
-	{
-	  PangoFcFontset *tmp_fontset = g_queue_pop_tail (cache);
-	  tmp_fontset->cache_link = NULL;
-	  g_hash_table_remove (priv->fontset_hash, tmp_fontset->key);
-	}
+      patterns_unlock (fcfontmap);
+      return;
+    }
 
-      fontset->cache_link = g_list_prepend (NULL, fontset);
+  used = g_hash_table_new (NULL, NULL);
+
+  g_hash_table_iter_init (&iter, priv->patterns_hash);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_add (used, key);
+
+  g_hash_table_iter_init (&iter, priv->font_hash);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    g_hash_table_add (used, ((PangoFcFontKey *) key)->pattern);
+
+  g_hash_table_iter_init (&iter, priv->pattern_hash);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    {
+      if (!g_hash_table_contains (used, key))
+        {
+          g_hash_table_iter_remove (&iter);
+          priv->stats[PANGO_FC_FONT_MAP_CACHE_PATTERNS].evictions++;
+        }
     }
 
-  g_queue_push_head_link (cache, fontset->cache_link);
+  g_hash_table_destroy (used);
+
+  patterns_unlock (fcfontmap);
 }
 
-static PangoFontset *
-pango_fc_font_map_load_fontset (PangoFontMap                 *fontmap,
-				PangoContext                 *context,
+/* Evicts fontsets from the end of the cache until
+ * at most keep are left
+ */
+static void
+pango_fc_font_map_trim_fontsets (PangoFcFontMap *fcfontmap,
+                                 guint           keep)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  GQueue *cache = priv->fontset_cache;
+
+  if (cache->length <= keep)
+    return;
+
+  while (cache->length > keep)
+    {
+      PangoFcFontset *tmp_fontset = g_queue_pop_tail (cache);
+      tmp_fontset->cache_link = NULL;
+      g_hash_table_remove (priv->fontset_hash, tmp_fontset->key);
+      priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTSETS].evictions++;
+    }
+
+  pango_fc_font_map_trim_patterns (fcfontmap);
+}
+
+static void
+pango_fc_fontset_cache (PangoFcFontset *fontset,
+			PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  GQueue *cache = priv->fontset_cache;
+
+  if (fontset->cache_link)
+    {
+      if (fontset->cache_link == cache->head)
+        return;
+
+      /* Already in cache, move to head
+       */
+      if (fontset->cache_link == cache->tail)
+	cache->tail = fontset->cache_link->prev;
+
+      cache->head = g_list_remove_link (cache->head, fontset->cache_link);
+      cache->length--;
+    }
+  else
+    {
+      /* Add to cache initially
+       */
+      pango_fc_font_map_trim_fontsets (fcfontmap,
+                                       MAX (priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTSETS].limit, 1) - 1);
+
+      fontset->cache_link = g_list_prepend (NULL, fontset);
+    }
+
+  g_queue_push_head_link (cache, fontset->cache_link);
+}
+
+static PangoFontset *
+pango_fc_font_map_load_fontset (PangoFontMap                 *fontmap,
+				PangoContext                 *context,
 				const PangoFontDescription   *desc,
 				PangoLanguage                *language)
 {
@@ -2501,18 +2951,35 @@ pango_fc_font_map_load_fontset (PangoFontMap                 *fontmap,
   PangoFcFontset *fontset;
   PangoFcFontsetKey key;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   pango_fc_fontset_key_init (&key, fcfontmap, context, desc, language);
 
   fontset = g_hash_table_lookup (priv->fontset_hash, &key);
 
-  if (G_UNLIKELY (!fontset))
+  if (G_LIKELY (fontset))
+    priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTSETS].hits++;
+  else
     {
-      PangoFcPatterns *patterns = pango_fc_font_map_get_patterns (fontmap, &key);
+      PangoFcFontsetKey *owned_key;
+      PangoFcPatterns *patterns;
+
+      priv->stats[PANGO_FC_FONT_MAP_CACHE_FONTSETS].misses++;
+
+      /* Subclasses get to see the key in default_substitute,
+       * so give them one with the extra fields unset
+       */
+      owned_key = pango_fc_fontset_key_copy (&key);
+      patterns = pango_fc_font_map_get_patterns (fontmap, owned_key);
 
       if (!patterns)
-	return NULL;
+        {
+          pango_fc_fontset_key_free (owned_key);
+          _pango_fc_font_map_unlock (fcfontmap);
+          return NULL;
+        }
 
-      fontset = pango_fc_fontset_new (&key, patterns);
+      fontset = pango_fc_fontset_new (owned_key, patterns);
       g_hash_table_insert (priv->fontset_hash, pango_fc_fontset_get_key (fontset), fontset);
 
       pango_fc_patterns_unref (patterns);
@@ -2520,11 +2987,11 @@ pango_fc_font_map_load_fontset (PangoFontMap                 *fontmap,
 
   pango_fc_fontset_cache (fontset, fcfontmap);
 
-  pango_font_description_free (key.desc);
-  g_free (key.variations);
-  g_free (key.features);
+  g_object_ref (fontset);
 
-  return g_object_ref (PANGO_FONTSET (fontset));
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return PANGO_FONTSET (fontset);
 }
 
 /**
@@ -2548,15 +3015,19 @@ pango_fc_font_map_cache_clear (PangoFcFontMap *fcfontmap)
   if (G_UNLIKELY (fcfontmap->priv->closed))
     return;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   removed = fcfontmap->priv->n_families;
 
   pango_fc_font_map_fini (fcfontmap);
-  pango_fc_font_map_init (fcfontmap);
+  pango_fc_font_map_reset (fcfontmap);
 
   ensure_families (fcfontmap);
 
   added = fcfontmap->priv->n_families;
 
+  _pango_fc_font_map_unlock (fcfontmap);
+
   g_list_model_items_changed (G_LIST_MODEL (fcfontmap), 0, removed, added);
   if (removed != added)
     g_object_notify (G_OBJECT (fcfontmap), "n-items");
@@ -2631,6 +3102,7 @@ pango_fc_font_map_set_config (PangoFcFontMap *fcfontmap,
   fcfontmap->priv->config = fcconfig;
 
   g_clear_pointer (&fcfontmap->priv->fonts, FcFontSetDestroy);
+  g_clear_pointer (&fcfontmap->priv->sort_cache, _pango_fc_sort_cache_free);
 
   if (oldconfig != fcconfig)
     pango_fc_font_map_config_changed (fcfontmap);
@@ -2663,6 +3135,359 @@ pango_fc_font_map_get_config (PangoFcFontMap *fcfontmap)
   return fcfontmap->priv->config;
 }
 
+/**
+ * pango_fc_font_map_set_thread_safe:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @thread_safe: whether @fcfontmap should be usable from multiple threads
+ *
+ * Sets whether the font map can be used from multiple threads
+ * at the same time.
+ *
+ * By default, a font map and the fonts and fontsets it creates
+ * must only be used from one thread, which is why
+ * [func@PangoCairo.FontMap.get_default] returns a separate font
+ * map for each thread. A thread-safe font map protects its caches
+ * with locks, so all threads can share a single font map, and with
+ * it the loaded fonts, coverages, metrics and HarfBuzz faces.
+ *
+ * This must be called before the font map is used to load fonts.
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_set_thread_safe (PangoFcFontMap *fcfontmap,
+                                   gboolean        thread_safe)
+{
+  PangoFcFontMapPrivate *priv;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+
+  priv = fcfontmap->priv;
+
+  g_return_if_fail (!priv->closed);
+  g_return_if_fail (g_hash_table_size (priv->font_hash) == 0);
+
+  thread_safe = !!thread_safe;
+  if (priv->thread_safe == thread_safe)
+    return;
+
+  if (thread_safe)
+    {
+      g_rec_mutex_init (&priv->lock);
+      g_mutex_init (&priv->patterns_lock);
+    }
+  else
+    {
+      g_rec_mutex_clear (&priv->lock);
+      g_mutex_clear (&priv->patterns_lock);
+    }
+
+  priv->thread_safe = thread_safe;
+}
+
+/**
+ * pango_fc_font_map_get_thread_safe:
+ * @fcfontmap: a `PangoFcFontMap`
+ *
+ * Returns whether the font map can be used from multiple threads.
+ *
+ * See [method@PangoFc.FontMap.set_thread_safe].
+ *
+ * Returns: %TRUE if @fcfontmap is thread-safe
+ *
+ * Since: 1.60
+ */
+gboolean
+pango_fc_font_map_get_thread_safe (PangoFcFontMap *fcfontmap)
+{
+  g_return_val_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap), FALSE);
+
+  return fcfontmap->priv->thread_safe;
+}
+
+/**
+ * pango_fc_font_map_set_cache_limit:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @cache: the cache to limit
+ * @limit: the maximum number of entries to keep, or `G_MAXUINT`
+ *
+ * Sets a limit for one of the caches of the font map.
+ *
+ * When a cache grows beyond its limit, the least recently used
+ * entries are evicted. Only the fontset and face data caches can
+ * be limited. The fontset cache always keeps the most recently
+ * used fontset, and the face data limit only counts the entries
+ * that are not used by any of the fonts of the font map.
+ *
+ * The default is to keep 256 fontsets and all face data.
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_set_cache_limit (PangoFcFontMap      *fcfontmap,
+                                   PangoFcFontMapCache  cache,
+                                   guint                limit)
+{
+  PangoFcFontMapPrivate *priv;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+  g_return_if_fail (cache == PANGO_FC_FONT_MAP_CACHE_FONTSETS ||
+                    cache == PANGO_FC_FONT_MAP_CACHE_FACE_DATA);
+
+  priv = fcfontmap->priv;
+
+  _pango_fc_font_map_lock (fcfontmap);
+
+  priv->stats[cache].limit = limit;
+
+  if (!priv->closed)
+    {
+      if (cache == PANGO_FC_FONT_MAP_CACHE_FONTSETS)
+        pango_fc_font_map_trim_fontsets (fcfontmap, MAX (limit, 1));
+      else
+        pango_fc_font_map_trim_face_data (fcfontmap, limit);
+    }
+
+  _pango_fc_font_map_unlock (fcfontmap);
+}
+
+/**
+ * pango_fc_font_map_get_cache_limit:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @cache: the cache
+ *
+ * Gets the limit of one of the caches of the font map.
+ *
+ * See [method@PangoFc.FontMap.set_cache_limit].
+ *
+ * Returns: the maximum number of entries in @cache,
+ *   or `G_MAXUINT` if it is not limited
+ *
+ * Since: 1.60
+ */
+guint
+pango_fc_font_map_get_cache_limit (PangoFcFontMap      *fcfontmap,
+                                   PangoFcFontMapCache  cache)
+{
+  g_return_val_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap), 0);
+  g_return_val_if_fail (cache < N_CACHES, 0);
+
+  return fcfontmap->priv->stats[cache].limit;
+}
+
+/**
+ * pango_fc_font_map_get_cache_stats:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @cache: the cache
+ * @stats: (out caller-allocates): return location for the statistics
+ *
+ * Gets statistics about one of the caches of the font map.
+ *
+ * This can be used to pick cache limits that fit the
+ * fonts an application uses.
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_get_cache_stats (PangoFcFontMap           *fcfontmap,
+                                   PangoFcFontMapCache       cache,
+                                   PangoFcFontMapCacheStats *stats)
+{
+  PangoFcFontMapPrivate *priv;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+  g_return_if_fail (cache < N_CACHES);
+  g_return_if_fail (stats != NULL);
+
+  priv = fcfontmap->priv;
+
+  _pango_fc_font_map_lock (fcfontmap);
+  patterns_lock (fcfontmap);
+
+  *stats = priv->stats[cache];
+
+  switch (cache)
+    {
+    case PANGO_FC_FONT_MAP_CACHE_FONTSETS:
+      stats->size = priv->fontset_cache ? priv->fontset_cache->length : 0;
+      break;
+    case PANGO_FC_FONT_MAP_CACHE_FONTS:
+      stats->size = priv->font_hash ? g_hash_table_size (priv->font_hash) : 0;
+      break;
+    case PANGO_FC_FONT_MAP_CACHE_FACE_DATA:
+      stats->size = priv->font_face_data_hash ? g_hash_table_size (priv->font_face_data_hash) : 0;
+      break;
+    case PANGO_FC_FONT_MAP_CACHE_PATTERNS:
+      stats->size = priv->pattern_hash ? g_hash_table_size (priv->pattern_hash) : 0;
+      break;
+    default:
+      g_assert_not_reached ();
+    }
+
+  patterns_unlock (fcfontmap);
+  _pango_fc_font_map_unlock (fcfontmap);
+}
+
+/**
+ * pango_fc_font_map_set_fontset_cache_file:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @filename: (type filename) (nullable): the cache file, or %NULL
+ *
+ * Sets a file for caching fontconfig results across processes.
+ *
+ * Loading a fontset requires fontconfig to match and sort the
+ * installed fonts against the font description, which is a large
+ * part of the startup time of short-lived processes. If a cache
+ * file is set, the results are taken from it when it has them,
+ * and fontconfig is only consulted for fontsets that are not in
+ * the file. The file is ignored if the installed fonts changed
+ * since it was written.
+ *
+ * The file is only read. Use [method@PangoFc.FontMap.save_fontset_cache]
+ * to write the results for the fontsets that were loaded.
+ *
+ * Since: 1.60
+ */
+void
+pango_fc_font_map_set_fontset_cache_file (PangoFcFontMap *fcfontmap,
+                                          const char     *filename)
+{
+  PangoFcFontMapPrivate *priv;
+
+  g_return_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap));
+
+  priv = fcfontmap->priv;
+
+  _pango_fc_font_map_lock (fcfontmap);
+
+  if (g_strcmp0 (priv->fontset_cache_file, filename) != 0)
+    {
+      g_free (priv->fontset_cache_file);
+      priv->fontset_cache_file = g_strdup (filename);
+      g_clear_pointer (&priv->sort_cache, _pango_fc_sort_cache_free);
+    }
+
+  _pango_fc_font_map_unlock (fcfontmap);
+}
+
+/**
+ * pango_fc_font_map_get_fontset_cache_file:
+ * @fcfontmap: a `PangoFcFontMap`
+ *
+ * Gets the file that was set with
+ * [method@PangoFc.FontMap.set_fontset_cache_file].
+ *
+ * Returns: (type filename) (nullable): the cache file
+ *
+ * Since: 1.60
+ */
+const char *
+pango_fc_font_map_get_fontset_cache_file (PangoFcFontMap *fcfontmap)
+{
+  g_return_val_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap), NULL);
+
+  return fcfontmap->priv->fontset_cache_file;
+}
+
+/**
+ * pango_fc_font_map_save_fontset_cache:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @error: return location for an error
+ *
+ * Writes the fontconfig results for the fontsets that the font
+ * map is holding on to, together with the results that were read
+ * from it, to the file set with
+ * [method@PangoFc.FontMap.set_fontset_cache_file].
+ *
+ * Returns: %TRUE if the file was written
+ *
+ * Since: 1.60
+ */
+gboolean
+pango_fc_font_map_save_fontset_cache (PangoFcFontMap  *fcfontmap,
+                                      GError         **error)
+{
+  PangoFcFontMapPrivate *priv;
+  PangoFcSortCache *cache;
+  GPtrArray *patterns;
+  GHashTableIter iter;
+  PangoFcPatterns *pats;
+  gboolean result;
+  guint i;
+
+  g_return_val_if_fail (PANGO_IS_FC_FONT_MAP (fcfontmap), FALSE);
+  g_return_val_if_fail (fcfontmap->priv->fontset_cache_file != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  priv = fcfontmap->priv;
+
+  _pango_fc_font_map_lock (fcfontmap);
+
+  if (priv->closed)
+    {
+      _pango_fc_font_map_unlock (fcfontmap);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                           "The font map has been shut down");
+      return FALSE;
+    }
+
+  cache = pango_fc_font_map_get_sort_cache (fcfontmap);
+
+  /* Don't hold the patterns lock while waiting for the mutex
+   * of a pattern set
+   */
+  patterns = g_ptr_array_new ();
+
+  patterns_lock (fcfontmap);
+  g_hash_table_iter_init (&iter, priv->patterns_hash);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &pats))
+    g_ptr_array_add (patterns, pango_fc_patterns_ref (pats));
+  patterns_unlock (fcfontmap);
+
+  for (i = 0; i < patterns->len; i++)
+    {
+      pats = g_ptr_array_index (patterns, i);
+
+      g_mutex_lock (&pats->mutex);
+      if (pats->match || pats->fontset)
+        _pango_fc_sort_cache_add (cache, pats->pattern, pats->match, pats->fontset);
+      g_mutex_unlock (&pats->mutex);
+
+      pango_fc_patterns_unref (pats);
+    }
+
+  g_ptr_array_unref (patterns);
+
+  result = _pango_fc_sort_cache_save (cache, priv->fontset_cache_file, error);
+
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return result;
+}
+
+/* Returns the match and sort results for the fontset cache
+ * file, loading the file on first use. This is NULL if no
+ * file was set.
+ */
+static PangoFcSortCache *
+pango_fc_font_map_get_sort_cache (PangoFcFontMap *fcfontmap)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+
+  if (!priv->fontset_cache_file)
+    return NULL;
+
+  if (!priv->sort_cache)
+    {
+      FcFontSet *fonts = pango_fc_font_map_get_config_fonts (fcfontmap);
+
+      priv->sort_cache = _pango_fc_sort_cache_new (font_set_copy (fonts));
+      _pango_fc_sort_cache_load (priv->sort_cache, priv->fontset_cache_file);
+    }
+
+  return priv->sort_cache;
+}
+
 static FcFontSet *
 pango_fc_font_map_get_config_fonts (PangoFcFontMap *fcfontmap)
 {
@@ -2681,23 +3506,72 @@ pango_fc_font_map_get_config_fonts (PangoFcFontMap *fcfontmap)
   return fcfontmap->priv->fonts;
 }
 
+static gboolean
+font_face_data_key_init (PangoFcFontFaceData *key,
+                         FcPattern           *font_pattern)
+{
+  if (FcPatternGetString (font_pattern, FC_FILE, 0, (FcChar8 **)(void*)&key->filename) != FcResultMatch)
+    return FALSE;
+
+  if (FcPatternGetInteger (font_pattern, FC_INDEX, 0, &key->id) != FcResultMatch)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Evicts unused face data from the end of the LRU list
+ * until at most keep entries are left
+ */
+static void
+pango_fc_font_map_trim_face_data (PangoFcFontMap *fcfontmap,
+                                  guint           keep)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+
+  while (priv->face_data_idle.length > keep)
+    {
+      GList *link = priv->face_data_idle.tail;
+
+      g_queue_unlink (&priv->face_data_idle, link);
+      g_hash_table_remove (priv->font_face_data_hash, link->data);
+      priv->stats[PANGO_FC_FONT_MAP_CACHE_FACE_DATA].evictions++;
+    }
+}
+
+/* The returned data stays valid until the next call
+ * that can add face data, unless a font in font_hash
+ * is using it
+ */
 static PangoFcFontFaceData *
 pango_fc_font_map_get_font_face_data (PangoFcFontMap *fcfontmap,
 				      FcPattern      *font_pattern)
 {
   PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFcFontMapCacheStats *stats = &priv->stats[PANGO_FC_FONT_MAP_CACHE_FACE_DATA];
   PangoFcFontFaceData key;
   PangoFcFontFaceData *data;
 
-  if (FcPatternGetString (font_pattern, FC_FILE, 0, (FcChar8 **)(void*)&key.filename) != FcResultMatch)
-    return NULL;
-
-  if (FcPatternGetInteger (font_pattern, FC_INDEX, 0, &key.id) != FcResultMatch)
+  if (!font_face_data_key_init (&key, font_pattern))
     return NULL;
 
   data = g_hash_table_lookup (priv->font_face_data_hash, &key);
   if (G_LIKELY (data))
-    return data;
+    {
+      stats->hits++;
+
+      if (data->n_fonts == 0 && priv->face_data_idle.head != &data->idle_link)
+        {
+          g_queue_unlink (&priv->face_data_idle, &data->idle_link);
+          g_queue_push_head_link (&priv->face_data_idle, &data->idle_link);
+        }
+
+      return data;
+    }
+
+  stats->misses++;
+
+  /* New entries start out unused, make room for it */
+  pango_fc_font_map_trim_face_data (fcfontmap, MAX (stats->limit, 1) - 1);
 
   data = g_slice_new0 (PangoFcFontFaceData);
   data->filename = key.filename;
@@ -2706,14 +3580,60 @@ pango_fc_font_map_get_font_face_data (PangoFcFontMap *fcfontmap,
   data->pattern = font_pattern;
   FcPatternReference (data->pattern);
 
+  data->idle_link.data = data;
+  g_queue_push_head_link (&priv->face_data_idle, &data->idle_link);
+
   g_hash_table_insert (priv->font_face_data_hash, data, data);
 
   return data;
 }
 
+/* Keeps the face data of fonts in font_hash alive */
+static void
+pango_fc_font_map_face_data_add_font (PangoFcFontMap *fcfontmap,
+                                      PangoFcFont    *fcfont)
+{
+  PangoFcFontFaceData *data;
+
+  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
+  if (!data)
+    return;
+
+  if (data->n_fonts++ == 0)
+    g_queue_unlink (&fcfontmap->priv->face_data_idle, &data->idle_link);
+}
+
+static void
+pango_fc_font_map_face_data_remove_font (PangoFcFontMap *fcfontmap,
+                                         PangoFcFont    *fcfont)
+{
+  PangoFcFontMapPrivate *priv = fcfontmap->priv;
+  PangoFcFontFaceData key;
+  PangoFcFontFaceData *data;
+
+  if (!font_face_data_key_init (&key, fcfont->font_pattern))
+    return;
+
+  data = g_hash_table_lookup (priv->font_face_data_hash, &key);
+  if (!data || data->n_fonts == 0)
+    return;
+
+  if (--data->n_fonts == 0)
+    {
+      g_queue_push_head_link (&priv->face_data_idle, &data->idle_link);
+      pango_fc_font_map_trim_face_data (fcfontmap, priv->stats[PANGO_FC_FONT_MAP_CACHE_FACE_DATA].limit);
+    }
+}
+
 typedef struct {
   PangoCoverage parent_instance;
 
+  /* covered and not_covered are updated as characters are
+   * looked up, so shared coverages need a lock
+   */
+  gboolean thread_safe;
+  GMutex mutex;
+
   FcCharSet *covered;
   FcCharSet *not_covered;
 } PangoFcCoverage;
@@ -2729,6 +3649,21 @@ G_DEFINE_TYPE (PangoFcCoverage, pango_fc_coverage, PANGO_TYPE_COVERAGE)
 static void
 pango_fc_coverage_init (PangoFcCoverage *coverage)
 {
+  g_mutex_init (&coverage->mutex);
+}
+
+static inline void
+pango_fc_coverage_lock (PangoFcCoverage *coverage)
+{
+  if (coverage->thread_safe)
+    g_mutex_lock (&coverage->mutex);
+}
+
+static inline void
+pango_fc_coverage_unlock (PangoFcCoverage *coverage)
+{
+  if (coverage->thread_safe)
+    g_mutex_unlock (&coverage->mutex);
 }
 
 static PangoCoverageLevel
@@ -2736,26 +3671,42 @@ pango_fc_coverage_real_get (PangoCoverage *coverage,
                             int            index)
 {
   PangoFcCoverage *fc_coverage = (PangoFcCoverage*)coverage;
+  PangoCoverageLevel level;
   gunichar ch1, ch2;
 
+  pango_fc_coverage_lock (fc_coverage);
+
   if (FcCharSetHasChar (fc_coverage->covered, index))
-    return PANGO_COVERAGE_EXACT;
+    level = PANGO_COVERAGE_EXACT;
+  else if (FcCharSetHasChar (fc_coverage->not_covered, index))
+    level = PANGO_COVERAGE_NONE;
+  else
+    level = -1;
+
+  pango_fc_coverage_unlock (fc_coverage);
 
-  if (FcCharSetHasChar (fc_coverage->not_covered, index))
-    return PANGO_COVERAGE_NONE;
+  if (level != (PangoCoverageLevel) -1)
+    return level;
+
+  level = PANGO_COVERAGE_NONE;
 
   if (g_unichar_decompose ((gunichar) index, &ch1, &ch2))
     {
       if ((pango_coverage_get (coverage, ch1) == PANGO_COVERAGE_EXACT) &&
           (ch2 == 0 || pango_coverage_get (coverage, ch2) == PANGO_COVERAGE_EXACT))
-        {
-          FcCharSetAddChar (fc_coverage->covered, index);
-          return PANGO_COVERAGE_EXACT;
-        }
+        level = PANGO_COVERAGE_EXACT;
     }
 
-  FcCharSetAddChar (fc_coverage->not_covered, index);
-  return PANGO_COVERAGE_NONE;
+  pango_fc_coverage_lock (fc_coverage);
+
+  if (level == PANGO_COVERAGE_EXACT)
+    FcCharSetAddChar (fc_coverage->covered, index);
+  else
+    FcCharSetAddChar (fc_coverage->not_covered, index);
+
+  pango_fc_coverage_unlock (fc_coverage);
+
+  return level;
 }
 
 static void
@@ -2765,6 +3716,8 @@ pango_fc_coverage_real_set (PangoCoverage *coverage,
 {
   PangoFcCoverage *fc_coverage = (PangoFcCoverage*)coverage;
 
+  pango_fc_coverage_lock (fc_coverage);
+
   if (level == PANGO_COVERAGE_NONE)
     {
       FcCharSetDelChar (fc_coverage->covered, index);
@@ -2775,6 +3728,8 @@ pango_fc_coverage_real_set (PangoCoverage *coverage,
       FcCharSetAddChar (fc_coverage->covered, index);
       FcCharSetDelChar (fc_coverage->not_covered, index);
     }
+
+  pango_fc_coverage_unlock (fc_coverage);
 }
 
 static PangoCoverage *
@@ -2784,8 +3739,11 @@ pango_fc_coverage_real_copy (PangoCoverage *coverage)
   PangoFcCoverage *copy;
 
   copy = g_object_new (pango_fc_coverage_get_type (), NULL);
+
+  pango_fc_coverage_lock (fc_coverage);
   copy->covered = FcCharSetCopy (fc_coverage->covered);
   copy->not_covered = FcCharSetCopy (fc_coverage->not_covered);
+  pango_fc_coverage_unlock (fc_coverage);
 
   return (PangoCoverage *)copy;
 }
@@ -2797,6 +3755,7 @@ pango_fc_coverage_finalize (GObject *object)
 
   FcCharSetDestroy (fc_coverage->covered);
   FcCharSetDestroy (fc_coverage->not_covered);
+  g_mutex_clear (&fc_coverage->mutex);
 
   G_OBJECT_CLASS (pango_fc_coverage_parent_class)->finalize (object);
 }
@@ -2819,11 +3778,17 @@ _pango_fc_font_map_get_coverage (PangoFcFontMap *fcfontmap,
 				 PangoFcFont    *fcfont)
 {
   PangoFcFontFaceData *data;
+  PangoCoverage *coverage;
   FcCharSet *charset;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
   if (G_UNLIKELY (!data))
-    return NULL;
+    {
+      coverage = NULL;
+      goto out;
+    }
 
   if (G_UNLIKELY (data->coverage == NULL))
     {
@@ -2832,12 +3797,21 @@ _pango_fc_font_map_get_coverage (PangoFcFontMap *fcfontmap,
        * doesn't require loading the font
        */
       if (FcPatternGetCharSet (fcfont->font_pattern, FC_CHARSET, 0, &charset) != FcResultMatch)
-        return pango_coverage_new ();
+        {
+          coverage = pango_coverage_new ();
+          goto out;
+        }
 
       data->coverage = _pango_fc_font_map_fc_to_coverage (charset);
+      ((PangoFcCoverage *) data->coverage)->thread_safe = fcfontmap->priv->thread_safe;
     }
 
-  return g_object_ref (data->coverage);
+  coverage = g_object_ref (data->coverage);
+
+out:
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return coverage;
 }
 
 /**
@@ -2895,11 +3869,15 @@ _pango_fc_font_map_get_languages (PangoFcFontMap *fcfontmap,
                                   PangoFcFont    *fcfont)
 {
   PangoFcFontFaceData *data;
+  PangoLanguage **languages = NULL;
   FcLangSet *langset;
+  int n;
+
+  _pango_fc_font_map_lock (fcfontmap);
 
   data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
   if (G_UNLIKELY (!data))
-    return NULL;
+    goto out;
 
   if (G_UNLIKELY (data->languages == NULL))
     {
@@ -2908,12 +3886,103 @@ _pango_fc_font_map_get_languages (PangoFcFontMap *fcfontmap,
        * doesn't require loading the font
        */
       if (FcPatternGetLangSet (fcfont->font_pattern, FC_LANG, 0, &langset) != FcResultMatch)
-        return NULL;
+        goto out;
 
       data->languages = _pango_fc_font_map_fc_to_languages (langset);
     }
 
-  return data->languages;
+  /* Copy them while we hold the lock, the face data may be
+   * evicted once we drop it
+   */
+  for (n = 0; data->languages[n]; n++)
+    ;
+  languages = g_memdup2 (data->languages, (n + 1) * sizeof (PangoLanguage *));
+
+out:
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return languages;
+}
+
+/*
+ * _pango_fc_font_map_get_sample_glyphs:
+ * @fcfontmap: a `PangoFcFontMap`
+ * @fcfont: a `PangoFcFont`
+ * @str: the sample string
+ * @n_glyphs: (out): return location for the number of glyphs
+ * @n_columns: (out): return location for the width of the
+ *   characters that have glyphs, in columns
+ *
+ * Looks up the glyphs for the characters of @str in the cmap
+ * of the face of @fcfont, skipping characters that the face
+ * does not have. The results are cached with the face data.
+ *
+ * Returns: (transfer full): the glyphs, free with g_free()
+ */
+hb_codepoint_t *
+_pango_fc_font_map_get_sample_glyphs (PangoFcFontMap *fcfontmap,
+                                      PangoFcFont    *fcfont,
+                                      const char     *str,
+                                      guint          *n_glyphs,
+                                      int            *n_columns)
+{
+  PangoFcFontFaceData *data;
+  PangoFcSampleGlyphs *sample = NULL;
+  hb_codepoint_t *glyphs = NULL;
+  GSList *l;
+
+  *n_glyphs = 0;
+  *n_columns = 0;
+
+  _pango_fc_font_map_lock (fcfontmap);
+
+  data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
+  if (G_UNLIKELY (!data))
+    goto out;
+
+  for (l = data->sample_glyphs; l; l = l->next)
+    {
+      sample = l->data;
+      if (strcmp (sample->str, str) == 0)
+        break;
+    }
+
+  if (!l)
+    {
+      hb_font_t *hb_font;
+      const char *p;
+
+      hb_font = hb_font_create (pango_fc_font_map_get_hb_face (fcfontmap, fcfont));
+
+      sample = g_new0 (PangoFcSampleGlyphs, 1);
+      sample->str = g_strdup (str);
+      sample->glyphs = g_new (hb_codepoint_t, g_utf8_strlen (str, -1));
+
+      for (p = str; *p; p = g_utf8_next_char (p))
+        {
+          gunichar wc = g_utf8_get_char (p);
+          hb_codepoint_t glyph;
+
+          if (!hb_font_get_nominal_glyph (hb_font, wc, &glyph))
+            continue;
+
+          sample->glyphs[sample->n_glyphs++] = glyph;
+          sample->n_columns += pango_unichar_width (wc);
+        }
+
+      hb_font_destroy (hb_font);
+
+      data->sample_glyphs = g_slist_prepend (data->sample_glyphs, sample);
+    }
+
+  *n_glyphs = sample->n_glyphs;
+  *n_columns = sample->n_columns;
+  glyphs = g_memdup2 (sample->glyphs, sample->n_glyphs * sizeof (hb_codepoint_t));
+
+out:
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return glyphs;
 }
 
 /**
@@ -2977,6 +4046,8 @@ pango_fc_font_map_shutdown (PangoFcFontMap *fcfontmap)
   if (priv->closed)
     return;
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   g_hash_table_foreach (priv->font_hash, (GHFunc) shutdown_font, fcfontmap);
   for (i = 0; i < priv->n_families; i++)
     priv->families[i]->fontmap = NULL;
@@ -2995,6 +4066,8 @@ pango_fc_font_map_shutdown (PangoFcFontMap *fcfontmap)
     }
 
   priv->closed = TRUE;
+
+  _pango_fc_font_map_unlock (fcfontmap);
 }
 
 static PangoWeight
@@ -3414,10 +4487,18 @@ static guint
 pango_fc_family_get_n_items (GListModel *list)
 {
   PangoFcFamily *fcfamily = PANGO_FC_FAMILY (list);
+  PangoFcFontMap *fcfontmap = fcfamily->fontmap;
+  guint n_items;
 
+  if (G_UNLIKELY (!fcfontmap))
+    return 0;
+
+  _pango_fc_font_map_lock (fcfontmap);
   ensure_faces (fcfamily);
+  n_items = (guint)fcfamily->n_faces;
+  _pango_fc_font_map_unlock (fcfontmap);
 
-  return (guint)fcfamily->n_faces;
+  return n_items;
 }
 
 static gpointer
@@ -3425,13 +4506,22 @@ pango_fc_family_get_item (GListModel *list,
                           guint       position)
 {
   PangoFcFamily *fcfamily = PANGO_FC_FAMILY (list);
+  PangoFcFontMap *fcfontmap = fcfamily->fontmap;
+  gpointer item = NULL;
+
+  if (G_UNLIKELY (!fcfontmap))
+    return NULL;
+
+  _pango_fc_font_map_lock (fcfontmap);
 
   ensure_faces (fcfamily);
 
   if (position < fcfamily->n_faces)
-    return g_object_ref (fcfamily->faces[position]);
+    item = g_object_ref (fcfamily->faces[position]);
 
-  return NULL;
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return item;
 }
 
 static void
@@ -3648,6 +4738,8 @@ pango_fc_family_list_faces (PangoFontFamily  *family,
   if (G_UNLIKELY (!fcfamily->fontmap))
     return;
 
+  _pango_fc_font_map_lock (fcfamily->fontmap);
+
   ensure_faces (fcfamily);
 
   if (n_faces)
@@ -3655,6 +4747,8 @@ pango_fc_family_list_faces (PangoFontFamily  *family,
 
   if (faces)
     *faces = g_memdup2 (fcfamily->faces, fcfamily->n_faces * sizeof (PangoFontFace *));
+
+  _pango_fc_font_map_unlock (fcfamily->fontmap);
 }
 
 static PangoFontFace *
@@ -3662,8 +4756,14 @@ pango_fc_family_get_face (PangoFontFamily *family,
                           const char      *name)
 {
   PangoFcFamily *fcfamily = PANGO_FC_FAMILY (family);
+  PangoFontFace *result = NULL;
   int i;
 
+  if (G_UNLIKELY (!fcfamily->fontmap))
+    return NULL;
+
+  _pango_fc_font_map_lock (fcfamily->fontmap);
+
   ensure_faces (fcfamily);
 
   for (i = 0; i < fcfamily->n_faces; i++)
@@ -3672,10 +4772,15 @@ pango_fc_family_get_face (PangoFontFamily *family,
 
       if ((name != NULL && strcmp (name, pango_font_face_get_face_name (face)) == 0) ||
           (name == NULL && PANGO_FC_FACE (face)->regular))
-        return face;
+        {
+          result = face;
+          break;
+        }
     }
 
-  return NULL;
+  _pango_fc_font_map_unlock (fcfamily->fontmap);
+
+  return result;
 }
 
 static const char *
@@ -3750,7 +4855,8 @@ pango_fc_family_init (PangoFcFamily *fcfamily)
  * Retrieves the `hb_face_t` for the given `PangoFcFont`.
  *
  * Returns: (transfer none) (nullable): the `hb_face_t`
- *   for the given font
+ *   for the given font. It stays valid as long as @fcfont
+ *   is alive
  *
  * Since: 1.44
  */
@@ -3758,20 +4864,35 @@ hb_face_t *
 pango_fc_font_map_get_hb_face (PangoFcFontMap *fcfontmap,
                                PangoFcFont    *fcfont)
 {
+  static GQuark hb_face_quark = 0; /* MT-safe */
   PangoFcFontFaceData *data;
+  hb_face_t *hb_face;
+
+  _pango_fc_font_map_lock (fcfontmap);
 
   data = pango_fc_font_map_get_font_face_data (fcfontmap, fcfont->font_pattern);
 
+  /* The face is shared with other fontmaps */
   if (!data->hb_face)
-    {
-      hb_blob_t *blob;
+    data->hb_face = _pango_fc_face_cache_acquire (data->filename, data->id);
 
-      blob = hb_blob_create_from_file (data->filename);
-      data->hb_face = hb_face_create (blob, data->id);
-      hb_blob_destroy (blob);
-    }
+  hb_face = data->hb_face;
 
-  return data->hb_face;
+  /* The face data can be evicted or cleared while the font is
+   * still around, so the font keeps its own reference to the
+   * face it was handed
+   */
+  if (G_UNLIKELY (!hb_face_quark))
+    hb_face_quark = g_quark_from_static_string ("pango-fc-font-hb-face");
+
+  if (g_object_get_qdata (G_OBJECT (fcfont), hb_face_quark) != hb_face)
+    g_object_set_qdata_full (G_OBJECT (fcfont), hb_face_quark,
+                             hb_face_reference (hb_face),
+                             (GDestroyNotify) hb_face_destroy);
+
+  _pango_fc_font_map_unlock (fcfontmap);
+
+  return hb_face;
 }
 
 static gboolean
@@ -3924,11 +5045,39 @@ pango_fc_font_map_add_font_file (PangoFontMap  *fontmap,
   sets[FcSetApplication] = set;
   fonts = filter_by_format (sets, 2);
 
+  _pango_fc_font_map_lock (fcfontmap);
+
   for (int i = 0; i < fonts->nfont; i++)
     pango_fc_font_map_add_pattern (fcfontmap, fonts->fonts[i]);
 
+  _pango_fc_font_map_unlock (fcfontmap);
+
   FcFontSetDestroy (fonts);
   FcFontSetDestroy (set);
 
   return TRUE;
 }
+
+static gboolean
+pango_fc_font_map_is_thread_safe (PangoFontMap *fontmap)
+{
+  return PANGO_FC_FONT_MAP (fontmap)->priv->thread_safe;
+}
+
+/* Queues the sort for the fallback fonts of fontset, so that
+ * it runs in the fontconfig thread while the first font is
+ * being loaded
+ */
+static void
+pango_fc_font_map_prewarm_fontset (PangoFontMap *fontmap,
+                                   PangoFontset *fontset)
+{
+  PangoFcFontMap *fcfontmap = PANGO_FC_FONT_MAP (fontmap);
+
+  if (!PANGO_FC_IS_FONTSET (fontset))
+    return;
+
+  _pango_fc_font_map_lock (fcfontmap);
+  pango_fc_patterns_queue_sort (PANGO_FC_FONTSET (fontset)->patterns);
+  _pango_fc_font_map_unlock (fcfontmap);
+}
@@ -67,6 +67,93 @@ PANGO_AVAILABLE_IN_1_38
 FcConfig *
 pango_fc_font_map_get_config (PangoFcFontMap *fcfontmap);
 
+PANGO_AVAILABLE_IN_1_60
+void
+pango_fc_font_map_set_thread_safe (PangoFcFontMap *fcfontmap,
+                                   gboolean        thread_safe);
+PANGO_AVAILABLE_IN_1_60
+gboolean
+pango_fc_font_map_get_thread_safe (PangoFcFontMap *fcfontmap);
+
+/**
+ * PangoFcFontMapCache:
+ * @PANGO_FC_FONT_MAP_CACHE_FONTSETS: the recently used fontsets
+ * @PANGO_FC_FONT_MAP_CACHE_FONTS: the fonts that are in use. This
+ *   cache can not be limited
+ * @PANGO_FC_FONT_MAP_CACHE_FACE_DATA: the data that is shared by all
+ *   fonts using the same font file, like coverage and HarfBuzz faces.
+ *   The limit applies to the entries that no font is using
+ * @PANGO_FC_FONT_MAP_CACHE_PATTERNS: the uniquified fontconfig patterns.
+ *   This cache can not be limited directly, unused patterns are
+ *   dropped when it grows large compared to the fontset limit
+ *
+ * The caches of a `PangoFcFontMap`.
+ *
+ * See [method@PangoFc.FontMap.set_cache_limit] and
+ * [method@PangoFc.FontMap.get_cache_stats].
+ *
+ * Since: 1.60
+ */
+typedef enum {
+  PANGO_FC_FONT_MAP_CACHE_FONTSETS,
+  PANGO_FC_FONT_MAP_CACHE_FONTS,
+  PANGO_FC_FONT_MAP_CACHE_FACE_DATA,
+  PANGO_FC_FONT_MAP_CACHE_PATTERNS
+} PangoFcFontMapCache;
+
+/**
+ * PangoFcFontMapCacheStats:
+ * @size: the number of entries in the cache
+ * @limit: the limit for the cache, or `G_MAXUINT` if it is not limited
+ * @hits: the number of lookups that found an entry
+ * @misses: the number of lookups that had to create an entry
+ * @evictions: the number of entries that were evicted to stay
+ *   within the limit
+ *
+ * Statistics about one of the caches of a `PangoFcFontMap`.
+ *
+ * The counters are kept across [method@PangoFc.FontMap.cache_clear].
+ *
+ * Since: 1.60
+ */
+typedef struct _PangoFcFontMapCacheStats PangoFcFontMapCacheStats;
+
+struct _PangoFcFontMapCacheStats
+{
+  guint size;
+  guint limit;
+  guint64 hits;
+  guint64 misses;
+  guint64 evictions;
+};
+
+PANGO_AVAILABLE_IN_1_60
+void
+pango_fc_font_map_set_cache_limit (PangoFcFontMap      *fcfontmap,
+                                   PangoFcFontMapCache  cache,
+                                   guint                limit);
+PANGO_AVAILABLE_IN_1_60
+guint
+pango_fc_font_map_get_cache_limit (PangoFcFontMap      *fcfontmap,
+                                   PangoFcFontMapCache  cache);
+PANGO_AVAILABLE_IN_1_60
+void
+pango_fc_font_map_get_cache_stats (PangoFcFontMap           *fcfontmap,
+                                   PangoFcFontMapCache       cache,
+                                   PangoFcFontMapCacheStats *stats);
+
+PANGO_AVAILABLE_IN_1_60
+void
+pango_fc_font_map_set_fontset_cache_file (PangoFcFontMap *fcfontmap,
+                                          const char     *filename);
+PANGO_AVAILABLE_IN_1_60
+const char *
+pango_fc_font_map_get_fontset_cache_file (PangoFcFontMap *fcfontmap);
+PANGO_AVAILABLE_IN_1_60
+gboolean
+pango_fc_font_map_save_fontset_cache     (PangoFcFontMap  *fcfontmap,
+                                          GError         **error);
+
 /**
  * PangoFcDecoderFindFunc:
  * @pattern: a fully resolved `FcPattern` specifying the font on the system
@@ -53,6 +53,13 @@ struct _PangoFcMetricsInfo
 
 void _pango_fc_font_shutdown (PangoFcFont *fcfont);
 
+_PANGO_EXTERN
+void           _pango_fc_font_map_lock            (PangoFcFontMap *fcfontmap);
+_PANGO_EXTERN
+void           _pango_fc_font_map_unlock          (PangoFcFontMap *fcfontmap);
+_PANGO_EXTERN
+gboolean       _pango_fc_font_map_is_thread_safe  (PangoFcFontMap *fcfontmap);
+
 void           _pango_fc_font_map_remove          (PangoFcFontMap *fcfontmap,
 						   PangoFcFont    *fcfont);
 
@@ -81,6 +88,34 @@ PangoFontMetrics *pango_fc_font_create_base_metrics_for_context (PangoFcFont   *
 PangoLanguage **_pango_fc_font_map_get_languages (PangoFcFontMap *fcfontmap,
                                                   PangoFcFont    *fcfont);
 
+hb_codepoint_t *_pango_fc_font_map_get_sample_glyphs (PangoFcFontMap *fcfontmap,
+                                                      PangoFcFont    *fcfont,
+                                                      const char     *str,
+                                                      guint          *n_glyphs,
+                                                      int            *n_columns);
+
+typedef struct _PangoFcSortCache PangoFcSortCache;
+
+PangoFcSortCache *_pango_fc_sort_cache_new    (FcFontSet         *fonts);
+void              _pango_fc_sort_cache_free   (PangoFcSortCache  *cache);
+gboolean          _pango_fc_sort_cache_load   (PangoFcSortCache  *cache,
+                                               const char        *filename);
+gboolean          _pango_fc_sort_cache_lookup (PangoFcSortCache  *cache,
+                                               FcPattern         *pattern,
+                                               FcPattern        **match,
+                                               FcFontSet        **sorted);
+void              _pango_fc_sort_cache_add    (PangoFcSortCache  *cache,
+                                               FcPattern         *pattern,
+                                               FcPattern         *match,
+                                               FcFontSet         *sorted);
+gboolean          _pango_fc_sort_cache_save   (PangoFcSortCache  *cache,
+                                               const char        *filename,
+                                               GError           **error);
+
+hb_face_t *       _pango_fc_face_cache_acquire (const char        *filename,
+                                                unsigned int       index);
+void              _pango_fc_face_cache_release (hb_face_t         *hb_face);
+
 G_END_DECLS
 
 #endif /* __PANGOFC_PRIVATE_H__ */
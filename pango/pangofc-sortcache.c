@@ -0,0 +1,504 @@
+/* Pango
+ * pangofc-sortcache.c: Persistent cache of fontconfig match and sort results
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "pangofc-private.h"
+
+/* The cache file stores the results of FcFontSetMatch() and
+ * FcFontSetSort() for search patterns, so that short-lived
+ * processes can skip them. Fonts are stored as positions in
+ * the set of fonts of the fontconfig configuration, and the
+ * file records a fingerprint of that set. When the fonts change,
+ * the fingerprint no longer matches and the file is ignored.
+ *
+ * The file is mapped and used in place. It consists of a header
+ * followed by the entries. All fields are 32 bits wide, except
+ * for the fingerprint, and are in native byte order:
+ *
+ *   header: magic (8 bytes), version, n_fonts,
+ *           fingerprint (64 bits), n_entries, reserved
+ *   entry:  key_size, match, n_sorted,
+ *           key (key_size bytes, nul-terminated, padded to 4 bytes),
+ *           sorted (n_sorted positions)
+ *
+ * The key is the search pattern, as unparsed by FcNameUnparse().
+ * A match of -1 means that FcFontSetMatch() found nothing, and
+ * an n_sorted of -1 that the sort results were never needed.
+ */
+
+#define SORT_CACHE_MAGIC "PANGOFCS"
+#define SORT_CACHE_VERSION 1
+
+typedef struct
+{
+  char magic[8];
+  guint32 version;
+  guint32 n_fonts;
+  guint64 fingerprint;
+  guint32 n_entries;
+  guint32 reserved;
+} SortCacheHeader;
+
+typedef struct
+{
+  guint32 key_size;
+  gint32 match;
+  gint32 n_sorted;
+} SortCacheRecord;
+
+typedef struct
+{
+  const char *key;
+  int match;
+  int n_sorted;
+  const guint32 *sorted;
+
+  /* Entries that were added after loading the file own
+   * their key and positions, the others point into the file
+   */
+  gboolean owned;
+} SortCacheEntry;
+
+struct _PangoFcSortCache
+{
+  FcFontSet *fonts;
+  guint64 fingerprint;
+
+  GMappedFile *file;
+  GHashTable *entries;    /* Maps key -> SortCacheEntry */
+
+  /* Used to find the positions of fonts when adding
+   * entries. Built on demand. The values are position + 1.
+   */
+  GHashTable *positions;       /* Maps FcPattern -> position */
+  GHashTable *file_positions;  /* Maps "file:index" -> position */
+};
+
+static void
+sort_cache_entry_free (gpointer data)
+{
+  SortCacheEntry *entry = data;
+
+  if (entry->owned)
+    {
+      g_free ((char *) entry->key);
+      g_free ((guint32 *) entry->sorted);
+    }
+
+  g_free (entry);
+}
+
+static guint64
+fingerprint_fonts (FcFontSet *fonts)
+{
+  guint64 fingerprint = G_GUINT64_CONSTANT (14695981039346656037);
+  int i;
+
+  for (i = 0; i < fonts->nfont; i++)
+    {
+      fingerprint ^= FcPatternHash (fonts->fonts[i]);
+      fingerprint *= G_GUINT64_CONSTANT (1099511628211);
+    }
+
+  return fingerprint;
+}
+
+static char *
+file_position_key (FcPattern *pattern)
+{
+  const char *file;
+  int index;
+
+  if (FcPatternGetString (pattern, FC_FILE, 0, (FcChar8 **)(void*)&file) != FcResultMatch ||
+      FcPatternGetInteger (pattern, FC_INDEX, 0, &index) != FcResultMatch)
+    return NULL;
+
+  return g_strdup_printf ("%s:%d", file, index);
+}
+
+/*
+ * _pango_fc_sort_cache_new:
+ * @fonts: (transfer full): the fonts of the fontconfig configuration
+ *
+ * Creates an empty cache for match and sort results
+ * among @fonts.
+ *
+ * Returns: a new `PangoFcSortCache`
+ */
+PangoFcSortCache *
+_pango_fc_sort_cache_new (FcFontSet *fonts)
+{
+  PangoFcSortCache *cache;
+
+  cache = g_new0 (PangoFcSortCache, 1);
+  cache->fonts = fonts;
+  cache->fingerprint = fingerprint_fonts (fonts);
+  cache->entries = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                          NULL, sort_cache_entry_free);
+
+  return cache;
+}
+
+void
+_pango_fc_sort_cache_free (PangoFcSortCache *cache)
+{
+  g_hash_table_unref (cache->entries);
+  g_clear_pointer (&cache->positions, g_hash_table_unref);
+  g_clear_pointer (&cache->file_positions, g_hash_table_unref);
+  g_clear_pointer (&cache->file, g_mapped_file_unref);
+  FcFontSetDestroy (cache->fonts);
+  g_free (cache);
+}
+
+/*
+ * _pango_fc_sort_cache_load:
+ * @cache: a `PangoFcSortCache`
+ * @filename: the cache file
+ *
+ * Maps @filename and adds its entries to @cache, if it
+ * was written for the same fonts.
+ *
+ * Returns: %TRUE if the file was loaded
+ */
+gboolean
+_pango_fc_sort_cache_load (PangoFcSortCache *cache,
+                           const char       *filename)
+{
+  GMappedFile *file;
+  const char *data, *p, *end;
+  const SortCacheHeader *header;
+  guint32 i;
+
+  g_return_val_if_fail (cache->file == NULL, FALSE);
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  if (!file)
+    return FALSE;
+
+  data = g_mapped_file_get_contents (file);
+  end = data + g_mapped_file_get_length (file);
+
+  if (end - data < (gssize) sizeof (SortCacheHeader))
+    goto fail;
+
+  header = (const SortCacheHeader *) data;
+  if (memcmp (header->magic, SORT_CACHE_MAGIC, 8) != 0 ||
+      header->version != SORT_CACHE_VERSION ||
+      header->n_fonts != (guint32) cache->fonts->nfont ||
+      header->fingerprint != cache->fingerprint)
+    goto fail;
+
+  p = data + sizeof (SortCacheHeader);
+  for (i = 0; i < header->n_entries; i++)
+    {
+      const SortCacheRecord *record;
+      SortCacheEntry *entry;
+      const guint32 *sorted;
+      int j;
+
+      if (end - p < (gssize) sizeof (SortCacheRecord))
+        goto fail;
+
+      record = (const SortCacheRecord *) p;
+      p += sizeof (SortCacheRecord);
+
+      if (record->key_size == 0 || record->key_size % 4 != 0 ||
+          (gsize) (end - p) < record->key_size ||
+          record->match < -1 || record->match >= cache->fonts->nfont ||
+          record->n_sorted < -1 || record->n_sorted > cache->fonts->nfont ||
+          (record->match == -1 && record->n_sorted == -1))
+        goto fail;
+
+      if (p[record->key_size - 1] != '\0')
+        goto fail;
+
+      sorted = (const guint32 *) (p + record->key_size);
+      p += record->key_size;
+
+      if (record->n_sorted > 0)
+        {
+          if ((gsize) (end - p) < record->n_sorted * sizeof (guint32))
+            goto fail;
+
+          for (j = 0; j < record->n_sorted; j++)
+            {
+              if (sorted[j] >= (guint32) cache->fonts->nfont)
+                goto fail;
+            }
+
+          p += record->n_sorted * sizeof (guint32);
+        }
+
+      entry = g_new (SortCacheEntry, 1);
+      entry->key = (const char *) record + sizeof (SortCacheRecord);
+      entry->match = record->match;
+      entry->n_sorted = record->n_sorted;
+      entry->sorted = sorted;
+      entry->owned = FALSE;
+
+      g_hash_table_insert (cache->entries, (gpointer) entry->key, entry);
+    }
+
+  cache->file = file;
+
+  return TRUE;
+
+fail:
+  /* Drop whatever we added from the file before finding
+   * out that it is corrupt
+   */
+  g_hash_table_remove_all (cache->entries);
+  g_mapped_file_unref (file);
+
+  return FALSE;
+}
+
+/*
+ * _pango_fc_sort_cache_lookup:
+ * @cache: a `PangoFcSortCache`
+ * @pattern: the search pattern
+ * @match: (out): return location for the best match among the fonts,
+ *   or %NULL if there was none or it isn't known
+ * @sorted: (out): return location for a new `FcFontSet` with the
+ *   untrimmed sort results, or %NULL if they aren't known
+ *
+ * Looks up the results of FcFontSetMatch() and FcFontSetSort()
+ * for @pattern. The match is one of the fonts of the cache, and
+ * still needs to be passed to FcFontRenderPrepare().
+ *
+ * Returns: %TRUE if @cache has results for @pattern
+ */
+gboolean
+_pango_fc_sort_cache_lookup (PangoFcSortCache  *cache,
+                             FcPattern         *pattern,
+                             FcPattern        **match,
+                             FcFontSet        **sorted)
+{
+  SortCacheEntry *entry;
+  FcChar8 *key;
+  int i;
+
+  *match = NULL;
+  *sorted = NULL;
+
+  if (g_hash_table_size (cache->entries) == 0)
+    return FALSE;
+
+  key = FcNameUnparse (pattern);
+  if (!key)
+    return FALSE;
+
+  entry = g_hash_table_lookup (cache->entries, key);
+  FcStrFree (key);
+
+  if (!entry)
+    return FALSE;
+
+  if (entry->match >= 0)
+    *match = cache->fonts->fonts[entry->match];
+
+  if (entry->n_sorted >= 0)
+    {
+      *sorted = FcFontSetCreate ();
+      for (i = 0; i < entry->n_sorted; i++)
+        {
+          FcPattern *font = cache->fonts->fonts[entry->sorted[i]];
+
+          FcPatternReference (font);
+          FcFontSetAdd (*sorted, font);
+        }
+    }
+
+  return TRUE;
+}
+
+static void
+ensure_positions (PangoFcSortCache *cache)
+{
+  int i;
+
+  if (cache->positions)
+    return;
+
+  cache->positions = g_hash_table_new (NULL, NULL);
+  cache->file_positions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (i = 0; i < cache->fonts->nfont; i++)
+    {
+      FcPattern *font = cache->fonts->fonts[i];
+      char *key;
+
+      g_hash_table_insert (cache->positions, font, GINT_TO_POINTER (i + 1));
+
+      key = file_position_key (font);
+      if (key && !g_hash_table_contains (cache->file_positions, key))
+        g_hash_table_insert (cache->file_positions, key, GINT_TO_POINTER (i + 1));
+      else
+        g_free (key);
+    }
+}
+
+/*
+ * _pango_fc_sort_cache_add:
+ * @cache: a `PangoFcSortCache`
+ * @pattern: the search pattern
+ * @match: (nullable): the result of FcFontSetMatch()
+ * @sorted: (nullable): the untrimmed result of FcFontSetSort()
+ *
+ * Records results for @pattern, to be written out by
+ * _pango_fc_sort_cache_save(). If @match is %NULL, @sorted
+ * must be set, and FcFontSetMatch() is assumed to have failed.
+ * Results that refer to fonts that are not in the cache are
+ * ignored.
+ */
+void
+_pango_fc_sort_cache_add (PangoFcSortCache *cache,
+                          FcPattern        *pattern,
+                          FcPattern        *match,
+                          FcFontSet        *sorted)
+{
+  SortCacheEntry *entry, *old;
+  FcChar8 *key;
+  int match_pos = -1;
+  guint32 *positions = NULL;
+  int i;
+
+  g_return_if_fail (match != NULL || sorted != NULL);
+
+  key = FcNameUnparse (pattern);
+  if (!key)
+    return;
+
+  old = g_hash_table_lookup (cache->entries, key);
+  if (old && (old->n_sorted >= 0 || !sorted))
+    {
+      FcStrFree (key);
+      return;
+    }
+
+  ensure_positions (cache);
+
+  if (match)
+    {
+      char *file_key = file_position_key (match);
+
+      if (file_key)
+        match_pos = GPOINTER_TO_INT (g_hash_table_lookup (cache->file_positions, file_key)) - 1;
+      g_free (file_key);
+
+      if (match_pos < 0)
+        sorted = NULL;
+    }
+
+  if (sorted)
+    {
+      positions = g_new (guint32, MAX (sorted->nfont, 1));
+
+      for (i = 0; i < sorted->nfont; i++)
+        {
+          int pos = GPOINTER_TO_INT (g_hash_table_lookup (cache->positions, sorted->fonts[i])) - 1;
+
+          if (pos < 0)
+            break;
+
+          positions[i] = pos;
+        }
+
+      if (i < sorted->nfont)
+        g_clear_pointer (&positions, g_free);
+    }
+
+  if (match_pos < 0 && !positions)
+    {
+      FcStrFree (key);
+      return;
+    }
+
+  entry = g_new (SortCacheEntry, 1);
+  entry->key = g_strdup ((const char *) key);
+  entry->match = match_pos;
+  entry->n_sorted = positions ? sorted->nfont : -1;
+  entry->sorted = positions;
+  entry->owned = TRUE;
+
+  FcStrFree (key);
+
+  g_hash_table_replace (cache->entries, (gpointer) entry->key, entry);
+}
+
+/*
+ * _pango_fc_sort_cache_save:
+ * @cache: a `PangoFcSortCache`
+ * @filename: the cache file
+ * @error: return location for an error
+ *
+ * Writes all entries of @cache to @filename, replacing
+ * it atomically.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+_pango_fc_sort_cache_save (PangoFcSortCache  *cache,
+                           const char        *filename,
+                           GError           **error)
+{
+  SortCacheHeader header = { { 0, }, };
+  static const char padding[4] = { 0, };
+  GByteArray *bytes;
+  GHashTableIter iter;
+  SortCacheEntry *entry;
+  gboolean result;
+
+  memcpy (header.magic, SORT_CACHE_MAGIC, 8);
+  header.version = SORT_CACHE_VERSION;
+  header.n_fonts = cache->fonts->nfont;
+  header.fingerprint = cache->fingerprint;
+  header.n_entries = g_hash_table_size (cache->entries);
+
+  bytes = g_byte_array_new ();
+  g_byte_array_append (bytes, (const guint8 *) &header, sizeof (header));
+
+  g_hash_table_iter_init (&iter, cache->entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      SortCacheRecord record;
+      gsize len = strlen (entry->key) + 1;
+
+      record.key_size = (len + 3) & ~3;
+      record.match = entry->match;
+      record.n_sorted = entry->n_sorted;
+
+      g_byte_array_append (bytes, (const guint8 *) &record, sizeof (record));
+      g_byte_array_append (bytes, (const guint8 *) entry->key, len);
+      g_byte_array_append (bytes, (const guint8 *) padding, record.key_size - len);
+      if (entry->n_sorted > 0)
+        g_byte_array_append (bytes, (const guint8 *) entry->sorted,
+                             entry->n_sorted * sizeof (guint32));
+    }
+
+  result = g_file_set_contents (filename, (const char *) bytes->data, bytes->len, error);
+
+  g_byte_array_unref (bytes);
+
+  return result;
+}
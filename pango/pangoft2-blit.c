@@ -0,0 +1,346 @@
+/* Pango
+ * pangoft2-blit.c: Compositing coverage into FT_Bitmaps
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "pangoft2-private.h"
+
+/* All compositing into the target bitmap is a saturating add
+ * of 8-bit coverage values. We have vectorized versions of the
+ * row operations for SSE2, AVX2 and NEON. SSE2 and NEON are part
+ * of the baseline of the architectures where we use them, AVX2
+ * is picked at runtime if the CPU supports it.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(_M_ARM64)
+#define HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef struct
+{
+  void (* add_row)  (guchar       *dest,
+                     const guchar *src,
+                     int           width);
+  void (* add_span) (guchar       *dest,
+                     guchar        value,
+                     int           width);
+} BlitFuncs;
+
+static BlitFuncs blit_funcs;
+
+/* Expands the bits of a byte, most significant first,
+ * into 8 bytes of 0x00 or 0xff
+ */
+static guint64 mono_expand[256];
+
+static void
+add_row_c (guchar       *dest,
+           const guchar *src,
+           int           width)
+{
+  int i;
+
+  for (i = 0; i < width; i++)
+    {
+      int v = dest[i] + src[i];
+      dest[i] = MIN (v, 0xff);
+    }
+}
+
+static void
+add_span_c (guchar *dest,
+            guchar  value,
+            int     width)
+{
+  int i;
+
+  for (i = 0; i < width; i++)
+    {
+      int v = dest[i] + value;
+      dest[i] = MIN (v, 0xff);
+    }
+}
+
+#ifdef HAVE_SSE2
+static void
+add_row_sse2 (guchar       *dest,
+              const guchar *src,
+              int           width)
+{
+  int i;
+
+  for (i = 0; i + 16 <= width; i += 16)
+    {
+      __m128i d = _mm_loadu_si128 ((const __m128i *) (dest + i));
+      __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+
+      _mm_storeu_si128 ((__m128i *) (dest + i), _mm_adds_epu8 (d, s));
+    }
+
+  add_row_c (dest + i, src + i, width - i);
+}
+
+static void
+add_span_sse2 (guchar *dest,
+               guchar  value,
+               int     width)
+{
+  __m128i v = _mm_set1_epi8 ((char) value);
+  int i;
+
+  for (i = 0; i + 16 <= width; i += 16)
+    {
+      __m128i d = _mm_loadu_si128 ((const __m128i *) (dest + i));
+
+      _mm_storeu_si128 ((__m128i *) (dest + i), _mm_adds_epu8 (d, v));
+    }
+
+  add_span_c (dest + i, value, width - i);
+}
+#endif
+
+#ifdef HAVE_AVX2
+__attribute__ ((target ("avx2")))
+static void
+add_row_avx2 (guchar       *dest,
+              const guchar *src,
+              int           width)
+{
+  int i;
+
+  for (i = 0; i + 32 <= width; i += 32)
+    {
+      __m256i d = _mm256_loadu_si256 ((const __m256i *) (dest + i));
+      __m256i s = _mm256_loadu_si256 ((const __m256i *) (src + i));
+
+      _mm256_storeu_si256 ((__m256i *) (dest + i), _mm256_adds_epu8 (d, s));
+    }
+
+  add_row_c (dest + i, src + i, width - i);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+add_span_avx2 (guchar *dest,
+               guchar  value,
+               int     width)
+{
+  __m256i v = _mm256_set1_epi8 ((char) value);
+  int i;
+
+  for (i = 0; i + 32 <= width; i += 32)
+    {
+      __m256i d = _mm256_loadu_si256 ((const __m256i *) (dest + i));
+
+      _mm256_storeu_si256 ((__m256i *) (dest + i), _mm256_adds_epu8 (d, v));
+    }
+
+  add_span_c (dest + i, value, width - i);
+}
+#endif
+
+#ifdef HAVE_NEON
+static void
+add_row_neon (guchar       *dest,
+              const guchar *src,
+              int           width)
+{
+  int i;
+
+  for (i = 0; i + 16 <= width; i += 16)
+    vst1q_u8 (dest + i, vqaddq_u8 (vld1q_u8 (dest + i), vld1q_u8 (src + i)));
+
+  add_row_c (dest + i, src + i, width - i);
+}
+
+static void
+add_span_neon (guchar *dest,
+               guchar  value,
+               int     width)
+{
+  uint8x16_t v = vdupq_n_u8 (value);
+  int i;
+
+  for (i = 0; i + 16 <= width; i += 16)
+    vst1q_u8 (dest + i, vqaddq_u8 (vld1q_u8 (dest + i), v));
+
+  add_span_c (dest + i, value, width - i);
+}
+#endif
+
+static void
+init_blit_funcs (void)
+{
+  static gsize initialized = 0;
+
+  if (g_once_init_enter (&initialized))
+    {
+      int i, k;
+
+      for (i = 0; i < 256; i++)
+        {
+          guchar bytes[8];
+
+          for (k = 0; k < 8; k++)
+            bytes[k] = (i & (0x80 >> k)) ? 0xff : 0;
+
+          memcpy (&mono_expand[i], bytes, 8);
+        }
+
+      blit_funcs.add_row = add_row_c;
+      blit_funcs.add_span = add_span_c;
+
+#if defined (HAVE_SSE2)
+      blit_funcs.add_row = add_row_sse2;
+      blit_funcs.add_span = add_span_sse2;
+#elif defined (HAVE_NEON)
+      blit_funcs.add_row = add_row_neon;
+      blit_funcs.add_span = add_span_neon;
+#endif
+
+#ifdef HAVE_AVX2
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        {
+          blit_funcs.add_row = add_row_avx2;
+          blit_funcs.add_span = add_span_avx2;
+        }
+#endif
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+/*
+ * _pango_ft2_blit_gray_row:
+ * @dest: the first destination pixel
+ * @src: the first source pixel
+ * @width: the number of pixels
+ *
+ * Composites a row of 8-bit coverage values into a grayscale
+ * bitmap row, saturating at 0xff.
+ */
+void
+_pango_ft2_blit_gray_row (guchar       *dest,
+                          const guchar *src,
+                          int           width)
+{
+  if (width <= 0)
+    return;
+
+  init_blit_funcs ();
+  blit_funcs.add_row (dest, src, width);
+}
+
+/*
+ * _pango_ft2_blit_mono_row:
+ * @dest: the destination pixel for @x_start
+ * @src: the start of a row of a 1-bit bitmap
+ * @x_start: the first pixel of the row to composite
+ * @x_limit: the end of the pixels to composite
+ *
+ * Composites pixels @x_start to @x_limit of a row of a 1-bit,
+ * msb-first bitmap into a grayscale bitmap row. Set bits turn
+ * the destination pixel to 0xff.
+ */
+void
+_pango_ft2_blit_mono_row (guchar       *dest,
+                          const guchar *src,
+                          int           x_start,
+                          int           x_limit)
+{
+  int ix = x_start;
+
+  init_blit_funcs ();
+
+  /* Leading pixels up to a byte boundary */
+  for (; ix < x_limit && (ix % 8) != 0; ix++, dest++)
+    {
+      if (src[ix / 8] & (0x80 >> (ix % 8)))
+        *dest = 0xff;
+    }
+
+  /* Whole source bytes, 8 pixels at a time */
+  for (; ix + 8 <= x_limit; ix += 8, dest += 8)
+    {
+      guchar bits = src[ix / 8];
+      guint64 d;
+
+      if (bits == 0)
+        continue;
+
+      if (bits == 0xff)
+        {
+          memset (dest, 0xff, 8);
+          continue;
+        }
+
+      memcpy (&d, dest, 8);
+      d |= mono_expand[bits];
+      memcpy (dest, &d, 8);
+    }
+
+  /* Trailing pixels */
+  for (; ix < x_limit; ix++, dest++)
+    {
+      if (src[ix / 8] & (0x80 >> (ix % 8)))
+        *dest = 0xff;
+    }
+}
+
+/*
+ * _pango_ft2_fill_span:
+ * @dest: the first destination pixel
+ * @value: the coverage to add
+ * @width: the number of pixels
+ *
+ * Adds the same coverage value to a span of pixels of
+ * a grayscale bitmap row, saturating at 0xff.
+ */
+void
+_pango_ft2_fill_span (guchar *dest,
+                      guchar  value,
+                      int     width)
+{
+  if (width <= 0 || value == 0)
+    return;
+
+  if (value == 0xff)
+    {
+      memset (dest, 0xff, width);
+      return;
+    }
+
+  init_blit_funcs ();
+  blit_funcs.add_span (dest, value, width);
+}
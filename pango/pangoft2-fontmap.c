@@ -53,6 +53,8 @@ struct _PangoFT2FontMap
   double dpi_y;
 
   PangoRenderer *renderer;
+  PangoFT2GlyphCache *glyph_cache;
+  int render_threads;
 };
 
 struct _PangoFT2FontMapClass
@@ -97,6 +99,9 @@ pango_ft2_font_map_init (PangoFT2FontMap *fontmap)
   fontmap->dpi_x   = 72.0;
   fontmap->dpi_y   = 72.0;
 
+  fontmap->glyph_cache = _pango_ft2_glyph_cache_new (PANGO_FT2_GLYPH_CACHE_DEFAULT_SIZE);
+  fontmap->render_threads = 1;
+
   error = FT_Init_FreeType (&fontmap->library);
   if (error != FT_Err_Ok)
     g_critical ("pango_ft2_font_map_init: Could not initialize freetype");
@@ -110,6 +115,8 @@ pango_ft2_font_map_finalize (GObject *object)
   if (ft2fontmap->renderer)
     g_object_unref (ft2fontmap->renderer);
 
+  _pango_ft2_glyph_cache_free (ft2fontmap->glyph_cache);
+
   G_OBJECT_CLASS (pango_ft2_font_map_parent_class)->finalize (object);
 
   FT_Done_FreeType (ft2fontmap->library);
@@ -229,6 +236,98 @@ pango_ft2_font_map_set_resolution (PangoFT2FontMap *fontmap,
   pango_ft2_font_map_substitute_changed (fontmap);
 }
 
+/**
+ * pango_ft2_font_map_set_glyph_cache_size:
+ * @fontmap: a `PangoFT2FontMap`
+ * @max_size: the maximum size of the cache, in bytes
+ *
+ * Sets the memory budget for rendered glyphs.
+ *
+ * The renderers for @fontmap keep rendered glyph bitmaps
+ * in a cache that is shared by all fonts of the fontmap.
+ * When the cache grows beyond @max_size bytes, the least
+ * recently used glyphs are dropped from it.
+ *
+ * Since: 1.60
+ */
+void
+pango_ft2_font_map_set_glyph_cache_size (PangoFT2FontMap *fontmap,
+                                         gsize            max_size)
+{
+  g_return_if_fail (PANGO_FT2_IS_FONT_MAP (fontmap));
+
+  _pango_ft2_glyph_cache_set_max_size (fontmap->glyph_cache, max_size);
+}
+
+/**
+ * pango_ft2_font_map_get_glyph_cache_size:
+ * @fontmap: a `PangoFT2FontMap`
+ *
+ * Gets the memory budget for rendered glyphs that has been
+ * set with [method@PangoFT2.FontMap.set_glyph_cache_size].
+ *
+ * Return value: the maximum size of the glyph cache, in bytes
+ *
+ * Since: 1.60
+ */
+gsize
+pango_ft2_font_map_get_glyph_cache_size (PangoFT2FontMap *fontmap)
+{
+  g_return_val_if_fail (PANGO_FT2_IS_FONT_MAP (fontmap), 0);
+
+  return _pango_ft2_glyph_cache_get_max_size (fontmap->glyph_cache);
+}
+
+/**
+ * pango_ft2_font_map_set_render_threads:
+ * @fontmap: a `PangoFT2FontMap`
+ * @n_threads: the maximum number of threads to use, or 0
+ *   to use one thread per processor
+ *
+ * Sets the number of threads that are used to render layouts.
+ *
+ * If @n_threads is bigger than 1, [func@PangoFT2.render_layout]
+ * and [func@PangoFT2.render_layout_subpixel] split big bitmaps into
+ * horizontal bands that are drawn in parallel. The result is the
+ * same as when drawing with a single thread.
+ *
+ * The default is to use a single thread.
+ *
+ * Since: 1.60
+ */
+void
+pango_ft2_font_map_set_render_threads (PangoFT2FontMap *fontmap,
+                                       int              n_threads)
+{
+  g_return_if_fail (PANGO_FT2_IS_FONT_MAP (fontmap));
+  g_return_if_fail (n_threads >= 0);
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  fontmap->render_threads = n_threads;
+}
+
+/**
+ * pango_ft2_font_map_get_render_threads:
+ * @fontmap: a `PangoFT2FontMap`
+ *
+ * Gets the number of threads that are used to render layouts.
+ *
+ * See [method@PangoFT2.FontMap.set_render_threads].
+ *
+ * Return value: the maximum number of threads
+ *
+ * Since: 1.60
+ */
+int
+pango_ft2_font_map_get_render_threads (PangoFT2FontMap *fontmap)
+{
+  g_return_val_if_fail (PANGO_FT2_IS_FONT_MAP (fontmap), 1);
+
+  return fontmap->render_threads;
+}
+
 /**
  * pango_ft2_font_map_create_context: (skip)
  * @fontmap: a `PangoFT2FontMap`
@@ -343,6 +442,12 @@ _pango_ft2_font_map_get_renderer (PangoFT2FontMap *ft2fontmap)
   return ft2fontmap->renderer;
 }
 
+PangoFT2GlyphCache *
+_pango_ft2_font_map_get_glyph_cache (PangoFT2FontMap *ft2fontmap)
+{
+  return ft2fontmap->glyph_cache;
+}
+
 void
 _pango_ft2_font_map_default_substitute (PangoFcFontMap *fcfontmap,
 				       FcPattern      *pattern)
@@ -0,0 +1,515 @@
+/* Pango
+ * pangoft2-glyphcache.c: Cache of rendered glyph bitmaps
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "pangoft2-private.h"
+
+/* Glyph cache
+ *
+ * Rendered glyphs are kept in a single cache per fontmap, keyed by
+ * font, glyph and horizontal subpixel position. The cache has a byte
+ * budget; when it is exceeded, the least recently used glyphs are
+ * dropped.
+ *
+ * Bitmaps are not allocated individually. Small bitmaps are packed
+ * into slab pages, where every page holds slots of one power-of-two
+ * size class. Bitmaps that are too big for the largest size class
+ * get their own allocation.
+ */
+
+#define SLAB_PAGE_SIZE   16384
+#define MIN_SLOT_SHIFT   4      /* 16 bytes */
+#define MAX_SLOT_SHIFT   12     /* 4096 bytes */
+#define N_SLOT_CLASSES   (MAX_SLOT_SHIFT - MIN_SLOT_SHIFT + 1)
+
+typedef struct _SlabPage   SlabPage;
+typedef struct _CacheKey   CacheKey;
+typedef struct _CacheEntry CacheEntry;
+
+struct _SlabPage
+{
+  SlabPage *prev;
+  SlabPage *next;
+
+  int slot_class;
+  int n_used;
+  int n_bumped;
+
+  guchar *free_list;
+  guchar *data;
+};
+
+struct _CacheKey
+{
+  PangoFont *font; /* not owned, see _pango_ft2_glyph_cache_remove_font() */
+  PangoGlyph glyph;
+  int subpixel;
+};
+
+struct _CacheEntry
+{
+  CacheKey key;
+
+  PangoFT2RenderedGlyph rendered;
+
+  SlabPage *page;
+  gsize size;
+
+  GList lru_link;
+  GList font_link;
+};
+
+struct _PangoFT2GlyphCache
+{
+  GHashTable *entries;
+  GHashTable *fonts; /* PangoFont -> GQueue of CacheEntry */
+
+  GQueue lru;
+
+  /* Pages that have at least one free slot, per size class */
+  SlabPage *partial[N_SLOT_CLASSES];
+
+  gsize size;
+  gsize max_size;
+
+  /* While frozen, nothing is evicted */
+  int freeze_count;
+};
+
+static guint
+cache_key_hash (gconstpointer v)
+{
+  const CacheKey *key = v;
+
+  return GPOINTER_TO_UINT (key->font) ^
+         (key->glyph * 2654435761u) ^
+         key->subpixel;
+}
+
+static gboolean
+cache_key_equal (gconstpointer v1,
+                 gconstpointer v2)
+{
+  const CacheKey *key1 = v1;
+  const CacheKey *key2 = v2;
+
+  return key1->font == key2->font &&
+         key1->glyph == key2->glyph &&
+         key1->subpixel == key2->subpixel;
+}
+
+static int
+get_slot_class (gsize size)
+{
+  int shift = MIN_SLOT_SHIFT;
+
+  while (((gsize) 1 << shift) < size)
+    shift++;
+
+  if (shift > MAX_SLOT_SHIFT)
+    return -1;
+
+  return shift - MIN_SLOT_SHIFT;
+}
+
+static void
+slab_page_unlink (PangoFT2GlyphCache *cache,
+                  SlabPage           *page)
+{
+  if (page->prev)
+    page->prev->next = page->next;
+  else
+    cache->partial[page->slot_class] = page->next;
+
+  if (page->next)
+    page->next->prev = page->prev;
+
+  page->prev = page->next = NULL;
+}
+
+static void
+slab_page_link (PangoFT2GlyphCache *cache,
+                SlabPage           *page)
+{
+  page->prev = NULL;
+  page->next = cache->partial[page->slot_class];
+  if (page->next)
+    page->next->prev = page;
+  cache->partial[page->slot_class] = page;
+}
+
+static guchar *
+slab_alloc (PangoFT2GlyphCache  *cache,
+            int                  slot_class,
+            SlabPage           **page_out)
+{
+  int slot_size = 1 << (slot_class + MIN_SLOT_SHIFT);
+  int n_slots = SLAB_PAGE_SIZE / slot_size;
+  SlabPage *page;
+  guchar *slot;
+
+  page = cache->partial[slot_class];
+  if (page == NULL)
+    {
+      page = g_slice_new0 (SlabPage);
+      page->slot_class = slot_class;
+      page->data = g_malloc (SLAB_PAGE_SIZE);
+      slab_page_link (cache, page);
+    }
+
+  if (page->free_list)
+    {
+      slot = page->free_list;
+      page->free_list = *(guchar **) slot;
+    }
+  else
+    {
+      slot = page->data + page->n_bumped * slot_size;
+      page->n_bumped++;
+    }
+
+  page->n_used++;
+  if (page->n_used == n_slots)
+    slab_page_unlink (cache, page);
+
+  *page_out = page;
+
+  return slot;
+}
+
+static void
+slab_free (PangoFT2GlyphCache *cache,
+           SlabPage           *page,
+           guchar             *slot)
+{
+  int slot_size = 1 << (page->slot_class + MIN_SLOT_SHIFT);
+  int n_slots = SLAB_PAGE_SIZE / slot_size;
+
+  if (page->n_used == n_slots)
+    slab_page_link (cache, page);
+
+  page->n_used--;
+
+  if (page->n_used == 0)
+    {
+      slab_page_unlink (cache, page);
+      g_free (page->data);
+      g_slice_free (SlabPage, page);
+      return;
+    }
+
+  *(guchar **) slot = page->free_list;
+  page->free_list = slot;
+}
+
+static void
+cache_entry_free (PangoFT2GlyphCache *cache,
+                  CacheEntry         *entry)
+{
+  if (entry->page)
+    slab_free (cache, entry->page, entry->rendered.bitmap.buffer);
+  else
+    g_free (entry->rendered.bitmap.buffer);
+
+  g_slice_free (CacheEntry, entry);
+}
+
+static void
+cache_remove_entry (PangoFT2GlyphCache *cache,
+                    CacheEntry         *entry)
+{
+  GQueue *font_entries;
+
+  g_hash_table_remove (cache->entries, &entry->key);
+  g_queue_unlink (&cache->lru, &entry->lru_link);
+
+  font_entries = g_hash_table_lookup (cache->fonts, entry->key.font);
+  g_queue_unlink (font_entries, &entry->font_link);
+  if (g_queue_is_empty (font_entries))
+    g_hash_table_remove (cache->fonts, entry->key.font);
+
+  cache->size -= entry->size;
+
+  cache_entry_free (cache, entry);
+}
+
+static void
+cache_shrink (PangoFT2GlyphCache *cache,
+              CacheEntry         *keep)
+{
+  if (cache->freeze_count > 0)
+    return;
+
+  while (cache->size > cache->max_size)
+    {
+      CacheEntry *entry = g_queue_peek_tail (&cache->lru);
+
+      if (entry == NULL || entry == keep)
+        break;
+
+      cache_remove_entry (cache, entry);
+    }
+}
+
+static void
+free_font_entries (gpointer data)
+{
+  g_slice_free (GQueue, data);
+}
+
+PangoFT2GlyphCache *
+_pango_ft2_glyph_cache_new (gsize max_size)
+{
+  PangoFT2GlyphCache *cache;
+
+  cache = g_new0 (PangoFT2GlyphCache, 1);
+  cache->entries = g_hash_table_new (cache_key_hash, cache_key_equal);
+  cache->fonts = g_hash_table_new_full (NULL, NULL, NULL, free_font_entries);
+  g_queue_init (&cache->lru);
+  cache->max_size = max_size;
+
+  return cache;
+}
+
+void
+_pango_ft2_glyph_cache_free (PangoFT2GlyphCache *cache)
+{
+  CacheEntry *entry;
+
+  while ((entry = g_queue_peek_tail (&cache->lru)) != NULL)
+    cache_remove_entry (cache, entry);
+
+  g_hash_table_destroy (cache->entries);
+  g_hash_table_destroy (cache->fonts);
+
+  g_free (cache);
+}
+
+void
+_pango_ft2_glyph_cache_set_max_size (PangoFT2GlyphCache *cache,
+                                     gsize               max_size)
+{
+  cache->max_size = max_size;
+  cache_shrink (cache, NULL);
+}
+
+gsize
+_pango_ft2_glyph_cache_get_max_size (PangoFT2GlyphCache *cache)
+{
+  return cache->max_size;
+}
+
+gsize
+_pango_ft2_glyph_cache_get_size (PangoFT2GlyphCache *cache)
+{
+  return cache->size;
+}
+
+/*
+ * _pango_ft2_glyph_cache_freeze:
+ * @cache: a `PangoFT2GlyphCache`
+ *
+ * Stops evicting glyphs from @cache, so that glyphs returned
+ * by lookups and insertions stay valid until the cache is
+ * thawed again. The cache can grow beyond its budget while
+ * it is frozen.
+ */
+void
+_pango_ft2_glyph_cache_freeze (PangoFT2GlyphCache *cache)
+{
+  cache->freeze_count++;
+}
+
+/*
+ * _pango_ft2_glyph_cache_thaw:
+ * @cache: a `PangoFT2GlyphCache`
+ *
+ * Reverts the effect of a previous call to
+ * _pango_ft2_glyph_cache_freeze().
+ */
+void
+_pango_ft2_glyph_cache_thaw (PangoFT2GlyphCache *cache)
+{
+  g_return_if_fail (cache->freeze_count > 0);
+
+  cache->freeze_count--;
+  cache_shrink (cache, NULL);
+}
+
+/*
+ * _pango_ft2_glyph_cache_lookup:
+ * @cache: a `PangoFT2GlyphCache`
+ * @font: the font
+ * @glyph: the glyph
+ * @subpixel: the horizontal subpixel position, in units of
+ *   1 / %PANGO_FT2_SUBPIXEL_POSITIONS pixel
+ *
+ * Looks up a rendered glyph, and marks it as most recently used.
+ *
+ * Return value: the cached glyph, or %NULL. The glyph stays
+ *   valid until the next insertion into @cache.
+ */
+const PangoFT2RenderedGlyph *
+_pango_ft2_glyph_cache_lookup (PangoFT2GlyphCache *cache,
+                               PangoFont          *font,
+                               PangoGlyph          glyph,
+                               int                 subpixel)
+{
+  CacheKey key;
+  CacheEntry *entry;
+
+  key.font = font;
+  key.glyph = glyph;
+  key.subpixel = subpixel;
+
+  entry = g_hash_table_lookup (cache->entries, &key);
+  if (entry == NULL)
+    return NULL;
+
+  if (cache->lru.head != &entry->lru_link)
+    {
+      g_queue_unlink (&cache->lru, &entry->lru_link);
+      g_queue_push_head_link (&cache->lru, &entry->lru_link);
+    }
+
+  return &entry->rendered;
+}
+
+/*
+ * _pango_ft2_glyph_cache_insert:
+ * @cache: a `PangoFT2GlyphCache`
+ * @font: the font
+ * @glyph: the glyph
+ * @subpixel: the horizontal subpixel position
+ * @bitmap: the rendered bitmap. Its contents are copied
+ * @bitmap_left: left bearing of the bitmap
+ * @bitmap_top: top bearing of the bitmap
+ *
+ * Adds a rendered glyph to the cache, evicting least recently
+ * used glyphs if the cache grows beyond its budget.
+ *
+ * Return value: the cached glyph. It stays valid until the next
+ *   insertion into @cache.
+ */
+const PangoFT2RenderedGlyph *
+_pango_ft2_glyph_cache_insert (PangoFT2GlyphCache *cache,
+                               PangoFont          *font,
+                               PangoGlyph          glyph,
+                               int                 subpixel,
+                               const FT_Bitmap    *bitmap,
+                               int                 bitmap_left,
+                               int                 bitmap_top)
+{
+  CacheKey key;
+  CacheEntry *entry;
+  GQueue *font_entries;
+  gsize bitmap_size;
+  int slot_class;
+
+  key.font = font;
+  key.glyph = glyph;
+  key.subpixel = subpixel;
+
+  entry = g_hash_table_lookup (cache->entries, &key);
+  if (entry)
+    cache_remove_entry (cache, entry);
+
+  entry = g_slice_new0 (CacheEntry);
+  entry->key = key;
+  entry->lru_link.data = entry;
+  entry->font_link.data = entry;
+
+  entry->rendered.bitmap = *bitmap;
+  entry->rendered.bitmap_left = bitmap_left;
+  entry->rendered.bitmap_top = bitmap_top;
+
+  bitmap_size = (gsize) bitmap->rows * ABS (bitmap->pitch);
+  entry->size = sizeof (CacheEntry);
+
+  if (bitmap_size == 0)
+    entry->rendered.bitmap.buffer = NULL;
+  else
+    {
+      slot_class = get_slot_class (bitmap_size);
+      if (slot_class >= 0)
+        {
+          entry->rendered.bitmap.buffer = slab_alloc (cache, slot_class, &entry->page);
+          entry->size += 1 << (slot_class + MIN_SLOT_SHIFT);
+        }
+      else
+        {
+          entry->rendered.bitmap.buffer = g_malloc (bitmap_size);
+          entry->size += bitmap_size;
+        }
+
+      memcpy (entry->rendered.bitmap.buffer, bitmap->buffer, bitmap_size);
+    }
+
+  g_hash_table_insert (cache->entries, &entry->key, entry);
+  g_queue_push_head_link (&cache->lru, &entry->lru_link);
+
+  font_entries = g_hash_table_lookup (cache->fonts, font);
+  if (font_entries == NULL)
+    {
+      font_entries = g_slice_new0 (GQueue);
+      g_hash_table_insert (cache->fonts, font, font_entries);
+    }
+  g_queue_push_head_link (font_entries, &entry->font_link);
+
+  cache->size += entry->size;
+
+  cache_shrink (cache, entry);
+
+  return &entry->rendered;
+}
+
+/*
+ * _pango_ft2_glyph_cache_remove_font:
+ * @cache: a `PangoFT2GlyphCache`
+ * @font: a font
+ *
+ * Drops all cached glyphs for @font. This must be called
+ * before @font is finalized.
+ */
+void
+_pango_ft2_glyph_cache_remove_font (PangoFT2GlyphCache *cache,
+                                    PangoFont          *font)
+{
+  GQueue *font_entries;
+
+  font_entries = g_hash_table_lookup (cache->fonts, font);
+  if (font_entries == NULL)
+    return;
+
+  /* Removing the last entry frees font_entries */
+  while (!g_queue_is_empty (font_entries))
+    {
+      CacheEntry *entry = g_queue_peek_head (font_entries);
+      gboolean last = font_entries->length == 1;
+
+      cache_remove_entry (cache, entry);
+
+      if (last)
+        break;
+    }
+}
@@ -47,9 +47,11 @@
 #define PING(printlist)
 #endif
 
-typedef struct _PangoFT2Font      PangoFT2Font;
-typedef struct _PangoFT2GlyphInfo PangoFT2GlyphInfo;
-typedef struct _PangoFT2Renderer  PangoFT2Renderer;
+typedef struct _PangoFT2Font          PangoFT2Font;
+typedef struct _PangoFT2GlyphInfo     PangoFT2GlyphInfo;
+typedef struct _PangoFT2Renderer      PangoFT2Renderer;
+typedef struct _PangoFT2RenderedGlyph PangoFT2RenderedGlyph;
+typedef struct _PangoFT2GlyphCache    PangoFT2GlyphCache;
 
 struct _PangoFT2Font
 {
@@ -63,16 +65,27 @@ struct _PangoFT2Font
   GSList *metrics_by_lang;
 
   GHashTable *glyph_info;
-  GDestroyNotify glyph_cache_destroy;
 };
 
 struct _PangoFT2GlyphInfo
 {
   PangoRectangle logical_rect;
   PangoRectangle ink_rect;
-  void *cached_glyph;
 };
 
+struct _PangoFT2RenderedGlyph
+{
+  FT_Bitmap bitmap;
+  int bitmap_left;
+  int bitmap_top;
+};
+
+/* Number of horizontal positions per pixel that glyphs are rendered at */
+#define PANGO_FT2_SUBPIXEL_POSITIONS 4
+
+/* Default byte budget of the glyph cache of a fontmap */
+#define PANGO_FT2_GLYPH_CACHE_DEFAULT_SIZE (16 * 1024 * 1024)
+
 #define PANGO_TYPE_FT2_FONT              (pango_ft2_font_get_type ())
 #define PANGO_FT2_FONT(object)           (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_TYPE_FT2_FONT, PangoFT2Font))
 #define PANGO_FT2_IS_FONT(object)        (G_TYPE_CHECK_INSTANCE_TYPE ((object), PANGO_TYPE_FT2_FONT))
@@ -86,13 +99,40 @@ FT_Library     _pango_ft2_font_map_get_library    (PangoFontMap      *fontmap);
 void _pango_ft2_font_map_default_substitute (PangoFcFontMap *fcfontmap,
 					     FcPattern      *pattern);
 
-void *_pango_ft2_font_get_cache_glyph_data    (PangoFont      *font,
-					       int             glyph_index);
-void  _pango_ft2_font_set_cache_glyph_data    (PangoFont      *font,
-					       int             glyph_index,
-					       void           *cached_glyph);
-void  _pango_ft2_font_set_glyph_cache_destroy (PangoFont      *font,
-					       GDestroyNotify  destroy_notify);
+PangoFT2GlyphCache *_pango_ft2_font_map_get_glyph_cache (PangoFT2FontMap *ft2fontmap);
+
+PangoFT2GlyphCache *         _pango_ft2_glyph_cache_new          (gsize               max_size);
+void                         _pango_ft2_glyph_cache_free         (PangoFT2GlyphCache *cache);
+void                         _pango_ft2_glyph_cache_set_max_size (PangoFT2GlyphCache *cache,
+								  gsize               max_size);
+gsize                        _pango_ft2_glyph_cache_get_max_size (PangoFT2GlyphCache *cache);
+gsize                        _pango_ft2_glyph_cache_get_size     (PangoFT2GlyphCache *cache);
+const PangoFT2RenderedGlyph *_pango_ft2_glyph_cache_lookup       (PangoFT2GlyphCache *cache,
+								  PangoFont          *font,
+								  PangoGlyph          glyph,
+								  int                 subpixel);
+const PangoFT2RenderedGlyph *_pango_ft2_glyph_cache_insert       (PangoFT2GlyphCache *cache,
+								  PangoFont          *font,
+								  PangoGlyph          glyph,
+								  int                 subpixel,
+								  const FT_Bitmap    *bitmap,
+								  int                 bitmap_left,
+								  int                 bitmap_top);
+void                         _pango_ft2_glyph_cache_remove_font  (PangoFT2GlyphCache *cache,
+								  PangoFont          *font);
+void                         _pango_ft2_glyph_cache_freeze       (PangoFT2GlyphCache *cache);
+void                         _pango_ft2_glyph_cache_thaw         (PangoFT2GlyphCache *cache);
+
+void _pango_ft2_blit_gray_row (guchar       *dest,
+                               const guchar *src,
+                               int           width);
+void _pango_ft2_blit_mono_row (guchar       *dest,
+                               const guchar *src,
+                               int           x_start,
+                               int           x_limit);
+void _pango_ft2_fill_span     (guchar       *dest,
+                               guchar        value,
+                               int           width);
 
 #define PANGO_TYPE_FT2_RENDERER            (pango_ft2_renderer_get_type())
 #define PANGO_FT2_RENDERER(object)         (G_TYPE_CHECK_INSTANCE_CAST ((object), PANGO_TYPE_FT2_RENDERER, PangoFT2Renderer))
@@ -27,6 +27,8 @@
 #include "pangoft2-private.h"
 #include "pango-impl-utils.h"
 
+#include FT_OUTLINE_H
+
 /* for compatibility with older freetype versions */
 #ifndef FT_LOAD_TARGET_MONO
 #define FT_LOAD_TARGET_MONO  FT_LOAD_MONOCHROME
@@ -38,11 +40,60 @@ typedef struct _PangoFT2RendererClass PangoFT2RendererClass;
 #define PANGO_IS_FT2_RENDERER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), PANGO_TYPE_FT2_RENDERER))
 #define PANGO_FT2_RENDERER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), PANGO_TYPE_FT2_RENDERER, PangoFT2RendererClass))
 
+/* A range of rows of the target bitmap */
+typedef struct
+{
+  FT_Bitmap *bitmap;
+  int y_start;
+  int y_end;
+} Band;
+
+typedef enum
+{
+  DRAW_OP_GLYPH,
+  DRAW_OP_TRAPEZOID
+} DrawOpType;
+
+/* A recorded drawing operation, see pango_ft2_render_layout_banded() */
+typedef struct
+{
+  DrawOpType type;
+
+  /* The rows of the target bitmap that are touched */
+  int y_start;
+  int y_end;
+
+  union {
+    struct {
+      const PangoFT2RenderedGlyph *rendered;
+      int x;
+      int y;
+    } glyph;
+    struct {
+      double y1;
+      double x11;
+      double x21;
+      double y2;
+      double x12;
+      double x22;
+    } trapezoid;
+  } u;
+} DrawOp;
+
 struct _PangoFT2Renderer
 {
   PangoRenderer parent_instance;
 
   FT_Bitmap *bitmap;
+
+  /* While recording, drawing operations are collected in ops
+   * instead of being drawn to the bitmap. Glyphs in frozen_cache
+   * stay valid until recording is done, other rendered glyphs
+   * are kept alive in owned_glyphs.
+   */
+  GArray *ops;
+  GPtrArray *owned_glyphs;
+  PangoFT2GlyphCache *frozen_cache;
 };
 
 struct _PangoFT2RendererClass
@@ -87,13 +138,6 @@ pango_ft2_renderer_set_bitmap (PangoFT2Renderer *renderer,
   renderer->bitmap = bitmap;
 }
 
-typedef struct
-{
-  FT_Bitmap bitmap;
-  int bitmap_left;
-  int bitmap_top;
-} PangoFT2RenderedGlyph;
-
 static void
 pango_ft2_free_rendered_glyph (PangoFT2RenderedGlyph *rendered)
 {
@@ -101,6 +145,19 @@ pango_ft2_free_rendered_glyph (PangoFT2RenderedGlyph *rendered)
   g_slice_free (PangoFT2RenderedGlyph, rendered);
 }
 
+static PangoFT2RenderedGlyph *
+pango_ft2_copy_rendered_glyph (const PangoFT2RenderedGlyph *rendered)
+{
+  PangoFT2RenderedGlyph *copy;
+
+  copy = g_slice_new (PangoFT2RenderedGlyph);
+  *copy = *rendered;
+  copy->bitmap.buffer = g_memdup2 (rendered->bitmap.buffer,
+                                   rendered->bitmap.rows * rendered->bitmap.pitch);
+
+  return copy;
+}
+
 static PangoFT2RenderedGlyph *
 pango_ft2_font_render_box_glyph (int      width,
 				 int      height,
@@ -184,7 +241,8 @@ pango_ft2_font_render_box_glyph (int      width,
 
 static PangoFT2RenderedGlyph *
 pango_ft2_font_render_glyph (PangoFont *font,
-			     PangoGlyph glyph_index)
+			     PangoGlyph glyph_index,
+			     int        subpixel)
 {
   FT_Face face;
   gboolean invalid_input;
@@ -223,6 +281,9 @@ pango_ft2_font_render_glyph (PangoFont *font,
 
       /* Draw glyph */
       FT_Load_Glyph (face, glyph_index, ft2font->load_flags);
+      if (subpixel != 0 && face->glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+        FT_Outline_Translate (&face->glyph->outline,
+                              subpixel * 64 / PANGO_FT2_SUBPIXEL_POSITIONS, 0);
       FT_Render_Glyph (face->glyph,
 		       (ft2font->load_flags & FT_LOAD_TARGET_MONO ?
 			ft_render_mode_mono : ft_render_mode_normal));
@@ -251,55 +312,27 @@ generic_box:
 }
 
 static void
-pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
-			       PangoFont     *font,
-			       PangoGlyph     glyph,
-			       double         x,
-			       double         y)
+pango_ft2_blit_glyph (Band                        *band,
+		      const PangoFT2RenderedGlyph *rendered_glyph,
+		      int                          ixoff,
+		      int                          iyoff)
 {
-  FT_Bitmap *bitmap = PANGO_FT2_RENDERER (renderer)->bitmap;
-  PangoFT2RenderedGlyph *rendered_glyph;
-  gboolean add_glyph_to_cache;
+  FT_Bitmap *bitmap = band->bitmap;
   guchar *src, *dest;
-
   int x_start, x_limit;
   int y_start, y_limit;
-  int ixoff = floor (x + 0.5);
-  int iyoff = floor (y + 0.5);
-  int ix, iy;
-
-  if (glyph & PANGO_GLYPH_UNKNOWN_FLAG)
-    {
-      /* Since we don't draw hexbox for FT2 renderer,
-       * unifiy the rendered bitmap in the cache by converting
-       * all missing glyphs to either INVALID_INPUT or UNKNOWN_FLAG.
-       */
-
-      gunichar wc = glyph & (~PANGO_GLYPH_UNKNOWN_FLAG);
-
-      if (G_UNLIKELY (glyph == PANGO_GLYPH_INVALID_INPUT || wc > 0x10FFFF))
-	glyph = PANGO_GLYPH_INVALID_INPUT;
-      else
-	glyph = PANGO_GLYPH_UNKNOWN_FLAG;
-    }
+  int iy;
 
-  rendered_glyph = _pango_ft2_font_get_cache_glyph_data (font, glyph);
-  add_glyph_to_cache = FALSE;
-  if (rendered_glyph == NULL)
-    {
-      rendered_glyph = pango_ft2_font_render_glyph (font, glyph);
-      if (rendered_glyph == NULL)
-        return;
-      add_glyph_to_cache = TRUE;
-    }
+  if (rendered_glyph->bitmap.buffer == NULL)
+    return;
 
   x_start = MAX (0, - (ixoff + rendered_glyph->bitmap_left));
   x_limit = MIN ((int) rendered_glyph->bitmap.width,
 		 (int) (bitmap->width - (ixoff + rendered_glyph->bitmap_left)));
 
-  y_start = MAX (0,  - (iyoff - rendered_glyph->bitmap_top));
+  y_start = MAX (0, band->y_start - (iyoff - rendered_glyph->bitmap_top));
   y_limit = MIN ((int) rendered_glyph->bitmap.rows,
-		 (int) (bitmap->rows - (iyoff - rendered_glyph->bitmap_top)));
+		 band->y_end - (iyoff - rendered_glyph->bitmap_top));
 
   src = rendered_glyph->bitmap.buffer +
     y_start * rendered_glyph->bitmap.pitch;
@@ -314,26 +347,7 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
       src += x_start;
       for (iy = y_start; iy < y_limit; iy++)
 	{
-	  guchar *s = src;
-	  guchar *d = dest;
-
-	  for (ix = x_start; ix < x_limit; ix++)
-	    {
-	      switch (*s)
-		{
-		case 0:
-		  break;
-		case 0xff:
-		  *d = 0xff;
-                  break;
-		default:
-		  *d = MIN ((gushort) *d + (gushort) *s, 0xff);
-		  break;
-		}
-
-	      s++;
-	      d++;
-	    }
+	  _pango_ft2_blit_gray_row (dest, src, x_limit - x_start);
 
 	  dest += bitmap->pitch;
 	  src  += rendered_glyph->bitmap.pitch;
@@ -341,21 +355,9 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
       break;
 
     case ft_pixel_mode_mono:
-      src += x_start / 8;
       for (iy = y_start; iy < y_limit; iy++)
 	{
-	  guchar *s = src;
-	  guchar *d = dest;
-
-	  for (ix = x_start; ix < x_limit; ix++)
-	    {
-	      if ((*s) & (1 << (7 - (ix % 8))))
-		*d |= 0xff;
-
-	      if ((ix % 8) == 7)
-		s++;
-	      d++;
-	    }
+	  _pango_ft2_blit_mono_row (dest, src, x_start, x_limit);
 
 	  dest += bitmap->pitch;
 	  src  += rendered_glyph->bitmap.pitch;
@@ -368,13 +370,108 @@ pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
 		 rendered_glyph->bitmap.pixel_mode);
       break;
     }
+}
 
-  if (add_glyph_to_cache)
+static void
+pango_ft2_renderer_draw_glyph (PangoRenderer *renderer,
+			       PangoFont     *font,
+			       PangoGlyph     glyph,
+			       double         x,
+			       double         y)
+{
+  PangoFT2Renderer *ft2renderer = PANGO_FT2_RENDERER (renderer);
+  PangoFT2GlyphCache *cache = NULL;
+  const PangoFT2RenderedGlyph *rendered_glyph = NULL;
+  PangoFT2RenderedGlyph *uncached_glyph = NULL;
+  int subpixel;
+  int ixoff;
+  int iyoff = floor (y + 0.5);
+
+  if (glyph & PANGO_GLYPH_UNKNOWN_FLAG)
     {
-      _pango_ft2_font_set_glyph_cache_destroy (font,
-					       (GDestroyNotify) pango_ft2_free_rendered_glyph);
-      _pango_ft2_font_set_cache_glyph_data (font,
-					    glyph, rendered_glyph);
+      /* Since we don't draw hexbox for FT2 renderer,
+       * unifiy the rendered bitmap in the cache by converting
+       * all missing glyphs to either INVALID_INPUT or UNKNOWN_FLAG.
+       */
+
+      gunichar wc = glyph & (~PANGO_GLYPH_UNKNOWN_FLAG);
+
+      if (G_UNLIKELY (glyph == PANGO_GLYPH_INVALID_INPUT || wc > 0x10FFFF))
+	glyph = PANGO_GLYPH_INVALID_INPUT;
+      else
+	glyph = PANGO_GLYPH_UNKNOWN_FLAG;
+    }
+
+  /* Boxes and monochrome glyphs are positioned on whole pixels,
+   * everything else on a 1 / PANGO_FT2_SUBPIXEL_POSITIONS pixel grid.
+   */
+  if ((glyph & PANGO_GLYPH_UNKNOWN_FLAG) ||
+      !PANGO_FT2_IS_FONT (font) ||
+      (PANGO_FT2_FONT (font)->load_flags & FT_LOAD_TARGET_MONO))
+    {
+      ixoff = floor (x + 0.5);
+      subpixel = 0;
+    }
+  else
+    {
+      double qx = floor (x * PANGO_FT2_SUBPIXEL_POSITIONS + 0.5);
+
+      ixoff = floor (qx / PANGO_FT2_SUBPIXEL_POSITIONS);
+      subpixel = qx - ixoff * PANGO_FT2_SUBPIXEL_POSITIONS;
+    }
+
+  if (PANGO_FT2_IS_FONT (font) && PANGO_FC_FONT (font)->fontmap)
+    {
+      cache = _pango_ft2_font_map_get_glyph_cache (PANGO_FT2_FONT_MAP (PANGO_FC_FONT (font)->fontmap));
+      rendered_glyph = _pango_ft2_glyph_cache_lookup (cache, font, glyph, subpixel);
+    }
+
+  if (rendered_glyph == NULL)
+    {
+      uncached_glyph = pango_ft2_font_render_glyph (font, glyph, subpixel);
+      if (uncached_glyph == NULL)
+        return;
+
+      if (cache)
+        {
+          rendered_glyph = _pango_ft2_glyph_cache_insert (cache, font, glyph, subpixel,
+                                                          &uncached_glyph->bitmap,
+                                                          uncached_glyph->bitmap_left,
+                                                          uncached_glyph->bitmap_top);
+          pango_ft2_free_rendered_glyph (uncached_glyph);
+          uncached_glyph = NULL;
+        }
+      else
+        rendered_glyph = uncached_glyph;
+    }
+
+  if (ft2renderer->ops)
+    {
+      DrawOp op;
+
+      if (cache != ft2renderer->frozen_cache && uncached_glyph == NULL)
+        rendered_glyph = uncached_glyph = pango_ft2_copy_rendered_glyph (rendered_glyph);
+
+      if (uncached_glyph)
+        g_ptr_array_add (ft2renderer->owned_glyphs, uncached_glyph);
+
+      op.type = DRAW_OP_GLYPH;
+      op.y_start = iyoff - rendered_glyph->bitmap_top;
+      op.y_end = op.y_start + rendered_glyph->bitmap.rows;
+      op.u.glyph.rendered = rendered_glyph;
+      op.u.glyph.x = ixoff;
+      op.u.glyph.y = iyoff;
+
+      g_array_append_val (ft2renderer->ops, op);
+    }
+  else
+    {
+      Band band = { ft2renderer->bitmap, 0, ft2renderer->bitmap->rows };
+
+      pango_ft2_blit_glyph (&band, rendered_glyph, ixoff, iyoff);
+
+      if (uncached_glyph)
+        pango_ft2_free_rendered_glyph (uncached_glyph);
     }
 }
 
@@ -384,18 +481,38 @@ typedef struct {
   double x2;
 } Position;
 
+static int
+get_pixel_coverage (Position *t,
+		    Position *b,
+		    double    dy,
+		    int       x)
+{
+  double top_left = MAX (t->x1, x);
+  double top_right = MIN (t->x2, x + 1);
+  double bottom_left = MAX (b->x1, x);
+  double bottom_right = MIN (b->x2, x + 1);
+  double c = 0.5 * dy * ((top_right - top_left) + (bottom_right - bottom_left));
+
+  /* When converting to [0,255], we round up. This is intended
+   * to prevent the problem of pixels that get divided into
+   * multiple slices not being fully black.
+   */
+  return c * 256;
+}
+
 static void
-draw_simple_trap (PangoRenderer *renderer,
-		  Position      *t,
-		  Position      *b)
+draw_simple_trap (Band     *band,
+		  Position *t,
+		  Position *b)
 {
-  FT_Bitmap *bitmap = PANGO_FT2_RENDERER (renderer)->bitmap;
+  FT_Bitmap *bitmap = band->bitmap;
   int iy = floor (t->y);
   int x1, x2, x;
+  int inner_x1, inner_x2;
   double dy = b->y - t->y;
   guchar *dest;
 
-  if (iy < 0 || iy >= (int) bitmap->rows)
+  if (iy < band->y_start || iy >= band->y_end)
     return;
   dest = bitmap->buffer + iy * bitmap->pitch;
 
@@ -412,22 +529,22 @@ draw_simple_trap (PangoRenderer *renderer,
   x1 = CLAMP (x1, 0, (int) bitmap->width);
   x2 = CLAMP (x2, 0, (int) bitmap->width);
 
-  for (x = x1; x < x2; x++)
-    {
-      double top_left = MAX (t->x1, x);
-      double top_right = MIN (t->x2, x + 1);
-      double bottom_left = MAX (b->x1, x);
-      double bottom_right = MIN (b->x2, x + 1);
-      double c = 0.5 * dy * ((top_right - top_left) + (bottom_right - bottom_left));
-
-      /* When converting to [0,255], we round up. This is intended
-       * to prevent the problem of pixels that get divided into
-       * multiple slices not being fully black.
-       */
-      int ic = c * 256;
+  /* Pixels between inner_x1 and inner_x2 are covered over their
+   * full width at the top and at the bottom, so they all get a
+   * coverage of dy, and can be filled as one span.
+   */
+  inner_x1 = CLAMP (ceil (MAX (t->x1, b->x1)), x1, x2);
+  inner_x2 = CLAMP (floor (MIN (t->x2, b->x2)), inner_x1, x2);
 
-      dest[x] = MIN (dest[x] + ic, 255);
-    }
+  for (x = x1; x < inner_x1; x++)
+    dest[x] = MIN (dest[x] + get_pixel_coverage (t, b, dy, x), 255);
+
+  _pango_ft2_fill_span (dest + inner_x1,
+			MIN ((int) (dy * 256), 255),
+			inner_x2 - inner_x1);
+
+  for (x = inner_x2; x < x2; x++)
+    dest[x] = MIN (dest[x] + get_pixel_coverage (t, b, dy, x), 255);
 }
 
 static void
@@ -451,14 +568,13 @@ interpolate_position (Position *result,
  * line so we have to accumulate to get the final result.
  */
 static void
-pango_ft2_renderer_draw_trapezoid (PangoRenderer   *renderer,
-				   PangoRenderPart  part G_GNUC_UNUSED,
-				   double           y1,
-				   double           x11,
-				   double           x21,
-				   double           y2,
-				   double           x12,
-				   double           x22)
+draw_trapezoid (Band   *band,
+		double  y1,
+		double  x11,
+		double  x21,
+		double  y2,
+		double  x12,
+		double  x22)
 {
   Position pos;
   Position t;
@@ -572,11 +688,217 @@ pango_ft2_renderer_draw_trapezoid (PangoRenderer   *renderer,
 	    }
 	}
 
-      draw_simple_trap (renderer, &pos, &pos_next);
+      draw_simple_trap (band, &pos, &pos_next);
       pos = pos_next;
     }
 }
 
+static void
+pango_ft2_renderer_draw_trapezoid (PangoRenderer   *renderer,
+				   PangoRenderPart  part G_GNUC_UNUSED,
+				   double           y1,
+				   double           x11,
+				   double           x21,
+				   double           y2,
+				   double           x12,
+				   double           x22)
+{
+  PangoFT2Renderer *ft2renderer = PANGO_FT2_RENDERER (renderer);
+
+  if (ft2renderer->ops)
+    {
+      DrawOp op;
+
+      op.type = DRAW_OP_TRAPEZOID;
+      op.y_start = floor (MIN (y1, y2));
+      op.y_end = ceil (MAX (y1, y2)) + 1;
+      op.u.trapezoid.y1 = y1;
+      op.u.trapezoid.x11 = x11;
+      op.u.trapezoid.x21 = x21;
+      op.u.trapezoid.y2 = y2;
+      op.u.trapezoid.x12 = x12;
+      op.u.trapezoid.x22 = x22;
+
+      g_array_append_val (ft2renderer->ops, op);
+    }
+  else
+    {
+      Band band = { ft2renderer->bitmap, 0, ft2renderer->bitmap->rows };
+
+      draw_trapezoid (&band, y1, x11, x21, y2, x12, x22);
+    }
+}
+
+/* Band-parallel rendering
+ *
+ * For big bitmaps, we split the bitmap into horizontal bands that
+ * are drawn by a pool of threads. The layout is walked, and glyphs
+ * are rendered, on the calling thread; this records the drawing
+ * operations, so no fonts, FT_Faces or layouts are touched by the
+ * worker threads. Each worker only draws the recorded operations
+ * that intersect its band, clipped to the band.
+ *
+ * Since all compositing is a saturating add (or setting pixels
+ * to 0xff), the result does not depend on the order in which
+ * operations are drawn, and is the same as for the serial path.
+ */
+
+/* Don't bother with threads for bands smaller than this */
+#define MIN_BAND_HEIGHT 32
+
+typedef struct
+{
+  FT_Bitmap *bitmap;
+  GArray *ops;
+
+  int n_bands;
+  int band_height;
+  int next_band; /* atomic */
+
+  GMutex mutex;
+  GCond cond;
+  int n_workers;
+} BandJob;
+
+static void
+draw_band (BandJob *job,
+	   int      index)
+{
+  Band band;
+  guint i;
+
+  band.bitmap = job->bitmap;
+  band.y_start = index * job->band_height;
+  band.y_end = MIN (band.y_start + job->band_height, (int) job->bitmap->rows);
+
+  for (i = 0; i < job->ops->len; i++)
+    {
+      DrawOp *op = &g_array_index (job->ops, DrawOp, i);
+
+      if (op->y_end <= band.y_start || op->y_start >= band.y_end)
+	continue;
+
+      switch (op->type)
+	{
+	case DRAW_OP_GLYPH:
+	  pango_ft2_blit_glyph (&band, op->u.glyph.rendered, op->u.glyph.x, op->u.glyph.y);
+	  break;
+
+	case DRAW_OP_TRAPEZOID:
+	  draw_trapezoid (&band,
+			  op->u.trapezoid.y1, op->u.trapezoid.x11, op->u.trapezoid.x21,
+			  op->u.trapezoid.y2, op->u.trapezoid.x12, op->u.trapezoid.x22);
+	  break;
+
+	default:
+	  g_assert_not_reached ();
+	}
+    }
+}
+
+static void
+draw_bands (BandJob *job)
+{
+  int index;
+
+  while ((index = g_atomic_int_add (&job->next_band, 1)) < job->n_bands)
+    draw_band (job, index);
+}
+
+static void
+band_worker (gpointer data,
+	     gpointer user_data G_GNUC_UNUSED)
+{
+  BandJob *job = data;
+
+  draw_bands (job);
+
+  g_mutex_lock (&job->mutex);
+  job->n_workers--;
+  if (job->n_workers == 0)
+    g_cond_signal (&job->cond);
+  g_mutex_unlock (&job->mutex);
+}
+
+static GThreadPool *
+get_band_pool (void)
+{
+  static GThreadPool *pool = NULL;
+
+  if (g_once_init_enter (&pool))
+    g_once_init_leave (&pool, g_thread_pool_new (band_worker, NULL,
+						 g_get_num_processors (),
+						 FALSE, NULL));
+
+  return pool;
+}
+
+static void
+pango_ft2_render_layout_banded (PangoFT2FontMap *fontmap,
+				FT_Bitmap       *bitmap,
+				PangoLayout     *layout,
+				int              x,
+				int              y,
+				int              n_threads)
+{
+  PangoFT2Renderer *renderer;
+  PangoFT2GlyphCache *cache;
+  GThreadPool *pool;
+  BandJob job;
+  int i;
+
+  renderer = PANGO_FT2_RENDERER (_pango_ft2_font_map_get_renderer (fontmap));
+  cache = _pango_ft2_font_map_get_glyph_cache (fontmap);
+
+  /* Record */
+  _pango_ft2_glyph_cache_freeze (cache);
+
+  pango_ft2_renderer_set_bitmap (renderer, bitmap);
+  renderer->ops = g_array_new (FALSE, FALSE, sizeof (DrawOp));
+  renderer->owned_glyphs = g_ptr_array_new_with_free_func ((GDestroyNotify) pango_ft2_free_rendered_glyph);
+  renderer->frozen_cache = cache;
+
+  pango_renderer_draw_layout (PANGO_RENDERER (renderer), layout, x, y);
+
+  job.bitmap = bitmap;
+  job.ops = renderer->ops;
+  renderer->ops = NULL;
+  renderer->frozen_cache = NULL;
+
+  /* Draw */
+  job.n_bands = MIN (4 * n_threads, (int) bitmap->rows / MIN_BAND_HEIGHT);
+  job.band_height = (bitmap->rows + job.n_bands - 1) / job.n_bands;
+  job.next_band = 0;
+  g_mutex_init (&job.mutex);
+  g_cond_init (&job.cond);
+  job.n_workers = 0;
+
+  pool = get_band_pool ();
+
+  g_mutex_lock (&job.mutex);
+  for (i = 1; i < MIN (n_threads, job.n_bands); i++)
+    {
+      if (g_thread_pool_push (pool, &job, NULL))
+	job.n_workers++;
+    }
+  g_mutex_unlock (&job.mutex);
+
+  draw_bands (&job);
+
+  g_mutex_lock (&job.mutex);
+  while (job.n_workers > 0)
+    g_cond_wait (&job.cond, &job.mutex);
+  g_mutex_unlock (&job.mutex);
+
+  g_mutex_clear (&job.mutex);
+  g_cond_clear (&job.cond);
+
+  g_array_unref (job.ops);
+  g_clear_pointer (&renderer->owned_glyphs, g_ptr_array_unref);
+
+  _pango_ft2_glyph_cache_thaw (cache);
+}
+
 /**
  * pango_ft2_render_layout_subpixel:
  * @bitmap: a FT_Bitmap to render the layout onto
@@ -603,12 +925,21 @@ pango_ft2_render_layout_subpixel (FT_Bitmap   *bitmap,
   PangoContext *context;
   PangoFontMap *fontmap;
   PangoRenderer *renderer;
+  int n_threads;
 
   g_return_if_fail (bitmap != NULL);
   g_return_if_fail (PANGO_IS_LAYOUT (layout));
 
   context = pango_layout_get_context (layout);
   fontmap = pango_context_get_font_map (context);
+
+  n_threads = pango_ft2_font_map_get_render_threads (PANGO_FT2_FONT_MAP (fontmap));
+  if (n_threads > 1 && bitmap->rows >= 2 * MIN_BAND_HEIGHT)
+    {
+      pango_ft2_render_layout_banded (PANGO_FT2_FONT_MAP (fontmap), bitmap, layout, x, y, n_threads);
+      return;
+    }
+
   renderer = _pango_ft2_font_map_get_renderer (PANGO_FT2_FONT_MAP (fontmap));
 
   pango_ft2_renderer_set_bitmap (PANGO_FT2_RENDERER (renderer), bitmap);
@@ -433,14 +433,10 @@ pango_ft2_font_real_unlock_face (PangoFcFont *font G_GNUC_UNUSED)
 static gboolean
 pango_ft2_free_glyph_info_callback (gpointer key G_GNUC_UNUSED,
 				    gpointer value,
-				    gpointer data)
+				    gpointer data G_GNUC_UNUSED)
 {
-  PangoFT2Font *font = PANGO_FT2_FONT (data);
   PangoFT2GlyphInfo *info = value;
 
-  if (font->glyph_cache_destroy && info->cached_glyph)
-    (*font->glyph_cache_destroy) (info->cached_glyph);
-
   g_slice_free (PangoFT2GlyphInfo, info);
   return TRUE;
 }
@@ -449,6 +445,11 @@ static void
 pango_ft2_font_finalize (GObject *object)
 {
   PangoFT2Font *ft2font = (PangoFT2Font *)object;
+  PangoFcFont *fcfont = (PangoFcFont *)object;
+
+  if (fcfont->fontmap)
+    _pango_ft2_glyph_cache_remove_font (_pango_ft2_font_map_get_glyph_cache (PANGO_FT2_FONT_MAP (fcfont->fontmap)),
+                                        (PangoFont *) ft2font);
 
   if (ft2font->face)
     {
@@ -507,47 +508,3 @@ pango_ft2_get_unknown_glyph (PangoFont *font)
   else
     return PANGO_GLYPH_EMPTY;
 }
-
-void *
-_pango_ft2_font_get_cache_glyph_data (PangoFont *font,
-				     int        glyph_index)
-{
-  PangoFT2GlyphInfo *info;
-
-  if (!PANGO_FT2_IS_FONT (font))
-    return NULL;
-
-  info = pango_ft2_font_get_glyph_info (font, glyph_index, FALSE);
-
-  if (info == NULL)
-    return NULL;
-
-  return info->cached_glyph;
-}
-
-void
-_pango_ft2_font_set_cache_glyph_data (PangoFont     *font,
-				     int            glyph_index,
-				     void          *cached_glyph)
-{
-  PangoFT2GlyphInfo *info;
-
-  if (!PANGO_FT2_IS_FONT (font))
-    return;
-
-  info = pango_ft2_font_get_glyph_info (font, glyph_index, TRUE);
-
-  info->cached_glyph = cached_glyph;
-
-  /* TODO: Implement limiting of the number of cached glyphs */
-}
-
-void
-_pango_ft2_font_set_glyph_cache_destroy (PangoFont      *font,
-					 GDestroyNotify  destroy_notify)
-{
-  if (!PANGO_FT2_IS_FONT (font))
-    return;
-
-  PANGO_FT2_FONT (font)->glyph_cache_destroy = destroy_notify;
-}
@@ -116,6 +116,16 @@ PANGO_AVAILABLE_IN_1_2
 void          pango_ft2_font_map_set_resolution         (PangoFT2FontMap        *fontmap,
 							 double                  dpi_x,
 							 double                  dpi_y);
+PANGO_AVAILABLE_IN_1_60
+void          pango_ft2_font_map_set_glyph_cache_size   (PangoFT2FontMap        *fontmap,
+							 gsize                   max_size);
+PANGO_AVAILABLE_IN_1_60
+gsize         pango_ft2_font_map_get_glyph_cache_size   (PangoFT2FontMap        *fontmap);
+PANGO_AVAILABLE_IN_1_60
+void          pango_ft2_font_map_set_render_threads     (PangoFT2FontMap        *fontmap,
+							 int                     n_threads);
+PANGO_AVAILABLE_IN_1_60
+int           pango_ft2_font_map_get_render_threads     (PangoFT2FontMap        *fontmap);
 #ifndef PANGO_DISABLE_DEPRECATED
 PANGO_DEPRECATED_IN_1_48_FOR(pango_fc_font_map_set_default_substitute)
 void          pango_ft2_font_map_set_default_substitute (PangoFT2FontMap        *fontmap,
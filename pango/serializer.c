@@ -26,6 +26,7 @@
 #include <pango/pango-context-private.h>
 #include <pango/pango-enum-types.h>
 #include <pango/pango-font-private.h>
+#include <pango/pango-item-private.h>
 
 #include <hb-ot.h>
 #include "pango/json/gtkjsonparserprivate.h"
@@ -255,6 +256,25 @@ get_script_name (PangoScript script)
   return NULL;
 }
 
+/* Items carry the GUnicodeScript of their text, which
+ * can be newer than the last PangoScript value
+ */
+static gboolean
+is_valid_script (guint32 script)
+{
+  GEnumClass *enum_class;
+  gboolean valid;
+
+  if (script > G_MAXUINT8)
+    return FALSE;
+
+  enum_class = g_type_class_ref (G_TYPE_UNICODE_SCRIPT);
+  valid = g_enum_get_value (enum_class, script) != NULL;
+  g_type_class_unref (enum_class);
+
+  return valid;
+}
+
 static const char *tab_align_names[] = {
   "left",
   "right",
@@ -580,6 +600,26 @@ add_log_attrs (GtkJsonPrinter *printer,
   gtk_json_printer_end (printer);
 }
 
+static char *
+get_font_checksum (PangoFont *font)
+{
+  hb_font_t *hb_font;
+  hb_blob_t *blob;
+  const char *data;
+  guint length;
+  char *str;
+
+  hb_font = pango_font_get_hb_font (font);
+  blob = hb_face_reference_blob (hb_font_get_face (hb_font));
+
+  data = hb_blob_get_data (blob, &length);
+  str = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *)data, length);
+
+  hb_blob_destroy (blob);
+
+  return str;
+}
+
 static void
 add_font (GtkJsonPrinter *printer,
           const char     *member,
@@ -589,8 +629,6 @@ add_font (GtkJsonPrinter *printer,
   char *str;
   hb_font_t *hb_font;
   hb_face_t *face;
-  hb_blob_t *blob;
-  const char *data;
   guint length;
   const int *coords;
   hb_feature_t features[32];
@@ -606,15 +644,10 @@ add_font (GtkJsonPrinter *printer,
 
   hb_font = pango_font_get_hb_font (font);
   face = hb_font_get_face (hb_font);
-  blob = hb_face_reference_blob (face);
-
-  data = hb_blob_get_data (blob, &length);
-  str = g_compute_checksum_for_data (G_CHECKSUM_SHA256, (const guchar *)data, length);
 
+  str = get_font_checksum (font);
   gtk_json_printer_add_string (printer, "checksum", str);
-
   g_free (str);
-  hb_blob_destroy (blob);
 
   coords = hb_font_get_var_coords_normalized (hb_font, &length);
   if (length > 0)
@@ -702,6 +735,9 @@ add_run (GtkJsonPrinter *printer,
   if (run->item->analysis.font)
     add_font (printer, "font", run->item->analysis.font);
 
+  if (pango_analysis_get_size_font (&run->item->analysis))
+    add_font (printer, "size-font", pango_analysis_get_size_font (&run->item->analysis));
+
   gtk_json_printer_add_integer (printer, "flags", run->item->analysis.flags & ANALYSIS_FLAGS);
 
   if (run->item->analysis.extra_attrs)
@@ -751,8 +787,6 @@ add_run (GtkJsonPrinter *printer,
   gtk_json_printer_end (printer);
 }
 
-#undef ANALYSIS_FLAGS
-
 static void
 add_line (GtkJsonPrinter  *printer,
           PangoLayoutLine *line)
@@ -1417,210 +1451,1411 @@ json_parser_fill_context (GtkJsonParser *parser,
 }
 
 enum {
-  LAYOUT_CONTEXT,
-  LAYOUT_COMMENT,
-  LAYOUT_TEXT,
-  LAYOUT_ATTRIBUTES,
-  LAYOUT_FONT,
-  LAYOUT_TABS,
-  LAYOUT_JUSTIFY,
-  LAYOUT_JUSTIFY_LAST_LINE,
-  LAYOUT_SINGLE_PARAGRAPH,
-  LAYOUT_AUTO_DIR,
-  LAYOUT_ALIGNMENT,
-  LAYOUT_WRAP,
-  LAYOUT_ELLIPSIZE,
-  LAYOUT_WIDTH,
-  LAYOUT_HEIGHT,
-  LAYOUT_INDENT,
-  LAYOUT_SPACING,
-  LAYOUT_LINE_SPACING,
-  LAYOUT_OUTPUT
+  FONT_DESCRIPTION,
+  FONT_CHECKSUM,
+  FONT_VARIATIONS,
+  FONT_FEATURES,
+  FONT_MATRIX
 };
 
-static const char *layout_members[] = {
-  "context",
-  "comment",
-  "text",
-  "attributes",
-  "font",
-  "tabs",
-  "justify",
-  "justify-last-line",
-  "single-paragraph",
-  "auto-dir",
-  "alignment",
-  "wrap",
-  "ellipsize",
-  "width",
-  "height",
-  "indent",
-  "spacing",
-  "line-spacing",
-  "output",
+static const char *font_members[] = {
+  "description",
+  "checksum",
+  "variations",
+  "features",
+  "matrix",
   NULL
 };
 
-static void
-json_parser_fill_layout (GtkJsonParser               *parser,
-                         PangoLayout                 *layout,
-                         PangoLayoutDeserializeFlags  flags)
+static PangoFont *
+json_parser_load_font (GtkJsonParser  *parser,
+                       PangoContext   *context,
+                       char          **checksum,
+                       GError        **error)
 {
+  PangoFont *font = NULL;
+
   gtk_json_parser_start_object (parser);
 
   do
     {
-      char *str;
-
-      switch (gtk_json_parser_select_member (parser, layout_members))
+      switch (gtk_json_parser_select_member (parser, font_members))
         {
-        case LAYOUT_CONTEXT:
-          if (flags & PANGO_LAYOUT_DESERIALIZE_CONTEXT)
-            json_parser_fill_context (parser, pango_layout_get_context (layout));
+        case FONT_DESCRIPTION:
+          {
+            PangoFontDescription *desc = parser_get_font_description (parser);
+            if (desc)
+              {
+                g_clear_object (&font);
+                font = pango_context_load_font (context, desc);
+                pango_font_description_free (desc);
+              }
+          }
           break;
 
-        case LAYOUT_COMMENT:
-          str = gtk_json_parser_get_string (parser);
-          g_object_set_data_full (G_OBJECT (layout), "comment", str, g_free);
+        case FONT_CHECKSUM:
+          if (checksum)
+            {
+              g_free (*checksum);
+              *checksum = gtk_json_parser_get_string (parser);
+            }
           break;
 
-        case LAYOUT_TEXT:
-          str = gtk_json_parser_get_string (parser);
-          pango_layout_set_text (layout, str, -1);
-          g_free (str);
+        default:
           break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
 
-        case LAYOUT_ATTRIBUTES:
-          {
-            PangoAttrList *attributes = pango_attr_list_new ();
-            json_parser_fill_attr_list (parser, attributes);
-            pango_layout_set_attributes (layout, attributes);
-            pango_attr_list_unref (attributes);
-          }
-          break;
+  gtk_json_parser_end (parser);
 
-        case LAYOUT_FONT:
-          {
-            PangoFontDescription *desc = parser_get_font_description (parser);;
-            pango_layout_set_font_description (layout, desc);
-            pango_font_description_free (desc);
-          }
-          break;
+  return font;
+}
 
-        case LAYOUT_TABS:
-          {
-            PangoTabArray *tabs = pango_tab_array_new (0, FALSE);
-            json_parser_fill_tab_array (parser, tabs);
-            pango_layout_set_tabs (layout, tabs);
-            pango_tab_array_free (tabs);
-          }
-          break;
+/* {{{ Output */
 
-        case LAYOUT_JUSTIFY:
-          pango_layout_set_justify (layout, gtk_json_parser_get_boolean (parser));
-          break;
+/* The output of a layout is only restored if all its fonts
+ * can be loaded, and are the same fonts that were used when
+ * it was serialized. Otherwise, it is dropped and the text
+ * is laid out again.
+ */
+typedef struct
+{
+  PangoLayout *layout;
+  gboolean present;
+  gboolean fonts_match;
+  GHashTable *checksums; /* PangoFont -> checksum of its face */
 
-        case LAYOUT_JUSTIFY_LAST_LINE:
-          pango_layout_set_justify_last_line (layout, gtk_json_parser_get_boolean (parser));
-          break;
+  gboolean is_wrapped;
+  gboolean is_ellipsized;
+  GArray *log_attrs;
+  GSList *lines; /* in reverse order */
+} LayoutOutput;
 
-        case LAYOUT_SINGLE_PARAGRAPH:
-          pango_layout_set_single_paragraph_mode (layout, gtk_json_parser_get_boolean (parser));
-          break;
+static void
+layout_output_init (LayoutOutput *output,
+                    PangoLayout  *layout)
+{
+  memset (output, 0, sizeof (LayoutOutput));
+  output->layout = layout;
+  output->fonts_match = TRUE;
+  output->checksums = g_hash_table_new_full (NULL, NULL, g_object_unref, g_free);
+  output->log_attrs = g_array_new (FALSE, TRUE, sizeof (PangoLogAttr));
+}
 
-        case LAYOUT_AUTO_DIR:
-          pango_layout_set_auto_dir (layout, gtk_json_parser_get_boolean (parser));
-          break;
+static void
+layout_output_clear (LayoutOutput *output)
+{
+  g_hash_table_unref (output->checksums);
+  if (output->log_attrs)
+    g_array_unref (output->log_attrs);
+  g_slist_free_full (output->lines, (GDestroyNotify) pango_layout_line_unref);
+}
 
-        case LAYOUT_ALIGNMENT:
-          pango_layout_set_alignment (layout, (PangoAlignment) parser_select_string (parser, alignment_names));
-          break;
+static void
+layout_output_check_font (LayoutOutput *output,
+                          PangoFont    *font,
+                          const char   *checksum)
+{
+  char *font_checksum;
 
-        case LAYOUT_WRAP:
-          pango_layout_set_wrap (layout, (PangoWrapMode) parser_select_string (parser, wrap_names));
-          break;
+  if (!font)
+    {
+      output->fonts_match = FALSE;
+      return;
+    }
 
-        case LAYOUT_ELLIPSIZE:
-          pango_layout_set_ellipsize (layout, (PangoEllipsizeMode) parser_select_string (parser, ellipsize_names));
-          break;
+  if (!checksum)
+    return;
 
-        case LAYOUT_WIDTH:
-          pango_layout_set_width (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+  /* Checksumming the font data is expensive, do it once per font */
+  font_checksum = g_hash_table_lookup (output->checksums, font);
+  if (!font_checksum)
+    {
+      font_checksum = get_font_checksum (font);
+      g_hash_table_insert (output->checksums, g_object_ref (font), font_checksum);
+    }
 
-        case LAYOUT_HEIGHT:
-          pango_layout_set_height (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+  if (strcmp (font_checksum, checksum) != 0)
+    output->fonts_match = FALSE;
+}
 
-        case LAYOUT_INDENT:
-          pango_layout_set_indent (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+static PangoFont *
+json_parser_load_output_font (GtkJsonParser *parser,
+                              LayoutOutput  *output)
+{
+  PangoFont *font;
+  char *checksum = NULL;
 
-        case LAYOUT_SPACING:
-          pango_layout_set_spacing (layout, (int) gtk_json_parser_get_number (parser));
-          break;
+  font = json_parser_load_font (parser, output->layout->context, &checksum, NULL);
+  layout_output_check_font (output, font, checksum);
+  g_free (checksum);
 
-        case LAYOUT_LINE_SPACING:
-          pango_layout_set_line_spacing (layout, gtk_json_parser_get_number (parser));
-          break;
+  return font;
+}
 
-        case LAYOUT_OUTPUT:
-          break;
+static gboolean
+is_char_boundary (PangoLayout *layout,
+                  int          index)
+{
+  if (index == layout->length)
+    return TRUE;
 
-        default:
-          break;
+  return (gint32) g_utf8_get_char_validated (layout->text + index, layout->length - index) >= 0;
+}
+
+/* Checks that the lines fit the text of the layout, fills
+ * in the character offsets of the items and makes the lines
+ * the output of the layout.
+ */
+static gboolean
+layout_output_apply (LayoutOutput  *output,
+                     GError       **error)
+{
+  PangoLayout *layout = output->layout;
+  const char *line_start;
+  int line_offset;
+
+  if (!output->present || !output->fonts_match)
+    return TRUE;
+
+  if (!layout->text)
+    pango_layout_set_text (layout, NULL, 0);
+
+  if (output->log_attrs->len != layout->n_chars + 1)
+    goto invalid;
+
+  output->lines = g_slist_reverse (output->lines);
+
+  line_start = layout->text;
+  line_offset = 0;
+  for (GSList *l = output->lines; l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+      const char *start;
+
+      if (line->start_index < line_start - layout->text ||
+          line->start_index > layout->length ||
+          line->length < 0 ||
+          line->length > layout->length - line->start_index ||
+          !is_char_boundary (layout, line->start_index))
+        goto invalid;
+
+      start = layout->text + line->start_index;
+      line_offset += g_utf8_pointer_to_offset (line_start, start);
+      line_start = start;
+
+      for (GSList *r = line->runs; r; r = r->next)
+        {
+          PangoLayoutRun *run = r->data;
+          PangoItem *item = run->item;
+
+          if (item->offset < line->start_index ||
+              item->length < 0 ||
+              item->offset - line->start_index > line->length - item->length ||
+              !is_char_boundary (layout, item->offset) ||
+              !is_char_boundary (layout, item->offset + item->length))
+            goto invalid;
+
+          for (int i = 0; i < run->glyphs->num_glyphs; i++)
+            {
+              if (run->glyphs->log_clusters[i] < 0 ||
+                  run->glyphs->log_clusters[i] > MAX (item->length - 1, 0))
+                goto invalid;
+            }
+
+          ((PangoItemPrivate *)item)->char_offset = line_offset +
+              g_utf8_pointer_to_offset (start, layout->text + item->offset);
+          item->num_chars = g_utf8_pointer_to_offset (layout->text + item->offset,
+                                                      layout->text + item->offset + item->length);
         }
     }
-  while (gtk_json_parser_next (parser));
 
-  gtk_json_parser_end (parser);
+  _pango_layout_set_output (layout,
+                            output->lines,
+                            (PangoLogAttr *) g_array_free (output->log_attrs, FALSE),
+                            output->is_wrapped,
+                            output->is_ellipsized);
+  output->lines = NULL;
+  output->log_attrs = NULL;
+
+  return TRUE;
+
+invalid:
+  g_set_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID_VALUE,
+               "The output does not match the text of the layout");
+  return FALSE;
 }
 
 enum {
-  FONT_DESCRIPTION,
-  FONT_CHECKSUM,
-  FONT_VARIATIONS,
-  FONT_FEATURES,
-  FONT_MATRIX
+  LOG_ATTR_LINE_BREAK,
+  LOG_ATTR_MANDATORY_BREAK,
+  LOG_ATTR_CHAR_BREAK,
+  LOG_ATTR_WHITE,
+  LOG_ATTR_CURSOR_POSITION,
+  LOG_ATTR_WORD_START,
+  LOG_ATTR_WORD_END,
+  LOG_ATTR_SENTENCE_BOUNDARY,
+  LOG_ATTR_SENTENCE_START,
+  LOG_ATTR_SENTENCE_END,
+  LOG_ATTR_BACKSPACE_DELETES_CHARACTER,
+  LOG_ATTR_EXPANDABLE_SPACE,
+  LOG_ATTR_WORD_BOUNDARY,
+  LOG_ATTR_BREAK_INSERTS_HYPHEN,
+  LOG_ATTR_BREAK_REMOVES_PRECEDING
 };
 
-static const char *font_members[] = {
-  "description",
-  "checksum",
-  "variations",
-  "features",
-  "matrix",
+static const char *log_attr_members[] = {
+  "line-break",
+  "mandatory-break",
+  "char-break",
+  "white",
+  "cursor-position",
+  "word-start",
+  "word-end",
+  "sentence-boundary",
+  "sentence-start",
+  "sentence-end",
+  "backspace-deletes-character",
+  "expandable-space",
+  "word-boundary",
+  "break-inserts-hyphen",
+  "break-removes-preceding",
   NULL
 };
 
-static PangoFont *
-json_parser_load_font (GtkJsonParser  *parser,
-                       PangoContext   *context,
-                       GError        **error)
+static void
+json_parser_fill_log_attrs (GtkJsonParser *parser,
+                            GArray        *log_attrs)
 {
-  PangoFont *font = NULL;
-
-  gtk_json_parser_start_object (parser);
+  gtk_json_parser_start_array (parser);
 
-  switch (gtk_json_parser_select_member (parser, font_members))
-    {
-    case FONT_DESCRIPTION:
+  if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+    do
       {
-        PangoFontDescription *desc = parser_get_font_description (parser);
-        font = pango_context_load_font (context, desc);
-        pango_font_description_free (desc);
-      }
-      break;
-
-    default:
-      break;
-    }
+        PangoLogAttr attr = { 0, };
 
-  gtk_json_parser_end (parser);
+        gtk_json_parser_start_object (parser);
+
+        do
+          {
+            switch (gtk_json_parser_select_member (parser, log_attr_members))
+              {
+              case LOG_ATTR_LINE_BREAK:
+                attr.is_line_break = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_MANDATORY_BREAK:
+                attr.is_mandatory_break = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_CHAR_BREAK:
+                attr.is_char_break = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_WHITE:
+                attr.is_white = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_CURSOR_POSITION:
+                attr.is_cursor_position = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_WORD_START:
+                attr.is_word_start = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_WORD_END:
+                attr.is_word_end = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_SENTENCE_BOUNDARY:
+                attr.is_sentence_boundary = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_SENTENCE_START:
+                attr.is_sentence_start = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_SENTENCE_END:
+                attr.is_sentence_end = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_BACKSPACE_DELETES_CHARACTER:
+                attr.backspace_deletes_character = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_EXPANDABLE_SPACE:
+                attr.is_expandable_space = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_WORD_BOUNDARY:
+                attr.is_word_boundary = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_BREAK_INSERTS_HYPHEN:
+                attr.break_inserts_hyphen = gtk_json_parser_get_boolean (parser);
+                break;
+              case LOG_ATTR_BREAK_REMOVES_PRECEDING:
+                attr.break_removes_preceding = gtk_json_parser_get_boolean (parser);
+                break;
+              default:
+                break;
+              }
+          }
+        while (gtk_json_parser_next (parser));
+
+        gtk_json_parser_end (parser);
+
+        g_array_append_val (log_attrs, attr);
+      }
+    while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+enum {
+  GLYPH_GLYPH,
+  GLYPH_WIDTH,
+  GLYPH_X_OFFSET,
+  GLYPH_Y_OFFSET,
+  GLYPH_IS_CLUSTER_START,
+  GLYPH_IS_COLOR,
+  GLYPH_LOG_CLUSTER
+};
+
+static const char *glyph_members[] = {
+  "glyph",
+  "width",
+  "x-offset",
+  "y-offset",
+  "is-cluster-start",
+  "is-color",
+  "log-cluster",
+  NULL
+};
+
+static void
+json_parser_fill_glyphs (GtkJsonParser    *parser,
+                         PangoGlyphString *glyphs)
+{
+  GArray *infos;
+  GArray *log_clusters;
+
+  infos = g_array_new (FALSE, FALSE, sizeof (PangoGlyphInfo));
+  log_clusters = g_array_new (FALSE, FALSE, sizeof (int));
+
+  gtk_json_parser_start_array (parser);
+
+  if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+    do
+      {
+        PangoGlyphInfo info = { 0, };
+        int log_cluster = 0;
+
+        gtk_json_parser_start_object (parser);
+
+        do
+          {
+            switch (gtk_json_parser_select_member (parser, glyph_members))
+              {
+              case GLYPH_GLYPH:
+                /* PANGO_GLYPH_INVALID_INPUT is serialized as -1 */
+                info.glyph = (PangoGlyph) gtk_json_parser_get_int (parser);
+                break;
+              case GLYPH_WIDTH:
+                info.geometry.width = gtk_json_parser_get_int (parser);
+                break;
+              case GLYPH_X_OFFSET:
+                info.geometry.x_offset = gtk_json_parser_get_int (parser);
+                break;
+              case GLYPH_Y_OFFSET:
+                info.geometry.y_offset = gtk_json_parser_get_int (parser);
+                break;
+              case GLYPH_IS_CLUSTER_START:
+                info.attr.is_cluster_start = gtk_json_parser_get_boolean (parser);
+                break;
+              case GLYPH_IS_COLOR:
+                info.attr.is_color = gtk_json_parser_get_boolean (parser);
+                break;
+              case GLYPH_LOG_CLUSTER:
+                log_cluster = gtk_json_parser_get_int (parser);
+                break;
+              default:
+                break;
+              }
+          }
+        while (gtk_json_parser_next (parser));
+
+        gtk_json_parser_end (parser);
+
+        g_array_append_val (infos, info);
+        g_array_append_val (log_clusters, log_cluster);
+      }
+    while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+
+  pango_glyph_string_set_size (glyphs, infos->len);
+  if (infos->len > 0)
+    {
+      memcpy (glyphs->glyphs, infos->data, infos->len * sizeof (PangoGlyphInfo));
+      memcpy (glyphs->log_clusters, log_clusters->data, log_clusters->len * sizeof (int));
+    }
+
+  g_array_unref (infos);
+  g_array_unref (log_clusters);
+}
+
+enum {
+  RUN_OFFSET,
+  RUN_LENGTH,
+  RUN_TEXT,
+  RUN_BIDI_LEVEL,
+  RUN_GRAVITY,
+  RUN_LANGUAGE,
+  RUN_SCRIPT,
+  RUN_FONT,
+  RUN_SIZE_FONT,
+  RUN_FLAGS,
+  RUN_EXTRA_ATTRIBUTES,
+  RUN_Y_OFFSET,
+  RUN_START_X_OFFSET,
+  RUN_END_X_OFFSET,
+  RUN_GLYPHS
+};
+
+static const char *run_members[] = {
+  "offset",
+  "length",
+  "text",
+  "bidi-level",
+  "gravity",
+  "language",
+  "script",
+  "font",
+  "size-font",
+  "flags",
+  "extra-attributes",
+  "y-offset",
+  "start-x-offset",
+  "end-x-offset",
+  "glyphs",
+  NULL
+};
+
+static PangoScript
+parser_get_script (GtkJsonParser *parser)
+{
+  GEnumClass *enum_class;
+  GEnumValue *enum_value;
+  char *str;
+
+  str = gtk_json_parser_get_string (parser);
+
+  enum_class = g_type_class_ref (PANGO_TYPE_SCRIPT);
+  enum_value = g_enum_get_value_by_nick (enum_class, str);
+  g_type_class_unref (enum_class);
+
+  if (!enum_value)
+    gtk_json_parser_value_error (parser, "Failed to parse script: %s", str);
+
+  g_free (str);
+
+  return enum_value ? enum_value->value : PANGO_SCRIPT_UNKNOWN;
+}
+
+static PangoLayoutRun *
+json_parser_get_run (GtkJsonParser *parser,
+                     LayoutOutput  *output)
+{
+  PangoLayoutRun *run;
+  PangoItem *item;
+  PangoFont *font;
+  char *str;
+
+  run = g_slice_new0 (PangoLayoutRun);
+  run->item = item = pango_item_new ();
+  run->glyphs = pango_glyph_string_new ();
+
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      switch (gtk_json_parser_select_member (parser, run_members))
+        {
+        case RUN_OFFSET:
+          item->offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_LENGTH:
+          item->length = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_BIDI_LEVEL:
+          item->analysis.level = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_GRAVITY:
+          item->analysis.gravity = parser_select_string (parser, gravity_names);
+          break;
+
+        case RUN_LANGUAGE:
+          str = gtk_json_parser_get_string (parser);
+          item->analysis.language = pango_language_from_string (str);
+          g_free (str);
+          break;
+
+        case RUN_SCRIPT:
+          item->analysis.script = parser_get_script (parser);
+          break;
+
+        case RUN_FONT:
+          font = json_parser_load_output_font (parser, output);
+          g_clear_object (&item->analysis.font);
+          item->analysis.font = font;
+          break;
+
+        case RUN_SIZE_FONT:
+          font = json_parser_load_output_font (parser, output);
+          pango_analysis_set_size_font (&item->analysis, font);
+          g_clear_object (&font);
+          break;
+
+        case RUN_FLAGS:
+          item->analysis.flags |= gtk_json_parser_get_int (parser) & ANALYSIS_FLAGS;
+          break;
+
+        case RUN_EXTRA_ATTRIBUTES:
+          gtk_json_parser_start_array (parser);
+          if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+            do
+              {
+                PangoAttribute *attr = json_to_attribute (parser);
+                if (attr)
+                  item->analysis.extra_attrs = g_slist_prepend (item->analysis.extra_attrs, attr);
+              }
+            while (gtk_json_parser_next (parser));
+          gtk_json_parser_end (parser);
+          item->analysis.extra_attrs = g_slist_reverse (item->analysis.extra_attrs);
+          break;
+
+        case RUN_Y_OFFSET:
+          run->y_offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_START_X_OFFSET:
+          run->start_x_offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_END_X_OFFSET:
+          run->end_x_offset = gtk_json_parser_get_int (parser);
+          break;
+
+        case RUN_GLYPHS:
+          json_parser_fill_glyphs (parser, run->glyphs);
+          break;
+
+        case RUN_TEXT:
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+
+  return run;
+}
+
+enum {
+  LINE_START_INDEX,
+  LINE_LENGTH,
+  LINE_PARAGRAPH_START,
+  LINE_DIRECTION,
+  LINE_RUNS
+};
+
+static const char *line_members[] = {
+  "start-index",
+  "length",
+  "paragraph-start",
+  "direction",
+  "runs",
+  NULL
+};
+
+static PangoLayoutLine *
+json_parser_get_line (GtkJsonParser *parser,
+                      LayoutOutput  *output)
+{
+  PangoLayoutLine *line;
+
+  line = _pango_layout_line_new (output->layout);
+  line->start_index = 0;
+  line->is_paragraph_start = FALSE;
+  line->resolved_dir = PANGO_DIRECTION_LTR;
+
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      switch (gtk_json_parser_select_member (parser, line_members))
+        {
+        case LINE_START_INDEX:
+          line->start_index = gtk_json_parser_get_int (parser);
+          break;
+
+        case LINE_LENGTH:
+          line->length = gtk_json_parser_get_int (parser);
+          break;
+
+        case LINE_PARAGRAPH_START:
+          line->is_paragraph_start = gtk_json_parser_get_boolean (parser);
+          break;
+
+        case LINE_DIRECTION:
+          line->resolved_dir = parser_select_string (parser, direction_names);
+          break;
+
+        case LINE_RUNS:
+          gtk_json_parser_start_array (parser);
+          if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+            do
+              line->runs = g_slist_prepend (line->runs, json_parser_get_run (parser, output));
+            while (gtk_json_parser_next (parser));
+          gtk_json_parser_end (parser);
+          line->runs = g_slist_reverse (line->runs);
+          break;
+
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+
+  return line;
+}
+
+enum {
+  OUTPUT_IS_WRAPPED,
+  OUTPUT_IS_ELLIPSIZED,
+  OUTPUT_UNKNOWN_GLYPHS,
+  OUTPUT_WIDTH,
+  OUTPUT_HEIGHT,
+  OUTPUT_LOG_ATTRS,
+  OUTPUT_LINES
+};
+
+static const char *output_members[] = {
+  "is-wrapped",
+  "is-ellipsized",
+  "unknown-glyphs",
+  "width",
+  "height",
+  "log-attrs",
+  "lines",
+  NULL
+};
+
+static void
+json_parser_fill_output (GtkJsonParser *parser,
+                         LayoutOutput  *output)
+{
+  output->present = TRUE;
+
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      switch (gtk_json_parser_select_member (parser, output_members))
+        {
+        case OUTPUT_IS_WRAPPED:
+          output->is_wrapped = gtk_json_parser_get_boolean (parser);
+          break;
+
+        case OUTPUT_IS_ELLIPSIZED:
+          output->is_ellipsized = gtk_json_parser_get_boolean (parser);
+          break;
+
+        case OUTPUT_LOG_ATTRS:
+          g_array_set_size (output->log_attrs, 0);
+          json_parser_fill_log_attrs (parser, output->log_attrs);
+          break;
+
+        case OUTPUT_LINES:
+          gtk_json_parser_start_array (parser);
+          if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+            do
+              output->lines = g_slist_prepend (output->lines, json_parser_get_line (parser, output));
+            while (gtk_json_parser_next (parser));
+          gtk_json_parser_end (parser);
+          break;
+
+        /* These are computed from the lines */
+        case OUTPUT_UNKNOWN_GLYPHS:
+        case OUTPUT_WIDTH:
+        case OUTPUT_HEIGHT:
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+/* }}} */
+
+enum {
+  LAYOUT_CONTEXT,
+  LAYOUT_COMMENT,
+  LAYOUT_TEXT,
+  LAYOUT_ATTRIBUTES,
+  LAYOUT_FONT,
+  LAYOUT_TABS,
+  LAYOUT_JUSTIFY,
+  LAYOUT_JUSTIFY_LAST_LINE,
+  LAYOUT_SINGLE_PARAGRAPH,
+  LAYOUT_AUTO_DIR,
+  LAYOUT_ALIGNMENT,
+  LAYOUT_WRAP,
+  LAYOUT_ELLIPSIZE,
+  LAYOUT_WIDTH,
+  LAYOUT_HEIGHT,
+  LAYOUT_INDENT,
+  LAYOUT_SPACING,
+  LAYOUT_LINE_SPACING,
+  LAYOUT_OUTPUT
+};
+
+static const char *layout_members[] = {
+  "context",
+  "comment",
+  "text",
+  "attributes",
+  "font",
+  "tabs",
+  "justify",
+  "justify-last-line",
+  "single-paragraph",
+  "auto-dir",
+  "alignment",
+  "wrap",
+  "ellipsize",
+  "width",
+  "height",
+  "indent",
+  "spacing",
+  "line-spacing",
+  "output",
+  NULL
+};
+
+static void
+json_parser_fill_layout (GtkJsonParser               *parser,
+                         PangoLayout                 *layout,
+                         PangoLayoutDeserializeFlags  flags,
+                         LayoutOutput                *output)
+{
+  gtk_json_parser_start_object (parser);
+
+  do
+    {
+      char *str;
+
+      switch (gtk_json_parser_select_member (parser, layout_members))
+        {
+        case LAYOUT_CONTEXT:
+          if (flags & PANGO_LAYOUT_DESERIALIZE_CONTEXT)
+            json_parser_fill_context (parser, pango_layout_get_context (layout));
+          break;
+
+        case LAYOUT_COMMENT:
+          str = gtk_json_parser_get_string (parser);
+          g_object_set_data_full (G_OBJECT (layout), "comment", str, g_free);
+          break;
+
+        case LAYOUT_TEXT:
+          str = gtk_json_parser_get_string (parser);
+          pango_layout_set_text (layout, str, -1);
+          g_free (str);
+          break;
+
+        case LAYOUT_ATTRIBUTES:
+          {
+            PangoAttrList *attributes = pango_attr_list_new ();
+            json_parser_fill_attr_list (parser, attributes);
+            pango_layout_set_attributes (layout, attributes);
+            pango_attr_list_unref (attributes);
+          }
+          break;
+
+        case LAYOUT_FONT:
+          {
+            PangoFontDescription *desc = parser_get_font_description (parser);;
+            pango_layout_set_font_description (layout, desc);
+            pango_font_description_free (desc);
+          }
+          break;
+
+        case LAYOUT_TABS:
+          {
+            PangoTabArray *tabs = pango_tab_array_new (0, FALSE);
+            json_parser_fill_tab_array (parser, tabs);
+            pango_layout_set_tabs (layout, tabs);
+            pango_tab_array_free (tabs);
+          }
+          break;
+
+        case LAYOUT_JUSTIFY:
+          pango_layout_set_justify (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_JUSTIFY_LAST_LINE:
+          pango_layout_set_justify_last_line (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_SINGLE_PARAGRAPH:
+          pango_layout_set_single_paragraph_mode (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_AUTO_DIR:
+          pango_layout_set_auto_dir (layout, gtk_json_parser_get_boolean (parser));
+          break;
+
+        case LAYOUT_ALIGNMENT:
+          pango_layout_set_alignment (layout, (PangoAlignment) parser_select_string (parser, alignment_names));
+          break;
+
+        case LAYOUT_WRAP:
+          pango_layout_set_wrap (layout, (PangoWrapMode) parser_select_string (parser, wrap_names));
+          break;
+
+        case LAYOUT_ELLIPSIZE:
+          pango_layout_set_ellipsize (layout, (PangoEllipsizeMode) parser_select_string (parser, ellipsize_names));
+          break;
+
+        case LAYOUT_WIDTH:
+          pango_layout_set_width (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_HEIGHT:
+          pango_layout_set_height (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_INDENT:
+          pango_layout_set_indent (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_SPACING:
+          pango_layout_set_spacing (layout, (int) gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_LINE_SPACING:
+          pango_layout_set_line_spacing (layout, gtk_json_parser_get_number (parser));
+          break;
+
+        case LAYOUT_OUTPUT:
+          if (output)
+            json_parser_fill_output (parser, output);
+          break;
+
+        default:
+          break;
+        }
+    }
+  while (gtk_json_parser_next (parser));
+
+  gtk_json_parser_end (parser);
+}
+
+/* }}} */
+/* {{{ Binary format */
+
+/* The binary format is meant for shipping layouts that were
+ * computed ahead of time to processes that render them, with
+ * the same version of Pango on the same architecture.
+ *
+ * It starts with a magic and the JSON for the properties of
+ * the layout, like the text and attributes. If the output is
+ * included, it follows in raw form: the log attrs, a table of
+ * the fonts in pango_font_serialize() form, and the lines with
+ * their runs, whose glyphs can be copied without parsing.
+ */
+#define BINARY_MAGIC "PangoLB1"
+#define BINARY_MAGIC_LEN 8
+
+#define BINARY_WRAPPED    (1 << 0)
+#define BINARY_ELLIPSIZED (1 << 1)
+
+typedef struct
+{
+  gint32 start_index;
+  gint32 length;
+  guint32 is_paragraph_start;
+  guint32 resolved_dir;
+  guint32 n_runs;
+} BinaryLine;
+
+/* Followed by the language, the extra attributes as JSON,
+ * and num_glyphs PangoGlyphInfos and log clusters
+ */
+typedef struct
+{
+  gint32 offset;
+  gint32 length;
+  guint32 level;
+  guint32 gravity;
+  guint32 flags;
+  guint32 script;
+  gint32 font;
+  gint32 size_font;
+  gint32 y_offset;
+  gint32 start_x_offset;
+  gint32 end_x_offset;
+  guint32 language_size;
+  guint32 extra_attrs_size;
+  guint32 num_glyphs;
+} BinaryRun;
+
+static void
+binary_append_uint (GString *str,
+                    guint32  value)
+{
+  g_string_append_len (str, (const char *) &value, sizeof (guint32));
+}
+
+static void
+binary_append_data (GString    *str,
+                    const char *data,
+                    gsize       size)
+{
+  binary_append_uint (str, size);
+  g_string_append_len (str, data, size);
+}
+
+static gint32
+binary_add_font (GHashTable *fonts,
+                 GString    *str,
+                 PangoFont  *font)
+{
+  gpointer value;
+  gint32 index;
+  GBytes *bytes;
+  gsize size;
+  const char *data;
+
+  if (!font)
+    return -1;
+
+  if (g_hash_table_lookup_extended (fonts, font, NULL, &value))
+    return GPOINTER_TO_INT (value);
+
+  index = g_hash_table_size (fonts);
+  g_hash_table_insert (fonts, font, GINT_TO_POINTER (index));
+
+  bytes = pango_font_serialize (font);
+  data = g_bytes_get_data (bytes, &size);
+  binary_append_data (str, data, size);
+  g_bytes_unref (bytes);
+
+  return index;
+}
+
+static void
+binary_add_run (GString        *str,
+                PangoLayoutRun *run,
+                GHashTable     *fonts,
+                GString        *fonts_str)
+{
+  PangoItem *item = run->item;
+  const char *language;
+  GString *attrs_str = NULL;
+  BinaryRun br;
+
+  language = pango_language_to_string (item->analysis.language);
+  if (!language)
+    language = "";
+
+  if (item->analysis.extra_attrs)
+    {
+      GtkJsonPrinter *printer;
+
+      attrs_str = g_string_new (NULL);
+      printer = gtk_json_printer_new (gstring_write, attrs_str, NULL);
+      gtk_json_printer_start_array (printer, NULL);
+      for (GSList *l = item->analysis.extra_attrs; l; l = l->next)
+        add_attribute (printer, l->data);
+      gtk_json_printer_end (printer);
+      gtk_json_printer_free (printer);
+    }
+
+  memset (&br, 0, sizeof (BinaryRun));
+  br.offset = item->offset;
+  br.length = item->length;
+  br.level = item->analysis.level;
+  br.gravity = item->analysis.gravity;
+  br.flags = item->analysis.flags & ANALYSIS_FLAGS;
+  br.script = item->analysis.script;
+  br.font = binary_add_font (fonts, fonts_str, item->analysis.font);
+  br.size_font = binary_add_font (fonts, fonts_str, pango_analysis_get_size_font (&item->analysis));
+  br.y_offset = run->y_offset;
+  br.start_x_offset = run->start_x_offset;
+  br.end_x_offset = run->end_x_offset;
+  br.language_size = strlen (language);
+  br.extra_attrs_size = attrs_str ? attrs_str->len : 0;
+  br.num_glyphs = run->glyphs->num_glyphs;
+
+  g_string_append_len (str, (const char *) &br, sizeof (BinaryRun));
+  g_string_append_len (str, language, br.language_size);
+  if (attrs_str)
+    {
+      g_string_append_len (str, attrs_str->str, attrs_str->len);
+      g_string_free (attrs_str, TRUE);
+    }
+  g_string_append_len (str, (const char *) run->glyphs->glyphs,
+                       br.num_glyphs * sizeof (PangoGlyphInfo));
+  g_string_append_len (str, (const char *) run->glyphs->log_clusters,
+                       br.num_glyphs * sizeof (int));
+}
+
+static void
+binary_add_output (GString     *str,
+                   PangoLayout *layout)
+{
+  const PangoLogAttr *log_attrs;
+  int n_attrs;
+  GHashTable *fonts;
+  GString *fonts_str;
+  GString *lines_str;
+  guint32 flags = 0;
+
+  if (pango_layout_is_wrapped (layout))
+    flags |= BINARY_WRAPPED;
+  if (pango_layout_is_ellipsized (layout))
+    flags |= BINARY_ELLIPSIZED;
+  binary_append_uint (str, flags);
+
+  log_attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+  binary_append_data (str, (const char *) log_attrs, n_attrs * sizeof (PangoLogAttr));
+
+  /* The font table comes before the lines, but is
+   * collected while writing them
+   */
+  fonts = g_hash_table_new (NULL, NULL);
+  fonts_str = g_string_new (NULL);
+  lines_str = g_string_new (NULL);
+
+  for (GSList *l = layout->lines; l; l = l->next)
+    {
+      PangoLayoutLine *line = l->data;
+      BinaryLine bl;
+
+      memset (&bl, 0, sizeof (BinaryLine));
+      bl.start_index = line->start_index;
+      bl.length = line->length;
+      bl.is_paragraph_start = line->is_paragraph_start;
+      bl.resolved_dir = line->resolved_dir;
+      bl.n_runs = g_slist_length (line->runs);
+
+      g_string_append_len (lines_str, (const char *) &bl, sizeof (BinaryLine));
+
+      for (GSList *r = line->runs; r; r = r->next)
+        binary_add_run (lines_str, r->data, fonts, fonts_str);
+    }
+
+  binary_append_uint (str, g_hash_table_size (fonts));
+  g_string_append_len (str, fonts_str->str, fonts_str->len);
+
+  binary_append_uint (str, layout->line_count);
+  g_string_append_len (str, lines_str->str, lines_str->len);
+
+  g_string_free (lines_str, TRUE);
+  g_string_free (fonts_str, TRUE);
+  g_hash_table_unref (fonts);
+}
+
+static void
+layout_to_binary (GString                   *str,
+                  PangoLayout               *layout,
+                  PangoLayoutSerializeFlags  flags)
+{
+  GtkJsonPrinter *printer;
+  GString *json;
+
+  json = g_string_new (NULL);
+  printer = gtk_json_printer_new (gstring_write, json, NULL);
+  layout_to_json (printer, layout, flags & PANGO_LAYOUT_SERIALIZE_CONTEXT);
+  gtk_json_printer_free (printer);
+
+  g_string_append_len (str, BINARY_MAGIC, BINARY_MAGIC_LEN);
+  binary_append_data (str, json->str, json->len);
+  g_string_free (json, TRUE);
+
+  if (flags & PANGO_LAYOUT_SERIALIZE_OUTPUT)
+    {
+      binary_append_uint (str, TRUE);
+      binary_add_output (str, layout);
+    }
+  else
+    binary_append_uint (str, FALSE);
+}
+
+typedef struct
+{
+  const char *data;
+  gsize size;
+  gsize pos;
+} BinaryReader;
+
+static gboolean
+binary_reader_init (BinaryReader *reader,
+                    GBytes       *bytes)
+{
+  reader->data = g_bytes_get_data (bytes, &reader->size);
+  reader->pos = BINARY_MAGIC_LEN;
+
+  return reader->size >= BINARY_MAGIC_LEN &&
+         memcmp (reader->data, BINARY_MAGIC, BINARY_MAGIC_LEN) == 0;
+}
+
+/* Returns a pointer to the next n * size bytes, or NULL
+ * if there are not that many left
+ */
+static const char *
+binary_reader_get (BinaryReader *reader,
+                   gsize         n,
+                   gsize         size)
+{
+  const char *data;
+
+  if (size != 0 && n > (reader->size - reader->pos) / size)
+    return NULL;
+
+  data = reader->data + reader->pos;
+  reader->pos += n * size;
+
+  return data;
+}
+
+static gboolean
+binary_reader_read (BinaryReader *reader,
+                    gpointer      dest,
+                    gsize         size)
+{
+  const char *data = binary_reader_get (reader, 1, size);
+
+  if (!data)
+    return FALSE;
+
+  memcpy (dest, data, size);
+
+  return TRUE;
+}
+
+static const char *
+binary_reader_get_data (BinaryReader *reader,
+                        guint32      *size)
+{
+  if (!binary_reader_read (reader, size, sizeof (guint32)))
+    return NULL;
+
+  return binary_reader_get (reader, *size, 1);
+}
+
+static PangoFont *
+binary_load_font (const char   *data,
+                  gsize         size,
+                  LayoutOutput *output)
+{
+  GtkJsonParser *parser;
+  PangoFont *font;
+
+  parser = gtk_json_parser_new_for_string (data, size);
+  font = json_parser_load_output_font (parser, output);
+  gtk_json_parser_free (parser);
 
   return font;
 }
 
+static gboolean
+binary_read_extra_attrs (const char  *data,
+                         gsize        size,
+                         GSList     **extra_attrs)
+{
+  GtkJsonParser *parser;
+  gboolean ret;
+
+  parser = gtk_json_parser_new_for_string (data, size);
+
+  gtk_json_parser_start_array (parser);
+  if (gtk_json_parser_get_node (parser) != GTK_JSON_NONE)
+    do
+      {
+        PangoAttribute *attr = json_to_attribute (parser);
+        if (attr)
+          *extra_attrs = g_slist_prepend (*extra_attrs, attr);
+      }
+    while (gtk_json_parser_next (parser));
+  gtk_json_parser_end (parser);
+
+  *extra_attrs = g_slist_reverse (*extra_attrs);
+
+  ret = gtk_json_parser_get_error (parser) == NULL;
+  gtk_json_parser_free (parser);
+
+  return ret;
+}
+
+static gboolean
+binary_read_run (BinaryReader    *reader,
+                 GPtrArray       *fonts,
+                 PangoLayoutLine *line)
+{
+  PangoLayoutRun *run;
+  PangoItem *item;
+  BinaryRun br;
+  const char *data;
+  char *str;
+
+  if (!binary_reader_read (reader, &br, sizeof (BinaryRun)))
+    return FALSE;
+
+  if (br.font >= (gint32) fonts->len || br.size_font >= (gint32) fonts->len ||
+      br.gravity > PANGO_GRAVITY_AUTO || br.level > 125 ||
+      !is_valid_script (br.script))
+    return FALSE;
+
+  run = g_slice_new0 (PangoLayoutRun);
+  run->item = item = pango_item_new ();
+  run->glyphs = pango_glyph_string_new ();
+  line->runs = g_slist_prepend (line->runs, run);
+
+  item->offset = br.offset;
+  item->length = br.length;
+  item->analysis.level = br.level;
+  item->analysis.gravity = br.gravity;
+  item->analysis.flags |= br.flags & ANALYSIS_FLAGS;
+  item->analysis.script = br.script;
+  if (br.font >= 0)
+    item->analysis.font = g_object_ref (g_ptr_array_index (fonts, br.font));
+  if (br.size_font >= 0)
+    pango_analysis_set_size_font (&item->analysis, g_ptr_array_index (fonts, br.size_font));
+  run->y_offset = br.y_offset;
+  run->start_x_offset = br.start_x_offset;
+  run->end_x_offset = br.end_x_offset;
+
+  data = binary_reader_get (reader, br.language_size, 1);
+  if (!data)
+    return FALSE;
+  str = g_strndup (data, br.language_size);
+  item->analysis.language = pango_language_from_string (str);
+  g_free (str);
+
+  if (br.extra_attrs_size > 0)
+    {
+      data = binary_reader_get (reader, br.extra_attrs_size, 1);
+      if (!data ||
+          !binary_read_extra_attrs (data, br.extra_attrs_size, &item->analysis.extra_attrs))
+        return FALSE;
+    }
+
+  data = binary_reader_get (reader, br.num_glyphs, sizeof (PangoGlyphInfo));
+  if (!data)
+    return FALSE;
+  pango_glyph_string_set_size (run->glyphs, br.num_glyphs);
+  memcpy (run->glyphs->glyphs, data, br.num_glyphs * sizeof (PangoGlyphInfo));
+
+  data = binary_reader_get (reader, br.num_glyphs, sizeof (int));
+  if (!data)
+    return FALSE;
+  memcpy (run->glyphs->log_clusters, data, br.num_glyphs * sizeof (int));
+
+  return TRUE;
+}
+
+/* Returns FALSE if the data is truncated or invalid. If the
+ * fonts don't match, this stops reading early and returns
+ * TRUE, and the output is not applied.
+ */
+static gboolean
+binary_read_output (BinaryReader *reader,
+                    LayoutOutput *output)
+{
+  guint32 flags;
+  guint32 size;
+  guint32 n_fonts;
+  guint32 n_lines;
+  const char *data;
+  GPtrArray *fonts;
+  gboolean ret = FALSE;
+
+  output->present = TRUE;
+
+  if (!binary_reader_read (reader, &flags, sizeof (guint32)))
+    return FALSE;
+
+  output->is_wrapped = (flags & BINARY_WRAPPED) != 0;
+  output->is_ellipsized = (flags & BINARY_ELLIPSIZED) != 0;
+
+  data = binary_reader_get_data (reader, &size);
+  if (!data || size % sizeof (PangoLogAttr) != 0)
+    return FALSE;
+  g_array_append_vals (output->log_attrs, data, size / sizeof (PangoLogAttr));
+
+  if (!binary_reader_read (reader, &n_fonts, sizeof (guint32)))
+    return FALSE;
+
+  fonts = g_ptr_array_new_with_free_func (g_object_unref);
+
+  for (guint i = 0; i < n_fonts; i++)
+    {
+      PangoFont *font;
+
+      data = binary_reader_get_data (reader, &size);
+      if (!data)
+        goto out;
+
+      font = binary_load_font (data, size, output);
+      if (!output->fonts_match)
+        {
+          g_clear_object (&font);
+          ret = TRUE;
+          goto out;
+        }
+
+      g_ptr_array_add (fonts, font);
+    }
+
+  if (!binary_reader_read (reader, &n_lines, sizeof (guint32)))
+    goto out;
+
+  for (guint i = 0; i < n_lines; i++)
+    {
+      PangoLayoutLine *line;
+      BinaryLine bl;
+
+      if (!binary_reader_read (reader, &bl, sizeof (BinaryLine)) ||
+          bl.resolved_dir > PANGO_DIRECTION_NEUTRAL)
+        goto out;
+
+      line = _pango_layout_line_new (output->layout);
+      line->start_index = bl.start_index;
+      line->length = bl.length;
+      line->is_paragraph_start = bl.is_paragraph_start != 0;
+      line->resolved_dir = bl.resolved_dir;
+      output->lines = g_slist_prepend (output->lines, line);
+
+      for (guint j = 0; j < bl.n_runs; j++)
+        {
+          if (!binary_read_run (reader, fonts, line))
+            {
+              line->runs = g_slist_reverse (line->runs);
+              goto out;
+            }
+        }
+
+      line->runs = g_slist_reverse (line->runs);
+    }
+
+  ret = TRUE;
+
+out:
+  g_ptr_array_unref (fonts);
+
+  return ret;
+}
+
 /* }}} */
 /* {{{ Public API */
 
@@ -1638,6 +2873,11 @@ json_parser_load_font (GtkJsonParser  *parser,
  * The intended use of this function is testing, benchmarking and debugging.
  * The format is not meant as a permanent storage format.
  *
+ * With %PANGO_LAYOUT_SERIALIZE_BINARY, a compact binary form is
+ * produced instead of JSON. It can only be loaded by the same
+ * version of Pango on the same architecture, and is meant for
+ * passing precomputed layouts to a process that renders them.
+ *
  * Returns: a `GBytes` containing the serialized form of @layout
  *
  * Since: 1.50
@@ -1655,12 +2895,17 @@ pango_layout_serialize (PangoLayout               *layout,
 
   str = g_string_new ("");
 
-  printer = gtk_json_printer_new (gstring_write, str, NULL);
-  gtk_json_printer_set_flags (printer, GTK_JSON_PRINTER_PRETTY);
-  layout_to_json (printer, layout, flags);
-  gtk_json_printer_free (printer);
+  if (flags & PANGO_LAYOUT_SERIALIZE_BINARY)
+    layout_to_binary (str, layout, flags);
+  else
+    {
+      printer = gtk_json_printer_new (gstring_write, str, NULL);
+      gtk_json_printer_set_flags (printer, GTK_JSON_PRINTER_PRETTY);
+      layout_to_json (printer, layout, flags);
+      gtk_json_printer_free (printer);
 
-  g_string_append_c (str, '\n');
+      g_string_append_c (str, '\n');
+    }
 
   size = str->len;
   data = g_string_free (str, FALSE);
@@ -1728,6 +2973,13 @@ pango_layout_write_to_file (PangoLayout                *layout,
  * the one that was serialized, you can compare @bytes to the
  * result of serializing the layout again.
  *
+ * If @flags includes %PANGO_LAYOUT_DESERIALIZE_OUTPUT and @bytes
+ * contains the output of the layout, the lines are restored from
+ * it instead of being computed again. This only happens if all
+ * the fonts it refers to can be loaded from the font map of
+ * @context and have the same data as when the layout was
+ * serialized; otherwise the output is ignored.
+ *
  * Returns: (nullable) (transfer full): a new `PangoLayout`
  *
  * Since: 1.50
@@ -1741,13 +2993,38 @@ pango_layout_deserialize (PangoContext                 *context,
   PangoLayout *layout;
   GtkJsonParser *parser;
   const GError *parser_error;
+  LayoutOutput output;
+  BinaryReader reader;
+  gboolean binary;
 
   g_return_val_if_fail (PANGO_IS_CONTEXT (context), NULL);
 
   layout = pango_layout_new (context);
+  layout_output_init (&output, layout);
 
-  parser = gtk_json_parser_new_for_bytes (bytes);
-  json_parser_fill_layout (parser, layout, flags);
+  binary = binary_reader_init (&reader, bytes);
+  if (binary)
+    {
+      const char *json;
+      guint32 size;
+
+      json = binary_reader_get_data (&reader, &size);
+      if (!json)
+        {
+          g_set_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID,
+                       "The data is truncated");
+          layout_output_clear (&output);
+          g_object_unref (layout);
+          return NULL;
+        }
+
+      parser = gtk_json_parser_new_for_string (json, size);
+    }
+  else
+    parser = gtk_json_parser_new_for_bytes (bytes);
+
+  json_parser_fill_layout (parser, layout, flags,
+                           (flags & PANGO_LAYOUT_DESERIALIZE_OUTPUT) ? &output : NULL);
 
   parser_error = gtk_json_parser_get_error (parser);
 
@@ -1773,6 +3050,24 @@ pango_layout_deserialize (PangoContext                 *context,
 
   gtk_json_parser_free (parser);
 
+  if (layout && binary && (flags & PANGO_LAYOUT_DESERIALIZE_OUTPUT))
+    {
+      guint32 has_output;
+
+      if (!binary_reader_read (&reader, &has_output, sizeof (guint32)) ||
+          (has_output && !binary_read_output (&reader, &output)))
+        {
+          g_set_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID,
+                       "The output data is truncated or invalid");
+          g_clear_object (&layout);
+        }
+    }
+
+  if (layout && !layout_output_apply (&output, error))
+    g_clear_object (&layout);
+
+  layout_output_clear (&output);
+
   return layout;
 }
 
@@ -1846,7 +3141,7 @@ pango_font_deserialize (PangoContext  *context,
   g_return_val_if_fail (PANGO_IS_CONTEXT (context), NULL);
 
   parser = gtk_json_parser_new_for_bytes (bytes);
-  font = json_parser_load_font (parser, context, error);
+  font = json_parser_load_font (parser, context, NULL, error);
   gtk_json_parser_free (parser);
 
   return font;
@@ -528,6 +528,7 @@ pango_hb_shape (const char          *item_text,
       glyphs->log_clusters[i] = hb_glyph->cluster - item_offset;
       infos[i].attr.is_cluster_start = glyphs->log_clusters[i] != last_cluster;
       infos[i].attr.is_color = font_is_color && glyph_has_color (hb_font, hb_glyph->codepoint);
+      infos[i].attr.is_unsafe_to_break = (hb_glyph_info_get_glyph_flags (hb_glyph) & HB_GLYPH_FLAG_UNSAFE_TO_BREAK) != 0;
       hb_glyph++;
       last_cluster = glyphs->log_clusters[i];
     }
@@ -595,6 +596,7 @@ fallback_shape (const char          *text,
       pango_font_get_glyph_extents (analysis->font, glyph, NULL, &logical_rect);
 
       glyphs->glyphs[i].glyph = glyph;
+      glyphs->glyphs[i].attr.is_unsafe_to_break = FALSE;
 
       glyphs->glyphs[i].geometry.x_offset = 0;
       glyphs->glyphs[i].geometry.y_offset = 0;
@@ -272,6 +272,63 @@ test_parse_incrementally (gconstpointer d)
   g_free (expected_file);
 }
 
+static void
+test_parse_perf (void)
+{
+  GPtrArray *markups;
+  GDir *dir;
+  const char *name;
+  char *path;
+  double elapsed;
+  guint i;
+  int n;
+
+  markups = g_ptr_array_new_with_free_func (g_free);
+
+  path = g_test_build_filename (G_TEST_DIST, "markups", NULL);
+  dir = g_dir_open (path, 0, NULL);
+  g_free (path);
+  g_assert_nonnull (dir);
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      char *contents;
+
+      if (!strstr (name, "markup"))
+        continue;
+
+      path = g_test_build_filename (G_TEST_DIST, "markups", name, NULL);
+      if (g_file_get_contents (path, &contents, NULL, NULL))
+        g_ptr_array_add (markups, contents);
+      g_free (path);
+    }
+  g_dir_close (dir);
+
+  g_test_timer_start ();
+  for (n = 0; n < 1000; n++)
+    {
+      for (i = 0; i < markups->len; i++)
+        {
+          PangoAttrList *attrs = NULL;
+          char *text = NULL;
+
+          if (pango_parse_markup (g_ptr_array_index (markups, i), -1, 0,
+                                  &attrs, &text, NULL, NULL))
+            {
+              pango_attr_list_unref (attrs);
+              g_free (text);
+            }
+        }
+    }
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / 1000,
+                           "pango_parse_markup: %g ms per pass over %u markups",
+                           elapsed, markups->len);
+
+  g_ptr_array_unref (markups);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -318,5 +375,8 @@ main (int argc, char *argv[])
     }
   g_dir_close (dir);
 
+  if (g_test_perf ())
+    g_test_add_func ("/markup/perf/parse", test_parse_perf);
+
   return g_test_run ();
 }
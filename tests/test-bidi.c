@@ -156,6 +156,68 @@ test_bidi_embedding_levels (void)
     }
 }
 
+/* Check that the levels of items match the
+ * embedding levels of their characters
+ */
+static void
+assert_item_levels (const char   *text,
+                    PangoItem    *item,
+                    const guint8 *levels)
+{
+  int offset = g_utf8_pointer_to_offset (text, text + item->offset);
+
+  for (int j = 0; j < item->num_chars; j++)
+    g_assert_cmpint (item->analysis.level, ==, levels[offset + j]);
+}
+
+static void
+test_bidi_itemize_levels (void)
+{
+  const char *tests[] = {
+    "bahrain مصر kuwait",
+    "The title is مفتاح معايير الويب, in Arabic.",
+    "one two ثلاثة 1234 خمسة",
+    "abאב12cd",
+    "abאב‪xy‬cd",
+    "שלום עולם",
+    "hello world",
+  };
+  PangoDirection dirs[] = {
+    PANGO_DIRECTION_LTR,
+    PANGO_DIRECTION_RTL,
+    PANGO_DIRECTION_WEAK_LTR,
+  };
+  PangoFontMap *fontmap;
+  PangoContext *context;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+
+  for (int i = 0; i < G_N_ELEMENTS (tests); i++)
+    {
+      const char *text = tests[i];
+
+      for (int d = 0; d < G_N_ELEMENTS (dirs); d++)
+        {
+          PangoDirection dir = dirs[d];
+          guint8 *levels;
+          GList *items;
+
+          levels = pango_log2vis_get_embedding_levels (text, -1, &dir);
+          items = pango_itemize_with_base_dir (context, dirs[d], text, 0, strlen (text), NULL, NULL);
+
+          for (GList *l = items; l; l = l->next)
+            assert_item_levels (text, l->data, levels);
+
+          g_list_free_full (items, (GDestroyNotify) pango_item_free);
+          g_free (levels);
+        }
+    }
+
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 /* Some basic tests for pango_layout_move_cursor_visually inside
  * a single PangoLayoutLine:
  * - check that we actually move the cursor in the right direction
@@ -654,6 +716,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/bidi/type-for-unichar", test_bidi_type_for_unichar);
   g_test_add_func ("/bidi/unichar-direction", test_unichar_direction);
   g_test_add_func ("/bidi/embedding-levels", test_bidi_embedding_levels);
+  g_test_add_func ("/bidi/itemize-levels", test_bidi_itemize_levels);
   g_test_add_func ("/bidi/move-cursor-line", test_move_cursor_line);
   g_test_add_func ("/bidi/move-cursor-para", test_move_cursor_para);
   g_test_add_func ("/bidi/sinhala-cursor", test_sinhala_cursor);
@@ -122,6 +122,105 @@ test_ellipsize_fully (void)
   g_object_unref (fontmap);
 }
 
+/* Check that the ellipsis gets shaped with the right font
+ * when layouts with different fonts share a context.
+ */
+static void
+test_ellipsize_fonts (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  const char *fonts[] = { "Sans 10", "Sans 20", "Sans Bold 10", "Sans 10" };
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+
+  for (guint i = 0; i < G_N_ELEMENTS (fonts); i++)
+    {
+      PangoFontDescription *desc;
+      PangoLayout *layout;
+      int width, width2;
+
+      desc = pango_font_description_from_string (fonts[i]);
+
+      layout = pango_layout_new (context);
+      pango_layout_set_font_description (layout, desc);
+      pango_layout_set_text (layout, "…", -1);
+      pango_layout_get_size (layout, &width, NULL);
+      g_object_unref (layout);
+
+      layout = pango_layout_new (context);
+      pango_layout_set_font_description (layout, desc);
+      pango_layout_set_text (layout, "ellipsized", -1);
+      pango_layout_set_width (layout, 1 * PANGO_SCALE);
+      pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
+      pango_layout_get_size (layout, &width2, NULL);
+      g_object_unref (layout);
+
+      g_assert_cmpint (width, ==, width2);
+
+      pango_font_description_free (desc);
+    }
+
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* Measure ellipsizing a long single-line paragraph into a narrow width */
+static void
+test_ellipsize_long_line_perf (void)
+{
+  const PangoEllipsizeMode modes[] = {
+    PANGO_ELLIPSIZE_START,
+    PANGO_ELLIPSIZE_MIDDLE,
+    PANGO_ELLIPSIZE_END,
+  };
+  const char *names[] = { "start", "middle", "end" };
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  GString *text;
+  guint i;
+  int j;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+
+  text = g_string_new ("");
+  for (j = 0; j < 1000; j++)
+    g_string_append (text, "The quick brown fox jumps over the lazy dog. ");
+
+  for (i = 0; i < G_N_ELEMENTS (modes); i++)
+    {
+      PangoLayout *layout;
+      double elapsed;
+      int width;
+
+      layout = pango_layout_new (context);
+      pango_layout_set_text (layout, text->str, text->len);
+      pango_layout_set_width (layout, 200 * PANGO_SCALE);
+      pango_layout_set_ellipsize (layout, modes[i]);
+
+      g_test_timer_start ();
+      for (j = 0; j < 100; j++)
+        {
+          pango_layout_context_changed (layout);
+          pango_layout_get_size (layout, &width, NULL);
+        }
+      elapsed = g_test_timer_elapsed ();
+
+      g_assert_true (pango_layout_is_ellipsized (layout));
+      g_assert_cmpint (width, <=, 200 * PANGO_SCALE);
+
+      g_test_minimized_result (elapsed / 100, "ellipsize %s: %g ms per layout", names[i], elapsed * 10);
+
+      g_object_unref (layout);
+    }
+
+  g_string_free (text, TRUE);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -130,6 +229,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/ellipsize/height", test_ellipsize_height);
   g_test_add_func ("/layout/ellipsize/crash", test_ellipsize_crash);
   g_test_add_func ("/layout/ellipsize/fully", test_ellipsize_fully);
+  g_test_add_func ("/layout/ellipsize/fonts", test_ellipsize_fonts);
+
+  if (g_test_perf ())
+    g_test_add_func ("/layout/ellipsize/perf/long-line", test_ellipsize_long_line_perf);
 
   return g_test_run ();
 }
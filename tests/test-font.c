@@ -29,6 +29,7 @@
 #include <pango/pangocairo.h>
 
 #include "test-common.h"
+#include "pango/pango-font-private.h"
 
 #ifdef HAVE_FREETYPE
 #include <pango/pangoft2.h>
@@ -927,6 +928,66 @@ test_set_gravity (void)
   pango_font_description_free (desc);
 }
 
+static void
+test_intern (void)
+{
+  PangoFontDescription *desc1, *desc2;
+  PangoFontDescription *interned1, *interned2, *unsized, *unsized2;
+  PangoFontDescription *copy;
+
+  desc1 = pango_font_description_from_string ("Futura Medium Italic 14");
+  desc2 = pango_font_description_from_string ("futura medium italic 14");
+
+  interned1 = pango_font_description_intern (desc1);
+  interned2 = pango_font_description_intern (desc2);
+  g_assert_true (interned1 == interned2);
+  g_assert_true (pango_font_description_is_interned (interned1));
+  g_assert_false (pango_font_description_is_interned (desc1));
+  g_assert_true (pango_font_description_equal (interned1, desc1));
+  g_assert_cmpuint (pango_font_description_hash (interned1), ==, pango_font_description_hash (desc1));
+
+  /* Interning an interned description adds a reference */
+  g_assert_true (pango_font_description_intern (interned1) == interned1);
+  pango_font_description_free (interned1);
+
+  g_assert_null (pango_font_description_peek_interned_ignoring (interned1, PANGO_FONT_MASK_SIZE));
+  unsized = pango_font_description_intern_ignoring (interned1, PANGO_FONT_MASK_SIZE);
+  g_assert_true (unsized != interned1);
+  g_assert_true (pango_font_description_is_interned (unsized));
+  g_assert_false (pango_font_description_get_set_fields (unsized) & PANGO_FONT_MASK_SIZE);
+  g_assert_true (pango_font_description_peek_interned_ignoring (interned1, PANGO_FONT_MASK_SIZE) == unsized);
+  g_assert_null (pango_font_description_peek_interned_ignoring (interned1, PANGO_FONT_MASK_STYLE));
+  g_assert_true (pango_font_description_equal_ignoring (unsized, desc1, PANGO_FONT_MASK_SIZE));
+  g_assert_cmpuint (pango_font_description_hash (unsized), ==,
+                    pango_font_description_hash_ignoring (desc1, PANGO_FONT_MASK_SIZE));
+
+  unsized2 = pango_font_description_intern_ignoring (desc2, PANGO_FONT_MASK_SIZE);
+  g_assert_true (unsized2 == unsized);
+  pango_font_description_free (unsized2);
+
+  /* Copies are regular descriptions */
+  copy = pango_font_description_copy (interned1);
+  g_assert_false (pango_font_description_is_interned (copy));
+  pango_font_description_set_size (copy, 20 * PANGO_SCALE);
+  g_assert_false (pango_font_description_equal (copy, interned1));
+  g_assert_cmpint (pango_font_description_get_size (interned1), ==, 14 * PANGO_SCALE);
+  pango_font_description_free (copy);
+
+  /* The interned description is kept as long as there are references */
+  pango_font_description_free (interned1);
+  g_assert_cmpstr (pango_font_description_get_family (interned2), ==, "Futura");
+  g_assert_true (pango_font_description_intern (desc1) == interned2);
+  pango_font_description_free (interned2);
+  pango_font_description_free (interned2);
+
+  /* The derived description outlives the one it came from */
+  g_assert_cmpstr (pango_font_description_get_family (unsized), ==, "Futura");
+  pango_font_description_free (unsized);
+
+  pango_font_description_free (desc1);
+  pango_font_description_free (desc2);
+}
+
 static void
 test_match (void)
 {
@@ -1263,6 +1324,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/pango/fontdescription/to-filename", test_to_filename);
   g_test_add_func ("/pango/fontdescription/set-gravity", test_set_gravity);
   g_test_add_func ("/pango/fontdescription/match", test_match);
+  g_test_add_func ("/pango/fontdescription/intern", test_intern);
   g_test_add_func ("/pango/fontdescription/stretch-vs-width", test_stretch_vs_width);
   g_test_add_func ("/pango/font/extents", test_extents);
   g_test_add_func ("/pango/font/enumerate", test_enumerate);
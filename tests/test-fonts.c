@@ -1,6 +1,8 @@
 #include <string.h>
 #include <locale.h>
 
+#include <glib/gstdio.h>
+
 #include <pango/pango.h>
 #include <pango/pangocairo-fc.h>
 #include <pango/pangofc-fontmap.h>
@@ -161,6 +163,375 @@ test_fontset (gconstpointer d)
   g_object_unref (fontmap);
 }
 
+static void
+load_fontsets (PangoFontMap *fontmap,
+               PangoContext *context,
+               int           first_size,
+               int           n_sizes)
+{
+  PangoFontDescription *desc;
+  PangoFontset *fontset;
+  int i;
+
+  desc = pango_font_description_from_string ("Cantarell");
+  for (i = 0; i < n_sizes; i++)
+    {
+      pango_font_description_set_size (desc, (first_size + i) * PANGO_SCALE);
+      fontset = pango_font_map_load_fontset (fontmap, context, desc, pango_language_from_string ("en-us"));
+      g_object_unref (fontset);
+    }
+  pango_font_description_free (desc);
+}
+
+static void
+test_cache_limits (void)
+{
+  PangoFontMap *fontmap;
+  PangoFcFontMap *fcfontmap;
+  PangoContext *context;
+  PangoFcFontMapCacheStats stats;
+
+  fontmap = generate_font_map ();
+  fcfontmap = PANGO_FC_FONT_MAP (fontmap);
+  context = pango_font_map_create_context (fontmap);
+
+  g_assert_cmpuint (pango_fc_font_map_get_cache_limit (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FONTSETS), ==, 256);
+  g_assert_cmpuint (pango_fc_font_map_get_cache_limit (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FACE_DATA), ==, G_MAXUINT);
+
+  load_fontsets (fontmap, context, 10, 4);
+  load_fontsets (fontmap, context, 10, 4);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FONTSETS, &stats);
+  g_assert_cmpuint (stats.size, ==, 4);
+  g_assert_cmpuint (stats.limit, ==, 256);
+  g_assert_cmpuint (stats.misses, ==, 4);
+  g_assert_cmpuint (stats.hits, ==, 4);
+  g_assert_cmpuint (stats.evictions, ==, 0);
+
+  pango_fc_font_map_set_cache_limit (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FONTSETS, 2);
+  g_assert_cmpuint (pango_fc_font_map_get_cache_limit (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FONTSETS), ==, 2);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FONTSETS, &stats);
+  g_assert_cmpuint (stats.size, ==, 2);
+  g_assert_cmpuint (stats.evictions, ==, 2);
+
+  load_fontsets (fontmap, context, 20, 4);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_FONT_MAP_CACHE_FONTSETS, &stats);
+  g_assert_cmpuint (stats.size, <=, 2);
+  g_assert_cmpuint (stats.evictions, ==, 6);
+
+  pango_fc_font_map_get_cache_stats (fcfontmap, PANGO_FC_FONT_MAP_CACHE_PATTERNS, &stats);
+  g_assert_cmpuint (stats.size, >, 0);
+  g_assert_cmpuint (stats.limit, ==, G_MAXUINT);
+
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+static void
+test_fontset_cache_file (void)
+{
+  PangoFontMap *fontmap;
+  GError *error = NULL;
+  char *dir;
+  char *path;
+  char *s1, *s2;
+  const char *desc = "Cantarell 11\n";
+
+  dir = g_dir_make_tmp ("pango-fontset-cache-XXXXXX", &error);
+  g_assert_no_error (error);
+  path = g_build_filename (dir, "fontsets.cache", NULL);
+
+  fontmap = generate_font_map ();
+  s1 = list_fonts (fontmap, desc);
+  g_object_unref (fontmap);
+
+  /* A missing file is no error */
+  fontmap = generate_font_map ();
+  pango_fc_font_map_set_fontset_cache_file (PANGO_FC_FONT_MAP (fontmap), path);
+  g_assert_cmpstr (pango_fc_font_map_get_fontset_cache_file (PANGO_FC_FONT_MAP (fontmap)), ==, path);
+  s2 = list_fonts (fontmap, desc);
+  g_assert_cmpstr (s1, ==, s2);
+  g_free (s2);
+
+  g_assert_true (pango_fc_font_map_save_fontset_cache (PANGO_FC_FONT_MAP (fontmap), &error));
+  g_assert_no_error (error);
+  g_assert_true (g_file_test (path, G_FILE_TEST_IS_REGULAR));
+  g_object_unref (fontmap);
+
+  /* The results from the file give the same fonts */
+  fontmap = generate_font_map ();
+  pango_fc_font_map_set_fontset_cache_file (PANGO_FC_FONT_MAP (fontmap), path);
+  s2 = list_fonts (fontmap, desc);
+  g_assert_cmpstr (s1, ==, s2);
+  g_free (s2);
+  g_object_unref (fontmap);
+
+  /* A corrupt file is ignored */
+  g_file_set_contents (path, "PANGOFCS garbage", -1, &error);
+  g_assert_no_error (error);
+
+  fontmap = generate_font_map ();
+  pango_fc_font_map_set_fontset_cache_file (PANGO_FC_FONT_MAP (fontmap), path);
+  s2 = list_fonts (fontmap, desc);
+  g_assert_cmpstr (s1, ==, s2);
+  g_free (s2);
+  g_object_unref (fontmap);
+
+  g_remove (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+  g_free (s1);
+}
+
+static double
+time_to_first_layout (const char *cache_file)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoFontDescription *desc;
+  double elapsed;
+  int width, height;
+
+  g_test_timer_start ();
+
+  fontmap = generate_font_map ();
+  if (cache_file)
+    pango_fc_font_map_set_fontset_cache_file (PANGO_FC_FONT_MAP (fontmap), cache_file);
+
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Cantarell 11");
+  pango_context_set_font_description (context, desc);
+  pango_font_description_free (desc);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, "Hello wörld, Ελληνικά, עברית, 日本語 🐈", -1);
+  pango_layout_get_pixel_size (layout, &width, &height);
+
+  elapsed = g_test_timer_elapsed ();
+
+  if (cache_file)
+    pango_fc_font_map_save_fontset_cache (PANGO_FC_FONT_MAP (fontmap), NULL);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+
+  return elapsed;
+}
+
+static void
+test_fontset_cache_file_perf (void)
+{
+  char *dir;
+  char *path;
+  double uncached = 0, cached = 0;
+  int i;
+
+  dir = g_dir_make_tmp ("pango-fontset-cache-XXXXXX", NULL);
+  path = g_build_filename (dir, "fontsets.cache", NULL);
+
+  /* Write the cache file */
+  time_to_first_layout (path);
+
+  for (i = 0; i < 20; i++)
+    {
+      uncached += time_to_first_layout (NULL);
+      cached += time_to_first_layout (path);
+    }
+
+  g_test_minimized_result (uncached / 20, "time to first layout: %g ms", uncached * 50);
+  g_test_minimized_result (cached / 20, "time to first layout with a fontset cache file: %g ms", cached * 50);
+
+  g_remove (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+static void
+prewarm_done (GObject      *source,
+              GAsyncResult *result,
+              gpointer      data)
+{
+  GError *error = NULL;
+  gboolean *done = data;
+
+  g_assert_true (pango_font_map_prewarm_finish (PANGO_FONT_MAP (source), result, &error));
+  g_assert_no_error (error);
+
+  *done = TRUE;
+}
+
+static void
+prewarm_cancelled (GObject      *source,
+                   GAsyncResult *result,
+                   gpointer      data)
+{
+  GError *error = NULL;
+  gboolean *done = data;
+
+  g_assert_false (pango_font_map_prewarm_finish (PANGO_FONT_MAP (source), result, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+  g_error_free (error);
+
+  *done = TRUE;
+}
+
+static void
+test_prewarm (gconstpointer data)
+{
+  gboolean thread_safe = GPOINTER_TO_INT (data);
+  PangoFontMap *fontmap;
+  PangoFontDescription *descs[3];
+  PangoLanguage *languages[3];
+  PangoFcFontMapCacheStats stats;
+  PangoContext *context;
+  PangoFontset *fontset;
+  GCancellable *cancellable;
+  gboolean done;
+  int i, j;
+
+  fontmap = generate_font_map ();
+  pango_fc_font_map_set_thread_safe (PANGO_FC_FONT_MAP (fontmap), thread_safe);
+
+  descs[0] = pango_font_description_from_string ("Cantarell 11");
+  descs[1] = pango_font_description_from_string ("DejaVu Sans Bold 20");
+  descs[2] = NULL;
+  languages[0] = pango_language_from_string ("en-us");
+  languages[1] = pango_language_from_string ("ja");
+  languages[2] = NULL;
+
+  done = FALSE;
+  pango_font_map_prewarm (fontmap, descs, languages, NULL, prewarm_done, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  pango_fc_font_map_get_cache_stats (PANGO_FC_FONT_MAP (fontmap), PANGO_FC_FONT_MAP_CACHE_FONTSETS, &stats);
+  g_assert_cmpuint (stats.misses, ==, 4);
+  g_assert_cmpuint (stats.size, ==, 4);
+
+  /* Only the first font of each fontset is loaded */
+  pango_fc_font_map_get_cache_stats (PANGO_FC_FONT_MAP (fontmap), PANGO_FC_FONT_MAP_CACHE_FONTS, &stats);
+  g_assert_cmpuint (stats.size, >, 0);
+  g_assert_cmpuint (stats.size, <=, 4);
+
+  /* The fontsets are ready to use */
+  context = pango_font_map_create_context (fontmap);
+  for (i = 0; descs[i]; i++)
+    for (j = 0; languages[j]; j++)
+      {
+        fontset = pango_font_map_load_fontset (fontmap, context, descs[i], languages[j]);
+        g_object_unref (fontset);
+      }
+
+  pango_fc_font_map_get_cache_stats (PANGO_FC_FONT_MAP (fontmap), PANGO_FC_FONT_MAP_CACHE_FONTSETS, &stats);
+  g_assert_cmpuint (stats.misses, ==, 4);
+  g_assert_cmpuint (stats.hits, ==, 4);
+
+  cancellable = g_cancellable_new ();
+  g_cancellable_cancel (cancellable);
+
+  done = FALSE;
+  pango_font_map_prewarm (fontmap, descs, NULL, cancellable, prewarm_cancelled, &done);
+  while (!done)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_object_unref (cancellable);
+  g_object_unref (context);
+  pango_font_description_free (descs[0]);
+  pango_font_description_free (descs[1]);
+  g_object_unref (fontmap);
+}
+
+/* Check that the approximate widths that are computed
+ * without a layout are close to the measured ones
+ */
+static void
+test_approximate_widths (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoLanguage *language;
+  PangoFont *font;
+  PangoFontMetrics *metrics;
+  PangoLayout *layout;
+  const char *sample_str;
+  int width;
+  int char_width;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+  language = pango_language_from_string ("en-us");
+  pango_context_set_language (context, language);
+
+  desc = pango_font_description_from_string ("Cantarell 11");
+  font = pango_font_map_load_font (fontmap, context, desc);
+  metrics = pango_font_get_metrics (font, language);
+
+  sample_str = pango_language_get_sample_string (language);
+  layout = pango_layout_new (context);
+  pango_layout_set_font_description (layout, desc);
+  pango_layout_set_text (layout, sample_str, -1);
+  pango_layout_get_size (layout, &width, NULL);
+  char_width = width / g_utf8_strlen (sample_str, -1);
+
+  g_assert_cmpint (pango_font_metrics_get_approximate_char_width (metrics), >, 0);
+  g_assert_cmpint (ABS (pango_font_metrics_get_approximate_char_width (metrics) - char_width), <, char_width / 20);
+
+  pango_layout_set_text (layout, "0", -1);
+  pango_layout_get_size (layout, &width, NULL);
+
+  g_assert_cmpint (pango_font_metrics_get_approximate_digit_width (metrics), >=, width);
+
+  g_object_unref (layout);
+  pango_font_metrics_unref (metrics);
+  g_object_unref (font);
+  pango_font_description_free (desc);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* Check that fontmaps share the faces of font files */
+static void
+test_shared_faces (void)
+{
+  PangoFontMap *fontmap1, *fontmap2;
+  PangoContext *context1, *context2;
+  PangoFontDescription *desc;
+  PangoFont *font1, *font2;
+  hb_face_t *face1, *face2;
+
+  fontmap1 = generate_font_map ();
+  fontmap2 = generate_font_map ();
+  context1 = pango_font_map_create_context (fontmap1);
+  context2 = pango_font_map_create_context (fontmap2);
+
+  desc = pango_font_description_from_string ("Cantarell 11");
+  font1 = pango_font_map_load_font (fontmap1, context1, desc);
+  pango_font_description_set_size (desc, 20 * PANGO_SCALE);
+  font2 = pango_font_map_load_font (fontmap2, context2, desc);
+
+  face1 = hb_font_get_face (pango_font_get_hb_font (font1));
+  face2 = hb_font_get_face (pango_font_get_hb_font (font2));
+  g_assert_true (face1 == face2);
+
+  /* The face outlives the fontmaps while fonts use it */
+  g_object_unref (context1);
+  g_object_unref (fontmap1);
+  g_assert_cmpuint (hb_face_get_glyph_count (face2), >, 0);
+
+  g_object_unref (font1);
+  g_object_unref (font2);
+  pango_font_description_free (desc);
+  g_object_unref (context2);
+  g_object_unref (fontmap2);
+}
+
 static void
 generate_expected_output (const char *path)
 {
@@ -234,6 +605,16 @@ main (int argc, char *argv[])
     }
   g_dir_close (dir);
 
+  g_test_add_func ("/fontmap/cache-limits", test_cache_limits);
+  g_test_add_func ("/fontmap/fontset-cache-file", test_fontset_cache_file);
+  g_test_add_func ("/fontmap/shared-faces", test_shared_faces);
+  g_test_add_func ("/fontmap/approximate-widths", test_approximate_widths);
+  g_test_add_data_func ("/fontmap/prewarm", GINT_TO_POINTER (FALSE), test_prewarm);
+  g_test_add_data_func ("/fontmap/prewarm/threads", GINT_TO_POINTER (TRUE), test_prewarm);
+
+  if (g_test_perf ())
+    g_test_add_func ("/fontmap/perf/fontset-cache-file", test_fontset_cache_file_perf);
+
   res = g_test_run ();
 
   g_free (opt_fonts);
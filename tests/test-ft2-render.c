@@ -0,0 +1,359 @@
+/* Pango
+ * test-ft2-render.c: Test rendering to FT_Bitmaps
+ *
+ * Copyright (C) 2026 the Pango authors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.	 See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+#include <glib.h>
+#include <string.h>
+#include <locale.h>
+
+#include <pango/pangoft2.h>
+
+static char *opt_fonts = NULL;
+
+static PangoFontMap *
+generate_font_map (void)
+{
+  FcConfig *config;
+  PangoFontMap *map;
+  char *path;
+  gsize len;
+  char *conf;
+
+  map = pango_ft2_font_map_new ();
+
+  config = FcConfigCreate ();
+
+  path = g_build_filename (opt_fonts, "fonts.conf", NULL);
+  g_file_get_contents (path, &conf, &len, NULL);
+
+  if (!FcConfigParseAndLoadFromMemory (config, (const FcChar8 *) conf, TRUE))
+    g_error ("Failed to parse fontconfig configuration");
+
+  g_free (conf);
+  g_free (path);
+
+  FcConfigAppFontAddDir (config, (const FcChar8 *) opt_fonts);
+  pango_fc_font_map_set_config (PANGO_FC_FONT_MAP (map), config);
+  FcConfigDestroy (config);
+
+  return map;
+}
+
+static char *
+get_long_paragraph (void)
+{
+  GString *str;
+  int i;
+
+  str = g_string_new ("");
+  for (i = 0; i < 40; i++)
+    g_string_append_printf (str,
+                            "%d. The quick brown fox jumps over the lazy dog. "
+                            "Zwölf Boxkämpfer jagen Viktor quer über den großen Sylter Deich. ",
+                            i + 1);
+
+  return g_string_free (str, FALSE);
+}
+
+static FT_Bitmap *
+bitmap_new (int width,
+            int height)
+{
+  FT_Bitmap *bitmap;
+
+  bitmap = g_new0 (FT_Bitmap, 1);
+  bitmap->width = width;
+  bitmap->rows = height;
+  bitmap->pitch = width;
+  bitmap->pixel_mode = FT_PIXEL_MODE_GRAY;
+  bitmap->num_grays = 256;
+  bitmap->buffer = g_malloc0 (width * height);
+
+  return bitmap;
+}
+
+static void
+bitmap_free (FT_Bitmap *bitmap)
+{
+  g_free (bitmap->buffer);
+  g_free (bitmap);
+}
+
+static gboolean
+bitmap_equal (FT_Bitmap *bitmap1,
+              FT_Bitmap *bitmap2)
+{
+  return bitmap1->rows == bitmap2->rows &&
+         bitmap1->pitch == bitmap2->pitch &&
+         memcmp (bitmap1->buffer, bitmap2->buffer, bitmap1->rows * bitmap1->pitch) == 0;
+}
+
+static gboolean
+bitmap_is_empty (FT_Bitmap *bitmap)
+{
+  for (unsigned int i = 0; i < bitmap->rows * bitmap->pitch; i++)
+    {
+      if (bitmap->buffer[i] != 0)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+static PangoLayout *
+create_layout (PangoFontMap *fontmap,
+               const char   *text,
+               int           width)
+{
+  PangoContext *context;
+  PangoFontDescription *desc;
+  PangoLayout *layout;
+
+  context = pango_font_map_create_context (fontmap);
+  desc = pango_font_description_from_string ("Cantarell 11");
+  pango_context_set_font_description (context, desc);
+  pango_font_description_free (desc);
+
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+  pango_layout_set_width (layout, width * PANGO_SCALE);
+  g_object_unref (context);
+
+  return layout;
+}
+
+/* Check that evicting glyphs from the glyph cache
+ * does not affect the rendering
+ */
+static void
+test_glyph_cache_size (void)
+{
+  PangoFontMap *fontmap;
+  PangoLayout *layout;
+  FT_Bitmap *bitmap1, *bitmap2;
+  int width, height;
+  char *text;
+
+  fontmap = generate_font_map ();
+  text = get_long_paragraph ();
+  layout = create_layout (fontmap, text, 600);
+  pango_layout_get_pixel_size (layout, &width, &height);
+
+  bitmap1 = bitmap_new (width, height);
+  pango_ft2_render_layout (bitmap1, layout, 0, 0);
+  g_assert_false (bitmap_is_empty (bitmap1));
+
+  g_assert_cmpuint (pango_ft2_font_map_get_glyph_cache_size (PANGO_FT2_FONT_MAP (fontmap)), >, 0);
+  pango_ft2_font_map_set_glyph_cache_size (PANGO_FT2_FONT_MAP (fontmap), 0);
+  g_assert_cmpuint (pango_ft2_font_map_get_glyph_cache_size (PANGO_FT2_FONT_MAP (fontmap)), ==, 0);
+
+  bitmap2 = bitmap_new (width, height);
+  pango_ft2_render_layout (bitmap2, layout, 0, 0);
+  g_assert_true (bitmap_equal (bitmap1, bitmap2));
+
+  bitmap_free (bitmap1);
+  bitmap_free (bitmap2);
+  g_object_unref (layout);
+  g_free (text);
+  g_object_unref (fontmap);
+}
+
+/* Check that subpixel offsets are not snapped to whole pixels */
+static void
+test_glyph_cache_subpixel (void)
+{
+  PangoFontMap *fontmap;
+  PangoLayout *layout;
+  FT_Bitmap *bitmap1, *bitmap2;
+  int width, height;
+
+  fontmap = generate_font_map ();
+  layout = create_layout (fontmap, "Hamburgefonstiv", -1);
+  pango_layout_get_pixel_size (layout, &width, &height);
+
+  bitmap1 = bitmap_new (width + 2, height);
+  bitmap2 = bitmap_new (width + 2, height);
+
+  pango_ft2_render_layout_subpixel (bitmap1, layout, 0, 0);
+  pango_ft2_render_layout_subpixel (bitmap2, layout, PANGO_SCALE / 4, 0);
+  g_assert_false (bitmap_equal (bitmap1, bitmap2));
+
+  memset (bitmap2->buffer, 0, bitmap2->rows * bitmap2->pitch);
+  pango_ft2_render_layout_subpixel (bitmap2, layout, 0, 0);
+  g_assert_true (bitmap_equal (bitmap1, bitmap2));
+
+  bitmap_free (bitmap1);
+  bitmap_free (bitmap2);
+  g_object_unref (layout);
+  g_object_unref (fontmap);
+}
+
+/* Check that rules, which are drawn as trapezoids, are rendered */
+static void
+test_render_underline (void)
+{
+  PangoFontMap *fontmap;
+  PangoLayout *layout;
+  PangoAttrList *attrs;
+  FT_Bitmap *bitmap1, *bitmap2;
+  int width, height;
+
+  fontmap = generate_font_map ();
+  layout = create_layout (fontmap, "     ", -1);
+  pango_layout_get_pixel_size (layout, &width, &height);
+
+  bitmap1 = bitmap_new (width, height);
+  pango_ft2_render_layout (bitmap1, layout, 0, 0);
+  g_assert_true (bitmap_is_empty (bitmap1));
+
+  attrs = pango_attr_list_new ();
+  pango_attr_list_insert (attrs, pango_attr_underline_new (PANGO_UNDERLINE_SINGLE));
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  pango_ft2_render_layout (bitmap1, layout, 0, 0);
+  g_assert_false (bitmap_is_empty (bitmap1));
+
+  bitmap2 = bitmap_new (width, height);
+  pango_ft2_render_layout (bitmap2, layout, 0, 0);
+  g_assert_true (bitmap_equal (bitmap1, bitmap2));
+
+  bitmap_free (bitmap1);
+  bitmap_free (bitmap2);
+  g_object_unref (layout);
+  g_object_unref (fontmap);
+}
+
+/* Check that rendering in bands gives the same result
+ * as rendering with a single thread
+ */
+static void
+test_render_threads (void)
+{
+  PangoFontMap *fontmap;
+  PangoLayout *layout;
+  PangoAttrList *attrs;
+  FT_Bitmap *bitmap1, *bitmap2;
+  int width, height;
+  char *text;
+
+  fontmap = generate_font_map ();
+  text = get_long_paragraph ();
+  layout = create_layout (fontmap, text, 300);
+
+  attrs = pango_attr_list_new ();
+  pango_attr_list_insert (attrs, pango_attr_underline_new (PANGO_UNDERLINE_DOUBLE));
+  pango_attr_list_insert (attrs, pango_attr_strikethrough_new (TRUE));
+  pango_layout_set_attributes (layout, attrs);
+  pango_attr_list_unref (attrs);
+
+  pango_layout_get_pixel_size (layout, &width, &height);
+  g_assert_cmpint (height, >, 256);
+
+  g_assert_cmpint (pango_ft2_font_map_get_render_threads (PANGO_FT2_FONT_MAP (fontmap)), ==, 1);
+
+  bitmap1 = bitmap_new (width, height);
+  pango_ft2_render_layout_subpixel (bitmap1, layout, PANGO_SCALE / 3, PANGO_SCALE / 3);
+
+  pango_ft2_font_map_set_render_threads (PANGO_FT2_FONT_MAP (fontmap), 4);
+  g_assert_cmpint (pango_ft2_font_map_get_render_threads (PANGO_FT2_FONT_MAP (fontmap)), ==, 4);
+
+  bitmap2 = bitmap_new (width, height);
+  pango_ft2_render_layout_subpixel (bitmap2, layout, PANGO_SCALE / 3, PANGO_SCALE / 3);
+  g_assert_true (bitmap_equal (bitmap1, bitmap2));
+
+  /* Again, with glyphs being evicted from the cache */
+  pango_ft2_font_map_set_glyph_cache_size (PANGO_FT2_FONT_MAP (fontmap), 0);
+
+  memset (bitmap2->buffer, 0, bitmap2->rows * bitmap2->pitch);
+  pango_ft2_render_layout_subpixel (bitmap2, layout, PANGO_SCALE / 3, PANGO_SCALE / 3);
+  g_assert_true (bitmap_equal (bitmap1, bitmap2));
+
+  bitmap_free (bitmap1);
+  bitmap_free (bitmap2);
+  g_object_unref (layout);
+  g_free (text);
+  g_object_unref (fontmap);
+}
+
+static void
+test_render_layout_perf (void)
+{
+  PangoFontMap *fontmap;
+  PangoLayout *layout;
+  FT_Bitmap *bitmap;
+  int width, height;
+  char *path;
+  char *text;
+  double elapsed;
+  int i;
+
+  /* Time the long paragraph from utils/, not the generated one */
+  path = g_test_build_filename (G_TEST_DIST, "..", "utils", "test-long-paragraph.txt", NULL);
+  if (!g_file_get_contents (path, &text, NULL, NULL))
+    {
+      g_test_skip ("test-long-paragraph.txt not found");
+      g_free (path);
+      return;
+    }
+  g_free (path);
+
+  fontmap = generate_font_map ();
+  layout = create_layout (fontmap, text, 800);
+  pango_layout_get_pixel_size (layout, &width, &height);
+
+  bitmap = bitmap_new (width, height);
+
+  /* Warm up the glyph cache */
+  pango_ft2_render_layout (bitmap, layout, 0, 0);
+
+  g_test_timer_start ();
+  for (i = 0; i < 100; i++)
+    pango_ft2_render_layout (bitmap, layout, 0, 0);
+  elapsed = g_test_timer_elapsed ();
+
+  g_test_minimized_result (elapsed / 100, "pango_ft2_render_layout: %g ms per layout", elapsed * 10);
+
+  bitmap_free (bitmap);
+  g_object_unref (layout);
+  g_free (text);
+  g_object_unref (fontmap);
+}
+
+int
+main (int argc, char *argv[])
+{
+  setlocale (LC_ALL, "");
+
+  g_test_init (&argc, &argv, NULL);
+
+  opt_fonts = g_test_build_filename (G_TEST_DIST, "fonts", NULL);
+
+  g_test_add_func ("/ft2/glyph-cache/size", test_glyph_cache_size);
+  g_test_add_func ("/ft2/glyph-cache/subpixel", test_glyph_cache_subpixel);
+  g_test_add_func ("/ft2/render/underline", test_render_underline);
+  g_test_add_func ("/ft2/render/threads", test_render_threads);
+
+  if (g_test_perf ())
+    g_test_add_func ("/ft2/perf/render-layout", test_render_layout_perf);
+
+  return g_test_run ();
+}
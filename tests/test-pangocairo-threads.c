@@ -1,8 +1,13 @@
+#include "config.h"
 #include <stdlib.h>
 #include <string.h>
 #include <pango/pango.h>
 #include <pango/pangocairo.h>
 
+#ifdef HAVE_CAIRO_FREETYPE
+#include <pango/pangofc-fontmap.h>
+#endif
+
 #define WIDTH 100
 #define HEIGHT 100
 const char *text = "Hamburgerfonts\nวิวิวิวิวิวิ\nبهداد";
@@ -12,6 +17,9 @@ int num_threads = 5;
 
 GMutex mutex;
 
+/* If set, all threads use this as their default fontmap */
+PangoCairoFontMap *shared_fontmap = NULL;
+
 static cairo_surface_t *
 create_surface (void)
 {
@@ -51,6 +59,9 @@ thread_func (gpointer data)
 
   cairo_t *cr = cairo_create (surface);
 
+  if (shared_fontmap)
+    pango_cairo_font_map_set_default (shared_fontmap);
+
   layout = create_layout (cr);
 
   g_mutex_lock (&mutex);
@@ -63,11 +74,14 @@ thread_func (gpointer data)
 
   cairo_destroy (cr);
 
+  if (shared_fontmap)
+    pango_cairo_font_map_set_default (NULL);
+
   return 0;
 }
 
 static void
-pangocairo_threads (void)
+run_threads (void)
 {
   GPtrArray *threads = g_ptr_array_new ();
   GPtrArray *surfaces = g_ptr_array_new ();
@@ -97,9 +111,16 @@ pangocairo_threads (void)
 
   /* Now, draw a reference image and check results. */
   {
-    cairo_surface_t *ref_surface = create_surface ();
-    cairo_t *cr = cairo_create (ref_surface);
-    PangoLayout *layout = create_layout (cr);
+    cairo_surface_t *ref_surface;
+    cairo_t *cr;
+    PangoLayout *layout;
+
+    if (shared_fontmap)
+      pango_cairo_font_map_set_default (shared_fontmap);
+
+    ref_surface = create_surface ();
+    cr = cairo_create (ref_surface);
+    layout = create_layout (cr);
     unsigned char *ref_data = cairo_image_surface_get_data (ref_surface);
     unsigned int len = WIDTH * HEIGHT;
 
@@ -136,6 +157,39 @@ pangocairo_threads (void)
 
 }
 
+static void
+pangocairo_threads (void)
+{
+  run_threads ();
+}
+
+#ifdef HAVE_CAIRO_FREETYPE
+/* All threads share one fontmap, and its fonts */
+static void
+pangocairo_threads_shared_fontmap (void)
+{
+  PangoFontMap *fontmap;
+
+  fontmap = pango_cairo_font_map_new ();
+  if (!PANGO_IS_FC_FONT_MAP (fontmap))
+    {
+      g_object_unref (fontmap);
+      g_test_skip ("Not a fontconfig fontmap");
+      return;
+    }
+
+  g_assert_false (pango_fc_font_map_get_thread_safe (PANGO_FC_FONT_MAP (fontmap)));
+  pango_fc_font_map_set_thread_safe (PANGO_FC_FONT_MAP (fontmap), TRUE);
+  g_assert_true (pango_fc_font_map_get_thread_safe (PANGO_FC_FONT_MAP (fontmap)));
+
+  shared_fontmap = PANGO_CAIRO_FONT_MAP (fontmap);
+  run_threads ();
+  shared_fontmap = NULL;
+
+  g_object_unref (fontmap);
+}
+#endif
+
 int
 main (int argc, char **argv)
 {
@@ -147,6 +201,9 @@ main (int argc, char **argv)
     num_iters = atoi (argv[2]);
 
   g_test_add_func ("/pangocairo/threads", pangocairo_threads);
+#ifdef HAVE_CAIRO_FREETYPE
+  g_test_add_func ("/pangocairo/threads/shared-fontmap", pangocairo_threads_shared_fontmap);
+#endif
 
   return g_test_run ();
 }
@@ -20,6 +20,7 @@
  */
 
 #include <pango/pango.h>
+#include "pango/pango-attributes-private.h"
 
 static void
 test_copy (PangoAttribute *attr)
@@ -660,6 +661,81 @@ test_list_change12 (void)
   pango_attr_list_unref (list);
 }
 
+/* Check that attributes that start long before the changed
+ * range are still found
+ */
+static void
+test_list_change13 (void)
+{
+  PangoAttrList *list;
+  PangoAttribute *attr;
+
+  list = pango_attr_list_from_string ("0 10 weight 800\n"
+                                      "200 300 weight 800\n"
+                                      "210 212 style italic\n"
+                                      "220 222 style italic\n"
+                                      "230 232 style italic\n"
+                                      "240 242 style italic\n"
+                                      "250 252 style italic\n"
+                                      "260 262 style italic\n");
+
+  attr = attribute_from_string ("270 275 weight 400");
+  pango_attr_list_change (list, attr);
+
+  assert_attr_list (list, "0 10 weight ultrabold\n"
+                          "200 270 weight ultrabold\n"
+                          "210 212 style italic\n"
+                          "220 222 style italic\n"
+                          "230 232 style italic\n"
+                          "240 242 style italic\n"
+                          "250 252 style italic\n"
+                          "260 262 style italic\n"
+                          "270 275 weight normal\n"
+                          "275 300 weight ultrabold");
+
+  attr = attribute_from_string ("274 280 weight 400");
+  pango_attr_list_change (list, attr);
+
+  assert_attr_list (list, "0 10 weight ultrabold\n"
+                          "200 270 weight ultrabold\n"
+                          "210 212 style italic\n"
+                          "220 222 style italic\n"
+                          "230 232 style italic\n"
+                          "240 242 style italic\n"
+                          "250 252 style italic\n"
+                          "260 262 style italic\n"
+                          "270 280 weight normal\n"
+                          "280 300 weight ultrabold");
+
+  pango_attr_list_unref (list);
+}
+
+/* Test that attributes inserted in front of a later attribute
+ * are taken into account when looking for overlapping ones
+ */
+static void
+test_list_change14 (void)
+{
+  PangoAttrList *list;
+  PangoAttribute *attr;
+
+  list = pango_attr_list_from_string ("0 2 weight 800\n"
+                                      "50 51 style italic\n");
+
+  attr = attribute_from_string ("10 40 weight 400");
+  pango_attr_list_change (list, attr);
+
+  attr = attribute_from_string ("35 45 weight 800");
+  pango_attr_list_change (list, attr);
+
+  assert_attr_list (list, "0 2 weight ultrabold\n"
+                          "10 35 weight normal\n"
+                          "35 45 weight ultrabold\n"
+                          "50 51 style italic");
+
+  pango_attr_list_unref (list);
+}
+
 static void
 test_list_splice (void)
 {
@@ -1358,6 +1434,63 @@ test_iter_epsilon_zero (void)
   g_string_free (s, TRUE);
 }
 
+/* Check that a segment table has the same ranges and attributes
+ * as an attribute iterator
+ */
+static void
+test_segments (void)
+{
+  PangoAttrList *list;
+  PangoAttrSegments *segments;
+  PangoAttrIterator *iter;
+  guint segment = 0;
+
+  list = pango_attr_list_from_string ("0 -1 size 10\n"
+                                      "0 20 weight bold\n"
+                                      "5 15 weight light\n"
+                                      "5 25 underline single\n"
+                                      "10 12 font-desc \"Sans Italic\"\n"
+                                      "11 30 font-desc \"Serif 8\"\n"
+                                      "12 18 foreground #ff0000\n"
+                                      "14 16 weight heavy\n"
+                                      "40 50 rise 1000\n");
+
+  segments = _pango_attr_list_get_segments (list);
+
+  iter = pango_attr_list_get_iterator (list);
+  do
+    {
+      PangoAttribute * const *attrs;
+      guint n_attrs;
+      int start, end;
+      GSList *iter_attrs, *l;
+
+      g_assert_cmpuint (segment, <, segments->n_segments);
+
+      pango_attr_iterator_range (iter, &start, &end);
+      g_assert_cmpint (segments->segments[segment].start_index, ==, start);
+      g_assert_cmpint (segments->segments[segment].end_index, ==, end);
+
+      /* The segment has the attributes of the iterator, in reverse order */
+      attrs = _pango_attr_segments_get_attrs (segments, segment, &n_attrs);
+      iter_attrs = pango_attr_iterator_get_attrs (iter);
+      g_assert_cmpuint (n_attrs, ==, g_slist_length (iter_attrs));
+      for (l = iter_attrs; l; l = l->next)
+        g_assert_true (pango_attribute_equal (attrs[--n_attrs], l->data));
+
+      g_slist_free_full (iter_attrs, (GDestroyNotify) pango_attribute_destroy);
+
+      segment++;
+    }
+  while (pango_attr_iterator_next (iter));
+
+  g_assert_cmpuint (segment, ==, segments->n_segments);
+
+  pango_attr_iterator_destroy (iter);
+  _pango_attr_segments_free (segments);
+  pango_attr_list_unref (list);
+}
+
 static void
 test_gnumeric_splice (void)
 {
@@ -1420,6 +1553,76 @@ test_pitivi_crash (void)
   pango_attr_list_unref (list);
 }
 
+static PangoAttrList *
+create_highlight_list (int n_attrs)
+{
+  PangoAttrList *list;
+  int i;
+
+  list = pango_attr_list_new ();
+  pango_attr_list_insert (list, pango_attr_family_new ("Monospace"));
+
+  for (i = 0; i < n_attrs; i++)
+    {
+      PangoAttribute *attr;
+
+      attr = pango_attr_foreground_new (i % 7 * 1000, 0, 0);
+      attr->start_index = 10 * i;
+      attr->end_index = 10 * i + 5;
+      pango_attr_list_insert (list, attr);
+    }
+
+  return list;
+}
+
+static void
+test_list_perf (void)
+{
+  PangoAttrList *list;
+  PangoAttrIterator *iter;
+  int n_attrs = 100000;
+  double elapsed;
+  int i;
+
+  g_test_timer_start ();
+  list = create_highlight_list (n_attrs);
+  elapsed = g_test_timer_elapsed ();
+  g_test_message ("insert: %g ms for %d attributes", elapsed * 1000, n_attrs);
+
+  g_test_timer_start ();
+  for (i = 0; i < 1000; i++)
+    {
+      PangoAttribute *attr;
+
+      attr = pango_attr_background_new (0, 0, 0);
+      attr->start_index = 10 * n_attrs / 2 + 10 * i;
+      attr->end_index = attr->start_index + 8;
+      pango_attr_list_change (list, attr);
+    }
+  elapsed = g_test_timer_elapsed ();
+  g_test_message ("change: %g ms for 1000 changes", elapsed * 1000);
+
+  g_test_timer_start ();
+  for (i = 0; i < 1000; i++)
+    pango_attr_list_update (list, 10 * n_attrs / 2 + i, 1, 1);
+  elapsed = g_test_timer_elapsed ();
+  g_test_message ("update: %g ms for 1000 updates", elapsed * 1000);
+
+  g_test_timer_start ();
+  iter = pango_attr_list_get_iterator (list);
+  do
+    {
+      pango_attr_iterator_get (iter, PANGO_ATTR_FOREGROUND);
+      pango_attr_iterator_get (iter, PANGO_ATTR_UNDERLINE);
+    }
+  while (pango_attr_iterator_next (iter));
+  pango_attr_iterator_destroy (iter);
+  elapsed = g_test_timer_elapsed ();
+  g_test_minimized_result (elapsed, "iterate: %g ms", elapsed * 1000);
+
+  pango_attr_list_unref (list);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -1442,6 +1645,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/attributes/list/change10", test_list_change10);
   g_test_add_func ("/attributes/list/change11", test_list_change11);
   g_test_add_func ("/attributes/list/change12", test_list_change12);
+  g_test_add_func ("/attributes/list/change13", test_list_change13);
+  g_test_add_func ("/attributes/list/change14", test_list_change14);
   g_test_add_func ("/attributes/list/splice", test_list_splice);
   g_test_add_func ("/attributes/list/splice2", test_list_splice2);
   g_test_add_func ("/attributes/list/splice3", test_list_splice3);
@@ -1459,9 +1664,13 @@ main (int argc, char *argv[])
   g_test_add_func ("/attributes/iter/get_font", test_iter_get_font);
   g_test_add_func ("/attributes/iter/get_attrs", test_iter_get_attrs);
   g_test_add_func ("/attributes/iter/epsilon_zero", test_iter_epsilon_zero);
+  g_test_add_func ("/attributes/segments", test_segments);
   g_test_add_func ("/attributes/gnumeric-splice", test_gnumeric_splice);
   g_test_add_func ("/attributes/list/change_order", test_change_order);
   g_test_add_func ("/attributes/pitivi-crash", test_pitivi_crash);
 
+  if (g_test_perf ())
+    g_test_add_func ("/attributes/perf/list", test_list_perf);
+
   return g_test_run ();
 }
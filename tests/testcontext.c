@@ -129,6 +129,82 @@ test_set_round_glyph_positions (void)
   g_object_unref (context);
 }
 
+/* Check that repeated fontset loads give consistent results,
+ * and that changes to the context are taken into account
+ */
+static void
+test_load_fontset (void)
+{
+  PangoContext *context;
+  PangoFontDescription *desc, *desc2;
+  PangoLanguage *lang = pango_language_from_string ("en-us");
+  PangoFontset *fontset1, *fontset2, *fontset3, *fontset4;
+  PangoFont *font1, *font3;
+  PangoFontDescription *desc1, *desc3;
+  guint serial;
+
+  context = pango_font_map_create_context (pango_cairo_font_map_get_default ());
+
+  desc = pango_font_description_from_string ("Sans 12");
+  desc2 = pango_font_description_from_string ("Sans 20");
+
+  fontset1 = pango_context_load_fontset (context, desc, lang);
+  fontset2 = pango_context_load_fontset (context, desc2, lang);
+  g_assert_nonnull (fontset1);
+  g_assert_nonnull (fontset2);
+  g_assert_true (fontset1 != fontset2);
+
+  fontset3 = pango_context_load_fontset (context, desc, lang);
+  g_assert_true (fontset3 == fontset1);
+  g_object_unref (fontset3);
+
+  /* The same description, in a different object */
+  pango_font_description_free (desc2);
+  desc2 = pango_font_description_copy (desc);
+  fontset3 = pango_context_load_fontset (context, desc2, lang);
+  g_assert_true (fontset3 == fontset1);
+  g_object_unref (fontset3);
+
+  /* A different resolution needs a different fontset */
+  serial = pango_context_get_serial (context);
+  pango_cairo_context_set_resolution (context, 144);
+  g_assert_cmpuint (pango_context_get_serial (context), !=, serial);
+  fontset3 = pango_context_load_fontset (context, desc, lang);
+  g_assert_nonnull (fontset3);
+  g_assert_true (fontset3 != fontset1);
+
+  font1 = pango_fontset_get_font (fontset1, 'a');
+  font3 = pango_fontset_get_font (fontset3, 'a');
+  desc1 = pango_font_describe_with_absolute_size (font1);
+  desc3 = pango_font_describe_with_absolute_size (font3);
+  g_assert_cmpint (pango_font_description_get_size (desc1), <, pango_font_description_get_size (desc3));
+  pango_font_description_free (desc1);
+  pango_font_description_free (desc3);
+  g_object_unref (font1);
+  g_object_unref (font3);
+
+  /* Setting the same resolution again doesn't change anything */
+  serial = pango_context_get_serial (context);
+  pango_cairo_context_set_resolution (context, 144);
+  g_assert_cmpuint (pango_context_get_serial (context), ==, serial);
+  fontset4 = pango_context_load_fontset (context, desc, lang);
+  g_assert_true (fontset4 == fontset3);
+  g_object_unref (fontset4);
+  g_object_unref (fontset3);
+
+  /* Going back to the fontmap resolution gives the first fontset again */
+  pango_cairo_context_set_resolution (context, -1);
+  fontset3 = pango_context_load_fontset (context, desc, lang);
+  g_assert_true (fontset3 == fontset1);
+  g_object_unref (fontset3);
+
+  g_object_unref (fontset1);
+  g_object_unref (fontset2);
+  pango_font_description_free (desc);
+  pango_font_description_free (desc2);
+  g_object_unref (context);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -140,6 +216,7 @@ main (int argc, char *argv[])
   g_test_add_func ("/context/set-base-gravity", test_set_base_gravity);
   g_test_add_func ("/context/set-gravity-hint", test_set_gravity_hint);
   g_test_add_func ("/context/set-round-glyph-positions", test_set_round_glyph_positions);
+  g_test_add_func ("/context/load-fontset", test_load_fontset);
 
   return g_test_run ();
 }
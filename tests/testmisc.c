@@ -22,6 +22,7 @@
 #include "config.h"
 #include <glib.h>
 #include <pango/pangocairo.h>
+#include "pango/pango-layout-private.h"
 
 #ifdef HAVE_CAIRO_FREETYPE
 #include <pango/pango-ot.h>
@@ -879,6 +880,310 @@ test_small_caps_crash (void)
   g_object_unref (fontmap);
 }
 
+/* Check that paragraphs are split at all delimiters, and that
+ * relayouts with a cached analysis of the text give the same lines
+ */
+static void
+test_paragraph_delimiters (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  const char *text = "abc\r\ndef\rghi\n\n\u05d0\u05d1\u2029jkl\n";
+  int starts[] = { 0, 5, 9, 13, 14, 21, 25 };
+  PangoLayoutLine *line;
+  guint i;
+  int round;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+
+  for (round = 0; round < 2; round++)
+    {
+      g_assert_cmpint (pango_layout_get_line_count (layout), ==, G_N_ELEMENTS (starts));
+
+      for (i = 0; i < G_N_ELEMENTS (starts); i++)
+        {
+          line = pango_layout_get_line_readonly (layout, i);
+          g_assert_cmpint (line->start_index, ==, starts[i]);
+          g_assert_true (line->is_paragraph_start);
+        }
+
+      line = pango_layout_get_line_readonly (layout, 4);
+      g_assert_cmpint (line->resolved_dir, ==, PANGO_DIRECTION_RTL);
+      line = pango_layout_get_line_readonly (layout, 5);
+      g_assert_cmpint (line->resolved_dir, ==, PANGO_DIRECTION_LTR);
+
+      pango_layout_set_width (layout, 200 * PANGO_SCALE);
+    }
+
+  pango_layout_set_single_paragraph_mode (layout, TRUE);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, 1);
+
+  pango_layout_set_single_paragraph_mode (layout, FALSE);
+  g_assert_cmpint (pango_layout_get_line_count (layout), ==, G_N_ELEMENTS (starts));
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* Check that setting the same markup again keeps the lines
+ * and gives the same results, also after the attributes were
+ * changed in place, and that other layouts get the same results
+ * from the markup cache of the context
+ */
+static void
+test_set_markup_twice (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout, *layout2;
+  const char *markup = "<b>_Hello</b> <i>world</i>";
+  PangoAttrList *attrs;
+  PangoLayoutLine *line;
+  char *text;
+  gunichar accel_char;
+  guint serial;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  layout2 = pango_layout_new (context);
+
+  pango_layout_set_markup_with_accel (layout, markup, -1, '_', &accel_char);
+  g_assert_cmpstr (pango_layout_get_text (layout), ==, "Hello world");
+  g_assert_true (accel_char == 'H');
+
+  line = pango_layout_get_line_readonly (layout, 0);
+  serial = pango_layout_get_serial (layout);
+
+  accel_char = 0;
+  pango_layout_set_markup_with_accel (layout, markup, -1, '_', &accel_char);
+  g_assert_true (accel_char == 'H');
+  g_assert_cmpuint (pango_layout_get_serial (layout), ==, serial);
+  g_assert_true (pango_layout_get_line_readonly (layout, 0) == line);
+
+  /* changes made to the attributes in place don't survive */
+  attrs = pango_attr_list_copy (pango_layout_get_attributes (layout));
+  pango_attr_list_insert (pango_layout_get_attributes (layout),
+                          pango_attr_size_new (20 * PANGO_SCALE));
+
+  accel_char = 0;
+  pango_layout_set_markup_with_accel (layout, markup, -1, '_', &accel_char);
+  g_assert_true (accel_char == 'H');
+  g_assert_true (pango_attr_list_equal (attrs, pango_layout_get_attributes (layout)));
+  pango_attr_list_unref (attrs);
+
+  /* a different accel marker is different markup */
+  pango_layout_set_markup (layout, markup, -1);
+  g_assert_cmpstr (pango_layout_get_text (layout), ==, "_Hello world");
+
+  /* setting markup again replaces other text */
+  pango_layout_set_markup_with_accel (layout, markup, -1, '_', NULL);
+  pango_layout_set_text (layout, "Bye", -1);
+  pango_layout_set_markup_with_accel (layout, markup, -1, '_', NULL);
+  g_assert_cmpstr (pango_layout_get_text (layout), ==, "Hello world");
+
+  pango_layout_set_markup_with_accel (layout2, markup, -1, '_', &accel_char);
+  g_assert_true (accel_char == 'H');
+  g_assert_cmpstr (pango_layout_get_text (layout2), ==, "Hello world");
+  g_assert_true (pango_attr_list_equal (pango_layout_get_attributes (layout),
+                                        pango_layout_get_attributes (layout2)));
+  g_assert_true (pango_layout_get_attributes (layout) != pango_layout_get_attributes (layout2));
+
+  g_assert_true (pango_parse_markup (markup, -1, '_', &attrs, &text, NULL, NULL));
+  g_assert_cmpstr (text, ==, "Hello world");
+  g_assert_true (pango_attr_list_equal (attrs, pango_layout_get_attributes (layout2)));
+  pango_attr_list_unref (attrs);
+  g_free (text);
+
+  g_object_unref (layout2);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* Test that position queries give the same results for lines
+ * that are private to the layout, which cache their run positions,
+ * and for lines that have been handed out, which walk their runs.
+ * Also check the cached positions against the run widths.
+ */
+static void
+test_line_positions (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout, *layout2;
+  PangoLayoutLine *line, *line2;
+  const char *text = "one two ثلاثة 1234 خمسة six שבע eight";
+  PangoRectangle rect;
+  GSList *l;
+  int run_x;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  layout2 = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+  pango_layout_set_text (layout2, text, -1);
+
+  line = pango_layout_get_line_readonly (layout, 0);
+  line2 = pango_layout_get_line (layout2, 0);
+
+  for (int index = 0; index <= strlen (text); index = g_utf8_next_char (text + index) - text)
+    {
+      for (int trailing = 0; trailing < 2; trailing++)
+        {
+          int x, x2;
+
+          pango_layout_line_index_to_x (line, index, trailing, &x);
+          pango_layout_line_index_to_x (line2, index, trailing, &x2);
+          g_assert_cmpint (x, ==, x2);
+        }
+
+      for (int end = index; end <= strlen (text); end = g_utf8_next_char (text + end) - text)
+        {
+          int *ranges, *ranges2;
+          int n_ranges, n_ranges2;
+
+          pango_layout_line_get_x_ranges (line, index, end, &ranges, &n_ranges);
+          pango_layout_line_get_x_ranges (line2, index, end, &ranges2, &n_ranges2);
+          g_assert_cmpint (n_ranges, ==, n_ranges2);
+          g_assert_true (memcmp (ranges, ranges2, 2 * n_ranges * sizeof (int)) == 0);
+          g_free (ranges);
+          g_free (ranges2);
+
+          if (end == strlen (text))
+            break;
+        }
+
+      if (index == strlen (text))
+        break;
+    }
+
+  pango_layout_line_get_extents (line, NULL, &rect);
+  for (int x = -PANGO_SCALE; x < rect.width + PANGO_SCALE; x += PANGO_SCALE / 2)
+    {
+      int index, index2;
+      int trailing, trailing2;
+      gboolean inside, inside2;
+
+      inside = pango_layout_line_x_to_index (line, x, &index, &trailing);
+      inside2 = pango_layout_line_x_to_index (line2, x, &index2, &trailing2);
+      g_assert_true (inside == inside2);
+      g_assert_cmpint (index, ==, index2);
+      g_assert_cmpint (trailing, ==, trailing2);
+    }
+
+  run_x = 0;
+  for (l = line->runs; l; l = l->next)
+    {
+      PangoLayoutRun *run = l->data;
+      int width = pango_glyph_string_get_width (run->glyphs);
+      int x, index, trailing;
+
+      /* The leading edge of the first character of a run */
+      pango_layout_line_index_to_x (line, run->item->offset, FALSE, &x);
+      if (run->item->analysis.level % 2)
+        g_assert_cmpint (x, ==, run_x + width);
+      else
+        g_assert_cmpint (x, ==, run_x);
+
+      if (width > 0)
+        {
+          g_assert_true (pango_layout_line_x_to_index (line, run_x, &index, &trailing));
+          g_assert_cmpint (index, >=, run->item->offset);
+          g_assert_cmpint (index, <, run->item->offset + run->item->length);
+        }
+
+      run_x += width;
+    }
+  g_assert_cmpint (run_x, ==, rect.width);
+
+  g_object_unref (layout2);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+/* Test that the glyphs of runs that are taken out of the glyphs
+ * of their item while breaking lines are the same as if the runs
+ * had been shaped on their own.
+ */
+static void
+test_wrap_slices (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoLayoutIter *iter;
+  const char *text = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, "
+                     "sed do eiusmod tempor incididunt ut labore et dolore magna aliqua. "
+                     "واحد اثنان ثلاثة أربعة خمسة ستة سبعة ثمانية تسعة عشرة "
+                     "office affiliate waffle fjord";
+  const PangoLogAttr *log_attrs;
+  int n_attrs;
+
+  fontmap = pango_cairo_font_map_new ();
+  context = pango_font_map_create_context (fontmap);
+  layout = pango_layout_new (context);
+  pango_layout_set_text (layout, text, -1);
+  pango_layout_set_width (layout, 120 * PANGO_SCALE);
+  pango_layout_set_wrap (layout, PANGO_WRAP_WORD);
+
+  g_assert_cmpint (pango_layout_get_line_count (layout), >, 2);
+  g_assert_cmpuint (layout->reshapes_avoided, >, 0);
+
+  log_attrs = pango_layout_get_log_attrs_readonly (layout, &n_attrs);
+
+  iter = pango_layout_get_iter (layout);
+  do
+    {
+      PangoLayoutRun *run = pango_layout_iter_get_run_readonly (iter);
+      PangoGlyphString *glyphs;
+      PangoShapeFlags flags = PANGO_SHAPE_NONE;
+
+      if (!run)
+        continue;
+
+      if (pango_context_get_round_glyph_positions (context))
+        flags |= PANGO_SHAPE_ROUND_POSITIONS;
+
+      glyphs = pango_glyph_string_new ();
+      pango_shape_item (run->item, text, strlen (text),
+                        (PangoLogAttr *) log_attrs + pango_item_get_char_offset (run->item),
+                        glyphs, flags);
+
+      g_assert_cmpint (glyphs->num_glyphs, ==, run->glyphs->num_glyphs);
+      for (int i = 0; i < glyphs->num_glyphs; i++)
+        {
+          g_assert_cmpint (glyphs->log_clusters[i], ==, run->glyphs->log_clusters[i]);
+
+          /* The final space of a wrapped line is collapsed after shaping */
+          if (run->glyphs->glyphs[i].glyph == PANGO_GLYPH_EMPTY &&
+              run->glyphs->glyphs[i].geometry.width == 0 &&
+              glyphs->glyphs[i].glyph != PANGO_GLYPH_EMPTY)
+            continue;
+
+          g_assert_cmpuint (glyphs->glyphs[i].glyph, ==, run->glyphs->glyphs[i].glyph);
+          g_assert_cmpint (glyphs->glyphs[i].geometry.width, ==, run->glyphs->glyphs[i].geometry.width);
+          g_assert_cmpint (glyphs->glyphs[i].geometry.x_offset, ==, run->glyphs->glyphs[i].geometry.x_offset);
+          g_assert_cmpint (glyphs->glyphs[i].geometry.y_offset, ==, run->glyphs->glyphs[i].geometry.y_offset);
+        }
+
+      pango_glyph_string_free (glyphs);
+    }
+  while (pango_layout_iter_next_run (iter));
+  pango_layout_iter_free (iter);
+
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -912,6 +1217,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/layout/empty-line-height", test_empty_line_height);
   g_test_add_func ("/layout/gravity-metrics", test_gravity_metrics);
   g_test_add_func ("/layout/wrap-char", test_wrap_char);
+  g_test_add_func ("/layout/paragraph-delimiters", test_paragraph_delimiters);
+  g_test_add_func ("/layout/set-markup-twice", test_set_markup_twice);
+  g_test_add_func ("/layout/line-positions", test_line_positions);
+  g_test_add_func ("/layout/wrap-slices", test_wrap_slices);
   g_test_add_func ("/matrix/transform-rectangle", test_transform_rectangle);
   g_test_add_func ("/itemize/small-caps-crash", test_small_caps_crash);
 
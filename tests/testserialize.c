@@ -384,6 +384,108 @@ test_serialize_layout_context (void)
   g_object_unref (fontmap);
 }
 
+static PangoLayout *
+make_output_layout (PangoContext *context)
+{
+  PangoLayout *layout;
+
+  layout = pango_layout_new (context);
+  pango_layout_set_markup (layout,
+                           "Some <b>fun</b> with layouts!\n"
+                           "<span font=\"Cantarell 20\">A second paragraph</span> "
+                           "that is long enough to wrap",
+                           -1);
+  pango_layout_set_width (layout, 100 * PANGO_SCALE);
+
+  return layout;
+}
+
+static void
+test_serialize_layout_output (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoLayout *layout2;
+  GBytes *bytes;
+  GBytes *out_bytes;
+  GError *error = NULL;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+
+  layout = make_output_layout (context);
+  bytes = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  g_assert_true (PANGO_IS_LAYOUT (layout2));
+  g_assert_cmpint (pango_layout_get_line_count (layout2), ==, pango_layout_get_line_count (layout));
+  g_assert_true (pango_layout_is_wrapped (layout2));
+
+  out_bytes = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_cmpstr (g_bytes_get_data (out_bytes, NULL), ==, g_bytes_get_data (bytes, NULL));
+
+  g_bytes_unref (out_bytes);
+  g_object_unref (layout2);
+  g_bytes_unref (bytes);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
+static void
+test_serialize_layout_binary (void)
+{
+  PangoFontMap *fontmap;
+  PangoContext *context;
+  PangoLayout *layout;
+  PangoLayout *layout2;
+  GBytes *bytes;
+  GBytes *json_bytes;
+  GBytes *out_bytes;
+  GBytes *truncated;
+  GError *error = NULL;
+
+  fontmap = generate_font_map ();
+  context = pango_font_map_create_context (fontmap);
+
+  layout = make_output_layout (context);
+  bytes = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_OUTPUT | PANGO_LAYOUT_SERIALIZE_BINARY);
+  json_bytes = pango_layout_serialize (layout, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_no_error (error);
+  g_assert_true (PANGO_IS_LAYOUT (layout2));
+  g_assert_cmpstr (pango_layout_get_text (layout2), ==, pango_layout_get_text (layout));
+
+  out_bytes = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_cmpstr (g_bytes_get_data (out_bytes, NULL), ==, g_bytes_get_data (json_bytes, NULL));
+  g_bytes_unref (out_bytes);
+  g_object_unref (layout2);
+
+  /* Without the output flag, the text is laid out again */
+  layout2 = pango_layout_deserialize (context, bytes, PANGO_LAYOUT_DESERIALIZE_DEFAULT, &error);
+  g_assert_no_error (error);
+  out_bytes = pango_layout_serialize (layout2, PANGO_LAYOUT_SERIALIZE_OUTPUT);
+  g_assert_cmpstr (g_bytes_get_data (out_bytes, NULL), ==, g_bytes_get_data (json_bytes, NULL));
+  g_bytes_unref (out_bytes);
+  g_object_unref (layout2);
+
+  truncated = g_bytes_new_from_bytes (bytes, 0, g_bytes_get_size (bytes) - 1);
+  layout2 = pango_layout_deserialize (context, truncated, PANGO_LAYOUT_DESERIALIZE_OUTPUT, &error);
+  g_assert_error (error, PANGO_LAYOUT_DESERIALIZE_ERROR, PANGO_LAYOUT_DESERIALIZE_INVALID);
+  g_assert_null (layout2);
+  g_clear_error (&error);
+  g_bytes_unref (truncated);
+
+  g_bytes_unref (json_bytes);
+  g_bytes_unref (bytes);
+  g_object_unref (layout);
+  g_object_unref (context);
+  g_object_unref (fontmap);
+}
+
 static void
 test_serialize_layout_invalid (void)
 {
@@ -511,6 +613,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/serialize/layout/valid", test_serialize_layout_valid);
   g_test_add_func ("/serialize/layout/context", test_serialize_layout_context);
   g_test_add_func ("/serialize/layout/invalid", test_serialize_layout_invalid);
+  g_test_add_func ("/serialize/layout/output", test_serialize_layout_output);
+  g_test_add_func ("/serialize/layout/binary", test_serialize_layout_binary);
 
   return g_test_run ();
 }